@@ -0,0 +1,27 @@
+/* Wirepas Oy licensed under Apache License, Version 2.0
+ *
+ * See file LICENSE for full license details.
+ *
+ */
+#include <benchmark/benchmark.h>
+
+extern "C" {
+#define LOG_MODULE_NAME (char *) "bench"
+#include "logger.h"
+}
+
+int main(int argc, char ** argv)
+{
+    // Logs of the library would be measured too (duplicated fragments for
+    // example), they are disabled
+    Platform_set_log_level(NO_LOG_LEVEL);
+
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv))
+    {
+        return 1;
+    }
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
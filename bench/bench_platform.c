@@ -0,0 +1,475 @@
+/* Wirepas Oy licensed under Apache License, Version 2.0
+ *
+ * See file LICENSE for full license details.
+ *
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+
+#define LOG_MODULE_NAME "bench_plat"
+#define MAX_LOG_LEVEL INFO_LOG_LEVEL
+#include "logger.h"
+#include "bench_platform.h"
+#include "serial.h"
+#include "sim_node.h"
+#include "slip.h"
+
+/*
+ * Platform and serial implementation used by the benchmarks.
+ * The serial line is connected to a simulated node answering each request
+ * immediately, so only the gateway side of an exchange is measured.
+ */
+
+// End of frame in SLIP encoding
+#define SLIP_END    0xC0
+
+// Maximum number of works scheduled at the same time on a created worker
+#define MAX_NUMBER_PENDING_WORKS 4
+
+typedef struct
+{
+    Platform_work_f work;
+    unsigned long long deadline_ms;
+} pending_work_t;
+
+// Created workers have a thread, as modules using them wait for their works
+struct platform_worker
+{
+    pending_work_t pending_works[MAX_NUMBER_PENDING_WORKS];
+    pthread_t thread;
+    bool running;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;    //< On monotonic clock
+};
+
+struct platform_mutex
+{
+    pthread_mutex_t mutex;
+};
+
+struct platform_condition
+{
+    pthread_cond_t cond;
+};
+
+static Platform_dispatch_indication_f m_dispatch_indication_f = NULL;
+
+// Request lock, only taken by the library itself
+static pthread_mutex_t m_request_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// Encoded confirm waiting to be read by the library. Only accessed with the
+// request lock held, like the serial line
+static uint8_t m_rx_bytes[MAX_SLIP_FRAME_SIZE + 2];
+static size_t m_rx_size;
+static size_t m_rx_read;
+
+bool Bench_platform_dispatch(wpc_frame_t * frame_p)
+{
+    if (m_dispatch_indication_f == NULL)
+    {
+        return false;
+    }
+
+    m_dispatch_indication_f(frame_p,
+                            Platform_get_timestamp_ms_epoch(),
+                            Platform_get_timestamp_us_monotonic());
+    return true;
+}
+
+bool Platform_init(Platform_get_indication_f get_indication_f,
+                   Platform_dispatch_indication_f dispatch_indication_f)
+{
+    (void) get_indication_f;
+
+    if (dispatch_indication_f == NULL)
+    {
+        return false;
+    }
+
+    m_dispatch_indication_f = dispatch_indication_f;
+    return true;
+}
+
+unsigned long long Platform_get_timestamp_ms_epoch()
+{
+    struct timespec spec;
+
+    clock_gettime(CLOCK_REALTIME, &spec);
+    return ((unsigned long long) spec.tv_sec) * 1000 + (spec.tv_nsec) / 1000 / 1000;
+}
+
+unsigned long long Platform_get_timestamp_ms_monotonic()
+{
+    struct timespec spec;
+
+    clock_gettime(CLOCK_MONOTONIC, &spec);
+    return ((unsigned long long) spec.tv_sec) * 1000 + (spec.tv_nsec) / 1000 / 1000;
+}
+
+unsigned long long Platform_get_timestamp_us_monotonic()
+{
+    struct timespec spec;
+
+    clock_gettime(CLOCK_MONOTONIC_RAW, &spec);
+    return ((unsigned long long) spec.tv_sec) * 1000 * 1000 + (spec.tv_nsec) / 1000;
+}
+
+unsigned long long Platform_timestamp_us_monotonic_to_epoch(unsigned long long timestamp_us)
+{
+    struct timespec spec;
+
+    clock_gettime(CLOCK_REALTIME, &spec);
+    return ((unsigned long long) spec.tv_sec) * 1000 * 1000 + (spec.tv_nsec) / 1000
+           - (Platform_get_timestamp_us_monotonic() - timestamp_us);
+}
+
+void Platform_usleep(unsigned int time_us)
+{
+    // Waits are only needed by a real node (reboot for example), the
+    // simulated one is always ready
+    (void) time_us;
+}
+
+uintptr_t Platform_get_thread_id(void)
+{
+    return (uintptr_t) pthread_self();
+}
+
+bool Platform_lock_request()
+{
+    return pthread_mutex_lock(&m_request_mutex) == 0;
+}
+
+void Platform_unlock_request()
+{
+    pthread_mutex_unlock(&m_request_mutex);
+}
+
+void * Platform_malloc(size_t size)
+{
+    return malloc(size);
+}
+
+void Platform_free(void * ptr, size_t size)
+{
+    (void) size;
+    free(ptr);
+}
+
+bool Platform_schedule_work(Platform_work_f work, unsigned int delay_ms)
+{
+    // Nothing measured depends on delayed works, they are dropped
+    (void) work;
+    (void) delay_ms;
+    return true;
+}
+
+static void * execute_works(void * arg)
+{
+    struct platform_worker * worker_p = arg;
+
+    pthread_mutex_lock(&worker_p->mutex);
+    while (worker_p->running)
+    {
+        unsigned long long now = Platform_get_timestamp_ms_monotonic();
+        unsigned long long next_deadline_ms = 0;
+        Platform_work_f work = NULL;
+
+        for (int i = 0; i < MAX_NUMBER_PENDING_WORKS; i++)
+        {
+            pending_work_t * pending_p = &worker_p->pending_works[i];
+
+            if (pending_p->work == NULL)
+            {
+                continue;
+            }
+
+            if (pending_p->deadline_ms <= now)
+            {
+                work = pending_p->work;
+                pending_p->work = NULL;
+                break;
+            }
+
+            if ((next_deadline_ms == 0) || (pending_p->deadline_ms < next_deadline_ms))
+            {
+                next_deadline_ms = pending_p->deadline_ms;
+            }
+        }
+
+        if (work != NULL)
+        {
+            pthread_mutex_unlock(&worker_p->mutex);
+            work();
+            pthread_mutex_lock(&worker_p->mutex);
+        }
+        else if (next_deadline_ms == 0)
+        {
+            pthread_cond_wait(&worker_p->cond, &worker_p->mutex);
+        }
+        else
+        {
+            struct timespec ts = {
+                .tv_sec = next_deadline_ms / 1000,
+                .tv_nsec = (next_deadline_ms % 1000) * 1000 * 1000,
+            };
+            pthread_cond_timedwait(&worker_p->cond, &worker_p->mutex, &ts);
+        }
+    }
+    pthread_mutex_unlock(&worker_p->mutex);
+
+    return NULL;
+}
+
+platform_worker_t * Platform_worker_create(void)
+{
+    struct platform_worker * worker_p = calloc(1, sizeof(struct platform_worker));
+    pthread_condattr_t cond_attr;
+
+    if (worker_p == NULL)
+    {
+        return NULL;
+    }
+
+    pthread_condattr_init(&cond_attr);
+    pthread_condattr_setclock(&cond_attr, CLOCK_MONOTONIC);
+    pthread_mutex_init(&worker_p->mutex, NULL);
+    pthread_cond_init(&worker_p->cond, &cond_attr);
+
+    worker_p->running = true;
+    if (pthread_create(&worker_p->thread, NULL, execute_works, worker_p) != 0)
+    {
+        pthread_cond_destroy(&worker_p->cond);
+        pthread_mutex_destroy(&worker_p->mutex);
+        free(worker_p);
+        return NULL;
+    }
+
+    return worker_p;
+}
+
+bool Platform_worker_schedule(platform_worker_t * worker_p,
+                              Platform_work_f work,
+                              unsigned int delay_ms)
+{
+    int free_slot = -1;
+    bool res = true;
+
+    pthread_mutex_lock(&worker_p->mutex);
+    for (int i = 0; i < MAX_NUMBER_PENDING_WORKS; i++)
+    {
+        if (worker_p->pending_works[i].work == work)
+        {
+            // Already pending, merged with it
+            pthread_mutex_unlock(&worker_p->mutex);
+            return true;
+        }
+
+        if ((worker_p->pending_works[i].work == NULL) && (free_slot < 0))
+        {
+            free_slot = i;
+        }
+    }
+
+    if (free_slot < 0)
+    {
+        res = false;
+    }
+    else
+    {
+        worker_p->pending_works[free_slot].work = work;
+        worker_p->pending_works[free_slot].deadline_ms =
+            Platform_get_timestamp_ms_monotonic() + delay_ms;
+        pthread_cond_signal(&worker_p->cond);
+    }
+    pthread_mutex_unlock(&worker_p->mutex);
+
+    return res;
+}
+
+void Platform_worker_delete(platform_worker_t * worker_p)
+{
+    pthread_mutex_lock(&worker_p->mutex);
+    worker_p->running = false;
+    pthread_cond_signal(&worker_p->cond);
+    pthread_mutex_unlock(&worker_p->mutex);
+
+    pthread_join(worker_p->thread, NULL);
+    pthread_cond_destroy(&worker_p->cond);
+    pthread_mutex_destroy(&worker_p->mutex);
+    free(worker_p);
+}
+
+platform_mutex_t * Platform_mutex_create(void)
+{
+    struct platform_mutex * mutex_p = malloc(sizeof(struct platform_mutex));
+
+    if ((mutex_p != NULL) && (pthread_mutex_init(&mutex_p->mutex, NULL) != 0))
+    {
+        free(mutex_p);
+        mutex_p = NULL;
+    }
+    return mutex_p;
+}
+
+void Platform_mutex_lock(platform_mutex_t * mutex_p)
+{
+    pthread_mutex_lock(&mutex_p->mutex);
+}
+
+bool Platform_mutex_trylock(platform_mutex_t * mutex_p)
+{
+    return pthread_mutex_trylock(&mutex_p->mutex) == 0;
+}
+
+void Platform_mutex_unlock(platform_mutex_t * mutex_p)
+{
+    pthread_mutex_unlock(&mutex_p->mutex);
+}
+
+void Platform_mutex_delete(platform_mutex_t * mutex_p)
+{
+    pthread_mutex_destroy(&mutex_p->mutex);
+    free(mutex_p);
+}
+
+platform_condition_t * Platform_condition_create(void)
+{
+    struct platform_condition * cond_p = malloc(sizeof(struct platform_condition));
+
+    if ((cond_p != NULL) && (pthread_cond_init(&cond_p->cond, NULL) != 0))
+    {
+        free(cond_p);
+        cond_p = NULL;
+    }
+    return cond_p;
+}
+
+void Platform_condition_wait(platform_condition_t * cond_p, platform_mutex_t * mutex_p)
+{
+    pthread_cond_wait(&cond_p->cond, &mutex_p->mutex);
+}
+
+void Platform_condition_broadcast(platform_condition_t * cond_p)
+{
+    pthread_cond_broadcast(&cond_p->cond);
+}
+
+void Platform_condition_delete(platform_condition_t * cond_p)
+{
+    pthread_cond_destroy(&cond_p->cond);
+    free(cond_p);
+}
+
+bool Platform_capture_start(const char * path, size_t max_file_size, unsigned int max_files)
+{
+    (void) path;
+    (void) max_file_size;
+    (void) max_files;
+
+    LOGE("Frame capture is not available in benchmarks\n");
+    return false;
+}
+
+void Platform_capture_frame(bool from_node, const uint8_t * frame_p, size_t size)
+{
+    (void) from_node;
+    (void) frame_p;
+    (void) size;
+}
+
+void Platform_capture_stop(void)
+{
+}
+
+void Platform_close()
+{
+    m_dispatch_indication_f = NULL;
+}
+
+int Serial_open(const char * port_name, unsigned long bitrate)
+{
+    (void) port_name;
+    (void) bitrate;
+
+    Sim_node_init();
+    m_rx_size = 0;
+    m_rx_read = 0;
+    return 0;
+}
+
+int Serial_set_bitrate(unsigned long bitrate)
+{
+    (void) bitrate;
+    return 0;
+}
+
+int Serial_close(void)
+{
+    return 0;
+}
+
+int Serial_read(unsigned char * c, unsigned int timeout_ms)
+{
+    (void) timeout_ms;
+
+    if (m_rx_read >= m_rx_size)
+    {
+        // Nothing more will come
+        return 0;
+    }
+
+    *c = m_rx_bytes[m_rx_read++];
+    return 1;
+}
+
+int Serial_write(const unsigned char * buffer, unsigned int buffer_size)
+{
+    uint8_t decoded[MAX_SLIP_FRAME_SIZE];
+    wpc_frame_t confirm;
+    unsigned int start = 0;
+    unsigned int end = buffer_size;
+    int size;
+
+    // Library writes a single frame surrounded by end symbols
+    while ((start < end) && (buffer[start] == SLIP_END))
+    {
+        start++;
+    }
+    while ((end > start) && (buffer[end - 1] == SLIP_END))
+    {
+        end--;
+    }
+    if ((end - start < 2) || (end - start > sizeof(decoded)))
+    {
+        LOGE("Invalid frame written (%u bytes)\n", buffer_size);
+        return -1;
+    }
+
+    memcpy(decoded, buffer + start, end - start);
+    size = Slip_decode(decoded, end - start);
+    if (size < 3)
+    {
+        LOGE("Cannot decode frame written (%d)\n", size);
+        return -1;
+    }
+
+    Sim_node_handle_request((wpc_frame_t *) decoded, &confirm);
+
+    m_rx_bytes[0] = SLIP_END;
+    size = Slip_encode((uint8_t *) &confirm,
+                       FRAME_SIZE(&confirm),
+                       m_rx_bytes + 1,
+                       sizeof(m_rx_bytes) - 2);
+    if (size < 0)
+    {
+        return -1;
+    }
+    m_rx_bytes[size + 1] = SLIP_END;
+    m_rx_size = size + 2;
+    m_rx_read = 0;
+
+    return buffer_size;
+}
@@ -0,0 +1,22 @@
+/* Wirepas Oy licensed under Apache License, Version 2.0
+ *
+ * See file LICENSE for full license details.
+ *
+ */
+#ifndef BENCH_PLATFORM_H_
+#define BENCH_PLATFORM_H_
+
+#include "platform.h"
+
+/**
+ * \brief   Give an indication to the library as if it was polled from the
+ *          node
+ * \param   frame_p
+ *          The indication
+ * \return  True if dispatched, false if the library is not initialized
+ * \note    It is dispatched from the caller context, there is no polling
+ *          or dispatching thread in the benchmark platform
+ */
+bool Bench_platform_dispatch(wpc_frame_t * frame_p);
+
+#endif
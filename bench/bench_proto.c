@@ -0,0 +1,145 @@
+/* Wirepas Oy licensed under Apache License, Version 2.0
+ *
+ * See file LICENSE for full license details.
+ *
+ */
+#include <string.h>
+
+#include "bench_proto.h"
+#include "bench_platform.h"
+#include "sim_node.h"
+
+#include "generic_message.pb.h"
+#include <pb_encode.h>
+
+#define LOG_MODULE_NAME "bench_proto"
+#define MAX_LOG_LEVEL INFO_LOG_LEVEL
+#include "logger.h"
+
+// Size of the payload of send packet requests
+#define SEND_PACKET_PAYLOAD_SIZE    100
+
+// Size of the scratchpad uploaded in one request
+#define SCRATCHPAD_SIZE             1024
+
+static const char * m_request_names[BENCH_REQUEST_COUNT] = {
+    [BENCH_REQUEST_GET_CONFIGS] = "get_configs",
+    [BENCH_REQUEST_SET_CONFIG] = "set_config",
+    [BENCH_REQUEST_SEND_PACKET] = "send_packet",
+    [BENCH_REQUEST_GET_SCRATCHPAD_STATUS] = "get_scratchpad_status",
+    [BENCH_REQUEST_UPLOAD_SCRATCHPAD] = "upload_scratchpad",
+    [BENCH_REQUEST_PROCESS_SCRATCHPAD] = "process_scratchpad",
+    [BENCH_REQUEST_GET_GATEWAY_INFO] = "get_gateway_info",
+    [BENCH_REQUEST_SET_SCRATCHPAD_TARGET_AND_ACTION] = "set_scratchpad_target_and_action",
+};
+
+static uint64_t m_req_id = 0;
+
+static void fill_header(wp_RequestHeader * header_p)
+{
+    *header_p = (wp_RequestHeader) wp_RequestHeader_init_zero;
+    header_p->req_id = ++m_req_id;
+    header_p->has_sink_id = true;
+    strncpy(header_p->sink_id, BENCH_SINK_ID, sizeof(header_p->sink_id) - 1);
+}
+
+const char * Bench_proto_get_request_name(bench_request_e request)
+{
+    return (request < BENCH_REQUEST_COUNT) ? m_request_names[request] : "unknown";
+}
+
+size_t Bench_proto_encode_request(bench_request_e request, uint8_t * buffer_p, size_t buffer_size)
+{
+    wp_GenericMessage message = wp_GenericMessage_init_zero;
+    wp_WirepasMessage wirepas = wp_WirepasMessage_init_zero;
+    pb_ostream_t stream = pb_ostream_from_buffer(buffer_p, buffer_size);
+
+    // Only one of them is used for a given request
+    wp_GetConfigsReq get_configs = wp_GetConfigsReq_init_zero;
+    wp_SetConfigReq set_config = wp_SetConfigReq_init_zero;
+    wp_SendPacketReq send_packet = wp_SendPacketReq_init_zero;
+    wp_GetScratchpadStatusReq get_scratchpad_status = wp_GetScratchpadStatusReq_init_zero;
+    wp_UploadScratchpadReq upload_scratchpad = wp_UploadScratchpadReq_init_zero;
+    wp_ProcessScratchpadReq process_scratchpad = wp_ProcessScratchpadReq_init_zero;
+    wp_GetGwInfoReq get_gateway_info = wp_GetGwInfoReq_init_zero;
+    wp_SetScratchpadTargetAndActionReq set_target = wp_SetScratchpadTargetAndActionReq_init_zero;
+    uint8_t packet_payload[SEND_PACKET_PAYLOAD_SIZE];
+    PB_BYTES_ARRAY_T(SCRATCHPAD_SIZE) scratchpad;
+
+    message.wirepas = &wirepas;
+
+    switch (request)
+    {
+        case BENCH_REQUEST_GET_CONFIGS:
+            fill_header(&get_configs.header);
+            wirepas.get_configs_req = &get_configs;
+            break;
+        case BENCH_REQUEST_SET_CONFIG:
+            // Same channel as the current one, stack is not restarted
+            fill_header(&set_config.header);
+            strncpy(set_config.config.sink_id,
+                    BENCH_SINK_ID,
+                    sizeof(set_config.config.sink_id) - 1);
+            set_config.config.has_network_channel = true;
+            set_config.config.network_channel = 5;
+            wirepas.set_config_req = &set_config;
+            break;
+        case BENCH_REQUEST_SEND_PACKET:
+            fill_header(&send_packet.header);
+            send_packet.destination_address = 2;
+            send_packet.source_endpoint = 1;
+            send_packet.destination_endpoint = 1;
+            // Encoded by the callback of the message, like it is decoded
+            memset(packet_payload, 0xA5, SEND_PACKET_PAYLOAD_SIZE);
+            send_packet.payload.bytes = packet_payload;
+            send_packet.payload.size = SEND_PACKET_PAYLOAD_SIZE;
+            wirepas.send_packet_req = &send_packet;
+            break;
+        case BENCH_REQUEST_GET_SCRATCHPAD_STATUS:
+            fill_header(&get_scratchpad_status.header);
+            wirepas.get_scratchpad_status_req = &get_scratchpad_status;
+            break;
+        case BENCH_REQUEST_UPLOAD_SCRATCHPAD:
+            fill_header(&upload_scratchpad.header);
+            upload_scratchpad.seq = 2;
+            scratchpad.size = SCRATCHPAD_SIZE;
+            memset(scratchpad.bytes, 0x5A, SCRATCHPAD_SIZE);
+            upload_scratchpad.scratchpad = (pb_bytes_array_t *) &scratchpad;
+            wirepas.upload_scratchpad_req = &upload_scratchpad;
+            break;
+        case BENCH_REQUEST_PROCESS_SCRATCHPAD:
+            fill_header(&process_scratchpad.header);
+            wirepas.process_scratchpad_req = &process_scratchpad;
+            break;
+        case BENCH_REQUEST_GET_GATEWAY_INFO:
+            fill_header(&get_gateway_info.header);
+            wirepas.get_gateway_info_req = &get_gateway_info;
+            break;
+        case BENCH_REQUEST_SET_SCRATCHPAD_TARGET_AND_ACTION:
+            fill_header(&set_target.header);
+            set_target.target_and_action.action = wp_ScratchpadAction_NO_OTAP;
+            wirepas.set_scratchpad_target_and_action_req = &set_target;
+            break;
+        default:
+            return 0;
+    }
+
+    if (!pb_encode(&stream, wp_GenericMessage_fields, &message))
+    {
+        LOGE("Cannot encode %s request: %s\n",
+             Bench_proto_get_request_name(request),
+             PB_GET_ERROR(&stream));
+        return 0;
+    }
+
+    return stream.bytes_written;
+}
+
+bool Bench_proto_receive_data(uint32_t src_addr, size_t payload_size)
+{
+    static uint8_t payload[MAX_APDU_DSAP_SIZE];
+    wpc_frame_t frame;
+
+    Sim_node_build_data_rx(&frame, src_addr, payload, payload_size);
+    return Bench_platform_dispatch(&frame);
+}
@@ -0,0 +1,68 @@
+/* Wirepas Oy licensed under Apache License, Version 2.0
+ *
+ * See file LICENSE for full license details.
+ *
+ */
+#ifndef BENCH_PROTO_H_
+#define BENCH_PROTO_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Sink id given to WPC_Proto_initialize and used in requests
+#define BENCH_SINK_ID "sink0"
+
+/**
+ * \brief   Requests handled by WPC_Proto_handle_request
+ */
+typedef enum
+{
+    BENCH_REQUEST_GET_CONFIGS,
+    BENCH_REQUEST_SET_CONFIG,
+    BENCH_REQUEST_SEND_PACKET,
+    BENCH_REQUEST_GET_SCRATCHPAD_STATUS,
+    BENCH_REQUEST_UPLOAD_SCRATCHPAD,
+    BENCH_REQUEST_PROCESS_SCRATCHPAD,
+    BENCH_REQUEST_GET_GATEWAY_INFO,
+    BENCH_REQUEST_SET_SCRATCHPAD_TARGET_AND_ACTION,
+    BENCH_REQUEST_COUNT
+} bench_request_e;
+
+/**
+ * \brief   Get a printable name of a request
+ */
+const char * Bench_proto_get_request_name(bench_request_e request);
+
+/**
+ * \brief   Encode a request as a gateway backend would send it
+ * \param   request
+ *          The request to encode
+ * \param   buffer_p
+ *          Buffer to store the encoded request
+ * \param   buffer_size
+ *          Size of the buffer
+ * \return  Size of the encoded request, 0 in case of error
+ */
+size_t Bench_proto_encode_request(bench_request_e request, uint8_t * buffer_p, size_t buffer_size);
+
+/**
+ * \brief   Give a data rx indication to the library, as if it was received
+ *          from the simulated node
+ * \param   src_addr
+ *          Source address of the packet
+ * \param   payload_size
+ *          Size of the payload
+ * \return  True if dispatched
+ */
+bool Bench_proto_receive_data(uint32_t src_addr, size_t payload_size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
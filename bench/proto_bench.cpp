@@ -0,0 +1,169 @@
+/* Wirepas Oy licensed under Apache License, Version 2.0
+ *
+ * See file LICENSE for full license details.
+ *
+ */
+#include <benchmark/benchmark.h>
+
+#include <string>
+#include <vector>
+
+extern "C" {
+#include "wpc_proto.h"
+#include "proto_rx_event.h"
+#include "bench_proto.h"
+}
+
+static size_t m_events_received = 0;
+
+static void onDataRxEvent_cb(uint8_t * event_p,
+                             size_t event_size,
+                             uint32_t network_id,
+                             uint16_t src_ep,
+                             uint16_t dst_ep)
+{
+    (void) event_p;
+    (void) event_size;
+    (void) network_id;
+    (void) src_ep;
+    (void) dst_ep;
+    m_events_received++;
+}
+
+/**
+ * \brief   Initialize the library against the simulated node, once for all
+ *          the benchmarks
+ */
+static bool proto_ready(benchmark::State & state)
+{
+    static bool initialized = false;
+
+    if (!initialized)
+    {
+        initialized = (WPC_Proto_initialize("sim", 115200, "bench_gw", "bench", "1.0",
+                                            BENCH_SINK_ID) == APP_RES_PROTO_OK)
+                      && (WPC_Proto_register_for_data_rx_event(onDataRxEvent_cb)
+                          == APP_RES_PROTO_OK);
+    }
+
+    if (!initialized)
+    {
+        state.SkipWithError("Cannot initialize WPC proto");
+    }
+    return initialized;
+}
+
+static void BM_Proto_rx_event_encode(benchmark::State & state)
+{
+    std::vector<uint8_t> payload(state.range(0), 0x42);
+    std::vector<uint8_t> buffer(WPC_PROTO_OFFSET_DATA_SIZE + payload.size());
+    proto_rx_event_t event = {};
+
+    if (!proto_ready(state))
+    {
+        return;
+    }
+
+    event.payload_p = payload.data();
+    event.payload_size = payload.size();
+    event.src_addr = 0x12345;
+    event.dst_addr = 1;
+    event.src_ep = 1;
+    event.dst_ep = 1;
+    event.travel_time_ms = 25;
+    event.hop_count = 3;
+    event.rx_time_ms_epoch = 1700000000000ULL;
+    event.network_address = 0xABCDEF;
+
+    for (auto _ : state)
+    {
+        size_t size = Proto_rx_event_encode(&event, buffer.data(), buffer.size());
+        if (size == 0)
+        {
+            state.SkipWithError("Cannot encode event");
+            break;
+        }
+        benchmark::DoNotOptimize(size);
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_Proto_rx_event_encode)->ArgName("payload")->Arg(10)->Arg(50)->Arg(102);
+
+/**
+ * \brief   Full path of a received packet in the library, from the dispatch
+ *          of the indication to the callback with the encoded event
+ *          (onDataReceived)
+ */
+static void BM_Proto_data_received(benchmark::State & state)
+{
+    uint32_t src_addr = 0;
+
+    if (!proto_ready(state))
+    {
+        return;
+    }
+
+    m_events_received = 0;
+    for (auto _ : state)
+    {
+        // Different sources like on a real network
+        src_addr = (src_addr + 1) % 1000;
+        if (!Bench_proto_receive_data(src_addr + 2, state.range(0)))
+        {
+            state.SkipWithError("Cannot dispatch indication");
+            break;
+        }
+    }
+
+    if (m_events_received != (size_t) state.iterations())
+    {
+        state.SkipWithError("Not all packets were received");
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_Proto_data_received)->ArgName("payload")->Arg(10)->Arg(50)->Arg(102);
+
+/**
+ * \brief   Decode a request, handle it against the simulated node and
+ *          encode the response
+ */
+static void BM_Proto_handle_request(benchmark::State & state)
+{
+    bench_request_e request = (bench_request_e) state.range(0);
+    std::vector<uint8_t> request_buffer(2048);
+    std::vector<uint8_t> response(WPC_PROTO_MAX_RESPONSE_SIZE);
+    size_t request_size;
+
+    if (!proto_ready(state))
+    {
+        return;
+    }
+
+    state.SetLabel(Bench_proto_get_request_name(request));
+
+    request_size = Bench_proto_encode_request(request, request_buffer.data(), request_buffer.size());
+    if (request_size == 0)
+    {
+        state.SkipWithError("Cannot encode request");
+        return;
+    }
+
+    for (auto _ : state)
+    {
+        size_t response_size = response.size();
+        app_proto_res_e res = WPC_Proto_handle_request(request_buffer.data(),
+                                                       request_size,
+                                                       response.data(),
+                                                       &response_size);
+        if (res != APP_RES_PROTO_OK)
+        {
+            std::string error = "Request failed: " + std::to_string(res);
+            state.SkipWithError(error.c_str());
+            break;
+        }
+        benchmark::DoNotOptimize(response_size);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_Proto_handle_request)->ArgName("request")->DenseRange(0, BENCH_REQUEST_COUNT - 1);
@@ -0,0 +1,123 @@
+/* Wirepas Oy licensed under Apache License, Version 2.0
+ *
+ * See file LICENSE for full license details.
+ *
+ */
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <random>
+#include <vector>
+
+extern "C" {
+#include "reassembly.h"
+}
+
+// Fragmented packets are received from the network in fragments of this size
+#define FRAGMENT_SIZE       100
+#define FRAGMENTS_PER_PACKET 8
+#define PACKET_SIZE         (FRAGMENT_SIZE * FRAGMENTS_PER_PACKET)
+
+// Packet ids are on 12 bits
+#define PACKET_ID_MASK      0xFFF
+
+enum
+{
+    ORDER_IN_ORDER = 0,
+    ORDER_OUT_OF_ORDER = 1,
+    ORDER_DUPLICATES = 2,
+};
+
+/**
+ * \brief   Receive one packet from each source, fragments of all the sources
+ *          being interleaved so every packet is under reassembly at the same
+ *          time
+ *          Range 0 is the number of sources, range 1 the order of fragments
+ */
+static void BM_Reassembly(benchmark::State & state)
+{
+    const uint32_t sources = state.range(0);
+    const int order = state.range(1);
+    std::vector<uint8_t> payload(PACKET_SIZE);
+    std::vector<uint8_t> full(PACKET_SIZE);
+    std::vector<size_t> offsets;
+    std::mt19937 rng(42);
+    uint16_t packet_id = 0;
+    size_t packets = 0;
+
+    for (size_t i = 0; i < payload.size(); i++)
+    {
+        payload[i] = i;
+    }
+
+    // Same order of fragments for every iteration
+    for (size_t i = 0; i < FRAGMENTS_PER_PACKET; i++)
+    {
+        offsets.push_back(i * FRAGMENT_SIZE);
+        // A duplicate of the last fragment would start a new packet, as the
+        // packet is already delivered
+        if ((order == ORDER_DUPLICATES) && (i < FRAGMENTS_PER_PACKET - 1))
+        {
+            offsets.push_back(i * FRAGMENT_SIZE);
+        }
+    }
+    if (order == ORDER_OUT_OF_ORDER)
+    {
+        std::shuffle(offsets.begin(), offsets.end(), rng);
+        // Last fragment received first is the worst case
+        std::swap(*std::find(offsets.begin(), offsets.end(), PACKET_SIZE - FRAGMENT_SIZE),
+                  offsets.front());
+    }
+
+    reassembly_init();
+
+    for (auto _ : state)
+    {
+        for (size_t offset : offsets)
+        {
+            for (uint32_t src = 1; src <= sources; src++)
+            {
+                reassembly_fragment_t fragment;
+                size_t full_size;
+
+                fragment.src_add = src;
+                fragment.packet_id = packet_id;
+                fragment.size = FRAGMENT_SIZE;
+                fragment.offset = offset;
+                fragment.last_fragment = (offset == PACKET_SIZE - FRAGMENT_SIZE);
+                fragment.bytes = payload.data() + offset;
+                fragment.timestamp = 0;
+
+                // Duplicates are rejected, as expected
+                reassembly_add_fragment(&fragment, &full_size);
+                if (full_size != 0)
+                {
+                    size_t size = full.size();
+                    if (!reassembly_get_full_message(src, packet_id, full.data(), &size))
+                    {
+                        state.SkipWithError("Cannot get full message");
+                        return;
+                    }
+                    benchmark::DoNotOptimize(full.data());
+                    packets++;
+                }
+            }
+        }
+        packet_id = (packet_id + 1) & PACKET_ID_MASK;
+    }
+
+    if (!reassembly_is_queue_empty())
+    {
+        state.SkipWithError("Packets left under reassembly");
+    }
+
+    state.SetItemsProcessed(packets);
+    state.counters["fragments"] = benchmark::Counter(state.iterations() * offsets.size()
+                                                         * sources,
+                                                     benchmark::Counter::kIsRate);
+}
+BENCHMARK(BM_Reassembly)
+    ->ArgNames({"sources", "order"})
+    ->ArgsProduct({{1, 10, 100, 1000, 10000},
+                   {ORDER_IN_ORDER, ORDER_OUT_OF_ORDER, ORDER_DUPLICATES}});
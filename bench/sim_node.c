@@ -0,0 +1,262 @@
+/* Wirepas Oy licensed under Apache License, Version 2.0
+ *
+ * See file LICENSE for full license details.
+ *
+ */
+#include <string.h>
+#include <time.h>
+
+#include "sim_node.h"
+#include "util.h"
+
+/*
+ * Minimal node answering the requests of the library without any delay.
+ * It is only as smart as needed to let the gateway side code run its normal
+ * path: attributes are stored, every other request succeeds.
+ */
+
+// Values of MSAP_STACK_STATUS attribute
+#define STACK_STATUS_RUNNING    0x00
+#define STACK_STATUS_STOPPED    0x01
+
+// Result of an attribute read for an unknown attribute
+#define ATTRIBUTE_NOT_SET       4
+
+// Capacity reported in data tx confirms
+#define PDU_BUFFER_CAPACITY     32
+
+typedef struct
+{
+    uint8_t read_primitive_id;      //< CSAP or MSAP read primitive
+    uint16_t attribute_id;          //< Attribute id
+    uint8_t length;                 //< Exact length of the attribute
+    uint8_t value[16];              //< Current value, little endian
+} sim_attribute_t;
+
+// Default attributes of the node, copied at init
+static const sim_attribute_t m_default_attributes[] = {
+    {CSAP_ATTRIBUTE_READ_REQUEST, C_NODE_ADDRESS_ID, 4, {0x01, 0x00, 0x00, 0x00}},
+    {CSAP_ATTRIBUTE_READ_REQUEST, C_NETWORK_ADDRESS_ID, 3, {0xEF, 0xCD, 0xAB}},
+    {CSAP_ATTRIBUTE_READ_REQUEST, C_NETWORK_CHANNEL_ID, 1, {5}},
+    {CSAP_ATTRIBUTE_READ_REQUEST, C_NODE_ROLE_ID, 1, {0x01}},
+    {CSAP_ATTRIBUTE_READ_REQUEST, C_MTU_ID, 1, {102}},
+    {CSAP_ATTRIBUTE_READ_REQUEST, C_PDU_BUFFER_SIZE_ID, 1, {PDU_BUFFER_CAPACITY}},
+    {CSAP_ATTRIBUTE_READ_REQUEST, C_SCRATCHPAD_SEQUENCE_ID, 1, {1}},
+    {CSAP_ATTRIBUTE_READ_REQUEST, C_MESH_API_VER_ID, 2, {10, 0}},
+    {CSAP_ATTRIBUTE_READ_REQUEST, C_FIRMWARE_MAJOR_ID, 2, {5, 0}},
+    {CSAP_ATTRIBUTE_READ_REQUEST, C_FIRMWARE_MINOR_ID, 2, {4, 0}},
+    {CSAP_ATTRIBUTE_READ_REQUEST, C_FIRMWARE_MAINT_ID, 2, {0, 0}},
+    {CSAP_ATTRIBUTE_READ_REQUEST, C_FIRMWARE_DEV_ID, 2, {0, 0}},
+    {CSAP_ATTRIBUTE_READ_REQUEST, C_CIPHER_KEY_ID, 16, {0}},
+    {CSAP_ATTRIBUTE_READ_REQUEST, C_AUTH_KEY_ID, 16, {0}},
+    {CSAP_ATTRIBUTE_READ_REQUEST, C_CHANNEL_LIM_ID, 2, {1, 40}},
+    {CSAP_ATTRIBUTE_READ_REQUEST, C_APP_CONFIG_DATA_SIZE_ID, 1, {80}},
+    {CSAP_ATTRIBUTE_READ_REQUEST, C_HW_MAGIC, 2, {0x03, 0x00}},
+    {CSAP_ATTRIBUTE_READ_REQUEST, C_STACK_PROFILE, 2, {0x01, 0x00}},
+    {CSAP_ATTRIBUTE_READ_REQUEST, C_CHANNEL_MAP, 4, {0}},
+    {MSAP_ATTRIBUTE_READ_REQUEST, MSAP_STACK_STATUS, 1, {STACK_STATUS_RUNNING}},
+    {MSAP_ATTRIBUTE_READ_REQUEST, MSAP_PDU_BUFFER_USAGE, 1, {0}},
+    {MSAP_ATTRIBUTE_READ_REQUEST, MSAP_PDU_BUFFER_CAPACITY, 1, {PDU_BUFFER_CAPACITY}},
+    {MSAP_ATTRIBUTE_READ_REQUEST, MSAP_ENERGY, 1, {0}},
+    {MSAP_ATTRIBUTE_READ_REQUEST, MSAP_AUTOSTART, 1, {1}},
+    {MSAP_ATTRIBUTE_READ_REQUEST, MSAP_ROUTE_COUNT, 1, {1}},
+    {MSAP_ATTRIBUTE_READ_REQUEST, MSAP_SYSTEM_TIME, 4, {0}},
+    {MSAP_ATTRIBUTE_READ_REQUEST, MSAP_ACCESS_CYCLE_RANGE, 4, {0xD0, 0x07, 0x40, 0x1F}},
+    {MSAP_ATTRIBUTE_READ_REQUEST, MSAP_ACCESS_CYCLE_LIMITS, 4, {0xD0, 0x07, 0x40, 0x1F}},
+    {MSAP_ATTRIBUTE_READ_REQUEST, MSAP_CURRENT_ACCESS_CYCLE, 2, {0xD0, 0x07}},
+    {MSAP_ATTRIBUTE_READ_REQUEST, MSAP_SCRATCHPAD_BLOCK_MAX, 1, {112}},
+    {MSAP_ATTRIBUTE_READ_REQUEST, MSAP_SCRATCHPAD_NUM_BYTES, 4, {0}},
+};
+
+#define NUMBER_OF_ATTRIBUTES (sizeof(m_default_attributes) / sizeof(m_default_attributes[0]))
+
+static sim_attribute_t m_attributes[NUMBER_OF_ATTRIBUTES];
+
+static uint16_t m_pdu_id;
+
+// Start of the node, for its system time
+static struct timespec m_start;
+
+static sim_attribute_t * get_attribute(uint8_t read_primitive_id, uint16_t attribute_id)
+{
+    for (size_t i = 0; i < NUMBER_OF_ATTRIBUTES; i++)
+    {
+        if ((m_attributes[i].read_primitive_id == read_primitive_id)
+            && (m_attributes[i].attribute_id == attribute_id))
+        {
+            return &m_attributes[i];
+        }
+    }
+    return NULL;
+}
+
+static void set_stack_status(uint8_t status)
+{
+    get_attribute(MSAP_ATTRIBUTE_READ_REQUEST, MSAP_STACK_STATUS)->value[0] = status;
+}
+
+/**
+ * \brief   System time of the node since its start, in 1/128 s
+ */
+static uint32_t get_system_time(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (((now.tv_sec - m_start.tv_sec) * 1000000000LL + now.tv_nsec - m_start.tv_nsec) * 128)
+           / 1000000000;
+}
+
+static void handle_attribute_read(const wpc_frame_t * request_p, wpc_frame_t * confirm_p)
+{
+    attribute_read_conf_pl_t * conf_p = &confirm_p->payload.attribute_read_confirm_payload;
+    uint16_t attribute_id = uint16_decode_le(
+        (const uint8_t *) &request_p->payload.attribute_read_request_payload.attribute_id);
+    sim_attribute_t * attribute_p = get_attribute(request_p->primitive_id, attribute_id);
+
+    if ((request_p->primitive_id == MSAP_ATTRIBUTE_READ_REQUEST)
+        && (attribute_id == MSAP_SYSTEM_TIME))
+    {
+        uint32_encode_le(get_system_time(), attribute_p->value);
+    }
+
+    uint16_encode_le(attribute_id, (uint8_t *) &conf_p->attribute_id);
+    if (attribute_p == NULL)
+    {
+        conf_p->result = ATTRIBUTE_NOT_SET;
+        conf_p->attribute_length = 0;
+    }
+    else
+    {
+        conf_p->result = 0;
+        conf_p->attribute_length = attribute_p->length;
+        memcpy(conf_p->attribute_value, attribute_p->value, attribute_p->length);
+    }
+    confirm_p->payload_length = 4 + conf_p->attribute_length;
+}
+
+static void handle_attribute_write(const wpc_frame_t * request_p, wpc_frame_t * confirm_p)
+{
+    const attribute_write_req_pl_t * req_p = &request_p->payload.attribute_write_request_payload;
+    uint16_t attribute_id = uint16_decode_le((const uint8_t *) &req_p->attribute_id);
+    // Read primitive always follows the write one
+    sim_attribute_t * attribute_p = get_attribute(request_p->primitive_id + 1, attribute_id);
+
+    if ((attribute_p != NULL) && (req_p->attribute_length == attribute_p->length))
+    {
+        memcpy(attribute_p->value, req_p->attribute_value, attribute_p->length);
+    }
+
+    // Writes of attributes not read back are accepted too
+    confirm_p->payload.sap_generic_confirm_payload.result = 0;
+    confirm_p->payload_length = sizeof(sap_generic_conf_pl_t);
+}
+
+static void handle_data_tx(wpc_frame_t * confirm_p)
+{
+    dsap_data_tx_conf_pl_t * conf_p = &confirm_p->payload.dsap_data_tx_confirm_payload;
+
+    uint16_encode_le(m_pdu_id++, (uint8_t *) &conf_p->pdu_id);
+    conf_p->result = 0;
+    conf_p->capacity = PDU_BUFFER_CAPACITY - 1;
+    confirm_p->payload_length = sizeof(dsap_data_tx_conf_pl_t);
+}
+
+/**
+ * \brief   Confirms with a structure payload are answered with a zeroed
+ *          payload, meaning success and default values
+ */
+static void handle_struct_confirm(wpc_frame_t * confirm_p, size_t size)
+{
+    memset(&confirm_p->payload, 0, size);
+    confirm_p->payload_length = size;
+}
+
+void Sim_node_init(void)
+{
+    memcpy(m_attributes, m_default_attributes, sizeof(m_attributes));
+    m_pdu_id = 0;
+    clock_gettime(CLOCK_MONOTONIC, &m_start);
+}
+
+void Sim_node_handle_request(const wpc_frame_t * request_p, wpc_frame_t * confirm_p)
+{
+    confirm_p->primitive_id = request_p->primitive_id + SAP_CONFIRM_OFFSET;
+    confirm_p->frame_id = request_p->frame_id;
+
+    switch (request_p->primitive_id)
+    {
+        case CSAP_ATTRIBUTE_READ_REQUEST:
+        case MSAP_ATTRIBUTE_READ_REQUEST:
+            handle_attribute_read(request_p, confirm_p);
+            break;
+        case CSAP_ATTRIBUTE_WRITE_REQUEST:
+        case MSAP_ATTRIBUTE_WRITE_REQUEST:
+            handle_attribute_write(request_p, confirm_p);
+            break;
+        case DSAP_DATA_TX_REQUEST:
+        case DSAP_DATA_TX_TT_REQUEST:
+        case DSAP_DATA_TX_FRAG_REQUEST:
+            handle_data_tx(confirm_p);
+            break;
+        case MSAP_STACK_START_REQUEST:
+            set_stack_status(STACK_STATUS_RUNNING);
+            handle_struct_confirm(confirm_p, sizeof(sap_generic_conf_pl_t));
+            break;
+        case MSAP_STACK_STOP_REQUEST:
+            set_stack_status(STACK_STATUS_STOPPED);
+            handle_struct_confirm(confirm_p, sizeof(sap_generic_conf_pl_t));
+            break;
+        case MSAP_INDICATION_POLL_REQUEST:
+            // No indication pending
+            handle_struct_confirm(confirm_p, sizeof(sap_generic_conf_pl_t));
+            break;
+        case MSAP_SCRATCH_STATUS_REQUEST:
+            handle_struct_confirm(confirm_p, sizeof(msap_scratchpad_status_conf_pl_t));
+            break;
+        case MSAP_SCRATCH_TARGET_READ_REQUEST:
+            handle_struct_confirm(confirm_p, sizeof(msap_scratchpad_target_read_conf_pl_t));
+            break;
+        case MSAP_APP_CONFIG_DATA_READ_REQUEST:
+            handle_struct_confirm(confirm_p, sizeof(msap_app_config_data_read_conf_pl_t));
+            break;
+        case MSAP_SINK_COST_READ_REQUEST:
+            handle_struct_confirm(confirm_p, sizeof(msap_sink_cost_read_conf_pl_t));
+            break;
+        case MSAP_GET_NBORS_REQUEST:
+            handle_struct_confirm(confirm_p, sizeof(msap_get_nbors_conf_pl_t));
+            break;
+        default:
+            handle_struct_confirm(confirm_p, sizeof(sap_generic_conf_pl_t));
+            break;
+    }
+}
+
+void Sim_node_build_data_rx(wpc_frame_t * frame_p,
+                            uint32_t src_addr,
+                            const uint8_t * payload_p,
+                            size_t size)
+{
+    dsap_data_rx_ind_pl_t * ind_p = &frame_p->payload.dsap_data_rx_indication_payload;
+
+    if (size > MAX_APDU_DSAP_SIZE)
+    {
+        size = MAX_APDU_DSAP_SIZE;
+    }
+
+    frame_p->primitive_id = DSAP_DATA_RX_INDICATION;
+    frame_p->frame_id = 0;
+    ind_p->indication_status = 0;
+    uint32_encode_le(src_addr, (uint8_t *) &ind_p->src_add);
+    ind_p->src_endpoint = 1;
+    memcpy(&ind_p->dest_add,
+           get_attribute(CSAP_ATTRIBUTE_READ_REQUEST, C_NODE_ADDRESS_ID)->value,
+           sizeof(ind_p->dest_add));
+    ind_p->dest_endpoint = 1;
+    // Normal priority, 3 hops
+    ind_p->qos_hop_count = 3 << 2;
+    uint32_encode_le(ms_to_internal_time(25), (uint8_t *) &ind_p->travel_time);
+    ind_p->apdu_length = size;
+    memcpy(ind_p->apdu, payload_p, size);
+    frame_p->payload_length = offsetof(dsap_data_rx_ind_pl_t, apdu) + size;
+}
@@ -0,0 +1,48 @@
+/* Wirepas Oy licensed under Apache License, Version 2.0
+ *
+ * See file LICENSE for full license details.
+ *
+ */
+#ifndef SIM_NODE_H_
+#define SIM_NODE_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "wpc_types.h"
+
+/**
+ * \brief   Reset the simulated node to its default state
+ *          Node is a running sink with a fixed configuration
+ * \note    Must be called before any other function of the module
+ */
+void Sim_node_init(void);
+
+/**
+ * \brief   Answer a request as a node would do
+ * \param   request_p
+ *          The request received from the gateway
+ * \param   confirm_p
+ *          Filled with the confirm of the request
+ * \note    Every request is accepted. Attributes written are read back,
+ *          unknown attributes are reported as not set
+ */
+void Sim_node_handle_request(const wpc_frame_t * request_p, wpc_frame_t * confirm_p);
+
+/**
+ * \brief   Build a data rx indication as sent by the node
+ * \param   frame_p
+ *          Frame to fill
+ * \param   src_addr
+ *          Source address of the packet
+ * \param   payload_p
+ *          Payload of the packet
+ * \param   size
+ *          Size of the payload, truncated to the max apdu size
+ */
+void Sim_node_build_data_rx(wpc_frame_t * frame_p,
+                            uint32_t src_addr,
+                            const uint8_t * payload_p,
+                            size_t size);
+
+#endif
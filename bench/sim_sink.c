@@ -0,0 +1,563 @@
+/* Wirepas Oy licensed under Apache License, Version 2.0
+ *
+ * See file LICENSE for full license details.
+ *
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "sim_sink.h"
+#include "sim_node.h"
+#include "slip.h"
+#include "util.h"
+#include "wpc_types.h"
+
+#define LOG_MODULE_NAME "sim_sink"
+#define MAX_LOG_LEVEL INFO_LOG_LEVEL
+#include "logger.h"
+
+/*
+ * Sink seen from the gateway through a pseudo terminal, as a dual-MCU sink
+ * is seen through its uart.
+ * Uplink packets are generated at a fixed rate from a set of sources and
+ * queued until the gateway polls them. Every byte sent or received takes the
+ * time it would take on a uart at the configured bitrate (10 bits per byte).
+ * Other requests are answered by the simulated node.
+ */
+
+// End of frame in SLIP encoding
+#define SLIP_END                0xC0
+
+// Max size of fragments generated, as the MTU of the simulated node
+#define FRAGMENT_MAX_SIZE       102
+
+// Flag of the last fragment in fragment_offset_flag
+#define LAST_FRAGMENT_FLAG      0x8000
+
+// Packet ids of fragmented packets are on 12 bits
+#define PACKET_ID_MASK          0xFFF
+
+// Max wait when no packet is generated, to react to a stop
+#define IDLE_WAIT_US            10000
+
+// Filler of the payloads after the header
+#define PAYLOAD_FILLER          0x5A
+
+static sim_sink_conf_t m_conf;
+static int m_master_fd = -1;
+static pthread_t m_thread;
+static volatile bool m_running;
+
+// Protects the uplink state and the stats shared with the caller
+static pthread_mutex_t m_mutex = PTHREAD_MUTEX_INITIALIZER;
+static bool m_uplink_enabled;
+static sim_sink_stats_t m_stats;
+
+// Indications waiting for a poll, only accessed by the sink thread
+static wpc_frame_t * m_queue_p;
+static unsigned int m_queue_head;
+static unsigned int m_queue_count;
+static bool m_sending_indications;
+
+// Time the uart from sink to gateway is free again
+static uint64_t m_line_free_us;
+
+// Generation of uplink packets
+static uint64_t m_next_packet_us;
+static uint32_t m_sequence;
+static uint32_t m_next_source;
+static uint16_t m_packet_id;
+static unsigned int m_fragment_credit;
+
+// Request being received
+static uint8_t m_rx_buffer[MAX_SLIP_FRAME_SIZE];
+static size_t m_rx_size;
+
+static uint64_t get_time_us(void)
+{
+    struct timespec spec;
+
+    clock_gettime(CLOCK_MONOTONIC, &spec);
+    return ((uint64_t) spec.tv_sec) * 1000000 + spec.tv_nsec / 1000;
+}
+
+static void wait_until_us(uint64_t deadline_us)
+{
+    struct timespec deadline = {
+        .tv_sec = deadline_us / 1000000,
+        .tv_nsec = (deadline_us % 1000000) * 1000,
+    };
+
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) != 0)
+    {
+    }
+}
+
+/**
+ * \brief   Time to transfer bytes on the uart
+ */
+static uint64_t get_transfer_time_us(size_t bytes)
+{
+    if (m_conf.bitrate == 0)
+    {
+        return 0;
+    }
+    return (uint64_t) bytes * 10 * 1000000 / m_conf.bitrate;
+}
+
+static void update_stats(uint64_t * counter_p, uint64_t increment)
+{
+    pthread_mutex_lock(&m_mutex);
+    *counter_p += increment;
+    pthread_mutex_unlock(&m_mutex);
+}
+
+/**
+ * \brief   Send a frame to the gateway once the uart is free, and wait
+ *          until it is fully transferred
+ */
+static bool send_frame(wpc_frame_t * frame_p)
+{
+    uint8_t buffer[MAX_SLIP_FRAME_SIZE + 2];
+    uint64_t start_us;
+    int size;
+
+    buffer[0] = SLIP_END;
+    size = Slip_encode((uint8_t *) frame_p, FRAME_SIZE(frame_p), buffer + 1, sizeof(buffer) - 2);
+    if (size < 0)
+    {
+        LOGE("Cannot encode frame 0x%02x\n", frame_p->primitive_id);
+        return false;
+    }
+    buffer[size + 1] = SLIP_END;
+    size += 2;
+
+    start_us = get_time_us();
+    if (m_line_free_us > start_us)
+    {
+        start_us = m_line_free_us;
+    }
+    m_line_free_us = start_us + get_transfer_time_us(size);
+    wait_until_us(m_line_free_us);
+
+    if (write(m_master_fd, buffer, size) != size)
+    {
+        LOGE("Cannot write frame: %d\n", errno);
+        return false;
+    }
+    return true;
+}
+
+static bool enqueue(const wpc_frame_t * frame_p)
+{
+    if (m_queue_count >= m_conf.queue_size)
+    {
+        return false;
+    }
+    m_queue_p[(m_queue_head + m_queue_count) % m_conf.queue_size] = *frame_p;
+    m_queue_count++;
+    return true;
+}
+
+static void fill_payload(uint8_t * payload_p, uint64_t enqueue_us)
+{
+    memset(payload_p, PAYLOAD_FILLER, m_conf.payload_size);
+    uint32_encode_le((uint32_t) enqueue_us, payload_p);
+    uint32_encode_le((uint32_t) (enqueue_us >> 32), payload_p + 4);
+    uint32_encode_le(m_sequence++, payload_p + 8);
+}
+
+static void build_fragment(wpc_frame_t * frame_p,
+                           uint32_t src_addr,
+                           const uint8_t * payload_p,
+                           size_t offset,
+                           size_t size,
+                           bool last)
+{
+    dsap_data_rx_frag_ind_pl_t * ind_p = &frame_p->payload.dsap_data_rx_frag_indication_payload;
+
+    frame_p->primitive_id = DSAP_DATA_RX_FRAG_INDICATION;
+    frame_p->frame_id = 0;
+    ind_p->indication_status = 0;
+    uint32_encode_le(src_addr, (uint8_t *) &ind_p->src_add);
+    ind_p->src_endpoint = 1;
+    uint32_encode_le(1, (uint8_t *) &ind_p->dest_add);
+    ind_p->dest_endpoint = 1;
+    // Normal priority, 3 hops
+    ind_p->qos_hop_count = 3 << 2;
+    uint32_encode_le(ms_to_internal_time(25), (uint8_t *) &ind_p->travel_time);
+    ind_p->full_packet_id = m_packet_id;
+    ind_p->fragment_offset_flag = offset | (last ? LAST_FRAGMENT_FLAG : 0);
+    ind_p->apdu_length = size;
+    memcpy(ind_p->apdu, payload_p + offset, size);
+    frame_p->payload_length = offsetof(dsap_data_rx_frag_ind_pl_t, apdu) + size;
+}
+
+/**
+ * \brief   Queue a packet received by the sink at the given time
+ */
+static void generate_packet(uint64_t enqueue_us)
+{
+    static uint8_t payload[MAX_FULL_PACKET_SIZE];
+    uint32_t src_addr = 2 + m_next_source;
+    size_t fragments = 1;
+    wpc_frame_t frame;
+
+    m_next_source = (m_next_source + 1) % m_conf.sources;
+    fill_payload(payload, enqueue_us);
+
+    // Spread fragmented packets evenly in the flow
+    m_fragment_credit += m_conf.fragment_percent;
+    if ((m_fragment_credit >= 100) || (m_conf.payload_size > MAX_APDU_DSAP_SIZE))
+    {
+        if (m_fragment_credit >= 100)
+        {
+            m_fragment_credit -= 100;
+        }
+        fragments = (m_conf.payload_size + FRAGMENT_MAX_SIZE - 1) / FRAGMENT_MAX_SIZE;
+        if (fragments < 2)
+        {
+            fragments = 2;
+        }
+    }
+
+    // All the fragments of a packet are queued, or none
+    if (m_queue_count + fragments > m_conf.queue_size)
+    {
+        pthread_mutex_lock(&m_mutex);
+        m_stats.generated++;
+        m_stats.dropped++;
+        pthread_mutex_unlock(&m_mutex);
+        return;
+    }
+
+    if (fragments == 1)
+    {
+        Sim_node_build_data_rx(&frame, src_addr, payload, m_conf.payload_size);
+        enqueue(&frame);
+    }
+    else
+    {
+        size_t fragment_size = (m_conf.payload_size + fragments - 1) / fragments;
+        size_t offset = 0;
+
+        while (offset < m_conf.payload_size)
+        {
+            size_t size = m_conf.payload_size - offset;
+            if (size > fragment_size)
+            {
+                size = fragment_size;
+            }
+            build_fragment(&frame,
+                           src_addr,
+                           payload,
+                           offset,
+                           size,
+                           offset + size == m_conf.payload_size);
+            enqueue(&frame);
+            offset += size;
+        }
+        m_packet_id = (m_packet_id + 1) & PACKET_ID_MASK;
+    }
+
+    update_stats(&m_stats.generated, 1);
+}
+
+static void generate_packets(uint64_t now_us)
+{
+    bool enabled;
+
+    pthread_mutex_lock(&m_mutex);
+    enabled = m_uplink_enabled;
+    pthread_mutex_unlock(&m_mutex);
+
+    if (!enabled || (m_conf.uplink_rate == 0))
+    {
+        m_next_packet_us = 0;
+        return;
+    }
+
+    if (m_next_packet_us == 0)
+    {
+        m_next_packet_us = now_us;
+    }
+
+    // Packets are timestamped when they were due, even if generated late
+    while (m_next_packet_us <= now_us)
+    {
+        generate_packet(m_next_packet_us);
+        m_next_packet_us += 1000000 / m_conf.uplink_rate;
+    }
+}
+
+static bool send_next_indication(void)
+{
+    wpc_frame_t * frame_p = &m_queue_p[m_queue_head];
+
+    m_queue_head = (m_queue_head + 1) % m_conf.queue_size;
+    m_queue_count--;
+    frame_p->payload.generic_indication_payload.indication_status = (m_queue_count > 0);
+    m_sending_indications = true;
+
+    update_stats(&m_stats.indications, 1);
+    return send_frame(frame_p);
+}
+
+static void handle_frame(wpc_frame_t * frame_p)
+{
+    wpc_frame_t confirm;
+
+    if (frame_p->primitive_id >= SAP_RESPONSE_OFFSET)
+    {
+        // Response to an indication, gateway asks for the next one or stops
+        if (!m_sending_indications)
+        {
+            LOGW("Unexpected response 0x%02x\n", frame_p->primitive_id);
+            return;
+        }
+        m_sending_indications = false;
+        if ((frame_p->payload.sap_response_payload.result == 1) && (m_queue_count > 0))
+        {
+            send_next_indication();
+        }
+        return;
+    }
+
+    if (frame_p->primitive_id == MSAP_INDICATION_POLL_REQUEST)
+    {
+        update_stats(&m_stats.polls, 1);
+        confirm.primitive_id = frame_p->primitive_id + SAP_CONFIRM_OFFSET;
+        confirm.frame_id = frame_p->frame_id;
+        confirm.payload_length = sizeof(sap_generic_conf_pl_t);
+        confirm.payload.sap_generic_confirm_payload.result = (m_queue_count > 0);
+        if (send_frame(&confirm) && (m_queue_count > 0))
+        {
+            send_next_indication();
+        }
+        return;
+    }
+
+    update_stats(&m_stats.requests, 1);
+    Sim_node_handle_request(frame_p, &confirm);
+    send_frame(&confirm);
+
+    if ((m_conf.bitrate_attribute_id != 0)
+        && (frame_p->primitive_id == CSAP_ATTRIBUTE_WRITE_REQUEST)
+        && (uint16_decode_le(
+                (const uint8_t *) &frame_p->payload.attribute_write_request_payload.attribute_id)
+            == m_conf.bitrate_attribute_id)
+        && (frame_p->payload.attribute_write_request_payload.attribute_length == 4))
+    {
+        // Confirm went at the previous bitrate, as on a real sink
+        m_conf.bitrate = uint32_decode_le(
+            frame_p->payload.attribute_write_request_payload.attribute_value);
+        LOGI("Bitrate changed to %lu\n", m_conf.bitrate);
+    }
+}
+
+/**
+ * \brief   Parse the bytes received from the gateway and handle each
+ *          complete frame
+ */
+static void receive_bytes(const uint8_t * bytes_p, size_t size)
+{
+    for (size_t i = 0; i < size; i++)
+    {
+        int decoded;
+
+        if (bytes_p[i] != SLIP_END)
+        {
+            if (m_rx_size < sizeof(m_rx_buffer))
+            {
+                m_rx_buffer[m_rx_size++] = bytes_p[i];
+            }
+            continue;
+        }
+
+        // Consecutive end symbols are sent before each frame
+        if (m_rx_size < 2)
+        {
+            m_rx_size = 0;
+            continue;
+        }
+
+        // Frame is handled once fully transferred on the uart
+        wait_until_us(get_time_us() + get_transfer_time_us(m_rx_size + 4));
+
+        decoded = Slip_decode(m_rx_buffer, m_rx_size);
+        m_rx_size = 0;
+        if (decoded < 3)
+        {
+            LOGW("Cannot decode frame from gateway (%d)\n", decoded);
+            continue;
+        }
+        handle_frame((wpc_frame_t *) m_rx_buffer);
+    }
+}
+
+static void * sink_thread(void * unused)
+{
+    (void) unused;
+
+    while (m_running)
+    {
+        struct pollfd fds = { .fd = m_master_fd, .events = POLLIN };
+        uint64_t now_us = get_time_us();
+        uint64_t wait_us = IDLE_WAIT_US;
+        struct timespec cpu;
+        struct timespec timeout;
+
+        generate_packets(now_us);
+        if ((m_next_packet_us != 0) && (m_next_packet_us - now_us < wait_us))
+        {
+            wait_us = m_next_packet_us - now_us;
+        }
+
+        timeout.tv_sec = wait_us / 1000000;
+        timeout.tv_nsec = (wait_us % 1000000) * 1000;
+        if ((ppoll(&fds, 1, &timeout, NULL) > 0) && (fds.revents & POLLIN))
+        {
+            uint8_t bytes[256];
+            ssize_t size = read(m_master_fd, bytes, sizeof(bytes));
+            if (size > 0)
+            {
+                receive_bytes(bytes, size);
+            }
+        }
+        else if (fds.revents & POLLHUP)
+        {
+            // Gateway side is not opened (yet)
+            usleep(1000);
+        }
+
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu);
+        pthread_mutex_lock(&m_mutex);
+        m_stats.cpu_ns = ((uint64_t) cpu.tv_sec) * 1000000000 + cpu.tv_nsec;
+        pthread_mutex_unlock(&m_mutex);
+    }
+
+    return NULL;
+}
+
+bool Sim_sink_start(const sim_sink_conf_t * conf_p, char * port_name, size_t size)
+{
+    struct termios tty;
+    const char * name;
+
+    m_conf = *conf_p;
+    if (m_conf.payload_size < SIM_SINK_PAYLOAD_HEADER_SIZE)
+    {
+        m_conf.payload_size = SIM_SINK_PAYLOAD_HEADER_SIZE;
+    }
+    if (m_conf.payload_size > MAX_FULL_PACKET_SIZE)
+    {
+        m_conf.payload_size = MAX_FULL_PACKET_SIZE;
+    }
+    if ((m_conf.sources == 0) || (m_conf.queue_size == 0))
+    {
+        LOGE("Sink needs at least one source and one queue entry\n");
+        return false;
+    }
+
+    m_queue_p = malloc(m_conf.queue_size * sizeof(wpc_frame_t));
+    if (m_queue_p == NULL)
+    {
+        LOGE("Cannot allocate queue of %u indications\n", m_conf.queue_size);
+        return false;
+    }
+
+    m_master_fd = posix_openpt(O_RDWR | O_NOCTTY);
+    if ((m_master_fd < 0) || (grantpt(m_master_fd) != 0) || (unlockpt(m_master_fd) != 0)
+        || ((name = ptsname(m_master_fd)) == NULL))
+    {
+        LOGE("Cannot create pseudo terminal: %d\n", errno);
+        Sim_sink_stop();
+        return false;
+    }
+    strncpy(port_name, name, size - 1);
+    port_name[size - 1] = '\0';
+
+    // Bytes must go through unchanged, whatever the gateway sets
+    if (tcgetattr(m_master_fd, &tty) == 0)
+    {
+        cfmakeraw(&tty);
+        tcsetattr(m_master_fd, TCSANOW, &tty);
+    }
+
+    Sim_node_init();
+    memset(&m_stats, 0, sizeof(m_stats));
+    m_uplink_enabled = false;
+    m_queue_head = 0;
+    m_queue_count = 0;
+    m_sending_indications = false;
+    m_line_free_us = 0;
+    m_next_packet_us = 0;
+    m_sequence = 0;
+    m_next_source = 0;
+    m_packet_id = 0;
+    m_fragment_credit = 0;
+    m_rx_size = 0;
+
+    m_running = true;
+    if (pthread_create(&m_thread, NULL, sink_thread, NULL) != 0)
+    {
+        LOGE("Cannot create sink thread\n");
+        m_running = false;
+        Sim_sink_stop();
+        return false;
+    }
+
+    return true;
+}
+
+void Sim_sink_set_uplink(bool enabled)
+{
+    pthread_mutex_lock(&m_mutex);
+    m_uplink_enabled = enabled;
+    pthread_mutex_unlock(&m_mutex);
+}
+
+void Sim_sink_get_stats(sim_sink_stats_t * stats_p)
+{
+    pthread_mutex_lock(&m_mutex);
+    *stats_p = m_stats;
+    pthread_mutex_unlock(&m_mutex);
+}
+
+bool Sim_sink_get_enqueue_time(const uint8_t * payload_p, size_t size, uint64_t * enqueue_us_p)
+{
+    if (size < SIM_SINK_PAYLOAD_HEADER_SIZE)
+    {
+        return false;
+    }
+
+    *enqueue_us_p = uint32_decode_le(payload_p)
+                    | ((uint64_t) uint32_decode_le(payload_p + 4) << 32);
+    return true;
+}
+
+void Sim_sink_stop(void)
+{
+    if (m_running)
+    {
+        m_running = false;
+        pthread_join(m_thread, NULL);
+    }
+
+    if (m_master_fd >= 0)
+    {
+        close(m_master_fd);
+        m_master_fd = -1;
+    }
+
+    free(m_queue_p);
+    m_queue_p = NULL;
+}
@@ -0,0 +1,86 @@
+/* Wirepas Oy licensed under Apache License, Version 2.0
+ *
+ * See file LICENSE for full license details.
+ *
+ */
+#ifndef SIM_SINK_H_
+#define SIM_SINK_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+// Size of the header added by the sink at the start of uplink payloads
+#define SIM_SINK_PAYLOAD_HEADER_SIZE    12
+
+typedef struct
+{
+    unsigned long bitrate;          //< Emulated uart bitrate, 0 for no limit
+    unsigned int uplink_rate;       //< Packets generated per second
+    unsigned int fragment_percent;  //< Percentage of packets received fragmented
+    unsigned int payload_size;      //< Size of generated packets
+    unsigned int sources;           //< Number of nodes sending the packets
+    unsigned int queue_size;        //< Indications buffered by the sink
+    uint16_t bitrate_attribute_id;  //< Csap attribute switching the bitrate,
+                                    //  0 if bitrate cannot be changed
+} sim_sink_conf_t;
+
+typedef struct
+{
+    uint64_t generated;     //< Packets generated
+    uint64_t dropped;       //< Packets dropped as the sink buffer was full
+    uint64_t indications;   //< Data indications sent to the gateway
+    uint64_t polls;         //< Poll requests received
+    uint64_t requests;      //< Other requests received
+    uint64_t cpu_ns;        //< Cpu time used by the sink thread
+} sim_sink_stats_t;
+
+/**
+ * \brief   Start a simulated sink on the master side of a pseudo terminal
+ * \param   conf_p
+ *          Configuration of the sink, uplink is stopped until
+ *          \ref Sim_sink_set_uplink is called
+ * \param   port_name
+ *          Filled with the name of the serial port to open on gateway side
+ * \param   size
+ *          Size of port_name
+ * \return  True if started
+ * \note    Sink answers requests with the simulated node of sim_node.h and
+ *          polls with its queue of indications, at the pace of the bitrate
+ * \note    A write of bitrate_attribute_id changes the emulated bitrate once
+ *          its confirm is sent, as a sink entering bulk transfer mode
+ */
+bool Sim_sink_start(const sim_sink_conf_t * conf_p, char * port_name, size_t size);
+
+/**
+ * \brief   Start or stop the generation of uplink packets
+ * \param   enabled
+ *          True to generate packets at the configured rate
+ */
+void Sim_sink_set_uplink(bool enabled);
+
+/**
+ * \brief   Get the statistics of the sink
+ * \param   stats_p
+ *          Filled with the statistics since the start
+ */
+void Sim_sink_get_stats(sim_sink_stats_t * stats_p);
+
+/**
+ * \brief   Get the time a packet was queued in the sink
+ * \param   payload_p
+ *          Payload of the packet, as received by the gateway
+ * \param   size
+ *          Size of the payload
+ * \param   enqueue_us_p
+ *          Filled with the time (CLOCK_MONOTONIC) in us
+ * \return  True if the payload was generated by the sink
+ */
+bool Sim_sink_get_enqueue_time(const uint8_t * payload_p, size_t size, uint64_t * enqueue_us_p);
+
+/**
+ * \brief   Stop the sink and close the pseudo terminal
+ */
+void Sim_sink_stop(void);
+
+#endif
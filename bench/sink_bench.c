@@ -0,0 +1,632 @@
+/* Wirepas Oy licensed under Apache License, Version 2.0
+ *
+ * See file LICENSE for full license details.
+ *
+ */
+#define _GNU_SOURCE
+#include <getopt.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "wpc.h"
+#include "sim_sink.h"
+
+#define LOG_MODULE_NAME "sink_bench"
+#define MAX_LOG_LEVEL INFO_LOG_LEVEL
+#include "logger.h"
+
+/*
+ * End to end benchmark of the library with the linux platform, against a
+ * simulated sink behind a pseudo terminal (see sim_sink.c).
+ *
+ * Each configuration of the sweep runs in its own process, as the library
+ * cannot be initialized twice, and produces one line of JSON:
+ *  - sustained rate of indications and packets received
+ *  - host cpu per packet received (process cpu minus the simulated sink)
+ *  - uplink latency, from the packet queued in the sink to onDataReceived
+ *  - latency of WPC_send_data while uplink is running, split with the tx
+ *    trace of the library in time waiting for the request lock (polls),
+ *    writing on the uart and waiting for the confirm of the sink
+ *
+ * With a bulk bitrate, the measurement window runs in bulk transfer mode:
+ * library switches the sink and the uart to it after the warmup and back
+ * to the initial bitrate at the end of the window.
+ */
+
+#define MAX_SWEEP_VALUES        16
+
+// Indications buffered in the sink
+#define SINK_QUEUE_SIZE         128
+
+// Time for the library to start polling, before uplink is started
+#define SETTLE_MS               1000
+
+// Packets received before measurements start
+#define WARMUP_MS               500
+
+// Max time to receive packets still queued at the end of a run
+#define DRAIN_TIMEOUT_MS        2000
+
+// Size of downlink packets
+#define DOWNLINK_PAYLOAD_SIZE   20
+
+// Csap attribute changing the bitrate of the simulated sink
+#define BITRATE_ATTRIBUTE_ID    0x1000
+
+typedef struct
+{
+    unsigned long values[MAX_SWEEP_VALUES];
+    size_t count;
+} sweep_t;
+
+typedef struct
+{
+    uint32_t * samples_p;
+    size_t count;
+    size_t capacity;
+} samples_t;
+
+typedef struct
+{
+    sim_sink_conf_t sink;
+    unsigned int downlink_rate;
+    unsigned long bulk_bitrate;     //< 0 to stay at the sink bitrate
+    unsigned int duration_s;
+} run_conf_t;
+
+// Uplink packets, updated from the dispatch thread of the library
+static pthread_mutex_t m_mutex = PTHREAD_MUTEX_INITIALIZER;
+static uint64_t m_received;
+// Only packets queued after the start of the window are sampled, 0 to stop
+static uint64_t m_window_start_us;
+static samples_t m_uplink_latency;
+
+// Downlink packets, updated from the downlink thread
+static volatile bool m_downlink_running;
+static unsigned int m_downlink_rate;
+static uint64_t m_downlink_errors;
+static samples_t m_downlink_latency;
+static samples_t m_downlink_lock_wait;
+static samples_t m_downlink_write;
+static samples_t m_downlink_sink;
+
+static uint64_t get_time_us(void)
+{
+    struct timespec spec;
+
+    clock_gettime(CLOCK_MONOTONIC, &spec);
+    return ((uint64_t) spec.tv_sec) * 1000000 + spec.tv_nsec / 1000;
+}
+
+static uint64_t get_cpu_ns(void)
+{
+    struct timespec spec;
+
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &spec);
+    return ((uint64_t) spec.tv_sec) * 1000000000 + spec.tv_nsec;
+}
+
+static bool init_samples(samples_t * samples_p, size_t capacity)
+{
+    samples_p->samples_p = malloc(capacity * sizeof(uint32_t));
+    samples_p->count = 0;
+    samples_p->capacity = capacity;
+    return samples_p->samples_p != NULL;
+}
+
+static void add_sample(samples_t * samples_p, uint64_t value)
+{
+    // Samples above the capacity are dropped, capacity is sized for the run
+    if (samples_p->count < samples_p->capacity)
+    {
+        samples_p->samples_p[samples_p->count++] = value > UINT32_MAX ? UINT32_MAX : value;
+    }
+}
+
+static int compare_samples(const void * a, const void * b)
+{
+    uint32_t x = *(const uint32_t *) a;
+    uint32_t y = *(const uint32_t *) b;
+    return (x > y) - (x < y);
+}
+
+static uint32_t get_percentile(const samples_t * samples_p, double percentile)
+{
+    size_t index = (size_t) (percentile / 100.0 * (samples_p->count - 1) + 0.5);
+    return samples_p->samples_p[index];
+}
+
+static void print_latency(FILE * output_p, const char * name, samples_t * samples_p)
+{
+    if (samples_p->count == 0)
+    {
+        fprintf(output_p, "\"%s\":null", name);
+        return;
+    }
+
+    qsort(samples_p->samples_p, samples_p->count, sizeof(uint32_t), compare_samples);
+    fprintf(output_p,
+            "\"%s\":{\"samples\":%zu,\"p50\":%u,\"p99\":%u,\"p999\":%u,\"max\":%u}",
+            name,
+            samples_p->count,
+            get_percentile(samples_p, 50),
+            get_percentile(samples_p, 99),
+            get_percentile(samples_p, 99.9),
+            samples_p->samples_p[samples_p->count - 1]);
+}
+
+static void onTxTrace_cb(const app_tx_trace_t * trace_p)
+{
+    // Called from the downlink thread, packets are sent without indication
+    if (m_downlink_running)
+    {
+        add_sample(&m_downlink_lock_wait, trace_p->lock_wait_us);
+        add_sample(&m_downlink_write, trace_p->write_us);
+        add_sample(&m_downlink_sink, trace_p->sink_us);
+    }
+}
+
+static bool onDataReceived_cb(const uint8_t * bytes,
+                              size_t num_bytes,
+                              app_addr_t src_addr,
+                              app_addr_t dst_addr,
+                              app_qos_e qos,
+                              uint8_t src_ep,
+                              uint8_t dst_ep,
+                              uint32_t travel_time,
+                              uint8_t hop_count,
+                              unsigned long long timestamp_ms_epoch)
+{
+    uint64_t now_us = get_time_us();
+    uint64_t enqueue_us;
+
+    (void) src_addr;
+    (void) dst_addr;
+    (void) qos;
+    (void) src_ep;
+    (void) dst_ep;
+    (void) travel_time;
+    (void) hop_count;
+    (void) timestamp_ms_epoch;
+
+    if (!Sim_sink_get_enqueue_time(bytes, num_bytes, &enqueue_us))
+    {
+        return true;
+    }
+
+    pthread_mutex_lock(&m_mutex);
+    m_received++;
+    if ((m_window_start_us != 0) && (enqueue_us >= m_window_start_us))
+    {
+        add_sample(&m_uplink_latency, now_us - enqueue_us);
+    }
+    pthread_mutex_unlock(&m_mutex);
+
+    return true;
+}
+
+static void * downlink_thread(void * unused)
+{
+    uint8_t payload[DOWNLINK_PAYLOAD_SIZE];
+    uint64_t next_us = get_time_us();
+    uint16_t pdu_id = 0;
+
+    (void) unused;
+    memset(payload, 0xA5, sizeof(payload));
+
+    while (m_downlink_running)
+    {
+        uint64_t start_us;
+        app_res_e res;
+
+        next_us += 1000000 / m_downlink_rate;
+        while (get_time_us() < next_us)
+        {
+            usleep(next_us - get_time_us());
+        }
+
+        start_us = get_time_us();
+        res = WPC_send_data(payload,
+                            sizeof(payload),
+                            pdu_id++,
+                            2,
+                            APP_QOS_NORMAL,
+                            1,
+                            1,
+                            NULL,
+                            0);
+        add_sample(&m_downlink_latency, get_time_us() - start_us);
+        if (res != APP_RES_OK)
+        {
+            m_downlink_errors++;
+        }
+    }
+
+    return NULL;
+}
+
+static uint64_t get_received(void)
+{
+    uint64_t received;
+
+    pthread_mutex_lock(&m_mutex);
+    received = m_received;
+    pthread_mutex_unlock(&m_mutex);
+    return received;
+}
+
+static void set_window_start(uint64_t start_us)
+{
+    pthread_mutex_lock(&m_mutex);
+    m_window_start_us = start_us;
+    pthread_mutex_unlock(&m_mutex);
+}
+
+/**
+ * \brief   Run one configuration and print its results as a JSON line
+ * \return  0 if the run could be done
+ */
+static int run(const run_conf_t * conf_p, FILE * output_p)
+{
+    char port_name[64];
+    sim_sink_stats_t sink_start, sink_end, sink_drained;
+    uint64_t received_start, received_end;
+    uint64_t cpu_start_ns, cpu_end_ns;
+    uint64_t start_us, end_us;
+    pthread_t downlink;
+    uint64_t host_cpu_ns;
+    uint64_t window_packets;
+    double elapsed_s;
+    size_t capacity, downlink_capacity;
+
+    // Enough samples for the run even if the sink is late
+    capacity = (size_t) conf_p->sink.uplink_rate * conf_p->duration_s * 2 + 1000;
+    downlink_capacity = (size_t) conf_p->downlink_rate * conf_p->duration_s * 2 + 1000;
+    if (!init_samples(&m_uplink_latency, capacity)
+        || !init_samples(&m_downlink_latency, downlink_capacity)
+        || !init_samples(&m_downlink_lock_wait, downlink_capacity)
+        || !init_samples(&m_downlink_write, downlink_capacity)
+        || !init_samples(&m_downlink_sink, downlink_capacity))
+    {
+        LOGE("Cannot allocate samples\n");
+        return -1;
+    }
+
+    if (!Sim_sink_start(&conf_p->sink, port_name, sizeof(port_name)))
+    {
+        return -1;
+    }
+
+    if (WPC_initialize(port_name, conf_p->sink.bitrate) != APP_RES_OK)
+    {
+        LOGE("Cannot initialize the library on %s\n", port_name);
+        Sim_sink_stop();
+        return -1;
+    }
+    WPC_register_for_data(onDataReceived_cb);
+    WPC_enable_tx_trace(onTxTrace_cb, 0);
+    usleep(SETTLE_MS * 1000);
+
+    Sim_sink_set_uplink(true);
+    usleep(WARMUP_MS * 1000);
+
+    if ((conf_p->bulk_bitrate != 0)
+        && (WPC_start_bulk_transfer_mode(BITRATE_ATTRIBUTE_ID, conf_p->bulk_bitrate)
+            != APP_RES_OK))
+    {
+        LOGE("Cannot start bulk transfer mode at %lu\n", conf_p->bulk_bitrate);
+        WPC_close();
+        Sim_sink_stop();
+        return -1;
+    }
+
+    // Measurement window
+    m_downlink_rate = conf_p->downlink_rate;
+    m_downlink_running = (m_downlink_rate > 0);
+    if (m_downlink_running && (pthread_create(&downlink, NULL, downlink_thread, NULL) != 0))
+    {
+        LOGE("Cannot create downlink thread\n");
+        m_downlink_running = false;
+    }
+
+    Sim_sink_get_stats(&sink_start);
+    received_start = get_received();
+    cpu_start_ns = get_cpu_ns();
+    start_us = get_time_us();
+    set_window_start(start_us);
+
+    usleep(conf_p->duration_s * 1000000);
+
+    Sim_sink_get_stats(&sink_end);
+    received_end = get_received();
+    cpu_end_ns = get_cpu_ns();
+    end_us = get_time_us();
+    Sim_sink_set_uplink(false);
+
+    if (m_downlink_running)
+    {
+        m_downlink_running = false;
+        pthread_join(downlink, NULL);
+    }
+
+    if ((conf_p->bulk_bitrate != 0) && (WPC_stop_bulk_transfer_mode() != APP_RES_OK))
+    {
+        LOGE("Cannot stop bulk transfer mode\n");
+    }
+
+    // Packets still queued in the sink are not lost
+    for (int waited_ms = 0; waited_ms < DRAIN_TIMEOUT_MS; waited_ms += 10)
+    {
+        Sim_sink_get_stats(&sink_drained);
+        if (get_received() >= sink_drained.generated - sink_drained.dropped)
+        {
+            break;
+        }
+        usleep(10 * 1000);
+    }
+    Sim_sink_get_stats(&sink_drained);
+    set_window_start(0);
+
+    WPC_close();
+    Sim_sink_stop();
+
+    elapsed_s = (end_us - start_us) / 1e6;
+    window_packets = received_end - received_start;
+    host_cpu_ns = (cpu_end_ns - cpu_start_ns) - (sink_end.cpu_ns - sink_start.cpu_ns);
+
+    fprintf(output_p,
+            "{\"uplink_rate\":%u,\"fragment_percent\":%u,\"payload_size\":%u,"
+            "\"bitrate\":%lu,\"bulk_bitrate\":%lu,\"downlink_rate\":%u,\"sources\":%u,"
+            "\"duration_s\":%.3f,",
+            conf_p->sink.uplink_rate,
+            conf_p->sink.fragment_percent,
+            conf_p->sink.payload_size,
+            conf_p->sink.bitrate,
+            conf_p->bulk_bitrate,
+            conf_p->downlink_rate,
+            conf_p->sink.sources,
+            elapsed_s);
+    fprintf(output_p,
+            "\"generated\":%llu,\"dropped_in_sink\":%llu,\"dropped_in_window\":%llu,"
+            "\"received\":%llu,\"lost\":%lld,",
+            (unsigned long long) sink_drained.generated,
+            (unsigned long long) sink_drained.dropped,
+            (unsigned long long) (sink_end.dropped - sink_start.dropped),
+            (unsigned long long) get_received(),
+            (long long) (sink_drained.generated - sink_drained.dropped - get_received()));
+    fprintf(output_p,
+            "\"indications_per_s\":%.1f,\"packets_per_s\":%.1f,\"polls_per_s\":%.1f,",
+            (sink_end.indications - sink_start.indications) / elapsed_s,
+            window_packets / elapsed_s,
+            (sink_end.polls - sink_start.polls) / elapsed_s);
+    fprintf(output_p,
+            "\"host_cpu_percent\":%.2f,\"host_cpu_us_per_packet\":%.2f,",
+            host_cpu_ns / 1e7 / elapsed_s,
+            window_packets ? host_cpu_ns / 1e3 / window_packets : 0.0);
+    print_latency(output_p, "uplink_latency_us", &m_uplink_latency);
+    fprintf(output_p,
+            ",\"downlink_sent\":%zu,\"downlink_errors\":%llu,",
+            m_downlink_latency.count,
+            (unsigned long long) m_downlink_errors);
+    print_latency(output_p, "send_data_latency_us", &m_downlink_latency);
+    fprintf(output_p, ",");
+    print_latency(output_p, "send_data_lock_wait_us", &m_downlink_lock_wait);
+    fprintf(output_p, ",");
+    print_latency(output_p, "send_data_write_us", &m_downlink_write);
+    fprintf(output_p, ",");
+    print_latency(output_p, "send_data_sink_us", &m_downlink_sink);
+    fprintf(output_p, "}\n");
+    fflush(output_p);
+
+    return 0;
+}
+
+/**
+ * \brief   Run a configuration in a child process
+ * \return  True if the child could run it
+ */
+static bool run_in_child(const run_conf_t * conf_p, FILE * output_p, int log_level)
+{
+    pid_t pid;
+    int status;
+
+    fflush(output_p);
+    pid = fork();
+    if (pid < 0)
+    {
+        LOGE("Cannot fork\n");
+        return false;
+    }
+
+    if (pid == 0)
+    {
+        // Logs of the library go to stdout, keep it for the results
+        int output_fd = dup(fileno(output_p));
+        FILE * results_p = fdopen(output_fd, "w");
+
+        dup2(STDERR_FILENO, STDOUT_FILENO);
+        Platform_set_log_level(log_level);
+        _exit((results_p != NULL) && (run(conf_p, results_p) == 0) ? 0 : 1);
+    }
+
+    return (waitpid(pid, &status, 0) == pid) && WIFEXITED(status) && (WEXITSTATUS(status) == 0);
+}
+
+static bool parse_sweep(const char * arg, sweep_t * sweep_p)
+{
+    char * end;
+
+    sweep_p->count = 0;
+    while (*arg != '\0')
+    {
+        if (sweep_p->count == MAX_SWEEP_VALUES)
+        {
+            return false;
+        }
+        sweep_p->values[sweep_p->count++] = strtoul(arg, &end, 0);
+        if ((end == arg) || ((*end != ',') && (*end != '\0')))
+        {
+            return false;
+        }
+        arg = (*end == ',') ? end + 1 : end;
+    }
+    return sweep_p->count > 0;
+}
+
+void print_usage()
+{
+    printf("Usage: wpcSinkBench [OPTIONS]\n");
+    printf("Run the library against a simulated sink for each combination of the\n");
+    printf("swept values (comma separated lists) and print one JSON line per run\n");
+    printf("Options:\n");
+    printf("  -r, --rates <list>          Uplink packets per second (default: 100,1000)\n");
+    printf("  -f, --fragments <list>      Percentage of fragmented packets (default: 0,50)\n");
+    printf("  -p, --payloads <list>       Uplink payload sizes (default: 20,100)\n");
+    printf("  -b, --bitrates <list>       Uart bitrates (default: 115200,1000000)\n");
+    printf("  -l, --downlink <list>       Downlink packets per second (default: 0,10)\n");
+    printf("  -k, --bulk <list>           Bulk transfer bitrates, 0 for none (default: 0)\n");
+    printf("  -n, --sources <nodes>       Number of nodes sending uplink (default: 100)\n");
+    printf("  -d, --duration <s>          Duration of each run (default: 2)\n");
+    printf("  -o, --output <file>         Write results to file instead of stdout\n");
+    printf("  -v, --verbose               Print info logs of the library\n");
+    printf("  -h, --help                  Display this help message\n");
+}
+
+int main(int argc, char * argv[])
+{
+    sweep_t rates, fragments, payloads, bitrates, downlinks, bulks;
+    run_conf_t conf = {
+        .sink = {
+            .sources = 100,
+            .queue_size = SINK_QUEUE_SIZE,
+            .bitrate_attribute_id = BITRATE_ATTRIBUTE_ID,
+        },
+        .duration_s = 2,
+    };
+    int log_level = ERROR_LOG_LEVEL;
+    FILE * output_p = stdout;
+    int failed = 0;
+    int c;
+
+    parse_sweep("100,1000", &rates);
+    parse_sweep("0,50", &fragments);
+    parse_sweep("20,100", &payloads);
+    parse_sweep("115200,1000000", &bitrates);
+    parse_sweep("0,10", &downlinks);
+    parse_sweep("0", &bulks);
+
+    static struct option long_options[]
+        = { { "rates", required_argument, 0, 'r' },
+            { "fragments", required_argument, 0, 'f' },
+            { "payloads", required_argument, 0, 'p' },
+            { "bitrates", required_argument, 0, 'b' },
+            { "downlink", required_argument, 0, 'l' },
+            { "bulk", required_argument, 0, 'k' },
+            { "sources", required_argument, 0, 'n' },
+            { "duration", required_argument, 0, 'd' },
+            { "output", required_argument, 0, 'o' },
+            { "verbose", no_argument, 0, 'v' },
+            { "help", no_argument, 0, 'h' },
+            { 0, 0, 0, 0 } };
+    while ((c = getopt_long(argc, argv, "r:f:p:b:l:k:n:d:o:vh?", long_options, NULL)) != -1)
+    {
+        bool valid = true;
+
+        switch (c)
+        {
+            case 'r':
+                valid = parse_sweep(optarg, &rates);
+                break;
+            case 'f':
+                valid = parse_sweep(optarg, &fragments);
+                break;
+            case 'p':
+                valid = parse_sweep(optarg, &payloads);
+                break;
+            case 'b':
+                valid = parse_sweep(optarg, &bitrates);
+                break;
+            case 'l':
+                valid = parse_sweep(optarg, &downlinks);
+                break;
+            case 'k':
+                valid = parse_sweep(optarg, &bulks);
+                break;
+            case 'n':
+                conf.sink.sources = strtoul(optarg, NULL, 0);
+                valid = (conf.sink.sources > 0);
+                break;
+            case 'd':
+                conf.duration_s = strtoul(optarg, NULL, 0);
+                valid = (conf.duration_s > 0);
+                break;
+            case 'o':
+                output_p = fopen(optarg, "w");
+                valid = (output_p != NULL);
+                break;
+            case 'v':
+                log_level = INFO_LOG_LEVEL;
+                break;
+            case 'h':
+            case '?':
+            default:
+                valid = false;
+                break;
+        }
+
+        if (!valid)
+        {
+            print_usage();
+            return -1;
+        }
+    }
+
+    for (size_t r = 0; r < rates.count; r++)
+    {
+        for (size_t f = 0; f < fragments.count; f++)
+        {
+            for (size_t p = 0; p < payloads.count; p++)
+            {
+                for (size_t b = 0; b < bitrates.count; b++)
+                {
+                    for (size_t l = 0; l < downlinks.count; l++)
+                    {
+                        for (size_t k = 0; k < bulks.count; k++)
+                        {
+                            conf.sink.uplink_rate = rates.values[r];
+                            conf.sink.fragment_percent = fragments.values[f];
+                            conf.sink.payload_size = payloads.values[p];
+                            conf.sink.bitrate = bitrates.values[b];
+                            conf.downlink_rate = downlinks.values[l];
+                            conf.bulk_bitrate = bulks.values[k];
+                            if (!run_in_child(&conf, output_p, log_level))
+                            {
+                                LOGE("Run failed: rate=%u fragments=%u%% payload=%u "
+                                     "bitrate=%lu downlink=%u bulk=%lu\n",
+                                     conf.sink.uplink_rate,
+                                     conf.sink.fragment_percent,
+                                     conf.sink.payload_size,
+                                     conf.sink.bitrate,
+                                     conf.downlink_rate,
+                                     conf.bulk_bitrate);
+                                failed++;
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    if (output_p != stdout)
+    {
+        fclose(output_p);
+    }
+
+    return failed ? 1 : 0;
+}
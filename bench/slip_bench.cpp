@@ -0,0 +1,113 @@
+/* Wirepas Oy licensed under Apache License, Version 2.0
+ *
+ * See file LICENSE for full license details.
+ *
+ */
+#include <benchmark/benchmark.h>
+
+#include <cstring>
+#include <random>
+#include <vector>
+
+extern "C" {
+#include "slip.h"
+}
+
+// Biggest frame exchanged with the node: header, 255 bytes of payload
+// and crc
+#define MAX_FRAME_SIZE_WITH_CRC (3 + 255 + 2)
+
+/**
+ * \brief   Generate a frame whose given percentage of bytes must be escaped
+ */
+static std::vector<uint8_t> make_frame(size_t size, int escaped_percent)
+{
+    std::mt19937 rng(size * 100 + escaped_percent);
+    std::vector<uint8_t> frame(size);
+
+    for (auto & byte : frame)
+    {
+        if ((int) (rng() % 100) < escaped_percent)
+        {
+            byte = (rng() & 1) ? 0xC0 : 0xDB;
+        }
+        else
+        {
+            // Any value but the escaped ones
+            byte = rng() % 0xC0;
+        }
+    }
+    return frame;
+}
+
+static void SizesAndEscapes(benchmark::internal::Benchmark * b)
+{
+    for (int size : {16, 64, 128, MAX_FRAME_SIZE_WITH_CRC - 2})
+    {
+        for (int escaped_percent : {0, 10, 50, 100})
+        {
+            b->Args({size, escaped_percent});
+        }
+    }
+    b->ArgNames({"size", "escaped%"});
+}
+
+static void BM_Slip_encode(benchmark::State & state)
+{
+    std::vector<uint8_t> frame = make_frame(state.range(0), state.range(1));
+    std::vector<uint8_t> encoded(RECOMMENDED_BUFFER_SIZE(frame.size() + 2));
+
+    for (auto _ : state)
+    {
+        int size = Slip_encode(frame.data(), frame.size(), encoded.data(), encoded.size());
+        benchmark::DoNotOptimize(size);
+        benchmark::ClobberMemory();
+    }
+    state.SetBytesProcessed(state.iterations() * frame.size());
+}
+BENCHMARK(BM_Slip_encode)->Apply(SizesAndEscapes);
+
+static void BM_Slip_decode(benchmark::State & state)
+{
+    std::vector<uint8_t> frame = make_frame(state.range(0), state.range(1));
+    std::vector<uint8_t> encoded(RECOMMENDED_BUFFER_SIZE(frame.size() + 2));
+    std::vector<uint8_t> work(encoded.size());
+
+    int encoded_size = Slip_encode(frame.data(), frame.size(), encoded.data(), encoded.size());
+    if (encoded_size < 0)
+    {
+        state.SkipWithError("Cannot encode frame");
+        return;
+    }
+
+    for (auto _ : state)
+    {
+        // Decoding is done in place, the copy is part of the measure as it
+        // is for the library when a frame is received
+        memcpy(work.data(), encoded.data(), encoded_size);
+        int size = Slip_decode(work.data(), encoded_size);
+        if (size != (int) frame.size())
+        {
+            state.SkipWithError("Wrong decoded size");
+            break;
+        }
+        benchmark::DoNotOptimize(size);
+        benchmark::ClobberMemory();
+    }
+    state.SetBytesProcessed(state.iterations() * frame.size());
+}
+BENCHMARK(BM_Slip_decode)->Apply(SizesAndEscapes);
+
+static void BM_Crc(benchmark::State & state)
+{
+    std::vector<uint8_t> frame = make_frame(state.range(0), 0);
+
+    for (auto _ : state)
+    {
+        // Same computation as the crc of a frame (crc_fromBuffer)
+        uint16_t crc = Slip_crc_update(0xffff, frame.data(), frame.size());
+        benchmark::DoNotOptimize(crc);
+    }
+    state.SetBytesProcessed(state.iterations() * frame.size());
+}
+BENCHMARK(BM_Crc)->ArgName("size")->Arg(16)->Arg(64)->Arg(128)->Arg(MAX_FRAME_SIZE_WITH_CRC - 2);
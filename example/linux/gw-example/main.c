@@ -37,8 +37,6 @@ static char m_user[64] = "\0";
 static char m_password[128] = "\0";
 static bool use_ssl = true;
 
-static uint8_t m_proto_response_buffer[WPC_PROTO_MAX_RESPONSE_SIZE];
-
 static pthread_t m_thread_publish;
 // Mutex for publishing on MQTT
 static pthread_mutex_t m_pub_queue_mutex;
@@ -204,41 +202,60 @@ static void on_mqtt_message_delivered(void *context, MQTTClient_deliveryToken dt
     LOGI("Message with token %d delivery confirmed\n", dt);
 }
 
+static void on_proto_response(app_proto_res_e res,
+                              const uint8_t * response_p,
+                              size_t response_size,
+                              void * ctx)
+{
+    char * response_topic_p = ctx;
+
+    if (res == APP_RES_PROTO_OK)
+    {
+        LOGI("Response generated of size = %d for topic: %s\n", response_size, response_topic_p);
+        MQTT_publish(response_topic_p, (uint8_t *) response_p, response_size, false);
+    }
+    else
+    {
+        LOGE("Cannot handle request: %d\n", res);
+    }
+
+    free(response_topic_p);
+}
+
 static int on_message_rx_mqtt(void *context, char *topic, int topic_len, MQTTClient_message *message)
 {
-    size_t response_size;
     char * response_topic_p;
     app_proto_res_e res;
 
     LOGD("Message received on topic %s\n", topic);
-    response_size = sizeof(m_proto_response_buffer);
 
-    res = WPC_Proto_handle_request(message->payload, message->payloadlen, m_proto_response_buffer, &response_size);
-    if (res == APP_RES_PROTO_OK)
+    // response_topic is same as request with substitution of request with response
+    // Allocate space for response topic (+1 as "gw-response" is longer than "gw-request" by 1)
+    size_t response_topic_size = strlen(topic) + 2;
+    response_topic_p = (char *) malloc(response_topic_size);
+    if (!response_topic_p)
     {
-        // response_topic is same as request with substitution of request with response
-        // Allocate space for response topic (+1 as "gw-response" is longer than "gw-request" by 1)
-        size_t response_topic_size = strlen(topic) + 2;
-        response_topic_p = (char *) malloc(response_topic_size);
-        if (!response_topic_p)
-        {
-            LOGE("Cannot allocate space for response topic\n");
-        }
-        else
-        {
-            // Create response topic
-            snprintf(response_topic_p,
-                    response_topic_size,
-                    "gw-response/%s",
-                    topic + 11); // Everything after gw-request/
-            LOGI("Response generated of size = %d for topic: %s\n", response_size, response_topic_p);
-            MQTT_publish(response_topic_p, m_proto_response_buffer, response_size, false);
-            free(response_topic_p);
-        }
+        LOGE("Cannot allocate space for response topic\n");
     }
     else
     {
-        LOGE("Cannot handle request: %d\n", res);
+        // Create response topic
+        snprintf(response_topic_p,
+                response_topic_size,
+                "gw-response/%s",
+                topic + 11); // Everything after gw-request/
+
+        // Handled asynchronously to not block the MQTT client on long
+        // requests, response topic is released from the callback
+        res = WPC_Proto_submit_request(message->payload,
+                                       message->payloadlen,
+                                       on_proto_response,
+                                       response_topic_p);
+        if (res != APP_RES_PROTO_OK)
+        {
+            LOGE("Cannot submit request: %d\n", res);
+            free(response_topic_p);
+        }
     }
 
     MQTTClient_free(topic);
@@ -239,6 +239,27 @@ typedef struct
  */
 #define RESERVED_CHANNELS_MAX_NUM_BYTES 16
 
+/**
+ * \brief   Service access point of an attribute
+ */
+typedef enum
+{
+    APP_ATTR_CSAP,  //< Configuration attribute (CSAP)
+    APP_ATTR_MSAP   //< Management attribute (MSAP)
+} app_attr_sap_e;
+
+/**
+ * \brief   Description of a single attribute access in a batch
+ */
+typedef struct
+{
+    app_attr_sap_e sap;      //< Service access point of the attribute
+    uint16_t attribute_id;   //< Attribute id as defined in Dual MCU API
+    uint8_t length;          //< Attribute length in bytes
+    uint8_t * value_p;       //< Value to write or buffer to store read value
+    app_res_e result;        //< Result of the access for this attribute
+} app_attr_req_t;
+
 /**
  * \brief   Intialize the Wirepas Mesh serial communication
  * \param   port_name
@@ -262,6 +283,143 @@ void WPC_close(void);
  */
 app_res_e WPC_set_max_poll_fail_duration(unsigned int duration_s);
 
+/**
+ * \brief   Start capturing the frames exchanged with the sink
+ * \param   path
+ *          Path of the capture files, ".<index>" is appended for each file
+ * \param   max_file_size
+ *          Size in bytes of a file before starting a new one (at least 128kB)
+ * \param   max_files
+ *          Number of files kept, the oldest one is removed when a new one is
+ *          started
+ * \return  Return code of the operation
+ * \note    Frames are written without slip encoding and crc, in pcapng format,
+ *          with their direction and a microsecond timestamp. A Wireshark
+ *          dissector is available in tools/wireshark
+ * \note    Frames are buffered and written from a background thread, so the
+ *          serial exchanges are not delayed. If the file cannot be written
+ *          fast enough, frames are dropped
+ */
+app_res_e WPC_start_frame_capture(const char * path, uint32_t max_file_size, uint8_t max_files);
+
+/**
+ * \brief   Stop capturing the frames exchanged with the sink
+ * \return  Return code of the operation
+ */
+app_res_e WPC_stop_frame_capture(void);
+
+/**
+ * \brief   Set the backoff used to recover the link with the sink
+ *          When the sink didn't answer for the maximum poll fail duration,
+ *          the link is declared down, the serial port is closed and periodically
+ *          reopened until the sink answers again.
+ * \param   min_delay_ms
+ *          delay before first recovery attempt, doubled after each failure
+ * \param   max_delay_ms
+ *          maximum delay between two recovery attempts
+ * \return  Return code of the operation
+ */
+app_res_e WPC_set_link_recovery_backoff(unsigned int min_delay_ms, unsigned int max_delay_ms);
+
+/**
+ * \brief   Enter bulk transfer mode: temporarily use a higher bitrate on the
+ *          serial link, typically to upload or download a scratchpad
+ * \param   bitrate_attribute_id
+ *          CSAP attribute exposed by the sink to change its uart bitrate
+ *          (value written as 4 bytes). Sinks without such attribute cannot
+ *          use this mode
+ * \param   bitrate
+ *          Bitrate to use during the transfer
+ * \return  Return code of the operation
+ * \note    The sink is probed at the new bitrate. If it doesn't answer, the
+ *          link automatically falls back to its previous bitrate
+ * \note    If the link is lost during the transfer, it is recovered at the
+ *          bitrate given in \ref WPC_initialize. If the sink didn't reboot
+ *          and still answers at the transfer bitrate, it is asked to go back
+ *          to the initial bitrate first
+ */
+app_res_e WPC_start_bulk_transfer_mode(uint16_t bitrate_attribute_id, unsigned long bitrate);
+
+/**
+ * \brief   Leave bulk transfer mode and go back to the bitrate given in
+ *          \ref WPC_initialize
+ * \return  Return code of the operation
+ */
+app_res_e WPC_stop_bulk_transfer_mode(void);
+
+/**
+ * \brief   Read a list of attributes in a single transaction
+ * \param   reqs
+ *          List of attributes to read. Values are stored in value_p and
+ *          result of each read in result
+ * \param   n
+ *          Number of attributes to read
+ * \param   timestamp_ms_epoch_p
+ *          Pointer to store the timestamp of the snapshot. Can be NULL
+ * \return  Return code of the operation. APP_RES_OK means that the batch
+ *          was executed, result of each read must be checked individually
+ * \note    No other request or poll is done during the batch, so
+ *          values read are a coherent snapshot of the node state
+ */
+app_res_e WPC_attribute_batch_read(app_attr_req_t * reqs,
+                                   size_t n,
+                                   unsigned long long * timestamp_ms_epoch_p);
+
+/**
+ * \brief   Write a list of attributes in a single transaction
+ * \param   reqs
+ *          List of attributes to write with their values.
+ *          Result of each write is stored in result
+ * \param   n
+ *          Number of attributes to write
+ * \param   timestamp_ms_epoch_p
+ *          Pointer to store the timestamp of the transaction. Can be NULL
+ * \return  Return code of the operation. APP_RES_OK means that the batch
+ *          was executed, result of each write must be checked individually
+ */
+app_res_e WPC_attribute_batch_write(app_attr_req_t * reqs,
+                                    size_t n,
+                                    unsigned long long * timestamp_ms_epoch_p);
+
+/**
+ * \brief   Enable or disable the attribute cache
+ *          When enabled, attributes that only change on an explicit write or
+ *          a stack reboot (node address, role, mtu, firmware version,...)
+ *          are only read once from the node. Cache is invalidated when the
+ *          stack reboots.
+ * \param   enable
+ *          true to enable the cache, false to disable it (default)
+ * \return  Return code of the operation
+ */
+app_res_e WPC_enable_attribute_cache(bool enable);
+
+/**
+ * \brief   Get attribute cache counters
+ * \param   hits_p
+ *          Pointer to store the number of reads served from cache
+ * \param   misses_p
+ *          Pointer to store the number of cacheable reads sent to the node
+ * \return  Return code of the operation
+ */
+app_res_e WPC_get_attribute_cache_stats(uint32_t * hits_p, uint32_t * misses_p);
+
+/**
+ * \brief   Change the caching policy of an attribute
+ *          For example an application changing an attribute behind the
+ *          library (with another tool connected to the node) can disable
+ *          its caching
+ * \param   sap
+ *          Service access point of the attribute
+ * \param   attribute_id
+ *          Attribute id as defined in Dual MCU API
+ * \param   cacheable
+ *          true to cache the attribute until next write or stack reboot,
+ *          false to always read it from the node
+ * \return  Return code of the operation, APP_RES_INVALID_VALUE if the
+ *          attribute is not one of the attributes the cache can hold
+ */
+app_res_e WPC_set_attribute_cacheable(app_attr_sap_e sap, uint16_t attribute_id, bool cacheable);
+
 /**
  * \brief   Set maximum duration for fragment
  * \param   duration_s
@@ -703,6 +861,71 @@ app_res_e WPC_get_route_count(uint8_t * count_p);
  */
 app_res_e WPC_get_system_time(uint32_t * time_p);
 
+/**
+ * \brief   Estimate of the sink clock (system time) relative to the host clock
+ */
+typedef struct
+{
+    unsigned long long sink_time_us;    //< Sink system time at the reference point, in us
+    unsigned long long epoch_us;        //< Host time since epoch at the reference point, in us
+    int32_t drift_ppb;                  //< Drift of the sink clock relative to the host clock
+    uint32_t uncertainty_us;            //< Estimated error of a conversion
+    uint32_t samples;                   //< Samples used for the estimate
+} app_sink_clock_t;
+
+/**
+ * \brief   Enable or disable the estimation of the sink clock
+ *          The system time of the sink is read periodically (in the
+ *          background) and aligned to the host clock, so that times of the
+ *          sink can be converted to host time
+ * \param   period_s
+ *          Period between two reads of the system time once a first estimate
+ *          is done, 0 to disable the estimation (default)
+ * \return  Return code of the operation
+ * \note    A first estimate is available after a few seconds. Drift of the
+ *          sink clock is only estimated after a minute
+ */
+app_res_e WPC_enable_sink_clock_estimation(unsigned int period_s);
+
+/**
+ * \brief   Get the current estimate of the sink clock
+ * \param   clock_p
+ *          Pointer to store the estimate
+ * \return  Return code of the operation, APP_RES_ATTRIBUTE_NOT_SET if no
+ *          estimate is available yet
+ */
+app_res_e WPC_get_sink_clock_estimate(app_sink_clock_t * clock_p);
+
+/**
+ * \brief   Convert a sink system time into a host time since epoch
+ * \param   sink_time_us
+ *          Sink system time in us (same time base as
+ *          \ref WPC_get_system_time)
+ * \param   epoch_us_p
+ *          Pointer to store the time since epoch in us
+ * \return  Return code of the operation, APP_RES_ATTRIBUTE_NOT_SET if no
+ *          estimate is available yet
+ */
+app_res_e WPC_sink_time_to_epoch_us(unsigned long long sink_time_us,
+                                    unsigned long long * epoch_us_p);
+
+/**
+ * \brief   Get the time a received packet was sent by its source
+ * \param   rx_timestamp_ms_epoch
+ *          Reception time given to \ref onDataReceived_cb_f
+ * \param   travel_time_ms
+ *          Travel time given to \ref onDataReceived_cb_f, measured with the
+ *          clocks of the nodes
+ * \param   origin_ms_epoch_p
+ *          Pointer to store the time the packet was sent, in ms since epoch
+ * \return  Return code of the operation
+ * \note    Drift of the sink clock is corrected once estimated, see
+ *          \ref WPC_enable_sink_clock_estimation
+ */
+app_res_e WPC_get_origin_timestamp_ms_epoch(unsigned long long rx_timestamp_ms_epoch,
+                                            uint32_t travel_time_ms,
+                                            unsigned long long * origin_ms_epoch_p);
+
 /**
  * \brief   Get the current access cycle range
  * \param   min_ac_p
@@ -826,6 +1049,25 @@ app_res_e WPC_start_local_scratchpad_update(uint32_t len, uint8_t seq);
  */
 app_res_e WPC_upload_local_block_scratchpad(uint32_t len, const uint8_t * bytes, uint32_t start);
 
+/**
+ * \brief   Upload (write) a scratchpad block, with the max block size already
+ *          known, so it is not read again from the node
+ * \param   len
+ *          Length of the block (must be a multiple of 4 bytes)
+ * \param   bytes
+ *          Block content
+ * \param   start
+ *          Offset of the block relatively to the beginning of scratchpad
+ * \param   max_block_size
+ *          Max block size as returned by \ref WPC_get_scratchpad_block_max
+ * \return  Return code of the operation
+ * \note    Useful when uploading a scratchpad in several calls
+ */
+app_res_e WPC_upload_local_block_scratchpad_with_max(uint32_t len,
+                                                     const uint8_t * bytes,
+                                                     uint32_t start,
+                                                     uint8_t max_block_size);
+
 /**
  * \brief   Upload (write) a full scratchpad
  * \param   len
@@ -838,6 +1080,92 @@ app_res_e WPC_upload_local_block_scratchpad(uint32_t len, const uint8_t * bytes,
  */
 app_res_e WPC_upload_local_scratchpad(uint32_t len, const uint8_t * bytes, uint8_t seq);
 
+/**
+ * \brief   Compute the crc of a scratchpad image, as reported by the node in
+ *          its scratchpad status once the image is stored
+ * \param   len
+ *          Length of the scratchpad image
+ * \param   bytes
+ *          scratchpad image content
+ * \param   crc_p
+ *          Pointer to store the crc
+ *          Updated if return code is APP_RES_OK
+ * \return  Return code of the operation
+ * \note    Can be compared with \ref app_scratchpad_status_t scrat_crc to
+ *          avoid uploading an image already stored by the node
+ */
+app_res_e WPC_get_scratchpad_image_crc(uint32_t len, const uint8_t * bytes, uint16_t * crc_p);
+
+/**
+ * \brief   Callback called each time a scratchpad block is acknowledged by
+ *          the node during a resumable upload
+ * \param   uploaded
+ *          Number of bytes of the scratchpad acknowledged so far
+ * \param   total
+ *          Total length of the scratchpad being uploaded
+ */
+typedef void (*onScratchpadUploadProgress_cb_f)(uint32_t uploaded, uint32_t total);
+
+/**
+ * \brief   Upload (write) a full scratchpad in a resumable way
+ * \param   len
+ *          Length of the scratchpad (must be a multiple of 4 bytes)
+ * \param   bytes
+ *          scratchpad content (can be a memory mapped file)
+ * \param   seq
+ *          Sequence of the scratchpad to upload
+ * \param   offset_p
+ *          [in] Offset to start from. 0 starts a new upload (and erases the
+ *          current scratchpad), any other value resumes an upload previously
+ *          started with the same len and seq
+ *          [out] Number of bytes acknowledged by the node. Set back to 0 if
+ *          the node has lost the upload (APP_RES_NO_SCRATCHPAD_START), in
+ *          which case the upload must be started again
+ * \param   progress_cb
+ *          Callback called after each acknowledged block, can be NULL
+ * \return  Return code of the operation
+ *          APP_RES_INVALID_SCRATCHPAD if the scratchpad stored by the node
+ *          doesn't match the uploaded one (length, sequence or crc)
+ * \note    A block that didn't reach the node because of a serial link error
+ *          is sent again a few times (for at most 6 s), giving time to the
+ *          link to be recovered. If the confirm of a block is lost, the block
+ *          is read back from the node and only sent again if it is not
+ *          stored. If it cannot be read back, the error is returned and
+ *          *offset_p is the offset of this block
+ * \note    Once all blocks are written, the scratchpad status of the node is
+ *          compared with the crc computed locally instead of reading the
+ *          scratchpad back
+ */
+app_res_e WPC_upload_local_scratchpad_resumable(uint32_t len,
+                                                const uint8_t * bytes,
+                                                uint8_t seq,
+                                                uint32_t * offset_p,
+                                                onScratchpadUploadProgress_cb_f progress_cb);
+
+/**
+ * \brief   Upload (write) a full scratchpad read from a file descriptor
+ * \param   fd
+ *          File descriptor to read the scratchpad from. It is read with
+ *          pread so the file offset is not modified
+ * \param   len
+ *          Length of the scratchpad (must be a multiple of 4 bytes)
+ * \param   seq
+ *          Sequence of the scratchpad to upload
+ * \param   offset_p
+ *          Offset to resume from and number of bytes acknowledged, same as
+ *          for \ref WPC_upload_local_scratchpad_resumable
+ * \param   progress_cb
+ *          Callback called after each acknowledged block, can be NULL
+ * \return  Return code of the operation
+ *          APP_RES_DATA_ERROR if the file cannot be read
+ * \note    Only one block is held in memory at a time
+ */
+app_res_e WPC_upload_local_scratchpad_from_fd(int fd,
+                                              uint32_t len,
+                                              uint8_t seq,
+                                              uint32_t * offset_p,
+                                              onScratchpadUploadProgress_cb_f progress_cb);
+
 /**
  * \brief   Clear the local stored scratchpad
  * \return  Return code of the operation
@@ -955,6 +1283,120 @@ app_res_e WPC_send_data(const uint8_t * bytes,
  */
 app_res_e WPC_send_data_with_options(const app_message_t * message_p);
 
+// Fragments with their own retries in a trace, next ones are counted in the
+// last one
+#define APP_TX_TRACE_MAX_FRAGMENTS 16
+
+/**
+ * \brief   Trace of a sent packet
+ *          Durations are measured from the call to \ref WPC_send_data (or
+ *          \ref WPC_send_data_with_options)
+ */
+typedef struct
+{
+    app_addr_t dst_addr;                //!< Destination address
+    uint16_t pdu_id;                    //!< Pdu id
+    app_qos_e qos;                      //!< QoS used for transmission
+    int result;                         //!< Result code of the sink for the request,
+                                        //!< negative for a transport error
+    bool indication;                    //!< True if a TX indication was received
+    uint8_t indication_result;          //!< Result of the TX indication
+    uint32_t buffering_delay_ms;        //!< Time spent in the stack, from TX indication
+    uint8_t fragments;                  //!< Number of fragments, 0 if not fragmented
+    uint8_t retries;                    //!< Requests sent again after a crc error
+    uint8_t fragment_retries[APP_TX_TRACE_MAX_FRAGMENTS];  //!< Retries per fragment
+    unsigned long long submit_ms_epoch; //!< Time the packet was submitted
+    uint32_t lock_wait_us;              //!< Time waiting for other requests and polls
+    uint32_t write_us;                  //!< Time writing requests on the uart
+    uint32_t sink_us;                   //!< Time waiting for the confirms of the sink
+    uint32_t confirm_us;                //!< Time until the confirm of the last request
+    uint32_t indication_us;             //!< Time until the first byte of the TX indication
+} app_tx_trace_t;
+
+/**
+ * \brief   Callback definition to receive the trace of sent packets
+ * \param   trace_p
+ *          Trace of the packet
+ * \note    Called once the packet is confirmed (or refused) by the sink, or
+ *          once its TX indication is received if on_data_sent_cb was set
+ */
+typedef void (*onTxTrace_cb_f)(const app_tx_trace_t * trace_p);
+
+// Buckets of the latency histograms. Bucket i is for latencies below
+// APP_TX_STATS_LATENCY_LIMIT_US(i) (and above the limit of bucket i - 1),
+// last one is for greater latencies
+#define APP_TX_STATS_LATENCY_BUCKETS 24
+#define APP_TX_STATS_LATENCY_LIMIT_US(bucket) (256ULL << (bucket))
+
+/**
+ * \brief   Statistics of the packets sent to a destination with a QoS
+ */
+typedef struct
+{
+    app_addr_t dst_addr;                //!< Destination address
+    app_qos_e qos;                      //!< QoS used for transmission
+    uint32_t packets;                   //!< Packets submitted
+    uint32_t errors;                    //!< Packets refused by the sink or not sent
+    uint32_t fragments;                 //!< Fragments sent
+    uint32_t retries;                   //!< Requests sent again after a crc error
+    uint32_t indications;               //!< TX indications received
+    uint32_t failed_indications;        //!< TX indications with a failure result
+    uint64_t lock_wait_sum_us;          //!< Sum of lock_wait_us of traces
+    uint64_t write_sum_us;              //!< Sum of write_us of traces
+    uint64_t sink_sum_us;               //!< Sum of sink_us of traces
+    uint64_t buffering_delay_sum_ms;    //!< Sum of buffering_delay_ms of traces
+    uint32_t confirm_latency[APP_TX_STATS_LATENCY_BUCKETS];   //!< Packets per confirm_us
+    uint32_t delivery_latency[APP_TX_STATS_LATENCY_BUCKETS];  //!< Packets per indication_us
+} app_tx_stats_t;
+
+/**
+ * \brief   Enable or disable the tracing of sent packets
+ *          Time of each step of a packet sending (waiting for the request
+ *          lock, uart write, confirm of the sink and TX indication) is
+ *          measured
+ * \param   onTxTrace
+ *          Callback to receive the trace of each packet, can be NULL
+ * \param   max_destinations
+ *          Maximum number of destination and QoS pairs with statistics, 0
+ *          for no statistics. Tracing is disabled if onTxTrace is NULL too
+ *          (default)
+ * \return  Return code of the operation
+ * \note    Statistics are reset each time this function is called and freed
+ *          by \ref WPC_close
+ * \note    TX indication is only traced for packets sent with an
+ *          on_data_sent_cb
+ */
+app_res_e WPC_enable_tx_trace(onTxTrace_cb_f onTxTrace, unsigned int max_destinations);
+
+/**
+ * \brief   Get the statistics of packets sent to a destination
+ * \param   dst_addr
+ *          Destination address
+ * \param   qos
+ *          QoS used for transmission
+ * \param   stats_p
+ *          Pointer to store the statistics
+ * \return  Return code of the operation, APP_RES_UNKNOWN_DEST if nothing was
+ *          sent to this destination with this QoS, APP_RES_ATTRIBUTE_NOT_SET
+ *          if statistics are not enabled
+ */
+app_res_e WPC_get_tx_stats(app_addr_t dst_addr, app_qos_e qos, app_tx_stats_t * stats_p);
+
+/**
+ * \brief   Iterate over the statistics of all the destinations
+ * \param   cursor_p
+ *          Position of the iteration, must be set to 0 to get the first
+ *          destination. Updated to get the next one on next call
+ * \param   stats_p
+ *          Pointer to store the statistics of the next destination
+ * \return  Return code of the operation, APP_RES_UNKNOWN_DEST once all the
+ *          destinations are iterated, APP_RES_ATTRIBUTE_NOT_SET if
+ *          statistics are not enabled
+ * \note    Counters are read without stopping the sending, a packet in
+ *          progress may only be partially accounted
+ */
+app_res_e WPC_get_next_tx_stats(uint32_t * cursor_p, app_tx_stats_t * stats_p);
+
 /**
  * \brief   Set config data item
  * \param   endpoint
@@ -1077,6 +1519,89 @@ app_res_e WPC_register_for_data(onDataReceived_cb_f onDataReceived);
 app_res_e WPC_unregister_for_data();
 #endif
 
+// Buckets of the hop count histogram, last one is for greater hop counts
+#define APP_NODE_STATS_HOP_BUCKETS 16
+
+// Buckets of the travel time histogram. Bucket i is for travel times below
+// APP_NODE_STATS_TRAVEL_TIME_LIMIT_MS(i) (and above the limit of bucket
+// i - 1), last one is for greater travel times
+#define APP_NODE_STATS_TRAVEL_TIME_BUCKETS 16
+#define APP_NODE_STATS_TRAVEL_TIME_LIMIT_MS(bucket) (16UL << (bucket))
+
+/**
+ * \brief   Reception statistics of a source node
+ * \note    Hop count, travel time and qos of fragmented packets are the ones
+ *          of their last fragment, as given to \ref onDataReceived_cb_f
+ */
+typedef struct
+{
+    app_addr_t address;                     //!< Source address of the node
+    uint32_t packets;                       //!< Packets received (full packets)
+    uint32_t fragments;                     //!< Fragments received
+    uint32_t high_qos_packets;              //!< Packets received with high qos
+    uint64_t bytes;                         //!< Bytes received (packets and fragments)
+    uint64_t travel_time_sum_ms;            //!< Sum of travel time of packets
+    unsigned long long first_seen_ms_epoch; //!< Reception time of first packet or fragment
+    unsigned long long last_seen_ms_epoch;  //!< Reception time of last packet or fragment
+    uint32_t hop_count[APP_NODE_STATS_HOP_BUCKETS];  //!< Packets per hop count
+    uint32_t travel_time[APP_NODE_STATS_TRAVEL_TIME_BUCKETS];  //!< Packets per travel time
+} app_node_stats_t;
+
+/**
+ * \brief   Enable or disable the reception statistics per source node
+ *          Statistics are updated for each received packet and fragment,
+ *          whatever the registered data callbacks
+ * \param   max_nodes
+ *          Maximum number of nodes tracked, 0 to disable the statistics
+ *          (default). Packets from other nodes are only counted as untracked
+ * \return  Return code of the operation
+ * \note    Statistics are reset each time this function is called
+ * \note    Memory used is roughly 256 bytes per node. It is freed by
+ *          \ref WPC_close
+ */
+app_res_e WPC_enable_node_stats(unsigned int max_nodes);
+
+/**
+ * \brief   Get the reception statistics of a node
+ * \param   address
+ *          Source address of the node
+ * \param   stats_p
+ *          Pointer to store the statistics
+ * \return  Return code of the operation, APP_RES_UNKNOWN_DEST if nothing was
+ *          received from this node, APP_RES_ATTRIBUTE_NOT_SET if statistics
+ *          are not enabled
+ * \note    Statistics are read without stopping the reception. They are
+ *          consistent for a node but not between nodes
+ */
+app_res_e WPC_get_node_stats(app_addr_t address, app_node_stats_t * stats_p);
+
+/**
+ * \brief   Iterate over the statistics of all the nodes
+ * \param   cursor_p
+ *          Position of the iteration, must be set to 0 to get the first node.
+ *          Updated to get the next node on next call
+ * \param   stats_p
+ *          Pointer to store the statistics of the next node
+ * \return  Return code of the operation, APP_RES_UNKNOWN_DEST once all the
+ *          nodes are iterated, APP_RES_ATTRIBUTE_NOT_SET if statistics are
+ *          not enabled
+ * \note    Nodes are not iterated in a specific order. Nodes received for
+ *          the first time during an iteration may not be returned
+ */
+app_res_e WPC_get_next_node_stats(uint32_t * cursor_p, app_node_stats_t * stats_p);
+
+/**
+ * \brief   Get the number of nodes in the statistics
+ * \param   nodes_p
+ *          Pointer to store the number of nodes tracked
+ * \param   untracked_packets_p
+ *          Pointer to store the number of packets and fragments received from
+ *          nodes that could not be tracked as max_nodes was reached
+ * \return  Return code of the operation, APP_RES_ATTRIBUTE_NOT_SET if
+ *          statistics are not enabled
+ */
+app_res_e WPC_get_node_stats_count(uint32_t * nodes_p, uint32_t * untracked_packets_p);
+
 /**
  * \brief   Callback definition to register for scan neighbors done
  * \param   scan_ready
@@ -1125,6 +1650,58 @@ app_res_e WPC_register_for_stack_status(onStackStatusReceived_cb_f onStackStatus
  */
 app_res_e WPC_unregister_from_stack_status();
 
+/**
+ * \brief   Status given to the callback of \ref WPC_stop_stack_async when the
+ *          node didn't reboot in time
+ */
+#define APP_STACK_STATUS_NO_REBOOT 0xFF
+
+/**
+ * \brief   Stop the stack without waiting for the node to reboot
+ * \param   onStackStopped
+ *          Callback called once with the stack status sent by the node when
+ *          it has rebooted (from the dispatching thread), or with
+ *          \ref APP_STACK_STATUS_NO_REBOOT if the node didn't reboot within
+ *          the max poll fail duration (from a background thread)
+ * \return  Return code of the operation. Callback is only called if
+ *          APP_RES_OK is returned
+ * \note    Polling is kept active during the reboot. If node doesn't come
+ *          back, link will also be declared down after the max poll fail
+ *          duration (see \ref WPC_register_for_link_status)
+ */
+app_res_e WPC_stop_stack_async(onStackStatusReceived_cb_f onStackStopped);
+
+/**
+ * \brief   Cancel a pending asynchronous stop
+ *          The stop request is already sent, so the node still reboots, but
+ *          the callback given to \ref WPC_stop_stack_async is not called
+ * \return  APP_RES_OK if a stop was pending, APP_RES_NOT_REGISTERED otherwise
+ */
+app_res_e WPC_cancel_stop_stack_async(void);
+
+/**
+ * \brief   Callback definition to register for link status
+ * \param   link_up
+ *          false when link with sink is declared down,
+ *          true when it is recovered
+ */
+typedef void (*onLinkStatusChanged_cb_f)(bool link_up);
+
+/**
+ * \brief   Register for link status changes
+ * \param   onLinkStatusChanged
+ *          The callback to call when link goes down or is recovered
+ * \note    The callback is called from the polling thread without any lock
+ *          held, so it must be kept as simple as possible.
+ */
+app_res_e WPC_register_for_link_status(onLinkStatusChanged_cb_f onLinkStatusChanged);
+
+/**
+ * \brief   Unregister from link status changes
+ * \return  Return code of the operation
+ */
+app_res_e WPC_unregister_from_link_status();
+
 /**
  * \brief   Callback definition to register for config data item notification
  * \param   endpoint
@@ -49,7 +49,7 @@
 /*
  * Maximum size offset for data reception. Added to payload size, it can be used as an hint
  * to give a big enough buffer to @onDataReceived
- * note : see wp_SendPacketReq_size compared to payload size defined in wp_PacketReceivedEvent_payload_t
+ * note : it covers all the fields of a wp_PacketReceivedEvent except its payload,
  * assuming that is will be a wp_GenericMessage
  */
 #define WPC_PROTO_OFFSET_DATA_SIZE 100
@@ -124,6 +124,51 @@ app_proto_res_e WPC_Proto_handle_request(const uint8_t * request_p,
                                          uint8_t * response_p,
                                          size_t * response_size_p);
 
+/**
+ * \brief        Callback definition for the response of a request submitted
+ *               with @WPC_Proto_submit_request
+ * \param[in]    res
+ *               Return code of the request handling, same as the one of
+ *               @WPC_Proto_handle_request
+ * \param[in]    response_p
+ *               Pointer to the response, NULL if res is not APP_RES_PROTO_OK
+ *               Only valid during the callback
+ * \param[in]    response_size
+ *               Size of the response
+ * \param[in]    ctx
+ *               Context given when submitting the request
+ */
+typedef void (*onProtoResponse_cb_f)(app_proto_res_e res,
+                                     const uint8_t * response_p,
+                                     size_t response_size,
+                                     void * ctx);
+
+/**
+ * \brief        Submit a request in protobuf format, the response is given
+ *               asynchronously
+ * \param[in]    request_p
+ *               Pointer to the protobuf message, copied if needed
+ * \param[in]    request_size
+ *               Size of the request
+ * \param[in]    onProtoResponse_cb
+ *               Callback to call with the response
+ * \param[in]    ctx
+ *               Context given back to the callback
+ * \return       Return code of the operation. If APP_RES_PROTO_OK, the
+ *               callback will be called exactly once
+ * \note         Requests only reading the gateway state (GetGwInfo,
+ *               GetConfigs and GetScratchpadStatus) are answered
+ *               immediately, from the calling context, before this function
+ *               returns. Other requests are queued and handled one by one
+ *               in submission order from an internal worker, so a long
+ *               request (like a scratchpad upload) does not delay the read
+ *               only ones
+ */
+app_proto_res_e WPC_Proto_submit_request(const uint8_t * request_p,
+                                         size_t request_size,
+                                         onProtoResponse_cb_f onProtoResponse_cb,
+                                         void * ctx);
+
 
 /**
  * \brief   Callback definition for event status
@@ -141,6 +186,55 @@ typedef void (*onDataRxEvent_cb_f)(uint8_t * event_p,
  */
 app_proto_res_e WPC_Proto_register_for_data_rx_event(onDataRxEvent_cb_f onDataRxEvent_cb);
 
+/**
+ * \brief   Callback definition for batched data rx events
+ * \param   events_p
+ *          Encoded events, each one prefixed with its size as a protobuf
+ *          varint (length-delimited stream of wp_GenericMessage)
+ * \param   events_size
+ *          Total size of the events buffer
+ * \param   event_count
+ *          Number of events in the buffer
+ * \param   network_id
+ *          Network address shared by all events of the batch
+ * \param   src_ep
+ *          Source endpoint shared by all events of the batch
+ * \param   dst_ep
+ *          Destination endpoint shared by all events of the batch
+ */
+typedef void (*onDataRxEventBatch_cb_f)(uint8_t * events_p,
+                                        size_t events_size,
+                                        size_t event_count,
+                                        uint32_t network_id,
+                                        uint16_t src_ep,
+                                        uint16_t dst_ep);
+
+/**
+ * \brief   Register for receiving data rx events by batches instead of one
+ *          by one
+ *          Events with the same network address, source and destination
+ *          endpoints are grouped until max_events are collected or the
+ *          first one of the batch is max_delay_ms old
+ * \param   onDataRxEventBatch_cb
+ *          Callback to call for each batch
+ * \param   max_events
+ *          Maximum number of events in a batch
+ * \param   max_delay_ms
+ *          Maximum delay an event can wait in a batch before being delivered
+ * \return  Return code of the operation
+ * \note    Cannot be used together with @WPC_Proto_register_for_data_rx_event
+ * \note    A batch can be delivered before max_events is reached if its
+ *          buffer is full
+ * \note    Delivery on timeout runs from a worker dedicated to batches, so
+ *          it is not delayed by other background tasks (like the config
+ *          refresh after a stack status)
+ * \note    Callback is called without any lock held by the library, from the
+ *          dispatching context or the batch worker, one batch at a time
+ */
+app_proto_res_e WPC_Proto_register_for_data_rx_event_batch(onDataRxEventBatch_cb_f onDataRxEventBatch_cb,
+                                                           size_t max_events,
+                                                           unsigned int max_delay_ms);
+
 /**
  * \brief   Callback definition for event status
  * \param   ...
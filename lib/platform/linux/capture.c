@@ -0,0 +1,405 @@
+/* Wirepas Oy licensed under Apache License, Version 2.0
+ *
+ * See file LICENSE for full license details.
+ *
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#define LOG_MODULE_NAME "capture"
+#define MAX_LOG_LEVEL INFO_LOG_LEVEL
+#include "logger.h"
+
+#include "platform.h"
+
+/*
+ * Frames are written as pcapng Enhanced Packet Blocks in one of two buffers.
+ * When it is full (or periodically), buffers are swapped and a writer thread
+ * copies the full one to the current file, memory mapped.
+ */
+
+// Size of each of the two buffers
+#define CAPTURE_BUFFER_SIZE (64 * 1024)
+
+// Buffered frames are written to the file at least with this period
+#define CAPTURE_FLUSH_PERIOD_MS 1000
+
+// Max length of a file name, including the index added for rotation
+#define CAPTURE_MAX_PATH_LENGTH 256
+
+// pcapng block types
+#define PCAPNG_SECTION_HEADER_BLOCK     0x0A0D0D0A
+#define PCAPNG_INTERFACE_BLOCK          0x00000001
+#define PCAPNG_ENHANCED_PACKET_BLOCK    0x00000006
+#define PCAPNG_BYTE_ORDER_MAGIC         0x1A2B3C4D
+
+// pcapng options
+#define PCAPNG_OPT_ENDOFOPT             0
+#define PCAPNG_OPT_EPB_FLAGS            2
+#define PCAPNG_OPT_IF_TSRESOL           9
+
+// Direction in epb_flags
+#define PCAPNG_EPB_FLAGS_INBOUND        0x1
+#define PCAPNG_EPB_FLAGS_OUTBOUND       0x2
+
+// Frames are not a known link type, see tools/wireshark/wpc_sap.lua
+#define LINKTYPE_USER0                  147
+
+// Size of an Enhanced Packet Block without its padded data
+#define PCAPNG_EPB_OVERHEAD             44
+
+#define PAD_4(_len_) (((_len_) + 3) & ~3u)
+
+typedef struct
+{
+    size_t used;
+    uint8_t data[CAPTURE_BUFFER_SIZE];
+} capture_buffer_t;
+
+// Buffer filled by the producers is m_buffers[m_front]
+static capture_buffer_t m_buffers[2];
+static unsigned int m_front;
+
+static pthread_mutex_t m_capture_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t m_capture_cond;
+static pthread_t m_writer_thread;
+
+// Read without lock by producers, to return early when not capturing
+static bool m_capturing = false;
+static bool m_writer_running = false;
+static uint32_t m_dropped;
+
+// Offset to convert monotonic time to epoch time
+static int64_t m_epoch_offset_us;
+
+// Current file, only accessed by the writer thread (or when it is stopped)
+static char m_path[CAPTURE_MAX_PATH_LENGTH];
+static size_t m_max_file_size;
+static unsigned int m_max_files;
+static unsigned int m_file_index;
+static int m_fd = -1;
+static uint8_t * m_map_p = NULL;
+static size_t m_file_offset;
+
+static int64_t get_time_us(clockid_t clock)
+{
+    struct timespec spec;
+
+    clock_gettime(clock, &spec);
+    return (int64_t) spec.tv_sec * 1000000 + spec.tv_nsec / 1000;
+}
+
+static uint8_t * put_u16(uint8_t * p, uint16_t value)
+{
+    memcpy(p, &value, sizeof(value));
+    return p + sizeof(value);
+}
+
+static uint8_t * put_u32(uint8_t * p, uint32_t value)
+{
+    memcpy(p, &value, sizeof(value));
+    return p + sizeof(value);
+}
+
+/**
+ * \brief   Write the blocks starting a file: section header and interface
+ * \return  Size of the written blocks
+ */
+static size_t write_file_header(uint8_t * buffer_p)
+{
+    uint8_t * p = buffer_p;
+
+    // Section Header Block, in host byte order
+    p = put_u32(p, PCAPNG_SECTION_HEADER_BLOCK);
+    p = put_u32(p, 28);
+    p = put_u32(p, PCAPNG_BYTE_ORDER_MAGIC);
+    p = put_u16(p, 1);
+    p = put_u16(p, 0);
+    // Section length is not known
+    p = put_u32(p, 0xFFFFFFFF);
+    p = put_u32(p, 0xFFFFFFFF);
+    p = put_u32(p, 28);
+
+    // Interface Description Block with microsecond timestamps
+    p = put_u32(p, PCAPNG_INTERFACE_BLOCK);
+    p = put_u32(p, 32);
+    p = put_u16(p, LINKTYPE_USER0);
+    p = put_u16(p, 0);
+    p = put_u32(p, 0);
+    p = put_u16(p, PCAPNG_OPT_IF_TSRESOL);
+    p = put_u16(p, 1);
+    p = put_u32(p, 6);
+    p = put_u32(p, PCAPNG_OPT_ENDOFOPT);
+    p = put_u32(p, 32);
+
+    return p - buffer_p;
+}
+
+static void close_file(void)
+{
+    if (m_map_p != NULL)
+    {
+        munmap(m_map_p, m_max_file_size);
+        m_map_p = NULL;
+    }
+
+    if (m_fd >= 0)
+    {
+        close(m_fd);
+        m_fd = -1;
+    }
+}
+
+static bool open_file(void)
+{
+    char name[CAPTURE_MAX_PATH_LENGTH + 16];
+
+    // Only the last m_max_files files are kept
+    if (m_file_index >= m_max_files)
+    {
+        snprintf(name, sizeof(name), "%s.%u", m_path, m_file_index - m_max_files);
+        unlink(name);
+    }
+
+    snprintf(name, sizeof(name), "%s.%u", m_path, m_file_index);
+    m_file_index++;
+
+    m_fd = open(name, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (m_fd < 0)
+    {
+        LOGE("Cannot open capture file %s: %s\n", name, strerror(errno));
+        return false;
+    }
+
+    // Whole file is mapped once, it grows as frames are written
+    m_map_p = mmap(NULL, m_max_file_size, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+    if (m_map_p == MAP_FAILED)
+    {
+        LOGE("Cannot map capture file %s: %s\n", name, strerror(errno));
+        m_map_p = NULL;
+        close_file();
+        return false;
+    }
+
+    uint8_t header[64];
+    m_file_offset = write_file_header(header);
+    if (ftruncate(m_fd, m_file_offset) != 0)
+    {
+        close_file();
+        return false;
+    }
+    memcpy(m_map_p, header, m_file_offset);
+
+    LOGI("Capturing frames in %s\n", name);
+    return true;
+}
+
+static void write_to_file(const capture_buffer_t * buffer_p)
+{
+    if ((m_fd >= 0) && (m_file_offset + buffer_p->used > m_max_file_size))
+    {
+        close_file();
+    }
+
+    if ((m_fd < 0) && !open_file())
+    {
+        return;
+    }
+
+    // Mapped pages must be backed by the file before being written
+    if (ftruncate(m_fd, m_file_offset + buffer_p->used) != 0)
+    {
+        LOGE("Cannot extend capture file: %s\n", strerror(errno));
+        return;
+    }
+
+    memcpy(m_map_p + m_file_offset, buffer_p->data, buffer_p->used);
+    m_file_offset += buffer_p->used;
+}
+
+static void * write_buffers(void * unused)
+{
+    struct timespec deadline;
+    capture_buffer_t * back_p;
+
+    (void) unused;
+
+    pthread_mutex_lock(&m_capture_mutex);
+    while (true)
+    {
+        back_p = &m_buffers[m_front ^ 1];
+        if ((back_p->used == 0) && m_writer_running)
+        {
+            clock_gettime(CLOCK_MONOTONIC, &deadline);
+            deadline.tv_sec += CAPTURE_FLUSH_PERIOD_MS / 1000;
+            deadline.tv_nsec += (CAPTURE_FLUSH_PERIOD_MS % 1000) * 1000000;
+            if (deadline.tv_nsec >= 1000000000)
+            {
+                deadline.tv_sec++;
+                deadline.tv_nsec -= 1000000000;
+            }
+            pthread_cond_timedwait(&m_capture_cond, &m_capture_mutex, &deadline);
+            back_p = &m_buffers[m_front ^ 1];
+        }
+
+        // Periodic flush or end of capture, take what is in the front buffer
+        if ((back_p->used == 0) && (m_buffers[m_front].used > 0))
+        {
+            m_front ^= 1;
+            back_p = &m_buffers[m_front ^ 1];
+        }
+
+        if (back_p->used > 0)
+        {
+            // Producers only use the front buffer
+            pthread_mutex_unlock(&m_capture_mutex);
+            write_to_file(back_p);
+            pthread_mutex_lock(&m_capture_mutex);
+            back_p->used = 0;
+            continue;
+        }
+
+        if (!m_writer_running)
+        {
+            break;
+        }
+    }
+    pthread_mutex_unlock(&m_capture_mutex);
+
+    return NULL;
+}
+
+bool Platform_capture_start(const char * path, size_t max_file_size, unsigned int max_files)
+{
+    pthread_condattr_t cond_attr;
+
+    if ((path == NULL)
+        || (strlen(path) >= CAPTURE_MAX_PATH_LENGTH)
+        || (max_file_size < 2 * CAPTURE_BUFFER_SIZE)
+        || (max_files == 0))
+    {
+        return false;
+    }
+
+    if (m_writer_running)
+    {
+        LOGE("Capture already started\n");
+        return false;
+    }
+
+    strcpy(m_path, path);
+    m_max_file_size = max_file_size;
+    m_max_files = max_files;
+    m_file_index = 0;
+    m_buffers[0].used = 0;
+    m_buffers[1].used = 0;
+    m_front = 0;
+    m_dropped = 0;
+    m_epoch_offset_us = get_time_us(CLOCK_REALTIME) - get_time_us(CLOCK_MONOTONIC);
+
+    if (!open_file())
+    {
+        return false;
+    }
+
+    pthread_condattr_init(&cond_attr);
+    pthread_condattr_setclock(&cond_attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&m_capture_cond, &cond_attr);
+    pthread_condattr_destroy(&cond_attr);
+
+    m_writer_running = true;
+    if (pthread_create(&m_writer_thread, NULL, write_buffers, NULL) != 0)
+    {
+        LOGE("Cannot create capture writer\n");
+        m_writer_running = false;
+        close_file();
+        return false;
+    }
+
+    __atomic_store_n(&m_capturing, true, __ATOMIC_RELEASE);
+    return true;
+}
+
+void Platform_capture_frame(bool from_node, const uint8_t * frame_p, size_t size)
+{
+    capture_buffer_t * front_p;
+    int64_t timestamp_us;
+    size_t block_size;
+    uint8_t * p;
+
+    if (!__atomic_load_n(&m_capturing, __ATOMIC_ACQUIRE))
+    {
+        return;
+    }
+
+    timestamp_us = get_time_us(CLOCK_MONOTONIC) + m_epoch_offset_us;
+    block_size = PCAPNG_EPB_OVERHEAD + PAD_4(size);
+
+    pthread_mutex_lock(&m_capture_mutex);
+
+    front_p = &m_buffers[m_front];
+    if (front_p->used + block_size > CAPTURE_BUFFER_SIZE)
+    {
+        if (m_buffers[m_front ^ 1].used != 0)
+        {
+            // Writer is late, never wait for it
+            m_dropped++;
+            pthread_mutex_unlock(&m_capture_mutex);
+            return;
+        }
+
+        m_front ^= 1;
+        front_p = &m_buffers[m_front];
+        pthread_cond_signal(&m_capture_cond);
+    }
+
+    p = front_p->data + front_p->used;
+    p = put_u32(p, PCAPNG_ENHANCED_PACKET_BLOCK);
+    p = put_u32(p, block_size);
+    p = put_u32(p, 0);
+    p = put_u32(p, (uint32_t) ((uint64_t) timestamp_us >> 32));
+    p = put_u32(p, (uint32_t) timestamp_us);
+    p = put_u32(p, size);
+    p = put_u32(p, size);
+    memcpy(p, frame_p, size);
+    memset(p + size, 0, PAD_4(size) - size);
+    p += PAD_4(size);
+    p = put_u16(p, PCAPNG_OPT_EPB_FLAGS);
+    p = put_u16(p, 4);
+    p = put_u32(p, from_node ? PCAPNG_EPB_FLAGS_INBOUND : PCAPNG_EPB_FLAGS_OUTBOUND);
+    p = put_u32(p, PCAPNG_OPT_ENDOFOPT);
+    p = put_u32(p, block_size);
+    front_p->used += block_size;
+
+    pthread_mutex_unlock(&m_capture_mutex);
+}
+
+void Platform_capture_stop(void)
+{
+    pthread_mutex_lock(&m_capture_mutex);
+    if (!m_writer_running)
+    {
+        pthread_mutex_unlock(&m_capture_mutex);
+        return;
+    }
+    __atomic_store_n(&m_capturing, false, __ATOMIC_RELEASE);
+    m_writer_running = false;
+    pthread_cond_signal(&m_capture_cond);
+    pthread_mutex_unlock(&m_capture_mutex);
+
+    // Buffered frames are written first
+    pthread_join(m_writer_thread, NULL);
+    close_file();
+    pthread_cond_destroy(&m_capture_cond);
+
+    if (m_dropped > 0)
+    {
+        LOGW("%u frames were not captured\n", m_dropped);
+    }
+}
@@ -5,10 +5,13 @@
  */
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 
 #include <stdbool.h>
 #include <string.h>
 #include <time.h>
+#include <unistd.h>
+#include <sys/uio.h>
 
 #include <pthread.h>
 
@@ -88,6 +91,28 @@ static struct LoggingModule *register_logging_module(const char *const module_na
     return NULL;
 }
 
+/**
+ * \brief   Get the full name of a level
+ * \param   level
+ *          Level as a null terminated letter, returned as is if unknown
+ */
+static char * get_full_level(char * level)
+{
+    switch (*level)
+    {
+        case ('D'):
+            return DEBUG;
+        case ('I'):
+            return INFO;
+        case ('W'):
+            return WARNING;
+        case ('E'):
+            return ERROR;
+        default:
+            return level;
+    }
+}
+
 static inline void get_timestamp(char * timestamp)
 {
     struct tm result;
@@ -120,33 +145,548 @@ static inline void print_prefix(char level, char * module)
 {
     // Timestamp should always feat to 23 char, but some margins
     char timestamp[50];
-    char * full_level;
+    char unknown_level[2] = { level, '\0' };
+
+    get_timestamp(timestamp);
+    printf("%s | [%s] %s:", timestamp, get_full_level(unknown_level), module);
+}
+
+/*
+ * Logs are written asynchronously: each thread pushes its messages in its own
+ * lock-free ring and a writer thread adds the prefix and writes them in
+ * batches. Arguments are formatted in the ring by the caller, as they may not
+ * be valid anymore once the log call returns.
+ *
+ * The writer sleeps on a condition when all rings are empty and is only
+ * signaled by a producer if it is idle, so a busy writer costs nothing to the
+ * callers. Errors are written synchronously, after the previous messages of
+ * the same thread, so they are not lost if the process crashes right after.
+ */
+
+// Max size of a message (without prefix), longer ones are truncated
+#define LOG_MESSAGE_MAX_SIZE 256
+
+// Number of messages a thread can have waiting to be written (power of 2).
+// When full, messages are dropped and counted
+#define LOG_RING_SIZE 256
+
+// Max number of threads with a ring, others print their logs directly
+#define MAX_LOG_RINGS 16
+
+// Max number of messages written with a single writev
+#define LOG_WRITE_BATCH 64
+
+// Max size of a prefix: timestamp, level and module name
+#define LOG_PREFIX_MAX_SIZE (48 + MAX_LOG_MODULE_NAME_LENGTH)
+
+typedef struct
+{
+    uint64_t seq;                       //< Order of the message among all threads
+    struct timespec time;               //< Time of the log call
+    char * module;                      //< Module name (string literal)
+    char level;                         //< Log level as a letter
+    uint16_t length;                    //< Length of the message
+    char message[LOG_MESSAGE_MAX_SIZE];
+} log_record_t;
+
+typedef struct
+{
+    uint32_t head;                      //< Next record to write, set by owner
+    uint32_t tail;                      //< Next record to print, set by writer
+    uint32_t dropped;                   //< Messages dropped as ring was full
+    bool closed;                        //< Owner thread has exited
+    log_record_t records[LOG_RING_SIZE];
+} log_ring_t;
+
+// Rings are only added or removed with the mutex held
+static log_ring_t * m_rings[MAX_LOG_RINGS];
+static pthread_mutex_t m_rings_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t m_ring_key;
+
+static __thread log_ring_t * m_ring_p = NULL;
+static __thread bool m_no_ring = false;
+
+static uint64_t m_log_seq = 0;
+
+static pthread_once_t m_writer_once = PTHREAD_ONCE_INIT;
+static pthread_t m_writer_thread;
+static bool m_writer_running = false;
+static bool m_writer_stop = false;
+
+// Protects the sleeps of the writer and of the threads waiting for it
+static pthread_mutex_t m_writer_mutex = PTHREAD_MUTEX_INITIALIZER;
+// Signaled when a message is pushed while the writer is idle
+static pthread_cond_t m_writer_cond = PTHREAD_COND_INITIALIZER;
+// Signaled when messages are written and a thread waits for it
+static pthread_cond_t m_written_cond = PTHREAD_COND_INITIALIZER;
+static bool m_writer_idle = false;
+static uint32_t m_written_waiters = 0;
+
+// Prefix cache of the writer, date only changes once per second
+static time_t m_prefix_second = -1;
+static char m_prefix_date[80];
+
+static size_t format_prefix(const log_record_t * record_p, char * prefix)
+{
+    struct tm result;
+    char unknown_level[2] = { record_p->level, '\0' };
+    int length;
 
-    switch (level)
+    if (record_p->time.tv_sec != m_prefix_second)
     {
-        case ('D'):
-            full_level = DEBUG;
-            break;
-        case ('I'):
-            full_level = INFO;
+        m_prefix_second = record_p->time.tv_sec;
+        localtime_r(&m_prefix_second, &result);
+        snprintf(m_prefix_date,
+                 sizeof(m_prefix_date),
+                 "%04d-%02d-%02d %02d:%02d:%02d",
+                 result.tm_year + 1900,
+                 result.tm_mon + 1,
+                 result.tm_mday,
+                 result.tm_hour,
+                 result.tm_min,
+                 result.tm_sec);
+    }
+
+    length = snprintf(prefix,
+                      LOG_PREFIX_MAX_SIZE,
+                      "%s,%03d | [%s] %s:",
+                      m_prefix_date,
+                      (int) (record_p->time.tv_nsec / 1000000),
+                      get_full_level(unknown_level),
+                      record_p->module);
+
+    if (length < 0)
+    {
+        return 0;
+    }
+    return (length < LOG_PREFIX_MAX_SIZE) ? (size_t) length : LOG_PREFIX_MAX_SIZE - 1;
+}
+
+static void write_all(struct iovec * iov, int iovcnt)
+{
+    while (iovcnt > 0)
+    {
+        ssize_t written = writev(STDOUT_FILENO, iov, iovcnt);
+        if (written < 0)
+        {
+            // Nothing else can be done with logs that cannot be written
+            return;
+        }
+
+        // Skip what is written, it may end in the middle of a buffer
+        while ((iovcnt > 0) && ((size_t) written >= iov->iov_len))
+        {
+            written -= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if (iovcnt > 0)
+        {
+            iov->iov_base = (char *) iov->iov_base + written;
+            iov->iov_len -= written;
+        }
+    }
+}
+
+/**
+ * \brief   Report messages dropped since last call and release rings of
+ *          exited threads that are fully written
+ */
+static void check_rings(void)
+{
+    char report[LOG_PREFIX_MAX_SIZE + 64];
+    log_record_t record = { .level = 'W', .module = LOG_MODULE_NAME };
+    size_t length;
+
+    pthread_mutex_lock(&m_rings_mutex);
+    for (size_t i = 0; i < MAX_LOG_RINGS; i++)
+    {
+        log_ring_t * ring_p = m_rings[i];
+        if (ring_p == NULL)
+        {
+            continue;
+        }
+
+        uint32_t dropped = __atomic_exchange_n(&ring_p->dropped, 0, __ATOMIC_RELAXED);
+        if (dropped > 0)
+        {
+            clock_gettime(CLOCK_REALTIME, &record.time);
+            length = format_prefix(&record, report);
+            snprintf(report + length,
+                     sizeof(report) - length,
+                     "%u log messages dropped\n",
+                     dropped);
+            struct iovec iov = { .iov_base = report, .iov_len = strlen(report) };
+            write_all(&iov, 1);
+        }
+
+        if (__atomic_load_n(&ring_p->closed, __ATOMIC_ACQUIRE)
+            && (__atomic_load_n(&ring_p->head, __ATOMIC_ACQUIRE) == ring_p->tail))
+        {
+            m_rings[i] = NULL;
+            free(ring_p);
+        }
+    }
+    pthread_mutex_unlock(&m_rings_mutex);
+}
+
+/**
+ * \brief   Check if a ring has messages not written yet
+ * \note    Called with m_writer_mutex held, by the writer only
+ */
+static bool has_pending_messages(void)
+{
+    bool pending = false;
+
+    pthread_mutex_lock(&m_rings_mutex);
+    for (size_t i = 0; i < MAX_LOG_RINGS; i++)
+    {
+        if ((m_rings[i] != NULL)
+            && (__atomic_load_n(&m_rings[i]->head, __ATOMIC_ACQUIRE) != m_rings[i]->tail))
+        {
+            pending = true;
             break;
-        case ('W'):
-            full_level = WARNING;
+        }
+    }
+    pthread_mutex_unlock(&m_rings_mutex);
+
+    return pending;
+}
+
+/**
+ * \brief   Wait until a message is pushed or the writer is stopped
+ */
+static void wait_for_messages(void)
+{
+    pthread_mutex_lock(&m_writer_mutex);
+
+    // Producers check the flag after publishing their message: either the
+    // message is seen here or the producer sees the flag and signals
+    __atomic_store_n(&m_writer_idle, true, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (!has_pending_messages() && !__atomic_load_n(&m_writer_stop, __ATOMIC_ACQUIRE))
+    {
+        pthread_cond_wait(&m_writer_cond, &m_writer_mutex);
+    }
+    __atomic_store_n(&m_writer_idle, false, __ATOMIC_RELAXED);
+
+    pthread_mutex_unlock(&m_writer_mutex);
+}
+
+/**
+ * \brief   Wake up the writer if it is waiting for messages
+ * \note    Called after a message is published in a ring
+ */
+static void wake_writer(void)
+{
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&m_writer_idle, __ATOMIC_RELAXED))
+    {
+        pthread_mutex_lock(&m_writer_mutex);
+        pthread_cond_signal(&m_writer_cond);
+        pthread_mutex_unlock(&m_writer_mutex);
+    }
+}
+
+/**
+ * \brief   Wake up the threads waiting for their messages to be written
+ * \note    Called by the writer after tails are updated
+ */
+static void notify_written(void)
+{
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&m_written_waiters, __ATOMIC_RELAXED) > 0)
+    {
+        pthread_mutex_lock(&m_writer_mutex);
+        pthread_cond_broadcast(&m_written_cond);
+        pthread_mutex_unlock(&m_writer_mutex);
+    }
+}
+
+static void * write_logs(void * unused)
+{
+    (void) unused;
+    static char prefixes[LOG_WRITE_BATCH][LOG_PREFIX_MAX_SIZE];
+    struct iovec iov[2 * LOG_WRITE_BATCH];
+    uint32_t taken[MAX_LOG_RINGS];
+    log_ring_t * rings[MAX_LOG_RINGS];
+    size_t count;
+
+    while (true)
+    {
+        // Snapshot of rings, they cannot be released by anybody else
+        pthread_mutex_lock(&m_rings_mutex);
+        memcpy(rings, m_rings, sizeof(rings));
+        pthread_mutex_unlock(&m_rings_mutex);
+        memset(taken, 0, sizeof(taken));
+
+        // Take the oldest message of all rings, until batch is full
+        for (count = 0; count < LOG_WRITE_BATCH; count++)
+        {
+            const log_record_t * oldest_p = NULL;
+            size_t oldest_ring = 0;
+
+            for (size_t i = 0; i < MAX_LOG_RINGS; i++)
+            {
+                if (rings[i] == NULL)
+                {
+                    continue;
+                }
+
+                uint32_t next = rings[i]->tail + taken[i];
+                if (next == __atomic_load_n(&rings[i]->head, __ATOMIC_ACQUIRE))
+                {
+                    continue;
+                }
+
+                const log_record_t * record_p = &rings[i]->records[next % LOG_RING_SIZE];
+                if ((oldest_p == NULL) || (record_p->seq < oldest_p->seq))
+                {
+                    oldest_p = record_p;
+                    oldest_ring = i;
+                }
+            }
+
+            if (oldest_p == NULL)
+            {
+                break;
+            }
+
+            iov[2 * count].iov_base = prefixes[count];
+            iov[2 * count].iov_len = format_prefix(oldest_p, prefixes[count]);
+            iov[2 * count + 1].iov_base = (void *) oldest_p->message;
+            iov[2 * count + 1].iov_len = oldest_p->length;
+            taken[oldest_ring]++;
+        }
+
+        if (count > 0)
+        {
+            // Keep order with what is printed directly
+            fflush(stdout);
+            write_all(iov, 2 * count);
+
+            // Records can now be reused by their owner
+            for (size_t i = 0; i < MAX_LOG_RINGS; i++)
+            {
+                if (taken[i] > 0)
+                {
+                    __atomic_store_n(&rings[i]->tail,
+                                     rings[i]->tail + taken[i],
+                                     __ATOMIC_RELEASE);
+                }
+            }
+            notify_written();
+            continue;
+        }
+
+        check_rings();
+
+        // Everything is written
+        if (__atomic_load_n(&m_writer_stop, __ATOMIC_ACQUIRE))
+        {
             break;
-        case ('E'):
-            full_level = ERROR;
+        }
+
+        wait_for_messages();
+    }
+
+    return NULL;
+}
+
+static void close_ring(void * ring_p)
+{
+    // Released by writer once written
+    __atomic_store_n(&((log_ring_t *) ring_p)->closed, true, __ATOMIC_RELEASE);
+}
+
+static void stop_writer(void)
+{
+    // Pending logs are written before exiting
+    __atomic_store_n(&m_writer_running, false, __ATOMIC_RELEASE);
+    __atomic_store_n(&m_writer_stop, true, __ATOMIC_RELEASE);
+
+    pthread_mutex_lock(&m_writer_mutex);
+    pthread_cond_signal(&m_writer_cond);
+    pthread_mutex_unlock(&m_writer_mutex);
+
+    pthread_join(m_writer_thread, NULL);
+}
+
+static void start_writer(void)
+{
+    if (pthread_key_create(&m_ring_key, close_ring) != 0)
+    {
+        return;
+    }
+
+    if (pthread_create(&m_writer_thread, NULL, write_logs, NULL) != 0)
+    {
+        return;
+    }
+
+    m_writer_running = true;
+    atexit(stop_writer);
+}
+
+static log_ring_t * get_ring(void)
+{
+    log_ring_t * ring_p;
+
+    if ((m_ring_p != NULL) || m_no_ring)
+    {
+        return m_ring_p;
+    }
+
+    // Only done once per thread
+    m_no_ring = true;
+
+    pthread_once(&m_writer_once, start_writer);
+    if (!m_writer_running)
+    {
+        return NULL;
+    }
+
+    ring_p = calloc(1, sizeof(log_ring_t));
+    if (ring_p == NULL)
+    {
+        return NULL;
+    }
+
+    pthread_mutex_lock(&m_rings_mutex);
+    for (size_t i = 0; i < MAX_LOG_RINGS; i++)
+    {
+        if (m_rings[i] == NULL)
+        {
+            m_rings[i] = ring_p;
+            m_ring_p = ring_p;
             break;
-        default:
-            full_level = &level;
+        }
+    }
+    pthread_mutex_unlock(&m_rings_mutex);
+
+    if (m_ring_p == NULL)
+    {
+        free(ring_p);
+        return NULL;
+    }
+
+    pthread_setspecific(m_ring_key, ring_p);
+    m_no_ring = false;
+    return m_ring_p;
+}
+
+/**
+ * \brief   Format a message, truncated to LOG_MESSAGE_MAX_SIZE
+ * \return  Length of the message
+ */
+static uint16_t format_message(char * message, char * format, va_list args)
+{
+    int length = vsnprintf(message, LOG_MESSAGE_MAX_SIZE, format, args);
+
+    if (length < 0)
+    {
+        return 0;
+    }
+    if (length >= LOG_MESSAGE_MAX_SIZE)
+    {
+        length = LOG_MESSAGE_MAX_SIZE - 1;
+        message[length - 1] = '\n';
+    }
+    return (uint16_t) length;
+}
+
+/**
+ * \brief   Wait until all the messages of a ring are written
+ */
+static void wait_ring_written(log_ring_t * ring_p)
+{
+    pthread_mutex_lock(&m_writer_mutex);
+    __atomic_add_fetch(&m_written_waiters, 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    while ((__atomic_load_n(&ring_p->tail, __ATOMIC_ACQUIRE) != ring_p->head)
+           && __atomic_load_n(&m_writer_running, __ATOMIC_ACQUIRE))
+    {
+        pthread_cond_signal(&m_writer_cond);
+        pthread_cond_wait(&m_written_cond, &m_writer_mutex);
     }
+    __atomic_sub_fetch(&m_written_waiters, 1, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&m_writer_mutex);
+}
+
+/**
+ * \brief   Write a message from the calling thread
+ */
+static void write_message_now(char level, char * module, char * format, va_list args)
+{
+    char timestamp[50];
+    char unknown_level[2] = { level, '\0' };
+    char prefix[LOG_PREFIX_MAX_SIZE];
+    char message[LOG_MESSAGE_MAX_SIZE];
+    struct iovec iov[2];
+    int length;
+
     get_timestamp(timestamp);
-    printf("%s | [%s] %s:", timestamp, full_level, module);
+    length = snprintf(prefix,
+                      sizeof(prefix),
+                      "%s | [%s] %s:",
+                      timestamp,
+                      get_full_level(unknown_level),
+                      module);
+    if (length < 0)
+    {
+        length = 0;
+    }
+
+    iov[0].iov_base = prefix;
+    iov[0].iov_len = ((size_t) length < sizeof(prefix)) ? (size_t) length : sizeof(prefix) - 1;
+    iov[1].iov_base = message;
+    iov[1].iov_len = format_message(message, format, args);
+
+    fflush(stdout);
+    write_all(iov, 2);
 }
 
 void Platform_LOG(char level, char * module, char * format, va_list args)
 {
-    print_prefix(level, module);
-    vprintf(format, args);
+    log_ring_t * ring_p = get_ring();
+    log_record_t * record_p;
+    uint32_t head;
+
+    if ((ring_p == NULL) || !__atomic_load_n(&m_writer_running, __ATOMIC_ACQUIRE))
+    {
+        print_prefix(level, module);
+        vprintf(format, args);
+        return;
+    }
+
+    if (level == 'E')
+    {
+        // Keep the order with the previous messages of this thread
+        if (__atomic_load_n(&ring_p->tail, __ATOMIC_ACQUIRE) != ring_p->head)
+        {
+            wait_ring_written(ring_p);
+        }
+        write_message_now(level, module, format, args);
+        return;
+    }
+
+    head = ring_p->head;
+    if (head - __atomic_load_n(&ring_p->tail, __ATOMIC_ACQUIRE) == LOG_RING_SIZE)
+    {
+        // Never wait for the writer
+        __atomic_fetch_add(&ring_p->dropped, 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    record_p = &ring_p->records[head % LOG_RING_SIZE];
+    clock_gettime(CLOCK_REALTIME, &record_p->time);
+    record_p->seq = __atomic_fetch_add(&m_log_seq, 1, __ATOMIC_RELAXED);
+    record_p->module = module;
+    record_p->level = level;
+    record_p->length = format_message(record_p->message, format, args);
+
+    __atomic_store_n(&ring_p->head, head + 1, __ATOMIC_RELEASE);
+    wake_writer();
 }
 
 void Platform_print_buffer(uint8_t * buffer, int size)
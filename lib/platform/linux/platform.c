@@ -4,8 +4,10 @@
  *
  */
 #include <errno.h>
+#include <limits.h>
 #include <stdbool.h>
 #include <stdlib.h>
+#include <string.h>
 #include <pthread.h>
 #include <signal.h>
 #include <unistd.h>
@@ -71,6 +73,7 @@ typedef struct
 {
     wpc_frame_t frame;                      //< The received frame
     unsigned long long timestamp_ms_epoch;  //< The timestamp of reception
+    unsigned long long timestamp_us;        //< Same, monotonic
 } timestamped_frame_t;
 
 // Indications queue
@@ -89,6 +92,50 @@ static bool m_queue_empty = true;
 static pthread_mutex_t m_queue_mutex;
 static pthread_cond_t m_queue_not_empty_cond = PTHREAD_COND_INITIALIZER;
 
+/*****************************************************************************/
+/*                Background worker related variables                        */
+/*****************************************************************************/
+
+// Maximum number of distinct works pending at the same time on a worker.
+// The shared worker of Platform_schedule_work only has short works (end of an
+// asynchronous stop and sink clock sampling), modules doing long sequences
+// of requests to the node use their own worker
+#define MAX_NUMBER_PENDING_WORKS 4
+
+// Struct that describes a work waiting for execution
+typedef struct
+{
+    Platform_work_f work;            //< The work to execute, NULL if slot is free
+    unsigned long long deadline_ms;  //< Monotonic timestamp to execute it
+} pending_work_t;
+
+struct platform_worker
+{
+    pending_work_t pending_works[MAX_NUMBER_PENDING_WORKS]; //< Works waiting for execution
+    pthread_t thread;                   //< Thread executing the works
+    bool running;                       //< Set to false to stop the thread
+    pthread_mutex_t mutex;              //< Protects the pending works
+    pthread_cond_t cond;                //< On monotonic clock
+    struct platform_worker * next_p;    //< Next created worker
+};
+
+// Worker used by Platform_schedule_work
+static struct platform_worker m_shared_worker;
+
+// Workers created with Platform_worker_create, stopped with the platform
+static struct platform_worker * m_workers_p = NULL;
+static pthread_mutex_t m_workers_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+struct platform_mutex
+{
+    pthread_mutex_t mutex;
+};
+
+struct platform_condition
+{
+    pthread_cond_t cond;
+};
+
 /*****************************************************************************/
 /*                Dispatch indication Thread implementation                  */
 /*****************************************************************************/
@@ -128,7 +175,7 @@ static void * dispatch_indication(void * unused)
         pthread_mutex_unlock(&m_queue_mutex);
 
         // Dispatch the indication
-        m_dispatch_indication_f(&ind->frame, ind->timestamp_ms_epoch);
+        m_dispatch_indication_f(&ind->frame, ind->timestamp_ms_epoch, ind->timestamp_us);
 
         // Take the lock back to update empty status and wait on cond again in
         // next loop iteration
@@ -149,7 +196,9 @@ static void * dispatch_indication(void * unused)
 /*****************************************************************************/
 /*                Polling Thread implementation                              */
 /*****************************************************************************/
-static void onIndicationReceivedLocked(wpc_frame_t * frame, unsigned long long timestamp_ms)
+static void onIndicationReceivedLocked(wpc_frame_t * frame,
+                                       unsigned long long timestamp_ms,
+                                       unsigned long long timestamp_us)
 {
     LOGD("Frame received with timestamp = %lld\n", timestamp_ms);
     pthread_mutex_lock(&m_queue_mutex);
@@ -166,6 +215,7 @@ static void onIndicationReceivedLocked(wpc_frame_t * frame, unsigned long long t
         timestamped_frame_t * ind = &m_indications_queue[m_ind_queue_write];
         memcpy(&ind->frame, frame, sizeof(wpc_frame_t));
         ind->timestamp_ms_epoch = timestamp_ms;
+        ind->timestamp_us = timestamp_us;
 
         m_ind_queue_write = (m_ind_queue_write + 1) % MAX_NUMBER_INDICATION_QUEUE;
         // At least one indication ready, signal it
@@ -327,12 +377,342 @@ unsigned long long Platform_get_timestamp_ms_monotonic()
     return ((unsigned long long) spec.tv_sec) * 1000 + (spec.tv_nsec) / 1000 / 1000;
 }
 
+unsigned long long Platform_get_timestamp_us_monotonic()
+{
+    struct timespec spec;
+
+    // Raw clock is not slewed by NTP, so durations between frames are exact
+    clock_gettime(CLOCK_MONOTONIC_RAW, &spec);
+    return ((unsigned long long) spec.tv_sec) * 1000 * 1000 + (spec.tv_nsec) / 1000;
+}
+
+unsigned long long Platform_timestamp_us_monotonic_to_epoch(unsigned long long timestamp_us)
+{
+    struct timespec before, epoch, after;
+    unsigned long long before_us, epoch_us, after_us;
+
+    // Epoch clock is read between two reads of the monotonic one, so the
+    // offset is taken at the middle of them
+    clock_gettime(CLOCK_MONOTONIC_RAW, &before);
+    clock_gettime(CLOCK_REALTIME, &epoch);
+    clock_gettime(CLOCK_MONOTONIC_RAW, &after);
+
+    before_us = ((unsigned long long) before.tv_sec) * 1000 * 1000 + before.tv_nsec / 1000;
+    epoch_us = ((unsigned long long) epoch.tv_sec) * 1000 * 1000 + epoch.tv_nsec / 1000;
+    after_us = ((unsigned long long) after.tv_sec) * 1000 * 1000 + after.tv_nsec / 1000;
+
+    return epoch_us - (before_us + (after_us - before_us) / 2 - timestamp_us);
+}
+
+void Platform_usleep(unsigned int time_us)
+{
+    usleep(time_us);
+}
+
+uintptr_t Platform_get_thread_id(void)
+{
+    return (uintptr_t) pthread_self();
+}
+
 void * Platform_malloc(size_t size)
 {
     LOGD("M: %d\n", size);
     return malloc(size);
 }
 
+/*****************************************************************************/
+/*                Background worker Thread implementation                    */
+/*****************************************************************************/
+/**
+ * \brief   Thread to execute scheduled works once their debounce window
+ *          is elapsed
+ */
+static void * execute_works(void * arg)
+{
+    struct platform_worker * worker_p = arg;
+
+    pthread_mutex_lock(&worker_p->mutex);
+    while (worker_p->running)
+    {
+        unsigned long long now = Platform_get_timestamp_ms_monotonic();
+        unsigned long long next_deadline_ms = ULLONG_MAX;
+        Platform_work_f work = NULL;
+
+        for (unsigned int i = 0; i < MAX_NUMBER_PENDING_WORKS; i++)
+        {
+            pending_work_t * pending_p = &worker_p->pending_works[i];
+
+            if (pending_p->work == NULL)
+            {
+                continue;
+            }
+
+            if (pending_p->deadline_ms <= now)
+            {
+                work = pending_p->work;
+                pending_p->work = NULL;
+                break;
+            }
+
+            if (pending_p->deadline_ms < next_deadline_ms)
+            {
+                next_deadline_ms = pending_p->deadline_ms;
+            }
+        }
+
+        if (work != NULL)
+        {
+            // Execute it unlocked, so it can be scheduled again meanwhile
+            pthread_mutex_unlock(&worker_p->mutex);
+            work();
+            pthread_mutex_lock(&worker_p->mutex);
+        }
+        else if (next_deadline_ms == ULLONG_MAX)
+        {
+            pthread_cond_wait(&worker_p->cond, &worker_p->mutex);
+        }
+        else
+        {
+            struct timespec ts;
+            ts.tv_sec = next_deadline_ms / 1000;
+            ts.tv_nsec = (next_deadline_ms % 1000) * 1000 * 1000;
+            pthread_cond_timedwait(&worker_p->cond, &worker_p->mutex, &ts);
+        }
+    }
+    pthread_mutex_unlock(&worker_p->mutex);
+
+    LOGD("Exiting worker thread\n");
+    return NULL;
+}
+
+/**
+ * \brief   Initialize a worker and start its thread
+ */
+static bool start_worker(struct platform_worker * worker_p)
+{
+    pthread_condattr_t cond_attr;
+    pthread_condattr_init(&cond_attr);
+    pthread_condattr_setclock(&cond_attr, CLOCK_MONOTONIC);
+
+    memset(worker_p->pending_works, 0, sizeof(worker_p->pending_works));
+
+    if (pthread_mutex_init(&worker_p->mutex, NULL) != 0)
+    {
+        LOGE("Worker Mutex init failed\n");
+        return false;
+    }
+
+    if (pthread_cond_init(&worker_p->cond, &cond_attr) != 0)
+    {
+        LOGE("Worker condition init failed\n");
+        pthread_mutex_destroy(&worker_p->mutex);
+        return false;
+    }
+
+    worker_p->running = true;
+    if (pthread_create(&worker_p->thread, NULL, execute_works, worker_p) != 0)
+    {
+        LOGE("Cannot create worker thread\n");
+        worker_p->running = false;
+        pthread_cond_destroy(&worker_p->cond);
+        pthread_mutex_destroy(&worker_p->mutex);
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * \brief   Stop the thread of a worker, pending works are dropped
+ * \note    Nothing is done if already stopped
+ */
+static void stop_worker(struct platform_worker * worker_p)
+{
+    bool was_running;
+
+    pthread_mutex_lock(&worker_p->mutex);
+    was_running = worker_p->running;
+    worker_p->running = false;
+    for (unsigned int i = 0; i < MAX_NUMBER_PENDING_WORKS; i++)
+    {
+        worker_p->pending_works[i].work = NULL;
+    }
+    pthread_cond_signal(&worker_p->cond);
+    pthread_mutex_unlock(&worker_p->mutex);
+
+    // Wait for the work in progress to finish
+    if (was_running && !pthread_equal(pthread_self(), worker_p->thread))
+    {
+        pthread_join(worker_p->thread, NULL);
+    }
+}
+
+static bool schedule_work(struct platform_worker * worker_p,
+                          Platform_work_f work,
+                          unsigned int delay_ms)
+{
+    int free_slot = -1;
+    bool res = false;
+
+    pthread_mutex_lock(&worker_p->mutex);
+    if (worker_p->running)
+    {
+        for (int i = 0; i < MAX_NUMBER_PENDING_WORKS; i++)
+        {
+            if (worker_p->pending_works[i].work == work)
+            {
+                // Already pending, merged with it
+                free_slot = -1;
+                res = true;
+                break;
+            }
+
+            if ((worker_p->pending_works[i].work == NULL) && (free_slot < 0))
+            {
+                free_slot = i;
+            }
+        }
+
+        if (free_slot >= 0)
+        {
+            worker_p->pending_works[free_slot].work = work;
+            worker_p->pending_works[free_slot].deadline_ms =
+                Platform_get_timestamp_ms_monotonic() + delay_ms;
+            pthread_cond_signal(&worker_p->cond);
+            res = true;
+        }
+    }
+    pthread_mutex_unlock(&worker_p->mutex);
+
+    if (!res)
+    {
+        LOGW("Cannot schedule work\n");
+    }
+    return res;
+}
+
+bool Platform_schedule_work(Platform_work_f work, unsigned int delay_ms)
+{
+    return schedule_work(&m_shared_worker, work, delay_ms);
+}
+
+platform_worker_t * Platform_worker_create(void)
+{
+    struct platform_worker * worker_p = malloc(sizeof(struct platform_worker));
+
+    if (worker_p == NULL)
+    {
+        return NULL;
+    }
+
+    if (!start_worker(worker_p))
+    {
+        free(worker_p);
+        return NULL;
+    }
+
+    pthread_mutex_lock(&m_workers_mutex);
+    worker_p->next_p = m_workers_p;
+    m_workers_p = worker_p;
+    pthread_mutex_unlock(&m_workers_mutex);
+
+    return worker_p;
+}
+
+bool Platform_worker_schedule(platform_worker_t * worker_p,
+                              Platform_work_f work,
+                              unsigned int delay_ms)
+{
+    return schedule_work(worker_p, work, delay_ms);
+}
+
+void Platform_worker_delete(platform_worker_t * worker_p)
+{
+    struct platform_worker ** next_pp;
+
+    pthread_mutex_lock(&m_workers_mutex);
+    for (next_pp = &m_workers_p; *next_pp != NULL; next_pp = &(*next_pp)->next_p)
+    {
+        if (*next_pp == worker_p)
+        {
+            *next_pp = worker_p->next_p;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&m_workers_mutex);
+
+    // Already done if the platform is closed
+    stop_worker(worker_p);
+
+    pthread_cond_destroy(&worker_p->cond);
+    pthread_mutex_destroy(&worker_p->mutex);
+    free(worker_p);
+}
+
+/*****************************************************************************/
+/*                Synchronization primitives                                 */
+/*****************************************************************************/
+platform_mutex_t * Platform_mutex_create(void)
+{
+    struct platform_mutex * mutex_p = malloc(sizeof(struct platform_mutex));
+
+    if ((mutex_p != NULL) && (pthread_mutex_init(&mutex_p->mutex, NULL) != 0))
+    {
+        free(mutex_p);
+        mutex_p = NULL;
+    }
+    return mutex_p;
+}
+
+void Platform_mutex_lock(platform_mutex_t * mutex_p)
+{
+    pthread_mutex_lock(&mutex_p->mutex);
+}
+
+bool Platform_mutex_trylock(platform_mutex_t * mutex_p)
+{
+    return pthread_mutex_trylock(&mutex_p->mutex) == 0;
+}
+
+void Platform_mutex_unlock(platform_mutex_t * mutex_p)
+{
+    pthread_mutex_unlock(&mutex_p->mutex);
+}
+
+void Platform_mutex_delete(platform_mutex_t * mutex_p)
+{
+    pthread_mutex_destroy(&mutex_p->mutex);
+    free(mutex_p);
+}
+
+platform_condition_t * Platform_condition_create(void)
+{
+    struct platform_condition * cond_p = malloc(sizeof(struct platform_condition));
+
+    if ((cond_p != NULL) && (pthread_cond_init(&cond_p->cond, NULL) != 0))
+    {
+        free(cond_p);
+        cond_p = NULL;
+    }
+    return cond_p;
+}
+
+void Platform_condition_wait(platform_condition_t * cond_p, platform_mutex_t * mutex_p)
+{
+    pthread_cond_wait(&cond_p->cond, &mutex_p->mutex);
+}
+
+void Platform_condition_broadcast(platform_condition_t * cond_p)
+{
+    pthread_cond_broadcast(&cond_p->cond);
+}
+
+void Platform_condition_delete(platform_condition_t * cond_p)
+{
+    pthread_cond_destroy(&cond_p->cond);
+    free(cond_p);
+}
+
 void Platform_free(void *ptr, size_t size)
 {
     (void) size;
@@ -392,8 +772,16 @@ bool Platform_init(Platform_get_indication_f get_indication_f,
         goto error4;
     }
 
+    // Start a thread to execute scheduled works
+    if (!start_worker(&m_shared_worker))
+    {
+        goto error5;
+    }
+
     return true;
 
+error5:
+    pthread_kill(thread_dispatch, SIGKILL);
 error4:
     pthread_kill(thread_polling, SIGKILL);
 error3:
@@ -430,6 +818,24 @@ void Platform_close()
         pthread_join(thread_dispatch, &res);
     }
 
+    // Stop our worker threads, pending works are dropped. Created workers
+    // are only released when deleted by their owner
+    stop_worker(&m_shared_worker);
+    pthread_cond_destroy(&m_shared_worker.cond);
+    pthread_mutex_destroy(&m_shared_worker.mutex);
+
+    pthread_mutex_lock(&m_workers_mutex);
+    for (struct platform_worker * worker_p = m_workers_p;
+         worker_p != NULL;
+         worker_p = worker_p->next_p)
+    {
+        stop_worker(worker_p);
+    }
+    pthread_mutex_unlock(&m_workers_mutex);
+
+    // Frames exchanged until now are kept
+    Platform_capture_stop();
+
     // Destroy our mutexes
     pthread_mutex_destroy(&m_queue_mutex);
     pthread_mutex_destroy(&sending_mutex);
@@ -125,6 +125,31 @@ int Serial_open(const char * port_name, unsigned long bitrate)
     return int_open();
 }
 
+int Serial_set_bitrate(unsigned long bitrate)
+{
+    if (fd < 0)
+    {
+        LOGE("No serial link opened\n");
+        return -1;
+    }
+
+    // Let the current output go at the current bitrate
+    tcdrain(fd);
+
+    if (Serial_set_termios2_bitrate(fd, bitrate) != 0)
+    {
+        return -1;
+    }
+
+    // Anything received during the change is garbage
+    tcflush(fd, TCIFLUSH);
+
+    // Keep it in case the link has to be reopened
+    m_bitrate = bitrate;
+    LOGI("Bitrate changed to %lu\n", bitrate);
+    return 0;
+}
+
 int Serial_close()
 {
     if (fd < 0)
@@ -15,9 +15,12 @@
  *          The received indication
  * \param   timestamp_ms
  *          Timestamp of teh received indication
+ * \param   timestamp_us
+ *          Same timestamp from \ref Platform_get_timestamp_us_monotonic
  */
 typedef void (*onIndicationReceivedLocked_cb_f)(wpc_frame_t * frame,
-                                                unsigned long long timestamp_ms);
+                                                unsigned long long timestamp_ms,
+                                                unsigned long long timestamp_us);
 
 /**
  * \brief   Function to retrieved indication
@@ -39,10 +42,15 @@ typedef int (*Platform_get_indication_f)(unsigned int max_ind, onIndicationRecei
  *          The indication to dispatch
  * \param   timestamp_ms
  *          The timestamp of this indication reception
+ * \param   timestamp_us
+ *          Same timestamp from \ref Platform_get_timestamp_us_monotonic,
+ *          used to measure delays
  * \note    It is up to the platform implementation to call this method at
  *          the right place
  */
-typedef void (*Platform_dispatch_indication_f)(wpc_frame_t * frame, unsigned long long timestamp_ms);
+typedef void (*Platform_dispatch_indication_f)(wpc_frame_t * frame,
+                                               unsigned long long timestamp_ms,
+                                               unsigned long long timestamp_us);
 
 /**
  * \brief   Initialization of the platform part
@@ -74,6 +82,37 @@ unsigned long long Platform_get_timestamp_ms_epoch();
  */
 unsigned long long Platform_get_timestamp_ms_monotonic();
 
+/**
+ * \brief   Get a monotonic timestamp in us, not slewed by time adjustments
+ *          (CLOCK_MONOTONIC_RAW on linux)
+ * \return  Monotonic timestamp when the call to this function is made
+ */
+unsigned long long Platform_get_timestamp_us_monotonic();
+
+/**
+ * \brief   Convert a timestamp from \ref Platform_get_timestamp_us_monotonic
+ *          into a timestamp in us since epoch
+ * \param   timestamp_us
+ *          The monotonic timestamp to convert
+ * \return  Timestamp in us since epoch
+ * \note    Current offset between the two clocks is used, so conversion is
+ *          only accurate for recent timestamps
+ */
+unsigned long long Platform_timestamp_us_monotonic_to_epoch(unsigned long long timestamp_us);
+
+/**
+ * \brief   Suspend the calling context
+ * \param   time_us
+ *          Duration to sleep in microseconds
+ */
+void Platform_usleep(unsigned int time_us);
+
+/**
+ * \brief   Get an identifier of the calling context (thread)
+ * \return  Identifier of the context, distinct for each running context
+ */
+uintptr_t Platform_get_thread_id(void);
+
 /**
  * \brief  Call at the beginning of a locked section to send a request
  * \Note   It is up to the platform implementation to see if
@@ -108,6 +147,171 @@ void * Platform_malloc(size_t size);
  */
 void Platform_free(void *ptr, size_t size);
 
+/**
+ * \brief   Function prototype of a work executed by \ref Platform_schedule_work
+ */
+typedef void (*Platform_work_f)(void);
+
+/**
+ * \brief   Schedule a work to be executed in a background context, out of
+ *          the indication dispatching context
+ * \param   work
+ *          The work to execute
+ * \param   delay_ms
+ *          Debounce window. The work is executed delay_ms after the first
+ *          request and all the requests for the same work received in the
+ *          meantime are merged into this single execution
+ * \return  True if the work is scheduled or merged with a pending one, false
+ *          otherwise (it is then up to the caller to execute it directly)
+ * \note    A request received while the work is executing schedules a new
+ *          execution
+ */
+bool Platform_schedule_work(Platform_work_f work, unsigned int delay_ms);
+
+/**
+ * \brief   Background context with its own queue of works, for modules whose
+ *          works must not wait for the ones of other modules
+ */
+typedef struct platform_worker platform_worker_t;
+
+/**
+ * \brief   Create a background worker
+ * \return  The worker, NULL if it cannot be created
+ * \note    Workers are stopped by \ref Platform_close, works scheduled after
+ *          it are refused
+ */
+platform_worker_t * Platform_worker_create(void);
+
+/**
+ * \brief   Schedule a work on a given worker
+ * \param   worker_p
+ *          Worker created with \ref Platform_worker_create
+ * \param   work
+ *          The work to execute
+ * \param   delay_ms
+ *          Debounce window, same as \ref Platform_schedule_work
+ * \return  True if the work is scheduled or merged with a pending one, false
+ *          otherwise
+ */
+bool Platform_worker_schedule(platform_worker_t * worker_p,
+                              Platform_work_f work,
+                              unsigned int delay_ms);
+
+/**
+ * \brief   Delete a worker, its pending works are dropped
+ * \param   worker_p
+ *          Worker created with \ref Platform_worker_create
+ * \note    Waits for the work in progress, so it must not be called from
+ *          a work of this worker
+ */
+void Platform_worker_delete(platform_worker_t * worker_p);
+
+/**
+ * \brief   Mutex to protect data shared between contexts
+ */
+typedef struct platform_mutex platform_mutex_t;
+
+/**
+ * \brief   Create a mutex
+ * \return  The mutex, NULL if it cannot be created
+ */
+platform_mutex_t * Platform_mutex_create(void);
+
+/**
+ * \brief   Lock a mutex, waiting for it if locked by another context
+ * \param   mutex_p
+ *          Mutex created with \ref Platform_mutex_create
+ */
+void Platform_mutex_lock(platform_mutex_t * mutex_p);
+
+/**
+ * \brief   Lock a mutex only if it is free
+ * \param   mutex_p
+ *          Mutex created with \ref Platform_mutex_create
+ * \return  True if the mutex is locked by the caller
+ */
+bool Platform_mutex_trylock(platform_mutex_t * mutex_p);
+
+/**
+ * \brief   Unlock a mutex locked by the caller
+ * \param   mutex_p
+ *          Mutex created with \ref Platform_mutex_create
+ */
+void Platform_mutex_unlock(platform_mutex_t * mutex_p);
+
+/**
+ * \brief   Delete an unlocked mutex
+ * \param   mutex_p
+ *          Mutex created with \ref Platform_mutex_create
+ */
+void Platform_mutex_delete(platform_mutex_t * mutex_p);
+
+/**
+ * \brief   Condition to wait for a change of data protected by a mutex
+ */
+typedef struct platform_condition platform_condition_t;
+
+/**
+ * \brief   Create a condition
+ * \return  The condition, NULL if it cannot be created
+ */
+platform_condition_t * Platform_condition_create(void);
+
+/**
+ * \brief   Wait for the condition to be signaled
+ * \param   cond_p
+ *          Condition created with \ref Platform_condition_create
+ * \param   mutex_p
+ *          Mutex locked by the caller, released during the wait
+ * \note    Wake up can be spurious, caller must check its data again
+ */
+void Platform_condition_wait(platform_condition_t * cond_p, platform_mutex_t * mutex_p);
+
+/**
+ * \brief   Wake up all the contexts waiting for the condition
+ * \param   cond_p
+ *          Condition created with \ref Platform_condition_create
+ */
+void Platform_condition_broadcast(platform_condition_t * cond_p);
+
+/**
+ * \brief   Delete a condition nobody waits for
+ * \param   cond_p
+ *          Condition created with \ref Platform_condition_create
+ */
+void Platform_condition_delete(platform_condition_t * cond_p);
+
+/**
+ * \brief   Start capturing the frames exchanged with the node in pcapng files
+ * \param   path
+ *          Path of the capture files, an index is appended to it for each file
+ * \param   max_file_size
+ *          Size of a file before starting a new one
+ * \param   max_files
+ *          Number of files kept, the oldest one is removed when a new one is
+ *          started
+ * \return  True if capture is started, false otherwise
+ */
+bool Platform_capture_start(const char * path, size_t max_file_size, unsigned int max_files);
+
+/**
+ * \brief   Add a frame to the capture, if started
+ * \param   from_node
+ *          True if the frame is received from the node, false if sent to it
+ * \param   frame_p
+ *          The frame, without slip encoding and crc
+ * \param   size
+ *          Size of the frame
+ * \note    Frame is dropped if it cannot be buffered, caller never waits for
+ *          the file to be written
+ */
+void Platform_capture_frame(bool from_node, const uint8_t * frame_p, size_t size);
+
+/**
+ * \brief   Stop the capture and write the buffered frames
+ */
+void Platform_capture_stop(void);
+
 void Platform_close();
 
 #endif /* PLATFORM_H_ */
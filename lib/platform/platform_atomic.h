@@ -0,0 +1,80 @@
+/* Wirepas Oy licensed under Apache License, Version 2.0
+ *
+ * See file LICENSE for full license details.
+ *
+ */
+#ifndef PLATFORM_ATOMIC_H_
+#define PLATFORM_ATOMIC_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Atomic operations used by the library to share data between the
+ * dispatching thread and the API callers without lock. They map to the GCC
+ * __atomic builtins (also provided by clang), a toolchain without them only
+ * has to redefine this file.
+ */
+
+/* Memory orders */
+#define PLATFORM_RELAXED    __ATOMIC_RELAXED
+#define PLATFORM_ACQUIRE    __ATOMIC_ACQUIRE
+#define PLATFORM_RELEASE    __ATOMIC_RELEASE
+#define PLATFORM_SEQ_CST    __ATOMIC_SEQ_CST
+
+#define Platform_atomic_load(ptr, order)                __atomic_load_n((ptr), (order))
+#define Platform_atomic_store(ptr, value, order)        __atomic_store_n((ptr), (value), (order))
+#define Platform_atomic_exchange(ptr, value, order)     __atomic_exchange_n((ptr), (value), (order))
+#define Platform_atomic_fetch_add(ptr, value, order)    __atomic_fetch_add((ptr), (value), (order))
+#define Platform_atomic_add_fetch(ptr, value, order)    __atomic_add_fetch((ptr), (value), (order))
+#define Platform_atomic_sub_fetch(ptr, value, order)    __atomic_sub_fetch((ptr), (value), (order))
+#define Platform_atomic_fence(order)                    __atomic_thread_fence(order)
+
+/**
+ * \brief   Replace the value if it is still the expected one
+ * \note    On failure the current value is stored in *expected_p, loaded
+ *          with failure_order
+ */
+#define Platform_atomic_compare_exchange(ptr, expected_p, desired, order, failure_order) \
+    __atomic_compare_exchange_n((ptr), (expected_p), (desired), false, (order), (failure_order))
+
+/*
+ * Sequence lock: data with a single writer, copied by readers that never
+ * block it. The counter is odd while the data is written and readers retry
+ * their copy if it changed meanwhile:
+ *
+ *     Platform_seqlock_write_begin(&seq);         do
+ *     ... write data ...                          {
+ *     Platform_seqlock_write_end(&seq);               s = Platform_seqlock_read_begin(&seq);
+ *                                                     ... copy data ...
+ *                                                 } while (Platform_seqlock_read_retry(&seq, s));
+ */
+
+static inline void Platform_seqlock_write_begin(uint32_t * seq_p)
+{
+    Platform_atomic_store(seq_p, *seq_p + 1, PLATFORM_RELAXED);
+    Platform_atomic_fence(PLATFORM_RELEASE);
+}
+
+static inline void Platform_seqlock_write_end(uint32_t * seq_p)
+{
+    Platform_atomic_store(seq_p, *seq_p + 1, PLATFORM_RELEASE);
+}
+
+static inline uint32_t Platform_seqlock_read_begin(const uint32_t * seq_p)
+{
+    uint32_t seq;
+
+    // Writer only holds the data for a few instructions
+    while ((seq = Platform_atomic_load(seq_p, PLATFORM_ACQUIRE)) & 1)
+        ;
+    return seq;
+}
+
+static inline bool Platform_seqlock_read_retry(const uint32_t * seq_p, uint32_t seq)
+{
+    Platform_atomic_fence(PLATFORM_ACQUIRE);
+    return Platform_atomic_load(seq_p, PLATFORM_RELAXED) != seq;
+}
+
+#endif /* PLATFORM_ATOMIC_H_ */
@@ -20,6 +20,16 @@
  */
 int Serial_open(const char * port_name, unsigned long bitrate);
 
+/**
+ * \brief   Change the bitrate of the opened serial link
+ * \param   bitrate
+ *          New bitrate in bits per second
+ * \return  0 if success, -1 otherwise
+ * \note    Pending output is sent at the previous bitrate and pending input
+ *          is dropped before the change
+ */
+int Serial_set_bitrate(unsigned long bitrate);
+
 /**
  * \brief   Close a serial link previously opened with Serial_open
  * \return  0 if success, -1 otherwise
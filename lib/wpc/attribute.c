@@ -10,12 +10,135 @@
 #include "attribute.h"
 #include "wpc_types.h"
 #include "wpc_internal.h"
+#include "platform.h"
 #include "string.h"
 
-int attribute_write_request(uint8_t primitive_id,
-                            uint16_t attribute_id,
-                            uint8_t attribute_length,
-                            const uint8_t * attribute_value_p)
+/**
+ * \brief   Entry of the attribute cache
+ */
+typedef struct
+{
+    uint8_t read_primitive_id;            //< CSAP or MSAP read primitive
+    uint16_t attribute_id;                //< Attribute id
+    attribute_volatility_e volatility;    //< Caching policy for this attribute
+    bool valid;                           //< Is value valid
+    uint8_t length;                       //< Length of cached value
+    uint8_t value[MAX_ATTRIBUTE_SIZE];    //< Cached value
+} attribute_cache_entry_t;
+
+#define CACHE_ENTRY(primitive, id, volatility) \
+    {                                          \
+        primitive, id, volatility, false, 0, { 0 } \
+    }
+
+/**
+ * \brief   Attributes that can be cached and their default policy
+ *          Attributes not listed here are always read from the node
+ */
+static attribute_cache_entry_t m_cache[] = {
+    CACHE_ENTRY(CSAP_ATTRIBUTE_READ_REQUEST, C_NODE_ADDRESS_ID, ATTRIBUTE_CACHE_UNTIL_REBOOT),
+    CACHE_ENTRY(CSAP_ATTRIBUTE_READ_REQUEST, C_NETWORK_ADDRESS_ID, ATTRIBUTE_CACHE_UNTIL_REBOOT),
+    CACHE_ENTRY(CSAP_ATTRIBUTE_READ_REQUEST, C_NETWORK_CHANNEL_ID, ATTRIBUTE_CACHE_UNTIL_REBOOT),
+    CACHE_ENTRY(CSAP_ATTRIBUTE_READ_REQUEST, C_NODE_ROLE_ID, ATTRIBUTE_CACHE_UNTIL_REBOOT),
+    CACHE_ENTRY(CSAP_ATTRIBUTE_READ_REQUEST, C_MTU_ID, ATTRIBUTE_CACHE_UNTIL_REBOOT),
+    CACHE_ENTRY(CSAP_ATTRIBUTE_READ_REQUEST, C_PDU_BUFFER_SIZE_ID, ATTRIBUTE_CACHE_UNTIL_REBOOT),
+    CACHE_ENTRY(CSAP_ATTRIBUTE_READ_REQUEST, C_MESH_API_VER_ID, ATTRIBUTE_CACHE_UNTIL_REBOOT),
+    CACHE_ENTRY(CSAP_ATTRIBUTE_READ_REQUEST, C_FIRMWARE_MAJOR_ID, ATTRIBUTE_CACHE_UNTIL_REBOOT),
+    CACHE_ENTRY(CSAP_ATTRIBUTE_READ_REQUEST, C_FIRMWARE_MINOR_ID, ATTRIBUTE_CACHE_UNTIL_REBOOT),
+    CACHE_ENTRY(CSAP_ATTRIBUTE_READ_REQUEST, C_FIRMWARE_MAINT_ID, ATTRIBUTE_CACHE_UNTIL_REBOOT),
+    CACHE_ENTRY(CSAP_ATTRIBUTE_READ_REQUEST, C_FIRMWARE_DEV_ID, ATTRIBUTE_CACHE_UNTIL_REBOOT),
+    CACHE_ENTRY(CSAP_ATTRIBUTE_READ_REQUEST, C_CHANNEL_LIM_ID, ATTRIBUTE_CACHE_UNTIL_REBOOT),
+    CACHE_ENTRY(CSAP_ATTRIBUTE_READ_REQUEST, C_APP_CONFIG_DATA_SIZE_ID, ATTRIBUTE_CACHE_UNTIL_REBOOT),
+    CACHE_ENTRY(CSAP_ATTRIBUTE_READ_REQUEST, C_HW_MAGIC, ATTRIBUTE_CACHE_UNTIL_REBOOT),
+    CACHE_ENTRY(CSAP_ATTRIBUTE_READ_REQUEST, C_STACK_PROFILE, ATTRIBUTE_CACHE_UNTIL_REBOOT),
+    CACHE_ENTRY(CSAP_ATTRIBUTE_READ_REQUEST, C_SCRATCHPAD_SEQUENCE_ID, ATTRIBUTE_CACHE_NONE),
+    CACHE_ENTRY(MSAP_ATTRIBUTE_READ_REQUEST, MSAP_AUTOSTART, ATTRIBUTE_CACHE_UNTIL_REBOOT),
+    CACHE_ENTRY(MSAP_ATTRIBUTE_READ_REQUEST, MSAP_ACCESS_CYCLE_RANGE, ATTRIBUTE_CACHE_UNTIL_REBOOT),
+    CACHE_ENTRY(MSAP_ATTRIBUTE_READ_REQUEST, MSAP_ACCESS_CYCLE_LIMITS, ATTRIBUTE_CACHE_UNTIL_REBOOT),
+    CACHE_ENTRY(MSAP_ATTRIBUTE_READ_REQUEST, MSAP_SCRATCHPAD_BLOCK_MAX, ATTRIBUTE_CACHE_UNTIL_REBOOT),
+    CACHE_ENTRY(MSAP_ATTRIBUTE_READ_REQUEST, MSAP_SCRATCHPAD_NUM_BYTES, ATTRIBUTE_CACHE_UNTIL_REBOOT),
+};
+
+#define CACHE_SIZE (sizeof(m_cache) / sizeof(m_cache[0]))
+
+// Cache is disabled by default
+static bool m_cache_enabled = false;
+
+static uint32_t m_cache_hits = 0;
+static uint32_t m_cache_misses = 0;
+
+/**
+ * \brief   Find the cache entry of an attribute
+ * \param   primitive_id
+ *          Read or write primitive id (CSAP or MSAP)
+ * \param   attribute_id
+ *          The attribute id
+ * \return  The entry or NULL if attribute cannot be cached
+ */
+static attribute_cache_entry_t * get_cache_entry(uint8_t primitive_id, uint16_t attribute_id)
+{
+    // Writes and reads share the same entry
+    if (primitive_id == CSAP_ATTRIBUTE_WRITE_REQUEST)
+    {
+        primitive_id = CSAP_ATTRIBUTE_READ_REQUEST;
+    }
+    else if (primitive_id == MSAP_ATTRIBUTE_WRITE_REQUEST)
+    {
+        primitive_id = MSAP_ATTRIBUTE_READ_REQUEST;
+    }
+
+    for (size_t i = 0; i < CACHE_SIZE; i++)
+    {
+        if ((m_cache[i].read_primitive_id == primitive_id)
+            && (m_cache[i].attribute_id == attribute_id))
+        {
+            return &m_cache[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * \brief   Store a value in cache if attribute is cacheable
+ * \note    This function MUST be called with sending_mutex locked
+ */
+static void update_cache_locked(uint8_t primitive_id,
+                                uint16_t attribute_id,
+                                uint8_t attribute_length,
+                                const uint8_t * attribute_value_p)
+{
+    attribute_cache_entry_t * entry = get_cache_entry(primitive_id, attribute_id);
+    if (entry == NULL || entry->volatility == ATTRIBUTE_CACHE_NONE)
+    {
+        return;
+    }
+
+    memcpy(entry->value, attribute_value_p, attribute_length);
+    entry->length = attribute_length;
+    entry->valid = true;
+}
+
+/**
+ * \brief   Remove an attribute from cache
+ * \note    This function MUST be called with sending_mutex locked
+ */
+static void invalidate_cache_entry_locked(uint8_t primitive_id, uint16_t attribute_id)
+{
+    attribute_cache_entry_t * entry = get_cache_entry(primitive_id, attribute_id);
+    if (entry != NULL)
+    {
+        entry->valid = false;
+    }
+}
+
+/**
+ * \brief   Write an attribute
+ * \note    This function MUST be called with sending_mutex locked
+ */
+int attribute_write_request_locked(uint8_t primitive_id,
+                                   uint16_t attribute_id,
+                                   uint8_t attribute_length,
+                                   const uint8_t * attribute_value_p)
 {
     int res;
     wpc_frame_t request, confirm;
@@ -35,7 +158,18 @@ int attribute_write_request(uint8_t primitive_id,
     request.payload_length =
         sizeof(attribute_write_req_pl_t) - (MAX_ATTRIBUTE_SIZE - attribute_length);
 
-    res = WPC_Int_send_request(&request, &confirm);
+    res = WPC_Int_send_request_locked(&request, &confirm);
+
+    if (res == 0 && confirm.payload.sap_generic_confirm_payload.result == 0)
+    {
+        // Value written is the new value of the attribute
+        update_cache_locked(primitive_id, attribute_id, attribute_length, attribute_value_p);
+    }
+    else
+    {
+        // Not sure of the node state, read it back next time
+        invalidate_cache_entry_locked(primitive_id, attribute_id);
+    }
 
     if (res < 0)
         return res;
@@ -45,13 +179,34 @@ int attribute_write_request(uint8_t primitive_id,
     return confirm.payload.sap_generic_confirm_payload.result;
 }
 
-int attribute_read_request(uint8_t primitive_id,
-                           uint16_t attribute_id,
-                           uint8_t attribute_length,
-                           uint8_t * attribute_value_p)
+int attribute_read_request_locked(uint8_t primitive_id,
+                                  uint16_t attribute_id,
+                                  uint8_t attribute_length,
+                                  uint8_t * attribute_value_p)
 {
     int res;
     wpc_frame_t request, confirm;
+    attribute_cache_entry_t * entry = NULL;
+
+    if (m_cache_enabled)
+    {
+        entry = get_cache_entry(primitive_id, attribute_id);
+        if (entry != NULL && entry->volatility == ATTRIBUTE_CACHE_NONE)
+        {
+            entry = NULL;
+        }
+    }
+
+    if (entry != NULL)
+    {
+        if (entry->valid && entry->length == attribute_length)
+        {
+            memcpy(attribute_value_p, entry->value, attribute_length);
+            m_cache_hits++;
+            return 0;
+        }
+        m_cache_misses++;
+    }
 
     request.primitive_id = primitive_id;
     uint16_encode_le(attribute_id,
@@ -59,7 +214,7 @@ int attribute_read_request(uint8_t primitive_id,
                          request.payload.attribute_read_request_payload.attribute_id));
     request.payload_length = sizeof(attribute_read_req_pl_t);
 
-    res = WPC_Int_send_request(&request, &confirm);
+    res = WPC_Int_send_request_locked(&request, &confirm);
 
     if (res < 0)
         return res;
@@ -79,7 +234,122 @@ int attribute_read_request(uint8_t primitive_id,
         memcpy(attribute_value_p,
                confirm.payload.attribute_read_confirm_payload.attribute_value,
                attribute_length);
+
+        if (entry != NULL)
+        {
+            update_cache_locked(primitive_id, attribute_id, attribute_length, attribute_value_p);
+        }
     }
 
     return confirm.payload.attribute_read_confirm_payload.result;
 }
+
+int attribute_write_request(uint8_t primitive_id,
+                            uint16_t attribute_id,
+                            uint8_t attribute_length,
+                            const uint8_t * attribute_value_p)
+{
+    int res;
+
+    Platform_lock_request();
+    res = attribute_write_request_locked(primitive_id,
+                                         attribute_id,
+                                         attribute_length,
+                                         attribute_value_p);
+    Platform_unlock_request();
+
+    return res;
+}
+
+int attribute_read_request(uint8_t primitive_id,
+                           uint16_t attribute_id,
+                           uint8_t attribute_length,
+                           uint8_t * attribute_value_p)
+{
+    int res;
+
+    Platform_lock_request();
+    res = attribute_read_request_locked(primitive_id,
+                                        attribute_id,
+                                        attribute_length,
+                                        attribute_value_p);
+    Platform_unlock_request();
+
+    return res;
+}
+
+void attribute_batch_request(attribute_batch_item_t * items,
+                             size_t count,
+                             unsigned long long * timestamp_ms_epoch_p)
+{
+    // Keep the lock for the whole batch so no other request or poll
+    // can be interleaved
+    Platform_lock_request();
+
+    *timestamp_ms_epoch_p = Platform_get_timestamp_ms_epoch();
+
+    for (size_t i = 0; i < count; i++)
+    {
+        attribute_batch_item_t * item = &items[i];
+        if (item->write)
+        {
+            item->result = attribute_write_request_locked(item->primitive_id,
+                                                          item->attribute_id,
+                                                          item->attribute_length,
+                                                          item->attribute_value_p);
+        }
+        else
+        {
+            item->result = attribute_read_request_locked(item->primitive_id,
+                                                         item->attribute_id,
+                                                         item->attribute_length,
+                                                         item->attribute_value_p);
+        }
+    }
+
+    Platform_unlock_request();
+}
+
+void attribute_cache_enable(bool enable)
+{
+    Platform_lock_request();
+    m_cache_enabled = enable;
+    Platform_unlock_request();
+
+    attribute_cache_invalidate();
+}
+
+void attribute_cache_invalidate(void)
+{
+    Platform_lock_request();
+    for (size_t i = 0; i < CACHE_SIZE; i++)
+    {
+        m_cache[i].valid = false;
+    }
+    Platform_unlock_request();
+}
+
+bool attribute_cache_set_volatility(uint8_t primitive_id,
+                                    uint16_t attribute_id,
+                                    attribute_volatility_e volatility)
+{
+    attribute_cache_entry_t * entry = get_cache_entry(primitive_id, attribute_id);
+    if (entry == NULL)
+    {
+        return false;
+    }
+
+    Platform_lock_request();
+    entry->volatility = volatility;
+    entry->valid = false;
+    Platform_unlock_request();
+    return true;
+}
+
+void attribute_cache_get_stats(uint32_t * hits_p, uint32_t * misses_p)
+{
+    Platform_lock_request();
+    *hits_p = m_cache_hits;
+    *misses_p = m_cache_misses;
+    Platform_unlock_request();
+}
@@ -28,6 +28,9 @@ int csap_factory_reset_request()
 
     res = WPC_Int_send_request(&request, &confirm);
 
+    // All the attributes are erased
+    attribute_cache_invalidate();
+
     if (res < 0)
         return res;
 
@@ -10,7 +10,10 @@
 #include "wpc_internal.h"
 #include "util.h"
 #include "platform.h"
+#include "platform_atomic.h"
 #include "reassembly.h"
+#include "node_stats.h"
+#include "tx_trace.h"
 
 #include "string.h"
 
@@ -21,11 +24,22 @@ static onDataReceived_cb_f data_cb_table[MAX_NUMBER_EP];
 static onDataReceived_cb_f m_data_cb;
 #endif
 
+// State of an entry waiting for a TX indication. Entries are claimed by the
+// sending threads and released by the dispatching thread, without lock
+typedef enum
+{
+    INDICATION_ENTRY_FREE = 0,
+    INDICATION_ENTRY_FILLING,   //< Claimed by a sender, not filled yet
+    INDICATION_ENTRY_BUSY       //< Filled, waiting for its TX indication
+} indication_entry_state_e;
+
 typedef struct
 {
     onDataSent_cb_f cb;
     uint16_t pdu_id;
-    bool busy;
+    indication_entry_state_e state;
+    bool traced;
+    tx_trace_t trace;
 } packet_with_indication_t;
 
 // Static buffer used to reassemble messages. Allocated statically
@@ -37,17 +51,32 @@ static uint8_t reassembly_buffer[MAX_FULL_PACKET_SIZE];
 // Table to store the data sent callbacks status for Tx data
 static packet_with_indication_t indication_sent_cb_table[MAX_SENT_PACKET_WITH_INDICATION];
 
-static bool set_indication_cb(onDataSent_cb_f cb, uint16_t pdu_id)
+static bool set_indication_cb(onDataSent_cb_f cb, uint16_t pdu_id, const tx_trace_t * trace_p)
 {
     int i;
 
     for (i = 0; i < MAX_SENT_PACKET_WITH_INDICATION; i++)
     {
-        if (!indication_sent_cb_table[i].busy)
+        packet_with_indication_t * entry_p = &indication_sent_cb_table[i];
+        indication_entry_state_e expected = INDICATION_ENTRY_FREE;
+
+        // Several threads can send at the same time
+        if (Platform_atomic_compare_exchange(&entry_p->state,
+                                             &expected,
+                                             INDICATION_ENTRY_FILLING,
+                                             PLATFORM_ACQUIRE,
+                                             PLATFORM_RELAXED))
         {
-            indication_sent_cb_table[i].busy = true;
-            indication_sent_cb_table[i].cb = cb;
-            indication_sent_cb_table[i].pdu_id = pdu_id;
+            entry_p->cb = cb;
+            entry_p->pdu_id = pdu_id;
+            entry_p->traced = (trace_p != NULL);
+            if (trace_p != NULL)
+            {
+                entry_p->trace = *trace_p;
+            }
+
+            // Entry is only visible to the dispatching thread once filled
+            Platform_atomic_store(&entry_p->state, INDICATION_ENTRY_BUSY, PLATFORM_RELEASE);
             break;
         }
     }
@@ -55,23 +84,69 @@ static bool set_indication_cb(onDataSent_cb_f cb, uint16_t pdu_id)
     return i < MAX_SENT_PACKET_WITH_INDICATION;
 }
 
-static onDataSent_cb_f get_indication_cb(uint16_t pdu_id)
+static onDataSent_cb_f get_indication_cb(uint16_t pdu_id, tx_trace_t * trace_p, bool * traced_p)
 {
     onDataSent_cb_f cb = NULL;
 
+    *traced_p = false;
     for (int i = 0; i < MAX_SENT_PACKET_WITH_INDICATION; i++)
     {
-        if (indication_sent_cb_table[i].busy && indication_sent_cb_table[i].pdu_id == pdu_id)
+        packet_with_indication_t * entry_p = &indication_sent_cb_table[i];
+
+        if ((Platform_atomic_load(&entry_p->state, PLATFORM_ACQUIRE) == INDICATION_ENTRY_BUSY)
+            && entry_p->pdu_id == pdu_id)
         {
-            // Release entry
-            indication_sent_cb_table[i].busy = false;
-            cb = indication_sent_cb_table[i].cb;
+            cb = entry_p->cb;
+            if (entry_p->traced)
+            {
+                *trace_p = entry_p->trace;
+                *traced_p = true;
+            }
+
+            // Release entry once read, it can be reused by a sender
+            Platform_atomic_store(&entry_p->state, INDICATION_ENTRY_FREE, PLATFORM_RELEASE);
         }
     }
 
     return cb;
 }
 
+/**
+ * \brief   Send a request, timing it if the packet is traced
+ */
+static int send_request(wpc_frame_t * request,
+                        wpc_frame_t * confirm,
+                        tx_trace_t * trace_p,
+                        size_t fragment)
+{
+    WPC_Int_request_timing_t timing;
+    unsigned long long start_us;
+    int res;
+
+    if (trace_p == NULL)
+    {
+        return WPC_Int_send_request(request, confirm);
+    }
+
+    start_us = Platform_get_timestamp_us_monotonic();
+    res = WPC_Int_send_request_timed(request, confirm, &timing);
+    tx_trace_add_request(trace_p, start_us, &timing, fragment);
+
+    return res;
+}
+
+/**
+ * \brief   End the trace of a packet that failed
+ */
+static void end_trace_on_error(tx_trace_t * trace_p, int result)
+{
+    if (trace_p != NULL)
+    {
+        tx_trace_on_confirm(trace_p, result);
+        tx_trace_end(trace_p);
+    }
+}
+
 static void fill_tx_tt_request(wpc_frame_t * request,
                                const uint8_t * buffer,
                                size_t len,
@@ -164,6 +239,9 @@ int dsap_data_tx_request(const uint8_t * buffer,
     // Packet id used for fragmented packet
     static uint16_t packet_id = 0;
     uint8_t max_data_pdu_size = WPC_Int_get_mtu();
+    tx_trace_t trace;
+    tx_trace_t * trace_p = NULL;
+    bool indication_registered = false;
 
     if (len > MAX_FULL_PACKET_SIZE)
     {
@@ -184,6 +262,12 @@ int dsap_data_tx_request(const uint8_t * buffer,
         LOGI("Packet of size %d must be splitted in %d fragments (last is %d bytes)\n", len, fragments, last_fragment_size);
     }
 
+    if (tx_trace_start(&trace, dest_add, pdu_id, qos))
+    {
+        trace_p = &trace;
+        trace.trace.fragments = (uint8_t) fragments;
+    }
+
     // Fill the tx options
     if (on_data_sent_cb != NULL)
     {
@@ -210,7 +294,7 @@ int dsap_data_tx_request(const uint8_t * buffer,
             sizeof(dsap_data_tx_tt_req_pl_t) - (MAX_APDU_DSAP_SIZE - len);
 
         // Do the sending
-        res = WPC_Int_send_request(&request, &confirm);
+        res = send_request(&request, &confirm, trace_p, 0);
     }
     else
     {
@@ -250,11 +334,12 @@ int dsap_data_tx_request(const uint8_t * buffer,
             sizeof(dsap_data_tx_frag_req_pl_t) - (MAX_APDU_DSAP_SIZE - frag_len);
 
             // Do the sending
-            res = WPC_Int_send_request(&request, &confirm);
+            res = send_request(&request, &confirm, trace_p, i);
             if (res < 0)
             {
                 // No way to recall previous fragment, they will be sent
                 LOGE("Cannot send frag %d/%d for dst=%d id=%d size=%d\n", i, fragments, dest_add, p_id, frag_len);
+                end_trace_on_error(trace_p, res);
                 return res;
             }
 
@@ -265,20 +350,35 @@ int dsap_data_tx_request(const uint8_t * buffer,
             {
                 // No way to recall previous fragment, they will be sent
                 LOGE("Stack refused (res=%d) intermediate frag %d/%d for dst=%d id=%d size=%d\n", confirm_res, i, fragments, dest_add, p_id, frag_len);
+                end_trace_on_error(trace_p, confirm_res);
                 return confirm_res;
             }
         }
     }
 
     if (res < 0)
+    {
+        end_trace_on_error(trace_p, res);
         return res;
+    }
 
     confirm_res = confirm.payload.dsap_data_tx_confirm_payload.result;
 
+    if (trace_p != NULL)
+    {
+        tx_trace_on_confirm(trace_p, confirm_res);
+    }
+
     // If success, register the callback
     if (confirm_res == 0 && on_data_sent_cb != NULL)
     {
-        set_indication_cb(on_data_sent_cb, pdu_id);
+        indication_registered = set_indication_cb(on_data_sent_cb, pdu_id, trace_p);
+    }
+
+    // Otherwise trace ends with the TX indication
+    if (trace_p != NULL && !indication_registered)
+    {
+        tx_trace_end(trace_p);
     }
 
     LOGI("Send data result = 0x%02x capacity = %d \n",
@@ -288,9 +388,12 @@ int dsap_data_tx_request(const uint8_t * buffer,
     return confirm_res;
 }
 
-void dsap_data_tx_indication_handler(dsap_data_tx_ind_pl_t * payload)
+void dsap_data_tx_indication_handler(dsap_data_tx_ind_pl_t * payload,
+                                     unsigned long long timestamp_us)
 {
-    onDataSent_cb_f cb = get_indication_cb(payload->pdu_id);
+    tx_trace_t trace;
+    bool traced;
+    onDataSent_cb_f cb = get_indication_cb(payload->pdu_id, &trace, &traced);
 
     LOGD("Tx indication received: indication_status = %d, buffering_delay = "
          "%d\n",
@@ -303,6 +406,14 @@ void dsap_data_tx_indication_handler(dsap_data_tx_ind_pl_t * payload)
            internal_time_to_ms(payload->buffering_delay),
            payload->result);
     }
+
+    if (traced)
+    {
+        tx_trace_on_indication(&trace,
+                               payload->result,
+                               internal_time_to_ms(payload->buffering_delay),
+                               timestamp_us);
+    }
 }
 
 void dsap_data_rx_frag_indication_handler(dsap_data_rx_frag_ind_pl_t * payload,
@@ -310,6 +421,7 @@ void dsap_data_rx_frag_indication_handler(dsap_data_rx_frag_ind_pl_t * payload,
 {
     reassembly_fragment_t frag;
     size_t full_size;
+    bool full_packet;
     app_qos_e qos;
     uint8_t hop_count;
     uint32_t internal_travel_time = uint32_decode_le((uint8_t *) &(payload->travel_time));
@@ -334,7 +446,18 @@ void dsap_data_rx_frag_indication_handler(dsap_data_rx_frag_ind_pl_t * payload,
         .timestamp = timestamp_ms_epoch,
     };
 
-    if (reassembly_add_fragment(&frag, &full_size) && full_size != 0 )
+    full_packet = reassembly_add_fragment(&frag, &full_size) && full_size != 0;
+
+    node_stats_on_rx(payload->src_add,
+                     payload->apdu_length,
+                     true,
+                     full_packet,
+                     payload->qos_hop_count & 0x01,
+                     payload->qos_hop_count >> 2,
+                     internal_time_to_ms(internal_travel_time),
+                     timestamp_ms_epoch);
+
+    if (full_packet)
     {
         onDataReceived_cb_f cb;
         size_t full_size = sizeof(reassembly_buffer);
@@ -404,6 +527,15 @@ void dsap_data_rx_indication_handler(dsap_data_rx_ind_pl_t * payload,
          payload->dest_endpoint,
          timestamp_ms_epoch);
 
+    node_stats_on_rx(payload->src_add,
+                     payload->apdu_length,
+                     false,
+                     true,
+                     payload->qos_hop_count & 0x01,
+                     payload->qos_hop_count >> 2,
+                     internal_time_to_ms(internal_travel_time),
+                     timestamp_ms_epoch);
+
 #ifdef REGISTER_DATA_PER_ENDPOINT
     cb = data_cb_table[payload->dest_endpoint];
 #else
@@ -15,6 +15,8 @@
 #define ATTRIBUTE_UTIL_H_
 
 #include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
 
 // Maximum number of bytes in an attribute
 #define MAX_ATTRIBUTE_SIZE 40
@@ -39,6 +41,28 @@ typedef struct __attribute__((__packed__))
     uint8_t attribute_value[MAX_ATTRIBUTE_SIZE];
 } attribute_read_conf_pl_t;
 
+/**
+ * \brief   Caching policy of an attribute
+ */
+typedef enum
+{
+    ATTRIBUTE_CACHE_NONE,          //< Always read from the stack
+    ATTRIBUTE_CACHE_UNTIL_REBOOT   //< Only changed by a write or a reboot of the stack
+} attribute_volatility_e;
+
+/**
+ * \brief   Single attribute access of a batch
+ */
+typedef struct
+{
+    bool write;                    //< True to write attribute, false to read it
+    uint8_t primitive_id;          //< CSAP or MSAP read or write primitive
+    uint16_t attribute_id;         //< The attribute id
+    uint8_t attribute_length;      //< The attribute length
+    uint8_t * attribute_value_p;   //< Value to write or buffer to store it
+    int result;                    //< Same as attribute_read/write_request return
+} attribute_batch_item_t;
+
 /**
  * \brief    Request to write an attribute to the stack
  * \param    primitive_id
@@ -56,6 +80,17 @@ int attribute_write_request(uint8_t primitive_id,
                             uint16_t attribute_id,
                             uint8_t attribute_length,
                             const uint8_t * attribute_value_p);
+
+/**
+ * \brief    Write an attribute when the request lock is already taken
+ * \note     This function MUST be called between Platform_lock_request and
+ *           Platform_unlock_request
+ */
+int attribute_write_request_locked(uint8_t primitive_id,
+                                   uint16_t attribute_id,
+                                   uint8_t attribute_length,
+                                   const uint8_t * attribute_value_p);
+
 /**
  * \brief    Request to read an attribute from the stack
  * \param    primitive_id
@@ -74,4 +109,68 @@ int attribute_read_request(uint8_t primitive_id,
                            uint8_t attribute_length,
                            uint8_t * attribute_value_p);
 
+/**
+ * \brief    Read an attribute when the request lock is already taken,
+ *           from cache if possible
+ * \note     This function MUST be called between Platform_lock_request and
+ *           Platform_unlock_request
+ */
+int attribute_read_request_locked(uint8_t primitive_id,
+                                  uint16_t attribute_id,
+                                  uint8_t attribute_length,
+                                  uint8_t * attribute_value_p);
+
+/**
+ * \brief    Read and/or write a list of attributes in a single transaction
+ * \param    items
+ *           List of attributes to access, result of each access is
+ *           stored in it
+ * \param    count
+ *           Number of items
+ * \param    timestamp_ms_epoch_p
+ *           Pointer to store the timestamp of the transaction
+ * \note     No other request can be sent to the stack during the batch
+ *           execution, so items are coherent between them
+ */
+void attribute_batch_request(attribute_batch_item_t * items,
+                             size_t count,
+                             unsigned long long * timestamp_ms_epoch_p);
+
+/**
+ * \brief    Enable or disable the attribute cache
+ * \param    enable
+ *           True to serve cacheable attributes from cache
+ * \note     Cache content is invalidated in both cases
+ */
+void attribute_cache_enable(bool enable);
+
+/**
+ * \brief    Invalidate all the cached attributes
+ * \note     Must be called each time the stack may have rebooted
+ */
+void attribute_cache_invalidate(void);
+
+/**
+ * \brief    Change the caching policy of an attribute
+ * \param    primitive_id
+ *           CSAP or MSAP attribute read (or write) primitive
+ * \param    attribute_id
+ *           The attribute id
+ * \param    volatility
+ *           The new caching policy
+ * \return   False if attribute cannot be cached
+ */
+bool attribute_cache_set_volatility(uint8_t primitive_id,
+                                    uint16_t attribute_id,
+                                    attribute_volatility_e volatility);
+
+/**
+ * \brief    Get the attribute cache counters
+ * \param    hits_p
+ *           Pointer to store the number of reads served from cache
+ * \param    misses_p
+ *           Pointer to store the number of cacheable reads sent to the stack
+ */
+void attribute_cache_get_stats(uint32_t * hits_p, uint32_t * misses_p);
+
 #endif /* ATTRIBUTE_UTIL_H_ */
@@ -144,9 +144,15 @@ int dsap_data_tx_request(const uint8_t * buffer,
 
 /**
  * \brief   Handler for tx indication. It is called when sent data leaves the
- * node \param   payload Pointer to payload
+ *          node
+ * \param   payload
+ *          Pointer to payload
+ * \param   timestamp_us
+ *          Timestamp of reception of the indication, from
+ *          \ref Platform_get_timestamp_us_monotonic
  */
-void dsap_data_tx_indication_handler(dsap_data_tx_ind_pl_t * payload);
+void dsap_data_tx_indication_handler(dsap_data_tx_ind_pl_t * payload,
+                                     unsigned long long timestamp_us);
 
 /**
  * \brief   Handler for rx indication
@@ -31,6 +31,11 @@
 /* General constant */
 #define MAXIMUM_SCRATCHPAD_BLOCK_SIZE 112
 
+/* Header of a scratchpad image. The scratchpad crc reported by the node covers
+ * the image without its header, and it is also stored in the header */
+#define SCRATCHPAD_HEADER_SIZE 32
+#define SCRATCHPAD_HEADER_CRC_OFFSET 20
+
 /* Maximum number of neighbors in a */
 #define MAXIMUM_NUMBER_OF_NEIGHBOR 8
 
@@ -603,6 +608,26 @@ bool msap_register_for_stack_status(onStackStatusReceived_cb_f cb);
  */
 bool msap_unregister_from_stack_status();
 
+/**
+ * \brief   Register for the end of next stack reboot
+ * \param   cb
+ *          Callback to invoke once, on next stack state indication
+ * \return  True if registered successfully, false otherwise
+ */
+bool msap_register_for_stack_reboot(onStackStatusReceived_cb_f cb);
+
+/**
+ * \brief   Unregister from the end of next stack reboot
+ * \return  True if unregistered successfully, false otherwise
+ */
+bool msap_unregister_from_stack_reboot();
+
+/**
+ * \brief   Unregister from the end of next stack reboot and get the callback
+ * \return  The callback that was registered, NULL if none
+ */
+onStackStatusReceived_cb_f msap_take_stack_reboot_cb();
+
 /**
  * \brief   Register for config data item
  * \param   cb
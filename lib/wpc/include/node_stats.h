@@ -0,0 +1,84 @@
+/* Wirepas Oy licensed under Apache License, Version 2.0
+ *
+ * See file LICENSE for full license details.
+ *
+ */
+#ifndef NODE_STATS_H_
+#define NODE_STATS_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "wpc.h"
+
+/**
+ * \brief    Allocate a new statistics table, or free it
+ * \param    max_nodes
+ *           Maximum number of nodes in the table, 0 to free it
+ * \return   True if table is (re)allocated or freed
+ * \note     Previous statistics are discarded
+ */
+bool node_stats_enable(unsigned int max_nodes);
+
+/**
+ * \brief    Account a received packet or fragment
+ * \param    src_add
+ *           Source address of the packet
+ * \param    size
+ *           Size of the received apdu
+ * \param    fragment
+ *           True if it is a fragment
+ * \param    full_packet
+ *           True if it is a full packet (non fragmented packet or last
+ *           fragment of a reassembled packet)
+ * \param    high_qos
+ *           True if packet was received with high qos
+ * \param    hop_count
+ *           Hop count of the packet
+ * \param    travel_time_ms
+ *           Travel time of the packet
+ * \param    timestamp_ms_epoch
+ *           Reception time of the packet
+ * \note     Only called from the dispatching thread. Cost is O(1) and does
+ *           nothing if statistics are not enabled
+ */
+void node_stats_on_rx(uint32_t src_add,
+                      size_t size,
+                      bool fragment,
+                      bool full_packet,
+                      bool high_qos,
+                      uint8_t hop_count,
+                      uint32_t travel_time_ms,
+                      unsigned long long timestamp_ms_epoch);
+
+/**
+ * \brief    Get the statistics of a node
+ * \param    src_add
+ *           Source address of the node
+ * \param    stats_p
+ *           Pointer to store the statistics
+ * \return   APP_RES_OK, APP_RES_UNKNOWN_DEST or APP_RES_ATTRIBUTE_NOT_SET
+ */
+app_res_e node_stats_get(uint32_t src_add, app_node_stats_t * stats_p);
+
+/**
+ * \brief    Get the statistics of the next node of the table
+ * \param    cursor_p
+ *           Index in the table to start from, updated after the node found
+ * \param    stats_p
+ *           Pointer to store the statistics
+ * \return   APP_RES_OK, APP_RES_UNKNOWN_DEST or APP_RES_ATTRIBUTE_NOT_SET
+ */
+app_res_e node_stats_get_next(uint32_t * cursor_p, app_node_stats_t * stats_p);
+
+/**
+ * \brief    Get the number of nodes in the table
+ * \param    nodes_p
+ *           Pointer to store the number of nodes
+ * \param    untracked_p
+ *           Pointer to store the number of packets not tracked
+ * \return   APP_RES_OK or APP_RES_ATTRIBUTE_NOT_SET
+ */
+app_res_e node_stats_get_count(uint32_t * nodes_p, uint32_t * untracked_p);
+
+#endif
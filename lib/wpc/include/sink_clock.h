@@ -0,0 +1,59 @@
+/* Wirepas Oy licensed under Apache License, Version 2.0
+ *
+ * See file LICENSE for full license details.
+ *
+ */
+#ifndef SINK_CLOCK_H_
+#define SINK_CLOCK_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * \brief   Estimate of the sink clock relative to the host monotonic clock
+ */
+typedef struct
+{
+    unsigned long long host_us;   //< Reference point, host monotonic time
+    unsigned long long sink_us;   //< Sink system time at the reference point
+    double rate;                  //< Sink us elapsed per host us
+    uint32_t uncertainty_us;      //< Estimated error of a conversion
+    uint32_t samples;             //< Samples used for the estimate
+} sink_clock_estimate_t;
+
+/**
+ * \brief    Start or stop the periodic sampling of the sink clock
+ * \param    period_s
+ *           Period between samples once the first estimate is done,
+ *           0 to stop
+ * \return   True if sampling is started (or stopped)
+ * \note     Previous samples are discarded
+ */
+bool sink_clock_start(unsigned int period_s);
+
+/**
+ * \brief    Read the sink clock once and update the estimate
+ * \return   True if a sample was taken
+ */
+bool sink_clock_sample(void);
+
+/**
+ * \brief    Get the current estimate
+ * \param    estimate_p
+ *           Pointer to store the estimate
+ * \return   True if an estimate is available
+ */
+bool sink_clock_get_estimate(sink_clock_estimate_t * estimate_p);
+
+/**
+ * \brief    Convert a sink system time to the host monotonic clock
+ * \param    sink_us
+ *           Sink system time in us
+ * \param    host_us_p
+ *           Pointer to store the time from
+ *           \ref Platform_get_timestamp_us_monotonic
+ * \return   True if an estimate is available
+ */
+bool sink_clock_to_host_us(unsigned long long sink_us, unsigned long long * host_us_p);
+
+#endif
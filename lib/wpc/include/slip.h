@@ -63,6 +63,26 @@ int Slip_send_buffer(uint8_t * buffer, uint32_t len);
  */
 int Slip_get_buffer(uint8_t * buffer, uint32_t len, uint16_t timeout_ms);
 
+/**
+ * \brief   Get a buffer in slip encoding and the time its first byte was read
+ * \param   buffer
+ *          the buffer to store data
+ * \param   len
+ *          length of the provided buffer
+ * \param   timeout_ms
+ *          the timeout in millisecond to wait for data
+ * \param   first_byte_us_p
+ *          Pointer to store the time the opening delimiter (0xC0) of the
+ *          frame was read, from \ref Platform_get_timestamp_us_monotonic
+ * \return  Same as \ref Slip_get_buffer
+ * \note    Time to receive the rest of a long frame and to decode it is not
+ *          included in the timestamp
+ */
+int Slip_get_buffer_timestamped(uint8_t * buffer,
+                                uint32_t len,
+                                uint16_t timeout_ms,
+                                unsigned long long * first_byte_us_p);
+
 /**
  * \brief    Function prototype to write data to serial
  * \param    buffer
@@ -84,6 +104,20 @@ typedef int (*write_f)(const unsigned char * buffer, unsigned int buffer_size);
  */
 typedef int (*read_f)(unsigned char * c, unsigned int timeout_ms);
 
+/**
+ * \brief  Update a CRC-16-CCITT with a buffer
+ * \param  crc
+ *         Current crc value (0xffff for a new computation)
+ * \param  buf
+ *         Buffer to add to the crc
+ * \param  len
+ *         Size of the buffer
+ * \return The updated crc
+ * \note   This is the crc used for frames on the serial link and also the
+ *         one used by the stack to check a scratchpad content
+ */
+uint16_t Slip_crc_update(uint16_t crc, const uint8_t * buf, uint32_t len);
+
 /**
  * \brief    Init function for the slip module
  * \param    write
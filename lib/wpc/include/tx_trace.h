@@ -0,0 +1,120 @@
+/* Wirepas Oy licensed under Apache License, Version 2.0
+ *
+ * See file LICENSE for full license details.
+ *
+ */
+#ifndef TX_TRACE_H_
+#define TX_TRACE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "wpc.h"
+#include "wpc_internal.h"
+
+/**
+ * \brief   Trace of a packet being sent
+ */
+typedef struct
+{
+    app_tx_trace_t trace;
+    unsigned long long submit_us;   //< From Platform_get_timestamp_us_monotonic
+} tx_trace_t;
+
+/**
+ * \brief    Enable or disable the tracing
+ * \param    cb
+ *           Callback to call for each traced packet, can be NULL
+ * \param    max_destinations
+ *           Maximum number of destinations in statistics, 0 for no statistics
+ * \return   True if tracing is enabled (or disabled)
+ * \note     Previous statistics are discarded
+ */
+bool tx_trace_enable(onTxTrace_cb_f cb, unsigned int max_destinations);
+
+/**
+ * \brief    Start the trace of a packet
+ * \param    trace_p
+ *           Trace to initialize
+ * \param    dst_addr
+ *           Destination of the packet
+ * \param    pdu_id
+ *           Pdu id of the packet
+ * \param    qos
+ *           QoS of the packet
+ * \return   True if packet must be traced, false if tracing is disabled
+ */
+bool tx_trace_start(tx_trace_t * trace_p, uint32_t dst_addr, uint16_t pdu_id, uint8_t qos);
+
+/**
+ * \brief    Add a request (full packet or fragment) to a trace
+ * \param    trace_p
+ *           Trace of the packet
+ * \param    start_us
+ *           Time the request was submitted
+ * \param    timing_p
+ *           Timing of the request
+ * \param    fragment
+ *           Index of the fragment, 0 if not fragmented
+ */
+void tx_trace_add_request(tx_trace_t * trace_p,
+                          unsigned long long start_us,
+                          const WPC_Int_request_timing_t * timing_p,
+                          size_t fragment);
+
+/**
+ * \brief    Account the end of the sending of a packet
+ * \param    trace_p
+ *           Trace of the packet
+ * \param    result
+ *           Result of the last request, negative for a transport error
+ */
+void tx_trace_on_confirm(tx_trace_t * trace_p, int result);
+
+/**
+ * \brief    End the trace of a packet without TX indication
+ * \param    trace_p
+ *           Trace of the packet, given to the application
+ */
+void tx_trace_end(tx_trace_t * trace_p);
+
+/**
+ * \brief    End the trace of a packet with its TX indication
+ * \param    trace_p
+ *           Trace of the packet
+ * \param    result
+ *           Result of the TX indication
+ * \param    buffering_delay_ms
+ *           Buffering delay of the TX indication
+ * \param    timestamp_us
+ *           Reception time of the first byte of the TX indication, from
+ *           Platform_get_timestamp_us_monotonic
+ */
+void tx_trace_on_indication(tx_trace_t * trace_p,
+                            uint8_t result,
+                            uint32_t buffering_delay_ms,
+                            unsigned long long timestamp_us);
+
+/**
+ * \brief    Get the statistics of a destination
+ * \param    dst_addr
+ *           Destination address
+ * \param    qos
+ *           QoS used for transmission
+ * \param    stats_p
+ *           Pointer to store the statistics
+ * \return   APP_RES_OK, APP_RES_UNKNOWN_DEST or APP_RES_ATTRIBUTE_NOT_SET
+ */
+app_res_e tx_trace_get_stats(uint32_t dst_addr, uint8_t qos, app_tx_stats_t * stats_p);
+
+/**
+ * \brief    Get the statistics of the next destination
+ * \param    cursor_p
+ *           Index in the table to start from, updated after the destination found
+ * \param    stats_p
+ *           Pointer to store the statistics
+ * \return   APP_RES_OK, APP_RES_UNKNOWN_DEST or APP_RES_ATTRIBUTE_NOT_SET
+ */
+app_res_e tx_trace_get_next_stats(uint32_t * cursor_p, app_tx_stats_t * stats_p);
+
+#endif
@@ -17,6 +17,7 @@ typedef enum
     WPC_INT_WRONG_CRC = -5,          //< Wrong crc
     WPC_INT_WRONG_BUFFER_SIZE = -6,  //< Wrong provided buffer size
     WPC_INT_WRONG_CRC_FROM_HOST = -7,//< Wrong crc detected from host to node (indirect detection)
+    WPC_INT_LINK_DOWN_ERROR = -8,    //< Link with node is down and not recovered yet
 } WPC_Int_error_code_e;
 
 /**
@@ -47,6 +48,55 @@ int WPC_Int_send_request(wpc_frame_t * frame, wpc_frame_t * confirm);
  */
 int WPC_Int_send_request_timeout(wpc_frame_t * frame, wpc_frame_t * confirm, uint16_t timeout_ms);
 
+/**
+ * \brief   Function to send a request and wait for confirm for default timeout
+ *          when the request lock is already taken by the caller
+ * \param   frame
+ *          The request to send
+ * \param   confirm
+ *          The confirm received by the stack
+ * \return  0 if successful or negative value if an error happen
+ *
+ * \note    This method MUST be called between Platform_lock_request and
+ *          Platform_unlock_request. It allows a caller to chain several
+ *          requests without any other request or poll in between
+ */
+int WPC_Int_send_request_locked(wpc_frame_t * frame, wpc_frame_t * confirm);
+
+/**
+ * \brief   Timing of a request, from \ref Platform_get_timestamp_us_monotonic
+ */
+typedef struct
+{
+    unsigned long long lock_us;     //< Request lock taken
+    unsigned long long write_us;    //< Request written on the uart (last write if resent)
+    unsigned long long confirm_us;  //< First byte of the confirm received, 0 if none
+    uint8_t resends;                //< Request sent again after a crc error
+} WPC_Int_request_timing_t;
+
+/**
+ * \brief   Function to send a request and wait for confirm for default timeout,
+ *          recording the time of each step
+ * \param   frame
+ *          The request to send
+ * \param   confirm
+ *          The confirm received by the stack
+ * \param   timing_p
+ *          Filled with the timing of the request, even if it fails
+ * \return  0 if successful or negative value if an error happen
+ */
+int WPC_Int_send_request_timed(wpc_frame_t * frame,
+                               wpc_frame_t * confirm,
+                               WPC_Int_request_timing_t * timing_p);
+
+/**
+ * \brief   Get the time the first byte of the last confirm was received
+ * \return  Timestamp from \ref Platform_get_timestamp_us_monotonic
+ * \note    This method MUST be called between Platform_lock_request and
+ *          Platform_unlock_request, with the request it applies to
+ */
+unsigned long long WPC_Int_get_last_confirm_timestamp_us(void);
+
 /**
  * \brief   Disable/Enable the poll requests
  * \param   disabled
@@ -65,6 +115,48 @@ void WPC_Int_disable_poll_request(bool disabled);
  */
 bool WPC_Int_set_timeout_s_no_answer(unsigned int duration_s);
 
+/**
+ * \brief   Switch the link to a higher bitrate for bulk transfers
+ * \param   attribute_id
+ *          CSAP attribute used to set the sink uart bitrate
+ * \param   bitrate
+ *          Bitrate to use during the transfer
+ * \return  0 if the sink answers at the new bitrate, a negative value or
+ *          the attribute write result otherwise. In case of failure, the
+ *          link is set back to its previous bitrate
+ */
+int WPC_Int_start_bulk_transfer(uint16_t attribute_id, unsigned long bitrate);
+
+/**
+ * \brief   Switch the link back to the bitrate given at initialization
+ * \return  0 if successful or a negative value or the attribute write result
+ */
+int WPC_Int_stop_bulk_transfer(void);
+
+/**
+ * \brief   Set the backoff between two attempts to recover a broken link
+ * \param   min_delay_ms
+ *          delay before first attempt, doubled after each failed attempt
+ * \param   max_delay_ms
+ *          maximum delay between two attempts
+ * \return  True if success
+ */
+bool WPC_Int_set_link_recovery_backoff(unsigned int min_delay_ms, unsigned int max_delay_ms);
+
+/**
+ * \brief   Register for link status changes
+ * \param   cb
+ *          Callback to call when link goes down or is recovered
+ * \return  True if registered successfully, false otherwise
+ */
+bool WPC_Int_register_for_link_status(onLinkStatusChanged_cb_f cb);
+
+/**
+ * \brief   Unregister from link status changes
+ * \return  True if unregistered successfully, false otherwise
+ */
+bool WPC_Int_unregister_from_link_status(void);
+
 int WPC_Int_initialize(const char * port_name, unsigned long bitrate);
 
 void WPC_Int_close(void);
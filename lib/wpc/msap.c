@@ -29,6 +29,11 @@ static onScanNeighborsDone_cb_f m_scan_neighbor_cb = NULL;
  */
 static onStackStatusReceived_cb_f m_stack_status_cb = NULL;
 
+/**
+ * \brief   One shot callback to notify the end of a stack reboot
+ */
+static onStackStatusReceived_cb_f m_stack_reboot_cb = NULL;
+
 /**
  * \brief   Registered callback for config data item
  */
@@ -86,6 +91,11 @@ int msap_stack_stop_request()
     request.payload_length = 0;
 
     res = WPC_Int_send_request(&request, &confirm);
+
+    // Node reboots (even if confirm is lost), it may come back with a
+    // different firmware after a scratchpad update
+    attribute_cache_invalidate();
+
     if (res < 0)
         return res;
 
@@ -571,13 +581,26 @@ int msap_config_data_item_list_items_request(const uint8_t command,
 
 void msap_stack_state_indication_handler(msap_stack_state_ind_pl_t * payload)
 {
+    onStackStatusReceived_cb_f reboot_cb;
+
     LOGI("Status is 0x%02x\n", payload->status);
+
+    // Stack has rebooted, cached attributes may be outdated
+    attribute_cache_invalidate();
+
     if (m_stack_status_cb != NULL)
     {
         m_stack_status_cb(payload->status);
     }
 
     WPC_Int_set_mtu();
+
+    // Stack state indication is generated at boot, so it ends a pending reboot
+    reboot_cb = msap_take_stack_reboot_cb();
+    if (reboot_cb != NULL)
+    {
+        reboot_cb(payload->status);
+    }
 }
 
 void msap_app_config_data_rx_indication_handler(msap_app_config_data_rx_ind_pl_t * payload)
@@ -673,6 +696,28 @@ bool msap_unregister_from_stack_status()
     return UNREGISTER_CB(m_stack_status_cb);
 }
 
+bool msap_register_for_stack_reboot(onStackStatusReceived_cb_f cb)
+{
+    return REGISTER_CB(cb, m_stack_reboot_cb);
+}
+
+bool msap_unregister_from_stack_reboot()
+{
+    return UNREGISTER_CB(m_stack_reboot_cb);
+}
+
+onStackStatusReceived_cb_f msap_take_stack_reboot_cb()
+{
+    onStackStatusReceived_cb_f reboot_cb;
+
+    Platform_lock_request();
+    reboot_cb = m_stack_reboot_cb;
+    m_stack_reboot_cb = NULL;
+    Platform_unlock_request();
+
+    return reboot_cb;
+}
+
 bool msap_register_for_config_data_item(onConfigDataItemReceived_cb_f cb)
 {
     return REGISTER_CB(cb, m_config_data_item_cb);
@@ -0,0 +1,312 @@
+/* Wirepas Oy licensed under Apache License, Version 2.0
+ *
+ * See file LICENSE for full license details.
+ *
+ */
+#define LOG_MODULE_NAME "node_stats"
+#define MAX_LOG_LEVEL INFO_LOG_LEVEL
+#include "logger.h"
+
+#include <string.h>
+#include "node_stats.h"
+#include "platform.h"
+#include "platform_atomic.h"
+
+/*
+ * Statistics are stored in an open addressing hash table (linear probing)
+ * indexed by the source address. Table is allocated once for the maximum
+ * number of nodes and entries are never removed, so a lookup is O(1) and
+ * doesn't need any allocation on the data path.
+ *
+ * Table is only written from the dispatching thread. Each entry is protected
+ * by a sequence counter, odd while the entry is written: readers copy the
+ * entry and retry if the counter changed meanwhile, so they never block the
+ * reception. The table itself is only freed once no reader or writer uses it.
+ */
+
+// Load factor of the table is kept under 3/4
+#define MIN_TABLE_ENTRIES       16
+#define MAX_TABLE_ENTRIES       (1UL << 22)
+
+// Delay between two checks of the users of a table before freeing it
+#define FREE_TABLE_POLL_US      100
+
+typedef struct
+{
+    uint32_t seq;           //< Odd while the entry is updated
+    bool used;              //< Set once stats.address is valid
+    app_node_stats_t stats;
+} node_entry_t;
+
+typedef struct
+{
+    size_t size;            //< Allocated size
+    uint32_t mask;          //< Number of entries - 1
+    uint32_t shift;         //< Shift to get an index from a hash
+    uint32_t max_nodes;
+    uint32_t nodes;
+    uint32_t untracked;
+    node_entry_t entries[];
+} node_table_t;
+
+static node_table_t * m_table = NULL;
+
+// Number of readers and writers currently using m_table
+static uint32_t m_users = 0;
+
+static node_table_t * get_table(void)
+{
+    node_table_t * table_p;
+
+    Platform_atomic_add_fetch(&m_users, 1, PLATFORM_SEQ_CST);
+    table_p = Platform_atomic_load(&m_table, PLATFORM_SEQ_CST);
+    if (table_p == NULL)
+    {
+        Platform_atomic_sub_fetch(&m_users, 1, PLATFORM_RELEASE);
+    }
+
+    return table_p;
+}
+
+static void release_table(void)
+{
+    Platform_atomic_sub_fetch(&m_users, 1, PLATFORM_RELEASE);
+}
+
+/**
+ * \brief   Find the entry of a node, or the free entry to use for it
+ */
+static node_entry_t * find_entry(node_table_t * table_p, uint32_t address)
+{
+    // Fibonacci hashing, node addresses are often consecutive
+    uint32_t index = (address * 2654435769U) >> table_p->shift;
+
+    // Table is never full, so there is always a free entry at the end
+    while (true)
+    {
+        node_entry_t * entry_p = &table_p->entries[index];
+
+        if (!Platform_atomic_load(&entry_p->used, PLATFORM_ACQUIRE)
+            || entry_p->stats.address == address)
+        {
+            return entry_p;
+        }
+        index = (index + 1) & table_p->mask;
+    }
+}
+
+static void read_entry(const node_entry_t * entry_p, app_node_stats_t * stats_p)
+{
+    uint32_t seq;
+
+    do
+    {
+        seq = Platform_seqlock_read_begin(&entry_p->seq);
+        memcpy(stats_p, &entry_p->stats, sizeof(app_node_stats_t));
+    } while (Platform_seqlock_read_retry(&entry_p->seq, seq));
+}
+
+static unsigned int get_travel_time_bucket(uint32_t travel_time_ms)
+{
+    uint32_t units = travel_time_ms / APP_NODE_STATS_TRAVEL_TIME_LIMIT_MS(0);
+    unsigned int bucket;
+
+    if (units == 0)
+    {
+        return 0;
+    }
+
+    bucket = 32 - __builtin_clz(units);
+    return bucket < APP_NODE_STATS_TRAVEL_TIME_BUCKETS ? bucket
+                                                       : APP_NODE_STATS_TRAVEL_TIME_BUCKETS - 1;
+}
+
+bool node_stats_enable(unsigned int max_nodes)
+{
+    node_table_t * table_p = NULL;
+    node_table_t * previous_p;
+
+    if (max_nodes != 0)
+    {
+        uint32_t entries = MIN_TABLE_ENTRIES;
+        uint32_t bits = 4;
+        size_t size;
+
+        if (max_nodes > MAX_TABLE_ENTRIES / 4 * 3)
+        {
+            LOGE("Too many nodes for statistics: %u\n", max_nodes);
+            return false;
+        }
+
+        while (entries < max_nodes + max_nodes / 3 + 1)
+        {
+            entries <<= 1;
+            bits++;
+        }
+
+        size = sizeof(node_table_t) + entries * sizeof(node_entry_t);
+        table_p = Platform_malloc(size);
+        if (table_p == NULL)
+        {
+            LOGE("Cannot allocate statistics for %u nodes\n", max_nodes);
+            return false;
+        }
+
+        memset(table_p, 0, size);
+        table_p->size = size;
+        table_p->mask = entries - 1;
+        table_p->shift = 32 - bits;
+        table_p->max_nodes = max_nodes;
+    }
+
+    previous_p = Platform_atomic_exchange(&m_table, table_p, PLATFORM_SEQ_CST);
+    if (previous_p != NULL)
+    {
+        // Readers and writer are short, wait for them before freeing the
+        // previous table
+        while (Platform_atomic_load(&m_users, PLATFORM_SEQ_CST) != 0)
+        {
+            Platform_usleep(FREE_TABLE_POLL_US);
+        }
+        Platform_free(previous_p, previous_p->size);
+    }
+
+    LOGI("Node statistics %s (%u nodes)\n", max_nodes ? "enabled" : "disabled", max_nodes);
+    return true;
+}
+
+void node_stats_on_rx(uint32_t src_add,
+                      size_t size,
+                      bool fragment,
+                      bool full_packet,
+                      bool high_qos,
+                      uint8_t hop_count,
+                      uint32_t travel_time_ms,
+                      unsigned long long timestamp_ms_epoch)
+{
+    node_table_t * table_p;
+    node_entry_t * entry_p;
+    app_node_stats_t * stats_p;
+
+    // Fast path when statistics are disabled
+    if (Platform_atomic_load(&m_table, PLATFORM_RELAXED) == NULL)
+    {
+        return;
+    }
+
+    table_p = get_table();
+    if (table_p == NULL)
+    {
+        return;
+    }
+
+    entry_p = find_entry(table_p, src_add);
+    stats_p = &entry_p->stats;
+    if (!entry_p->used)
+    {
+        if (table_p->nodes >= table_p->max_nodes)
+        {
+            Platform_atomic_store(&table_p->untracked,
+                                  table_p->untracked + 1,
+                                  PLATFORM_RELAXED);
+            release_table();
+            return;
+        }
+
+        // Entry is not visible to readers yet
+        stats_p->address = src_add;
+        stats_p->first_seen_ms_epoch = timestamp_ms_epoch;
+        Platform_atomic_store(&entry_p->used, true, PLATFORM_RELEASE);
+        Platform_atomic_store(&table_p->nodes, table_p->nodes + 1, PLATFORM_RELAXED);
+    }
+
+    Platform_seqlock_write_begin(&entry_p->seq);
+
+    stats_p->bytes += size;
+    stats_p->last_seen_ms_epoch = timestamp_ms_epoch;
+    if (fragment)
+    {
+        stats_p->fragments++;
+    }
+    if (full_packet)
+    {
+        stats_p->packets++;
+        if (high_qos)
+        {
+            stats_p->high_qos_packets++;
+        }
+        stats_p->hop_count[hop_count < APP_NODE_STATS_HOP_BUCKETS ? hop_count
+                                                                  : APP_NODE_STATS_HOP_BUCKETS - 1]++;
+        stats_p->travel_time[get_travel_time_bucket(travel_time_ms)]++;
+        stats_p->travel_time_sum_ms += travel_time_ms;
+    }
+
+    Platform_seqlock_write_end(&entry_p->seq);
+
+    release_table();
+}
+
+app_res_e node_stats_get(uint32_t src_add, app_node_stats_t * stats_p)
+{
+    node_table_t * table_p = get_table();
+    node_entry_t * entry_p;
+    app_res_e res = APP_RES_UNKNOWN_DEST;
+
+    if (table_p == NULL)
+    {
+        return APP_RES_ATTRIBUTE_NOT_SET;
+    }
+
+    entry_p = find_entry(table_p, src_add);
+    if (Platform_atomic_load(&entry_p->used, PLATFORM_ACQUIRE))
+    {
+        read_entry(entry_p, stats_p);
+        res = APP_RES_OK;
+    }
+
+    release_table();
+    return res;
+}
+
+app_res_e node_stats_get_next(uint32_t * cursor_p, app_node_stats_t * stats_p)
+{
+    node_table_t * table_p = get_table();
+    app_res_e res = APP_RES_UNKNOWN_DEST;
+
+    if (table_p == NULL)
+    {
+        return APP_RES_ATTRIBUTE_NOT_SET;
+    }
+
+    for (uint32_t index = *cursor_p; index <= table_p->mask; index++)
+    {
+        node_entry_t * entry_p = &table_p->entries[index];
+
+        if (Platform_atomic_load(&entry_p->used, PLATFORM_ACQUIRE))
+        {
+            read_entry(entry_p, stats_p);
+            *cursor_p = index + 1;
+            res = APP_RES_OK;
+            break;
+        }
+    }
+
+    release_table();
+    return res;
+}
+
+app_res_e node_stats_get_count(uint32_t * nodes_p, uint32_t * untracked_p)
+{
+    node_table_t * table_p = get_table();
+
+    if (table_p == NULL)
+    {
+        return APP_RES_ATTRIBUTE_NOT_SET;
+    }
+
+    *nodes_p = Platform_atomic_load(&table_p->nodes, PLATFORM_RELAXED);
+    *untracked_p = Platform_atomic_load(&table_p->untracked, PLATFORM_RELAXED);
+
+    release_table();
+    return APP_RES_OK;
+}
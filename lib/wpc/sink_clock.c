@@ -0,0 +1,312 @@
+/* Wirepas Oy licensed under Apache License, Version 2.0
+ *
+ * See file LICENSE for full license details.
+ *
+ */
+#define LOG_MODULE_NAME "sink_clock"
+#define MAX_LOG_LEVEL INFO_LOG_LEVEL
+#include "logger.h"
+
+#include <string.h>
+#include "sink_clock.h"
+#include "attribute.h"
+#include "msap.h"
+#include "platform.h"
+#include "platform_atomic.h"
+#include "util.h"
+#include "wpc_constants.h"
+#include "wpc_internal.h"
+
+/*
+ * The sink system time (1/128 s resolution) is read from the node. Host
+ * timestamps the request just before it is sent and the confirm when its
+ * first byte is received: the node read its clock in between, so the middle
+ * of the two is taken, with half of the round trip as uncertainty.
+ *
+ * A line is fitted to the last samples with least squares. Samples with a
+ * long round trip (request delayed by the node) are not used. The resolution
+ * of the sink clock is averaged out by the number of samples, as they are
+ * taken at random phases of its ticks.
+ */
+
+// Samples kept for the estimate
+#define MAX_SAMPLES             32
+
+// First samples are taken quickly to get a first estimate
+#define BURST_SAMPLES           8
+#define BURST_PERIOD_MS         250
+
+// Samples with a round trip longer than this factor of the best one are
+// not used
+#define MAX_ROUND_TRIP_FACTOR   2
+
+// Delay added to the sampling period, from 0 to the sink clock resolution,
+// so samples are not taken at the same phase of the sink clock ticks
+#define SAMPLING_JITTER_MS(sample)  (((sample) * 5) % 8)
+
+// Drift cannot be estimated on shorter spans, the sink clock resolution
+// would dominate it
+#define MIN_DRIFT_SPAN_US       (60ULL * 1000 * 1000)
+
+// Sink clock is truncated to its resolution (1/128 s)
+#define SINK_TICKS_TO_US(ticks) (((ticks) * 15625) / 2)
+#define HALF_TICK_US            (1000000 / 128 / 2)
+
+typedef struct
+{
+    unsigned long long host_us;     //< Middle of request and confirm
+    unsigned long long sink_us;     //< Sink time, unwrapped
+    uint32_t round_trip_us;         //< From request sent to confirm received
+} sample_t;
+
+// Samples, only accessed with the request lock taken
+static sample_t m_samples[MAX_SAMPLES];
+static unsigned int m_samples_count;
+static unsigned int m_next_sample;
+static uint32_t m_last_sink_ticks;
+static unsigned long long m_sink_ticks;
+
+// Estimate is read from any context (dispatching thread for example) without
+// the request lock. It is only written with the request lock taken and is
+// protected by a sequence counter, odd while it is written: readers copy it
+// and retry if the counter changed meanwhile
+static uint32_t m_estimate_seq;
+static bool m_estimate_valid;
+static sink_clock_estimate_t m_estimate;
+
+static unsigned int m_period_s;
+static unsigned int m_sampling_count;
+
+/**
+ * \brief   Publish a new estimate, or invalidate it
+ * \param   estimate_p
+ *          New estimate, NULL if no estimate is available
+ * \note    This function MUST be called with sending_mutex locked
+ */
+static void publish_estimate_locked(const sink_clock_estimate_t * estimate_p)
+{
+    Platform_seqlock_write_begin(&m_estimate_seq);
+
+    m_estimate_valid = (estimate_p != NULL);
+    if (estimate_p != NULL)
+    {
+        memcpy(&m_estimate, estimate_p, sizeof(sink_clock_estimate_t));
+    }
+
+    Platform_seqlock_write_end(&m_estimate_seq);
+}
+
+static void reset_samples_locked(void)
+{
+    m_samples_count = 0;
+    m_next_sample = 0;
+    publish_estimate_locked(NULL);
+}
+
+/**
+ * \brief   Fit the sink clock on the samples
+ * \note    This function MUST be called with sending_mutex locked
+ */
+static void update_estimate_locked(void)
+{
+    sink_clock_estimate_t estimate;
+    const sample_t * newest_p = &m_samples[(m_next_sample + MAX_SAMPLES - 1) % MAX_SAMPLES];
+    uint32_t min_round_trip = UINT32_MAX;
+    unsigned long long first_host_us = newest_p->host_us;
+    double mean_x = 0, mean_y = 0;
+    double sxx = 0, sxy = 0;
+    double residuals = 0;
+    unsigned int used = 0;
+
+    for (unsigned int i = 0; i < m_samples_count; i++)
+    {
+        if (m_samples[i].round_trip_us < min_round_trip)
+        {
+            min_round_trip = m_samples[i].round_trip_us;
+        }
+    }
+
+    // Coordinates are relative to the newest sample to keep the precision
+    for (unsigned int i = 0; i < m_samples_count; i++)
+    {
+        const sample_t * sample_p = &m_samples[i];
+        if (sample_p->round_trip_us > min_round_trip * MAX_ROUND_TRIP_FACTOR)
+        {
+            continue;
+        }
+        mean_x += (double) (long long) (sample_p->host_us - newest_p->host_us);
+        mean_y += (double) (long long) (sample_p->sink_us - newest_p->sink_us);
+        if (sample_p->host_us < first_host_us)
+        {
+            first_host_us = sample_p->host_us;
+        }
+        used++;
+    }
+    mean_x /= used;
+    mean_y /= used;
+
+    for (unsigned int i = 0; i < m_samples_count; i++)
+    {
+        const sample_t * sample_p = &m_samples[i];
+        double dx, dy;
+
+        if (sample_p->round_trip_us > min_round_trip * MAX_ROUND_TRIP_FACTOR)
+        {
+            continue;
+        }
+        dx = (double) (long long) (sample_p->host_us - newest_p->host_us) - mean_x;
+        dy = (double) (long long) (sample_p->sink_us - newest_p->sink_us) - mean_y;
+        sxx += dx * dx;
+        sxy += dx * dy;
+    }
+
+    estimate.rate = 1.0;
+    if ((newest_p->host_us - first_host_us >= MIN_DRIFT_SPAN_US) && (sxx > 0))
+    {
+        estimate.rate = sxy / sxx;
+    }
+
+    for (unsigned int i = 0; i < m_samples_count; i++)
+    {
+        const sample_t * sample_p = &m_samples[i];
+        double residual;
+
+        if (sample_p->round_trip_us > min_round_trip * MAX_ROUND_TRIP_FACTOR)
+        {
+            continue;
+        }
+        residual = (double) (long long) (sample_p->sink_us - newest_p->sink_us) - mean_y
+                   - estimate.rate
+                         * ((double) (long long) (sample_p->host_us - newest_p->host_us)
+                            - mean_x);
+        residuals += (residual < 0) ? -residual : residual;
+    }
+
+    estimate.host_us = newest_p->host_us + (long long) mean_x;
+    estimate.sink_us = newest_p->sink_us + (long long) mean_y;
+    estimate.uncertainty_us = min_round_trip / 2 + (uint32_t) (residuals / used);
+    estimate.samples = used;
+
+    publish_estimate_locked(&estimate);
+}
+
+bool sink_clock_sample(void)
+{
+    uint8_t att[4];
+    unsigned long long request_us, confirm_us;
+    uint32_t ticks;
+    sample_t * sample_p;
+    int res;
+
+    Platform_lock_request();
+
+    request_us = Platform_get_timestamp_us_monotonic();
+    res = attribute_read_request_locked(MSAP_ATTRIBUTE_READ_REQUEST, MSAP_SYSTEM_TIME, 4, att);
+    confirm_us = WPC_Int_get_last_confirm_timestamp_us();
+    if ((res != 0) || (confirm_us < request_us))
+    {
+        Platform_unlock_request();
+        LOGW("Cannot read sink clock (%d)\n", res);
+        return false;
+    }
+
+    ticks = uint32_decode_le(att);
+    if ((m_samples_count > 0) && ((int32_t) (ticks - m_last_sink_ticks) < 0))
+    {
+        // Sink clock restarts with the stack
+        LOGI("Sink clock went backward, restart estimation\n");
+        reset_samples_locked();
+    }
+    if (m_samples_count == 0)
+    {
+        m_sink_ticks = ticks;
+    }
+    else
+    {
+        // Unwrapped on 64 bits
+        m_sink_ticks += (uint32_t) (ticks - m_last_sink_ticks);
+    }
+    m_last_sink_ticks = ticks;
+
+    sample_p = &m_samples[m_next_sample];
+    sample_p->host_us = request_us + (confirm_us - request_us) / 2;
+    sample_p->sink_us = SINK_TICKS_TO_US(m_sink_ticks) + HALF_TICK_US;
+    sample_p->round_trip_us = confirm_us - request_us;
+
+    m_next_sample = (m_next_sample + 1) % MAX_SAMPLES;
+    if (m_samples_count < MAX_SAMPLES)
+    {
+        m_samples_count++;
+    }
+
+    update_estimate_locked();
+
+    Platform_unlock_request();
+    return true;
+}
+
+static void sample_work(void)
+{
+    unsigned int period_s = Platform_atomic_load(&m_period_s, PLATFORM_RELAXED);
+
+    if (period_s == 0)
+    {
+        return;
+    }
+
+    sink_clock_sample();
+    m_sampling_count++;
+
+    // Period can be changed while sampling
+    period_s = Platform_atomic_load(&m_period_s, PLATFORM_RELAXED);
+    if (period_s != 0)
+    {
+        unsigned int delay_ms = (m_samples_count < BURST_SAMPLES) ? BURST_PERIOD_MS
+                                                                  : period_s * 1000;
+        Platform_schedule_work(sample_work, delay_ms + SAMPLING_JITTER_MS(m_sampling_count));
+    }
+}
+
+bool sink_clock_start(unsigned int period_s)
+{
+    Platform_lock_request();
+    reset_samples_locked();
+    Platform_atomic_store(&m_period_s, period_s, PLATFORM_RELAXED);
+    Platform_unlock_request();
+
+    if (period_s == 0)
+    {
+        return true;
+    }
+
+    return Platform_schedule_work(sample_work, 0);
+}
+
+bool sink_clock_get_estimate(sink_clock_estimate_t * estimate_p)
+{
+    uint32_t seq;
+    bool valid;
+
+    do
+    {
+        seq = Platform_seqlock_read_begin(&m_estimate_seq);
+        valid = m_estimate_valid;
+        memcpy(estimate_p, &m_estimate, sizeof(sink_clock_estimate_t));
+    } while (Platform_seqlock_read_retry(&m_estimate_seq, seq));
+
+    return valid;
+}
+
+bool sink_clock_to_host_us(unsigned long long sink_us, unsigned long long * host_us_p)
+{
+    sink_clock_estimate_t estimate;
+
+    if (!sink_clock_get_estimate(&estimate))
+    {
+        return false;
+    }
+
+    *host_us_p = estimate.host_us
+                 + (long long) ((double) (long long) (sink_us - estimate.sink_us) / estimate.rate);
+    return true;
+}
@@ -15,6 +15,7 @@
 #include "wpc_internal.h"
 #include "slip.h"
 #include "util.h"
+#include "platform.h"
 
 //#define PRINT_RECEIVED_CHAR
 
@@ -66,12 +67,8 @@ static const uint16_t crc_ccitt_lut[] = {
 static write_f write_function = NULL;
 static read_f read_function = NULL;
 
-/**
- * Compute the crc of a frame
- */
-static uint16_t crc_fromBuffer(uint8_t * buf, uint32_t len)
+uint16_t Slip_crc_update(uint16_t crc, const uint8_t * buf, uint32_t len)
 {
-    uint16_t crc = 0xffff;
     uint8_t index;
     uint32_t i;
 
@@ -83,6 +80,14 @@ static uint16_t crc_fromBuffer(uint8_t * buf, uint32_t len)
     return crc;
 }
 
+/**
+ * Compute the crc of a frame
+ */
+static uint16_t crc_fromBuffer(uint8_t * buf, uint32_t len)
+{
+    return Slip_crc_update(0xffff, buf, len);
+}
+
 /**
  * \brief   Convert an escaped frame to a normal frame
  * \param   buffer
@@ -93,7 +98,7 @@ static uint16_t crc_fromBuffer(uint8_t * buf, uint32_t len)
  */
 static uint32_t slip_decode_buffer(uint8_t * buffer, uint32_t len)
 {
-    uint8_t write = 0;
+    uint32_t write = 0;
     uint32_t read;
     for (read = 0; read < len; read++)
     {
@@ -124,7 +129,7 @@ static uint32_t slip_decode_buffer(uint8_t * buffer, uint32_t len)
 static uint32_t
 slip_encode_buffer(uint8_t * buffer, uint32_t len, uint8_t * buffer_escaped, uint32_t len_escaped)
 {
-    uint8_t write = 0;
+    uint32_t write = 0;
     uint32_t read;
     for (read = 0; read < len; read++)
     {
@@ -238,10 +243,22 @@ int Slip_send_buffer(uint8_t * buffer, uint32_t len)
         return WPC_INT_GEN_ERROR;
     }
 
+    Platform_capture_frame(false, buffer, len);
+
     return 0;
 }
 
 int Slip_get_buffer(uint8_t * buffer, uint32_t len, uint16_t timeout_ms)
+{
+    unsigned long long first_byte_us;
+
+    return Slip_get_buffer_timestamped(buffer, len, timeout_ms, &first_byte_us);
+}
+
+int Slip_get_buffer_timestamped(uint8_t * buffer,
+                                uint32_t len,
+                                uint16_t timeout_ms,
+                                unsigned long long * first_byte_us_p)
 {
     // Allocate the receiving buffer.
     uint8_t receiving_buffer[MAX_SIZE_ENCODED_BUFFER(len)];
@@ -284,14 +301,18 @@ int Slip_get_buffer(uint8_t * buffer, uint32_t len, uint16_t timeout_ms)
                     // the start of a frame instead of the end
                     LOGW("Too small packet received (size=%d)\n", size);
                     size = 0;
+                    *first_byte_us_p = Platform_get_timestamp_us_monotonic();
                     continue;
                 }
                 break;
             }
             else
             {
-                // Beginning of the frame
+                // Beginning of the frame. Reads are blocking, so the
+                // delimiter is read as soon as it arrives (unless the frame
+                // was already buffered)
                 start_of_frame_detected = true;
+                *first_byte_us_p = Platform_get_timestamp_us_monotonic();
             }
         }
         else if (start_of_frame_detected)
@@ -320,6 +341,7 @@ int Slip_get_buffer(uint8_t * buffer, uint32_t len, uint16_t timeout_ms)
     if (decoded_size > 0 && (unsigned int) decoded_size <= len)
     {
         memcpy(buffer, receiving_buffer, decoded_size);
+        Platform_capture_frame(true, buffer, decoded_size);
     }
     LOG_PRINT_BUFFER(buffer, decoded_size);
 
@@ -0,0 +1,421 @@
+/* Wirepas Oy licensed under Apache License, Version 2.0
+ *
+ * See file LICENSE for full license details.
+ *
+ */
+#define LOG_MODULE_NAME "tx_trace"
+#define MAX_LOG_LEVEL INFO_LOG_LEVEL
+#include "logger.h"
+
+#include <string.h>
+#include "tx_trace.h"
+#include "platform.h"
+#include "platform_atomic.h"
+
+/*
+ * Packets are sent from any application thread and their TX indications are
+ * received on the dispatching thread, so statistics have several writers.
+ * They are stored in an open addressing hash table (linear probing) indexed
+ * by destination and QoS: an entry is claimed with a compare and swap and is
+ * never removed, and its counters are updated atomically. Readers never
+ * block the sending.
+ *
+ * The table itself is only freed once no reader or writer uses it.
+ */
+
+// Load factor of the table is kept under 3/4
+#define MIN_TABLE_ENTRIES       16
+#define MAX_TABLE_ENTRIES       (1UL << 20)
+
+// Delay between two checks of the users of a table before freeing it
+#define FREE_TABLE_POLL_US      100
+
+typedef enum
+{
+    ENTRY_FREE = 0,
+    ENTRY_CLAIMED,  //< Key is being written
+    ENTRY_READY
+} entry_state_e;
+
+typedef struct
+{
+    uint32_t state;
+    app_tx_stats_t stats;
+} tx_entry_t;
+
+typedef struct
+{
+    size_t size;            //< Allocated size
+    uint32_t mask;          //< Number of entries - 1
+    uint32_t shift;         //< Shift to get an index from a hash
+    uint32_t max_entries;
+    uint32_t entries_count;
+    tx_entry_t entries[];
+} tx_table_t;
+
+static onTxTrace_cb_f m_trace_cb = NULL;
+
+static tx_table_t * m_table = NULL;
+
+// Number of readers and writers currently using m_table
+static uint32_t m_users = 0;
+
+static tx_table_t * get_table(void)
+{
+    tx_table_t * table_p;
+
+    Platform_atomic_add_fetch(&m_users, 1, PLATFORM_SEQ_CST);
+    table_p = Platform_atomic_load(&m_table, PLATFORM_SEQ_CST);
+    if (table_p == NULL)
+    {
+        Platform_atomic_sub_fetch(&m_users, 1, PLATFORM_RELEASE);
+    }
+
+    return table_p;
+}
+
+static void release_table(void)
+{
+    Platform_atomic_sub_fetch(&m_users, 1, PLATFORM_RELEASE);
+}
+
+/**
+ * \brief   Find the entry of a destination
+ * \param   insert
+ *          True to add the destination if not found (and table not full)
+ * \return  The entry or NULL if not found
+ */
+static tx_entry_t * find_entry(tx_table_t * table_p, uint32_t dst_addr, uint8_t qos, bool insert)
+{
+    // Fibonacci hashing on both keys
+    uint64_t key = ((uint64_t) dst_addr << 1) | (qos & 0x01);
+    uint32_t index = (uint32_t) ((key * 11400714819323198485ULL) >> 32) >> table_p->shift;
+
+    // Table is never full, so there is always a free entry at the end
+    while (true)
+    {
+        tx_entry_t * entry_p = &table_p->entries[index];
+        uint32_t state = Platform_atomic_load(&entry_p->state, PLATFORM_ACQUIRE);
+
+        if (state == ENTRY_FREE)
+        {
+            if (!insert)
+            {
+                return NULL;
+            }
+
+            if (Platform_atomic_fetch_add(&table_p->entries_count, 1, PLATFORM_RELAXED)
+                >= table_p->max_entries)
+            {
+                Platform_atomic_sub_fetch(&table_p->entries_count, 1, PLATFORM_RELAXED);
+                return NULL;
+            }
+
+            if (Platform_atomic_compare_exchange(&entry_p->state,
+                                                 &state,
+                                                 ENTRY_CLAIMED,
+                                                 PLATFORM_ACQUIRE,
+                                                 PLATFORM_ACQUIRE))
+            {
+                entry_p->stats.dst_addr = dst_addr;
+                entry_p->stats.qos = qos;
+                Platform_atomic_store(&entry_p->state, ENTRY_READY, PLATFORM_RELEASE);
+                return entry_p;
+            }
+
+            // Another writer claimed it first, state is updated
+            Platform_atomic_sub_fetch(&table_p->entries_count, 1, PLATFORM_RELAXED);
+        }
+
+        // Key is written right after the claim
+        while (state == ENTRY_CLAIMED)
+        {
+            state = Platform_atomic_load(&entry_p->state, PLATFORM_ACQUIRE);
+        }
+
+        if (entry_p->stats.dst_addr == dst_addr && entry_p->stats.qos == (app_qos_e) qos)
+        {
+            return entry_p;
+        }
+        index = (index + 1) & table_p->mask;
+    }
+}
+
+static void read_entry(tx_entry_t * entry_p, app_tx_stats_t * stats_p)
+{
+    app_tx_stats_t * src_p = &entry_p->stats;
+
+#define LOAD(field) stats_p->field = Platform_atomic_load(&src_p->field, PLATFORM_RELAXED)
+    stats_p->dst_addr = src_p->dst_addr;
+    stats_p->qos = src_p->qos;
+    LOAD(packets);
+    LOAD(errors);
+    LOAD(fragments);
+    LOAD(retries);
+    LOAD(indications);
+    LOAD(failed_indications);
+    LOAD(lock_wait_sum_us);
+    LOAD(write_sum_us);
+    LOAD(sink_sum_us);
+    LOAD(buffering_delay_sum_ms);
+    for (unsigned int i = 0; i < APP_TX_STATS_LATENCY_BUCKETS; i++)
+    {
+        LOAD(confirm_latency[i]);
+        LOAD(delivery_latency[i]);
+    }
+#undef LOAD
+}
+
+#define ADD(field, value) Platform_atomic_fetch_add(&(field), (value), PLATFORM_RELAXED)
+
+static unsigned int get_latency_bucket(uint32_t latency_us)
+{
+    uint32_t units = latency_us / APP_TX_STATS_LATENCY_LIMIT_US(0);
+    unsigned int bucket;
+
+    if (units == 0)
+    {
+        return 0;
+    }
+
+    bucket = 32 - __builtin_clz(units);
+    return bucket < APP_TX_STATS_LATENCY_BUCKETS ? bucket : APP_TX_STATS_LATENCY_BUCKETS - 1;
+}
+
+static uint32_t elapsed_us(unsigned long long from_us, unsigned long long to_us)
+{
+    return (to_us > from_us) ? (uint32_t) (to_us - from_us) : 0;
+}
+
+bool tx_trace_enable(onTxTrace_cb_f cb, unsigned int max_destinations)
+{
+    tx_table_t * table_p = NULL;
+    tx_table_t * previous_p;
+
+    if (max_destinations != 0)
+    {
+        uint32_t entries = MIN_TABLE_ENTRIES;
+        uint32_t bits = 4;
+        size_t size;
+
+        if (max_destinations > MAX_TABLE_ENTRIES / 4 * 3)
+        {
+            LOGE("Too many destinations for statistics: %u\n", max_destinations);
+            return false;
+        }
+
+        while (entries < max_destinations + max_destinations / 3 + 1)
+        {
+            entries <<= 1;
+            bits++;
+        }
+
+        size = sizeof(tx_table_t) + entries * sizeof(tx_entry_t);
+        table_p = Platform_malloc(size);
+        if (table_p == NULL)
+        {
+            LOGE("Cannot allocate statistics for %u destinations\n", max_destinations);
+            return false;
+        }
+
+        memset(table_p, 0, size);
+        table_p->size = size;
+        table_p->mask = entries - 1;
+        table_p->shift = 32 - bits;
+        table_p->max_entries = max_destinations;
+    }
+
+    Platform_atomic_store(&m_trace_cb, cb, PLATFORM_RELEASE);
+
+    previous_p = Platform_atomic_exchange(&m_table, table_p, PLATFORM_SEQ_CST);
+    if (previous_p != NULL)
+    {
+        // Readers and writers are short, wait for them before freeing the
+        // previous table
+        while (Platform_atomic_load(&m_users, PLATFORM_SEQ_CST) != 0)
+        {
+            Platform_usleep(FREE_TABLE_POLL_US);
+        }
+        Platform_free(previous_p, previous_p->size);
+    }
+
+    LOGI("Tx trace %s (%u destinations)\n",
+         (cb != NULL || max_destinations != 0) ? "enabled" : "disabled",
+         max_destinations);
+    return true;
+}
+
+bool tx_trace_start(tx_trace_t * trace_p, uint32_t dst_addr, uint16_t pdu_id, uint8_t qos)
+{
+    if (Platform_atomic_load(&m_trace_cb, PLATFORM_RELAXED) == NULL
+        && Platform_atomic_load(&m_table, PLATFORM_RELAXED) == NULL)
+    {
+        return false;
+    }
+
+    memset(trace_p, 0, sizeof(tx_trace_t));
+    trace_p->submit_us = Platform_get_timestamp_us_monotonic();
+    trace_p->trace.submit_ms_epoch = Platform_timestamp_us_monotonic_to_epoch(trace_p->submit_us) / 1000;
+    trace_p->trace.dst_addr = dst_addr;
+    trace_p->trace.pdu_id = pdu_id;
+    trace_p->trace.qos = qos;
+    return true;
+}
+
+void tx_trace_add_request(tx_trace_t * trace_p,
+                          unsigned long long start_us,
+                          const WPC_Int_request_timing_t * timing_p,
+                          size_t fragment)
+{
+    app_tx_trace_t * trace = &trace_p->trace;
+
+    if (fragment >= APP_TX_TRACE_MAX_FRAGMENTS)
+    {
+        fragment = APP_TX_TRACE_MAX_FRAGMENTS - 1;
+    }
+
+    trace->lock_wait_us += elapsed_us(start_us, timing_p->lock_us);
+    trace->write_us += elapsed_us(timing_p->lock_us, timing_p->write_us);
+    trace->retries += timing_p->resends;
+    trace->fragment_retries[fragment] += timing_p->resends;
+    if (timing_p->confirm_us != 0)
+    {
+        trace->sink_us += elapsed_us(timing_p->write_us, timing_p->confirm_us);
+        trace->confirm_us = elapsed_us(trace_p->submit_us, timing_p->confirm_us);
+    }
+}
+
+void tx_trace_on_confirm(tx_trace_t * trace_p, int result)
+{
+    app_tx_trace_t * trace = &trace_p->trace;
+    tx_table_t * table_p;
+
+    trace->result = result;
+
+    table_p = get_table();
+    if (table_p != NULL)
+    {
+        tx_entry_t * entry_p = find_entry(table_p, trace->dst_addr, trace->qos, true);
+
+        if (entry_p != NULL)
+        {
+            app_tx_stats_t * stats_p = &entry_p->stats;
+
+            ADD(stats_p->packets, 1);
+            if (result != 0)
+            {
+                ADD(stats_p->errors, 1);
+            }
+            else
+            {
+                ADD(stats_p->confirm_latency[get_latency_bucket(trace->confirm_us)], 1);
+            }
+            // Fragments are counted even if the packet is incomplete
+            ADD(stats_p->fragments, trace->fragments);
+            ADD(stats_p->retries, trace->retries);
+            ADD(stats_p->lock_wait_sum_us, trace->lock_wait_us);
+            ADD(stats_p->write_sum_us, trace->write_us);
+            ADD(stats_p->sink_sum_us, trace->sink_us);
+        }
+        release_table();
+    }
+}
+
+void tx_trace_end(tx_trace_t * trace_p)
+{
+    onTxTrace_cb_f cb = Platform_atomic_load(&m_trace_cb, PLATFORM_ACQUIRE);
+
+    if (cb != NULL)
+    {
+        cb(&trace_p->trace);
+    }
+}
+
+void tx_trace_on_indication(tx_trace_t * trace_p,
+                            uint8_t result,
+                            uint32_t buffering_delay_ms,
+                            unsigned long long timestamp_us)
+{
+    app_tx_trace_t * trace = &trace_p->trace;
+    tx_table_t * table_p;
+
+    trace->indication = true;
+    trace->indication_result = result;
+    trace->buffering_delay_ms = buffering_delay_ms;
+    if (timestamp_us > trace_p->submit_us)
+    {
+        unsigned long long indication_us = timestamp_us - trace_p->submit_us;
+        trace->indication_us = (indication_us < UINT32_MAX) ? (uint32_t) indication_us : UINT32_MAX;
+    }
+
+    table_p = get_table();
+    if (table_p != NULL)
+    {
+        tx_entry_t * entry_p = find_entry(table_p, trace->dst_addr, trace->qos, false);
+
+        if (entry_p != NULL)
+        {
+            app_tx_stats_t * stats_p = &entry_p->stats;
+
+            ADD(stats_p->indications, 1);
+            if (result != 0)
+            {
+                ADD(stats_p->failed_indications, 1);
+            }
+            ADD(stats_p->buffering_delay_sum_ms, buffering_delay_ms);
+            ADD(stats_p->delivery_latency[get_latency_bucket(trace->indication_us)], 1);
+        }
+        release_table();
+    }
+
+    tx_trace_end(trace_p);
+}
+
+app_res_e tx_trace_get_stats(uint32_t dst_addr, uint8_t qos, app_tx_stats_t * stats_p)
+{
+    tx_table_t * table_p = get_table();
+    tx_entry_t * entry_p;
+    app_res_e res = APP_RES_UNKNOWN_DEST;
+
+    if (table_p == NULL)
+    {
+        return APP_RES_ATTRIBUTE_NOT_SET;
+    }
+
+    entry_p = find_entry(table_p, dst_addr, qos, false);
+    if (entry_p != NULL)
+    {
+        read_entry(entry_p, stats_p);
+        res = APP_RES_OK;
+    }
+
+    release_table();
+    return res;
+}
+
+app_res_e tx_trace_get_next_stats(uint32_t * cursor_p, app_tx_stats_t * stats_p)
+{
+    tx_table_t * table_p = get_table();
+    app_res_e res = APP_RES_UNKNOWN_DEST;
+
+    if (table_p == NULL)
+    {
+        return APP_RES_ATTRIBUTE_NOT_SET;
+    }
+
+    for (uint32_t index = *cursor_p; index <= table_p->mask; index++)
+    {
+        tx_entry_t * entry_p = &table_p->entries[index];
+
+        if (Platform_atomic_load(&entry_p->state, PLATFORM_ACQUIRE) == ENTRY_READY)
+        {
+            read_entry(entry_p, stats_p);
+            *cursor_p = index + 1;
+            res = APP_RES_OK;
+            break;
+        }
+    }
+
+    release_table();
+    return res;
+}
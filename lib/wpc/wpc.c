@@ -6,15 +6,22 @@
 #define LOG_MODULE_NAME "wpc"
 #define MAX_LOG_LEVEL INFO_LOG_LEVEL
 #include "logger.h"
+#include <errno.h>
 #include <string.h>
+#include <unistd.h>
 #include "csap.h"
 #include "dsap.h"
 #include "msap.h"
+#include "node_stats.h"
+#include "sink_clock.h"
+#include "slip.h"  // For Slip_crc_update()
+#include "tx_trace.h"
 #include "util.h"
 
 #include "wpc.h"  // For DEFAULT_BITRATE
 #include "wpc_internal.h"
 #include "platform.h"  // For Platform_get_timestamp_ms_monotonic()
+#include "platform_atomic.h"
 
 /**
  * \brief   Macro to convert dual_mcu return code
@@ -35,6 +42,15 @@
 
 #define DEFAULT_TIMEOUT_AFTER_STOP_STACK_S 60
 
+// Delay after a stop request before checking the stack again. If status is
+// asked immediately, stack cannot answer as it is rebooting
+#define DELAY_BEFORE_STATUS_AFTER_STOP_MS 500
+
+// Delays between two stack status attempts while waiting for the stack.
+// Delay is doubled after each failed attempt
+#define STACK_STATUS_MIN_DELAY_MS 50U
+#define STACK_STATUS_MAX_DELAY_MS 2000U
+
 /** \brief   Timeout to get a valid stack response after
  *           a stop stack. It can be quite long in case of
  *           the bootloader is processing a scratchpad
@@ -42,6 +58,9 @@
 */
 static unsigned int m_timeout_after_stop_task_s = DEFAULT_TIMEOUT_AFTER_STOP_STACK_S;
 
+// Time an asynchronous stop is given up if the node didn't reboot (monotonic ms)
+static unsigned long long m_stop_stack_async_deadline_ms;
+
 app_res_e WPC_initialize(const char * port_name, unsigned long bitrate)
 {
     int res = WPC_Int_initialize(port_name, bitrate);
@@ -56,7 +75,12 @@ app_res_e WPC_initialize(const char * port_name, unsigned long bitrate)
 
 void WPC_close(void)
 {
+    // Samples of the sink clock are not valid for a next session
+    sink_clock_start(0);
     WPC_Int_close();
+    // Dispatching thread is stopped, nothing updates the statistics anymore
+    node_stats_enable(0);
+    tx_trace_enable(NULL, 0);
 }
 
 /* Error code LUT for reading attribute */
@@ -96,6 +120,152 @@ app_res_e WPC_set_max_poll_fail_duration(unsigned int duration_s)
     }
 }
 
+app_res_e WPC_start_frame_capture(const char * path, uint32_t max_file_size, uint8_t max_files)
+{
+    return Platform_capture_start(path, max_file_size, max_files) ? APP_RES_OK : APP_RES_INVALID_VALUE;
+}
+
+app_res_e WPC_stop_frame_capture(void)
+{
+    Platform_capture_stop();
+    return APP_RES_OK;
+}
+
+app_res_e WPC_set_link_recovery_backoff(unsigned int min_delay_ms, unsigned int max_delay_ms)
+{
+    return WPC_Int_set_link_recovery_backoff(min_delay_ms, max_delay_ms) ? APP_RES_OK : APP_RES_INVALID_VALUE;
+}
+
+static app_res_e convert_bulk_transfer_res(int res)
+{
+    if (res == 0)
+    {
+        return APP_RES_OK;
+    }
+    if (res == WPC_INT_WRONG_PARAM_ERROR)
+    {
+        return APP_RES_INVALID_VALUE;
+    }
+    if (res < 0)
+    {
+        return APP_RES_INTERNAL_ERROR;
+    }
+    return convert_error_code(ATT_WRITE_ERROR_CODE_LUT, res);
+}
+
+app_res_e WPC_start_bulk_transfer_mode(uint16_t bitrate_attribute_id, unsigned long bitrate)
+{
+    return convert_bulk_transfer_res(WPC_Int_start_bulk_transfer(bitrate_attribute_id, bitrate));
+}
+
+app_res_e WPC_stop_bulk_transfer_mode(void)
+{
+    return convert_bulk_transfer_res(WPC_Int_stop_bulk_transfer());
+}
+
+static app_res_e attribute_batch(app_attr_req_t * reqs,
+                                 size_t n,
+                                 bool write,
+                                 unsigned long long * timestamp_ms_epoch_p)
+{
+    attribute_batch_item_t * items;
+    unsigned long long timestamp_ms_epoch;
+
+    if (reqs == NULL || n == 0)
+    {
+        return APP_RES_INVALID_VALUE;
+    }
+
+    items = Platform_malloc(n * sizeof(attribute_batch_item_t));
+    if (items == NULL)
+    {
+        return APP_RES_OUT_OF_MEMORY;
+    }
+
+    for (size_t i = 0; i < n; i++)
+    {
+        items[i] = (attribute_batch_item_t){
+            .write = write,
+            .attribute_id = reqs[i].attribute_id,
+            .attribute_length = reqs[i].length,
+            .attribute_value_p = reqs[i].value_p,
+        };
+
+        if (reqs[i].sap == APP_ATTR_CSAP)
+        {
+            items[i].primitive_id = write ? CSAP_ATTRIBUTE_WRITE_REQUEST : CSAP_ATTRIBUTE_READ_REQUEST;
+        }
+        else
+        {
+            items[i].primitive_id = write ? MSAP_ATTRIBUTE_WRITE_REQUEST : MSAP_ATTRIBUTE_READ_REQUEST;
+        }
+    }
+
+    attribute_batch_request(items, n, &timestamp_ms_epoch);
+
+    for (size_t i = 0; i < n; i++)
+    {
+        reqs[i].result = write ? convert_error_code(ATT_WRITE_ERROR_CODE_LUT, items[i].result)
+                               : convert_error_code(ATT_READ_ERROR_CODE_LUT, items[i].result);
+    }
+
+    Platform_free(items, n * sizeof(attribute_batch_item_t));
+
+    if (timestamp_ms_epoch_p != NULL)
+    {
+        *timestamp_ms_epoch_p = timestamp_ms_epoch;
+    }
+
+    return APP_RES_OK;
+}
+
+app_res_e WPC_attribute_batch_read(app_attr_req_t * reqs,
+                                   size_t n,
+                                   unsigned long long * timestamp_ms_epoch_p)
+{
+    return attribute_batch(reqs, n, false, timestamp_ms_epoch_p);
+}
+
+app_res_e WPC_attribute_batch_write(app_attr_req_t * reqs,
+                                    size_t n,
+                                    unsigned long long * timestamp_ms_epoch_p)
+{
+    return attribute_batch(reqs, n, true, timestamp_ms_epoch_p);
+}
+
+app_res_e WPC_enable_attribute_cache(bool enable)
+{
+    attribute_cache_enable(enable);
+    return APP_RES_OK;
+}
+
+app_res_e WPC_get_attribute_cache_stats(uint32_t * hits_p, uint32_t * misses_p)
+{
+    if (hits_p == NULL || misses_p == NULL)
+    {
+        return APP_RES_INVALID_VALUE;
+    }
+
+    attribute_cache_get_stats(hits_p, misses_p);
+    return APP_RES_OK;
+}
+
+app_res_e WPC_set_attribute_cacheable(app_attr_sap_e sap, uint16_t attribute_id, bool cacheable)
+{
+    uint8_t primitive_id = (sap == APP_ATTR_CSAP) ? CSAP_ATTRIBUTE_READ_REQUEST
+                                                  : MSAP_ATTRIBUTE_READ_REQUEST;
+
+    if (!attribute_cache_set_volatility(primitive_id,
+                                        attribute_id,
+                                        cacheable ? ATTRIBUTE_CACHE_UNTIL_REBOOT
+                                                  : ATTRIBUTE_CACHE_NONE))
+    {
+        return APP_RES_INVALID_VALUE;
+    }
+
+    return APP_RES_OK;
+}
+
 app_res_e  WPC_set_max_fragment_duration(unsigned int duration_s)
 {
     if (dsap_set_max_fragment_duration(duration_s))
@@ -560,14 +730,22 @@ static bool get_stack_status(uint16_t timeout_s)
 {
     uint8_t status;
     app_res_e res = APP_RES_INTERNAL_ERROR;
+    unsigned int delay_ms = STACK_STATUS_MIN_DELAY_MS;
 
     // Compute timeout
     unsigned long long timeout = Platform_get_timestamp_ms_monotonic() + timeout_s * 1000;
 
-    while (res != APP_RES_OK && Platform_get_timestamp_ms_monotonic() < timeout)
+    while (true)
     {
         res = WPC_get_stack_status(&status);
-        LOGD("Cannot get status after start/stop, try again...\n");
+        if (res == APP_RES_OK || Platform_get_timestamp_ms_monotonic() >= timeout)
+        {
+            break;
+        }
+
+        LOGD("Cannot get status after start/stop, try again in %d ms...\n", delay_ms);
+        Platform_usleep(delay_ms * 1000);
+        delay_ms = MIN(delay_ms * 2, STACK_STATUS_MAX_DELAY_MS);
     }
 
     if (res != APP_RES_OK)
@@ -644,12 +822,9 @@ app_res_e WPC_stop_stack(void)
     }
     else
     {
-        // Active wait of 500ms to avoid a systematic timeout
-        // at each reboot. If status is asked immediately,
-        // stack cannot answer
-        unsigned long long end_wait = Platform_get_timestamp_ms_monotonic() + 500;
-        while (Platform_get_timestamp_ms_monotonic() < end_wait)
-            ;
+        // Wait to avoid a systematic timeout at each reboot.
+        // If status is asked immediately, stack cannot answer
+        Platform_usleep(DELAY_BEFORE_STATUS_AFTER_STOP_MS * 1000);
 
         // A stop of the stack will reboot the device
         // Wait for the stack to be up again
@@ -673,6 +848,93 @@ static app_res_e read_single_byte_msap(uint8_t att, uint8_t * pointer)
     return convert_error_code(ATT_READ_ERROR_CODE_LUT, res);
 }
 
+/**
+ * \brief   Give up an asynchronous stop if the node didn't reboot in time
+ * \note    Executed from the platform worker
+ */
+static void stop_stack_async_deadline(void)
+{
+    unsigned long long deadline_ms = Platform_atomic_load(&m_stop_stack_async_deadline_ms,
+                                                          PLATFORM_ACQUIRE);
+    unsigned long long now_ms = Platform_get_timestamp_ms_monotonic();
+    onStackStatusReceived_cb_f reboot_cb;
+
+    if (now_ms < deadline_ms)
+    {
+        // Work was already pending for a previous stop, wait for the new one
+        Platform_schedule_work(stop_stack_async_deadline, deadline_ms - now_ms);
+        return;
+    }
+
+    // Nothing to do if the stop already ended
+    reboot_cb = msap_take_stack_reboot_cb();
+    if (reboot_cb != NULL)
+    {
+        LOGE("Node didn't reboot after stop request\n");
+        reboot_cb(APP_STACK_STATUS_NO_REBOOT);
+    }
+}
+
+app_res_e WPC_stop_stack_async(onStackStatusReceived_cb_f onStackStopped)
+{
+    int res;
+    // Max poll fail duration may be disabled, don't wait forever
+    unsigned int timeout_ms = (m_timeout_after_stop_task_s ? m_timeout_after_stop_task_s
+                                                           : DEFAULT_TIMEOUT_AFTER_STOP_STACK_S)
+                              * 1000;
+
+    if (onStackStopped == NULL)
+    {
+        return APP_RES_INVALID_VALUE;
+    }
+
+    // Completion is notified by the stack state indication sent
+    // by the node when it boots again
+    if (!msap_register_for_stack_reboot(onStackStopped))
+    {
+        // A stop is already in progress
+        return APP_RES_ALREADY_REGISTERED;
+    }
+
+    // Give up if node doesn't come back, as the synchronous version
+    Platform_atomic_store(&m_stop_stack_async_deadline_ms,
+                          Platform_get_timestamp_ms_monotonic() + timeout_ms,
+                          PLATFORM_RELEASE);
+    if (!Platform_schedule_work(stop_stack_async_deadline, timeout_ms))
+    {
+        LOGE("Cannot schedule the end of the stop\n");
+        msap_unregister_from_stack_reboot();
+        return APP_RES_INTERNAL_ERROR;
+    }
+
+    res = msap_stack_stop_request();
+
+    // As for synchronous version, res < 0 can happen if node reboot
+    // too early, so wait for the indication anyway
+    if (res <= 0)
+    {
+        return APP_RES_OK;
+    }
+
+    // Stop refused, node will not reboot
+    msap_unregister_from_stack_reboot();
+    if (res == 1)
+    {
+        return APP_RES_STACK_ALREADY_STOPPED;
+    }
+    else if (res == 128)
+    {
+        return APP_RES_ACCESS_DENIED;
+    }
+
+    return APP_RES_INTERNAL_ERROR;
+}
+
+app_res_e WPC_cancel_stop_stack_async(void)
+{
+    return msap_unregister_from_stack_reboot() ? APP_RES_OK : APP_RES_NOT_REGISTERED;
+}
+
 app_res_e WPC_get_stack_status(uint8_t * status_p)
 {
     return read_single_byte_msap(MSAP_STACK_STATUS, status_p);
@@ -735,6 +997,74 @@ app_res_e WPC_get_system_time(uint32_t * time_p)
     return APP_RES_OK;
 }
 
+app_res_e WPC_enable_sink_clock_estimation(unsigned int period_s)
+{
+    return sink_clock_start(period_s) ? APP_RES_OK : APP_RES_INTERNAL_ERROR;
+}
+
+app_res_e WPC_get_sink_clock_estimate(app_sink_clock_t * clock_p)
+{
+    sink_clock_estimate_t estimate;
+
+    if (clock_p == NULL)
+    {
+        return APP_RES_INVALID_VALUE;
+    }
+
+    if (!sink_clock_get_estimate(&estimate))
+    {
+        return APP_RES_ATTRIBUTE_NOT_SET;
+    }
+
+    clock_p->sink_time_us = estimate.sink_us;
+    clock_p->epoch_us = Platform_timestamp_us_monotonic_to_epoch(estimate.host_us);
+    clock_p->drift_ppb = (int32_t) ((estimate.rate - 1.0) * 1e9);
+    clock_p->uncertainty_us = estimate.uncertainty_us;
+    clock_p->samples = estimate.samples;
+    return APP_RES_OK;
+}
+
+app_res_e WPC_sink_time_to_epoch_us(unsigned long long sink_time_us,
+                                    unsigned long long * epoch_us_p)
+{
+    unsigned long long host_us;
+
+    if (epoch_us_p == NULL)
+    {
+        return APP_RES_INVALID_VALUE;
+    }
+
+    if (!sink_clock_to_host_us(sink_time_us, &host_us))
+    {
+        return APP_RES_ATTRIBUTE_NOT_SET;
+    }
+
+    *epoch_us_p = Platform_timestamp_us_monotonic_to_epoch(host_us);
+    return APP_RES_OK;
+}
+
+app_res_e WPC_get_origin_timestamp_ms_epoch(unsigned long long rx_timestamp_ms_epoch,
+                                            uint32_t travel_time_ms,
+                                            unsigned long long * origin_ms_epoch_p)
+{
+    sink_clock_estimate_t estimate;
+    unsigned long long travel_time_host_ms = travel_time_ms;
+
+    if (origin_ms_epoch_p == NULL)
+    {
+        return APP_RES_INVALID_VALUE;
+    }
+
+    // Travel time is counted by the sink clock, convert it to host time
+    if (sink_clock_get_estimate(&estimate))
+    {
+        travel_time_host_ms = (unsigned long long) (travel_time_ms / estimate.rate + 0.5);
+    }
+
+    *origin_ms_epoch_p = rx_timestamp_ms_epoch - travel_time_host_ms;
+    return APP_RES_OK;
+}
+
 app_res_e WPC_get_access_cycle_range(uint16_t * min_ac_p, uint16_t * max_ac_p)
 {
     app_res_e ret;
@@ -967,8 +1297,7 @@ static const app_res_e SCRATCHPAD_LOCAL_BLOCK_ERROR_CODE_LUT[] = {
 app_res_e WPC_upload_local_block_scratchpad(uint32_t len, const uint8_t * bytes, uint32_t start)
 {
     app_res_e app_res;
-    uint32_t loaded = 0;
-    uint8_t max_block_size, block_size;
+    uint8_t max_block_size;
 
     app_res = WPC_get_scratchpad_block_max(&max_block_size);
     if (app_res != APP_RES_OK)
@@ -977,6 +1306,22 @@ app_res_e WPC_upload_local_block_scratchpad(uint32_t len, const uint8_t * bytes,
         return app_res;
     }
 
+    return WPC_upload_local_block_scratchpad_with_max(len, bytes, start, max_block_size);
+}
+
+app_res_e WPC_upload_local_block_scratchpad_with_max(uint32_t len,
+                                                     const uint8_t * bytes,
+                                                     uint32_t start,
+                                                     uint8_t max_block_size)
+{
+    uint32_t loaded = 0;
+    uint8_t block_size;
+
+    if (max_block_size == 0)
+    {
+        return APP_RES_INVALID_VALUE;
+    }
+
     while (loaded < len)
     {
         uint32_t remaining = len - loaded;
@@ -1001,6 +1346,326 @@ app_res_e WPC_upload_local_block_scratchpad(uint32_t len, const uint8_t * bytes,
     return APP_RES_OK;
 }
 
+// Number of times a scratchpad block is sent again after a link error before
+// giving up and letting the caller resume the upload later
+#define SCRATCHPAD_BLOCK_MAX_RETRIES 5
+
+// Delay before sending a block again, doubled for each retry so that the
+// link has time to be recovered (at most 0.25 + 0.5 + 1 + 2 + 2 s in total)
+#define SCRATCHPAD_BLOCK_RETRY_MIN_DELAY_MS 250U
+#define SCRATCHPAD_BLOCK_RETRY_MAX_DELAY_MS 2000U
+
+// Block result when the node has no scratchpad upload ongoing (rebooted)
+#define SCRATCHPAD_BLOCK_RES_NO_START 4
+
+/**
+ * \brief   Function prototype to read a part of a scratchpad image
+ * \param   ctx
+ *          Context of the reader
+ * \param   offset
+ *          Offset to read from
+ * \param   buffer
+ *          Buffer to store the read bytes
+ * \param   len
+ *          Number of bytes to read
+ * \return  True if exactly len bytes were read
+ */
+typedef bool (*scratchpad_reader_f)(const void * ctx, uint32_t offset, uint8_t * buffer, uint32_t len);
+
+static bool read_scratchpad_from_memory(const void * ctx, uint32_t offset, uint8_t * buffer, uint32_t len)
+{
+    memcpy(buffer, (const uint8_t *) ctx + offset, len);
+    return true;
+}
+
+static bool read_scratchpad_from_fd(const void * ctx, uint32_t offset, uint8_t * buffer, uint32_t len)
+{
+    const int fd = *(const int *) ctx;
+    uint32_t read_bytes = 0;
+
+    while (read_bytes < len)
+    {
+        ssize_t res = pread(fd, buffer + read_bytes, len - read_bytes, offset + read_bytes);
+        if (res < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (res <= 0)
+        {
+            LOGE("Cannot read scratchpad at offset %u (%d)\n", offset + read_bytes, errno);
+            return false;
+        }
+        read_bytes += res;
+    }
+    return true;
+}
+
+/**
+ * \brief   Add a block of the image to the scratchpad crc, skipping the header
+ */
+static uint16_t update_scratchpad_crc(uint16_t crc, uint32_t offset, const uint8_t * block, uint32_t len)
+{
+    if (offset + len <= SCRATCHPAD_HEADER_SIZE)
+    {
+        return crc;
+    }
+
+    if (offset < SCRATCHPAD_HEADER_SIZE)
+    {
+        uint32_t skip = SCRATCHPAD_HEADER_SIZE - offset;
+        block += skip;
+        len -= skip;
+    }
+
+    return Slip_crc_update(crc, block, len);
+}
+
+/**
+ * \brief   Check if a link error happened before the request reached the node
+ * \param   res
+ *          Negative result of a request
+ * \return  True if the node cannot have executed the request
+ */
+static bool is_request_undelivered(int res)
+{
+    // Request was not written or its crc was reported wrong by the node.
+    // Other errors (lost or corrupted confirm) don't tell if the node
+    // executed it
+    return (res == WPC_INT_LINK_DOWN_ERROR) || (res == WPC_INT_GEN_ERROR)
+           || (res == WPC_INT_WRONG_CRC_FROM_HOST);
+}
+
+/**
+ * \brief   Check if a block whose write result was lost is stored on the node
+ * \return  1 if the block is read back from the node with the same content,
+ *          0 if it is read back with another content, a negative value if it
+ *          cannot be read back
+ */
+static int check_scratchpad_block_stored(uint32_t addr_le, uint8_t block_size, const uint8_t * block)
+{
+    uint8_t stored[MAXIMUM_SCRATCHPAD_BLOCK_SIZE];
+    int res;
+
+    res = msap_scratchpad_block_read_request(addr_le, block_size, stored);
+    if (res != 0)
+    {
+        return res < 0 ? res : -1;
+    }
+
+    return memcmp(stored, block, block_size) == 0 ? 1 : 0;
+}
+
+static int send_scratchpad_block_with_retries(uint32_t offset,
+                                              uint8_t block_size,
+                                              const uint8_t * block,
+                                              bool last_block)
+{
+    uint32_t delay_ms = SCRATCHPAD_BLOCK_RETRY_MIN_DELAY_MS;
+    uint32_t addr_le;
+    int res;
+
+    uint32_encode_le(offset, (uint8_t *) &addr_le);
+
+    for (int retry = 0;; retry++)
+    {
+        res = msap_scratchpad_block_request(addr_le, block_size, block);
+        if (res >= 0 || retry == SCRATCHPAD_BLOCK_MAX_RETRIES)
+        {
+            return res;
+        }
+
+        if (!is_request_undelivered(res))
+        {
+            // Node may have written the block, writing it twice could
+            // corrupt the upload. Only send it again if it is not stored
+            const int stored = check_scratchpad_block_stored(addr_le, block_size, block);
+            if (stored == 1)
+            {
+                LOGW("Scratchpad block at %u stored despite error %d\n", offset, res);
+                return last_block ? 1 : 0;
+            }
+            else if (stored < 0)
+            {
+                // Node may not support reading back its scratchpad, or link
+                // is still broken: let the caller decide when to resume
+                LOGE("Cannot tell if scratchpad block at %u is stored (%d)\n", offset, res);
+                return res;
+            }
+
+            // Link is working again and block is not stored
+            LOGW("Scratchpad block at %u not stored after error %d, sending it again\n", offset, res);
+            continue;
+        }
+
+        LOGW("Link error (%d) on scratchpad block at %u, retrying in %ums\n", res, offset, delay_ms);
+        Platform_usleep(delay_ms * 1000);
+        delay_ms = MIN(delay_ms * 2, SCRATCHPAD_BLOCK_RETRY_MAX_DELAY_MS);
+    }
+}
+
+static app_res_e verify_uploaded_scratchpad(uint32_t len, uint8_t seq, uint16_t crc)
+{
+    app_scratchpad_status_t status;
+    app_res_e res;
+
+    res = WPC_get_local_scratchpad_status(&status);
+    if (res != APP_RES_OK)
+    {
+        LOGE("Cannot get scratchpad status to verify upload\n");
+        return res;
+    }
+
+    if (status.scrat_len != len || status.scrat_seq_number != seq
+        || (len > SCRATCHPAD_HEADER_SIZE && status.scrat_crc != crc))
+    {
+        LOGE("Uploaded scratchpad mismatch: len %u/%u seq %u/%u crc 0x%04x/0x%04x\n",
+             status.scrat_len,
+             len,
+             status.scrat_seq_number,
+             seq,
+             status.scrat_crc,
+             crc);
+        return APP_RES_INVALID_SCRATCHPAD;
+    }
+
+    return APP_RES_OK;
+}
+
+static app_res_e upload_scratchpad_stream(scratchpad_reader_f reader,
+                                          const void * ctx,
+                                          uint32_t len,
+                                          uint8_t seq,
+                                          uint32_t * offset_p,
+                                          onScratchpadUploadProgress_cb_f progress_cb)
+{
+    uint8_t block[MAXIMUM_SCRATCHPAD_BLOCK_SIZE];
+    uint8_t max_block_size, block_size;
+    uint16_t crc = 0xffff;
+    uint32_t offset;
+    app_res_e app_res;
+
+    if (offset_p == NULL || *offset_p > len)
+    {
+        return APP_RES_INVALID_VALUE;
+    }
+    offset = *offset_p;
+
+    // Block max size is only queried once for the whole upload
+    app_res = WPC_get_scratchpad_block_max(&max_block_size);
+    if (app_res != APP_RES_OK)
+    {
+        LOGE("Cannot get max block scratchpad size\n");
+        return app_res;
+    }
+
+    if (max_block_size > MAXIMUM_SCRATCHPAD_BLOCK_SIZE)
+    {
+        max_block_size = MAXIMUM_SCRATCHPAD_BLOCK_SIZE;
+    }
+
+    if (offset == 0)
+    {
+        app_res = WPC_start_local_scratchpad_update(len, seq);
+        if (app_res != APP_RES_OK)
+        {
+            LOGE("Cannot start scratchpad update\n");
+            return app_res;
+        }
+    }
+    else
+    {
+        // Resuming, the already acknowledged part must still be part of the crc
+        LOGI("Resuming scratchpad upload at %u/%u\n", offset, len);
+        for (uint32_t pos = 0; pos < offset; pos += block_size)
+        {
+            block_size = (offset - pos > max_block_size) ? max_block_size : offset - pos;
+            if (!reader(ctx, pos, block, block_size))
+            {
+                return APP_RES_DATA_ERROR;
+            }
+            crc = update_scratchpad_crc(crc, pos, block, block_size);
+        }
+    }
+
+    while (offset < len)
+    {
+        uint32_t remaining = len - offset;
+        block_size = (remaining > max_block_size) ? max_block_size : remaining;
+
+        if (!reader(ctx, offset, block, block_size))
+        {
+            return APP_RES_DATA_ERROR;
+        }
+
+        const int res = send_scratchpad_block_with_retries(offset,
+                                                           block_size,
+                                                           block,
+                                                           offset + block_size == len);
+        if (res == SCRATCHPAD_BLOCK_RES_NO_START)
+        {
+            LOGE("Scratchpad upload lost by the node, must be restarted\n");
+            *offset_p = 0;
+            return APP_RES_NO_SCRATCHPAD_START;
+        }
+
+        if (res > 1 || res < 0)
+        {
+            LOGE("Error in loading scratchpad block at %u -> %d\n", offset, res);
+            return convert_error_code(SCRATCHPAD_LOCAL_BLOCK_ERROR_CODE_LUT, res);
+        }
+
+        crc = update_scratchpad_crc(crc, offset, block, block_size);
+        offset += block_size;
+        *offset_p = offset;
+
+        if (progress_cb != NULL)
+        {
+            progress_cb(offset, len);
+        }
+    }
+
+    return verify_uploaded_scratchpad(len, seq, crc);
+}
+
+app_res_e WPC_get_scratchpad_image_crc(uint32_t len, const uint8_t * bytes, uint16_t * crc_p)
+{
+    if (bytes == NULL || crc_p == NULL || len <= SCRATCHPAD_HEADER_SIZE)
+    {
+        return APP_RES_INVALID_VALUE;
+    }
+
+    *crc_p = update_scratchpad_crc(0xffff, 0, bytes, len);
+    return APP_RES_OK;
+}
+
+app_res_e WPC_upload_local_scratchpad_resumable(uint32_t len,
+                                                const uint8_t * bytes,
+                                                uint8_t seq,
+                                                uint32_t * offset_p,
+                                                onScratchpadUploadProgress_cb_f progress_cb)
+{
+    if (bytes == NULL)
+    {
+        return APP_RES_INVALID_VALUE;
+    }
+
+    return upload_scratchpad_stream(read_scratchpad_from_memory, bytes, len, seq, offset_p, progress_cb);
+}
+
+app_res_e WPC_upload_local_scratchpad_from_fd(int fd,
+                                              uint32_t len,
+                                              uint8_t seq,
+                                              uint32_t * offset_p,
+                                              onScratchpadUploadProgress_cb_f progress_cb)
+{
+    if (fd < 0)
+    {
+        return APP_RES_INVALID_VALUE;
+    }
+
+    return upload_scratchpad_stream(read_scratchpad_from_fd, &fd, len, seq, offset_p, progress_cb);
+}
+
 /* Error code LUT for sink cost read/write */
 static const app_res_e SCRATCHPAD_CLEAR_LOCAL_ERROR_CODE_LUT[] = {
     APP_RES_OK,                 // 0
@@ -1205,6 +1870,31 @@ app_res_e WPC_send_data(const uint8_t * bytes,
     return WPC_send_data_with_options(&message);
 }
 
+app_res_e WPC_enable_tx_trace(onTxTrace_cb_f onTxTrace, unsigned int max_destinations)
+{
+    return tx_trace_enable(onTxTrace, max_destinations) ? APP_RES_OK : APP_RES_OUT_OF_MEMORY;
+}
+
+app_res_e WPC_get_tx_stats(app_addr_t dst_addr, app_qos_e qos, app_tx_stats_t * stats_p)
+{
+    if (stats_p == NULL)
+    {
+        return APP_RES_INVALID_VALUE;
+    }
+
+    return tx_trace_get_stats(dst_addr, qos, stats_p);
+}
+
+app_res_e WPC_get_next_tx_stats(uint32_t * cursor_p, app_tx_stats_t * stats_p)
+{
+    if (cursor_p == NULL || stats_p == NULL)
+    {
+        return APP_RES_INVALID_VALUE;
+    }
+
+    return tx_trace_get_next_stats(cursor_p, stats_p);
+}
+
 static const app_res_e CDC_ITEM_SET_ERROR_CODE_LUT[] = {
     APP_RES_OK,                      // 0
     APP_RES_NODE_NOT_A_SINK,         // 1
@@ -1312,6 +2002,41 @@ app_res_e WPC_unregister_for_data()
 }
 #endif
 
+app_res_e WPC_enable_node_stats(unsigned int max_nodes)
+{
+    return node_stats_enable(max_nodes) ? APP_RES_OK : APP_RES_OUT_OF_MEMORY;
+}
+
+app_res_e WPC_get_node_stats(app_addr_t address, app_node_stats_t * stats_p)
+{
+    if (stats_p == NULL)
+    {
+        return APP_RES_INVALID_VALUE;
+    }
+
+    return node_stats_get(address, stats_p);
+}
+
+app_res_e WPC_get_next_node_stats(uint32_t * cursor_p, app_node_stats_t * stats_p)
+{
+    if (cursor_p == NULL || stats_p == NULL)
+    {
+        return APP_RES_INVALID_VALUE;
+    }
+
+    return node_stats_get_next(cursor_p, stats_p);
+}
+
+app_res_e WPC_get_node_stats_count(uint32_t * nodes_p, uint32_t * untracked_packets_p)
+{
+    if (nodes_p == NULL || untracked_packets_p == NULL)
+    {
+        return APP_RES_INVALID_VALUE;
+    }
+
+    return node_stats_get_count(nodes_p, untracked_packets_p);
+}
+
 app_res_e WPC_register_for_app_config_data(onAppConfigDataReceived_cb_f onAppConfigDataReceived)
 {
     return msap_register_for_app_config(onAppConfigDataReceived) ? APP_RES_OK : APP_RES_ALREADY_REGISTERED;
@@ -1351,3 +2076,13 @@ app_res_e WPC_unregister_from_config_data_item()
 {
     return msap_unregister_from_config_data_item() ? APP_RES_OK : APP_RES_INVALID_VALUE;
 }
+
+app_res_e WPC_register_for_link_status(onLinkStatusChanged_cb_f onLinkStatusChanged)
+{
+    return WPC_Int_register_for_link_status(onLinkStatusChanged) ? APP_RES_OK : APP_RES_ALREADY_REGISTERED;
+}
+
+app_res_e WPC_unregister_from_link_status()
+{
+    return WPC_Int_unregister_from_link_status() ? APP_RES_OK : APP_RES_NOT_REGISTERED;
+}
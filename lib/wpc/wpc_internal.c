@@ -50,9 +50,26 @@
 // the OTAP exchange with neighbors that can be long with some profiles
 #define DEFAULT_MAX_POLL_FAIL_DURATION_MS (60 * 1000)
 
+// Default delays in ms between two attempts to recover the link with the sink
+// once it is declared broken. Delay is doubled after each failed attempt
+#define DEFAULT_LINK_RECOVERY_MIN_DELAY_MS 1000
+#define DEFAULT_LINK_RECOVERY_MAX_DELAY_MS (30 * 1000)
+
+// Max size of the serial port name to keep for the link recovery
+#define MAX_PORT_NAME_SIZE 256
+
 // Last successful exchange with node
 static unsigned long long m_last_successful_answer_ts;
 
+// Reception of the first byte of the last confirm (monotonic us)
+static unsigned long long m_last_confirm_us;
+
+// End of the uart write of the last request (monotonic us)
+static unsigned long long m_last_write_us;
+
+// Number of times the last request was sent again after a crc error
+static uint8_t m_last_request_resends;
+
 // Max delay before exiting
 static unsigned int m_timeout_no_answer_ms = DEFAULT_MAX_POLL_FAIL_DURATION_MS;
 
@@ -68,6 +85,53 @@ typedef struct
 
 static bool m_disabled_poll_request = false;
 
+// State of the link with the sink
+typedef enum
+{
+    LINK_UP,       //< Link is operational
+    LINK_DOWN,     //< Link is broken, transport is closed
+    LINK_PROBING   //< Transport is reopened, sink is not checked yet
+} link_state_e;
+
+static link_state_e m_link_state = LINK_UP;
+
+// Last link state notified to application (only accessed from polling context)
+static bool m_link_up_notified = true;
+
+// Serial settings used to reopen the link
+static char m_port_name[MAX_PORT_NAME_SIZE];
+static unsigned long m_bitrate;
+
+// Backoff between two link recovery attempts
+static unsigned int m_recovery_min_delay_ms = DEFAULT_LINK_RECOVERY_MIN_DELAY_MS;
+static unsigned int m_recovery_max_delay_ms = DEFAULT_LINK_RECOVERY_MAX_DELAY_MS;
+static unsigned int m_recovery_delay_ms;
+static unsigned long long m_next_recovery_attempt_ts;
+
+// Thread probing the sink while link is LINK_PROBING, requests
+// from other threads are rejected until link is up
+static uintptr_t m_probing_thread_id;
+
+// Callback to notify link state changes
+static onLinkStatusChanged_cb_f m_link_status_cb = NULL;
+
+// Time given to the sink to apply a new uart bitrate after its confirm
+#define BITRATE_SWITCH_DELAY_MS 20
+
+// Bitrate currently used on the link, differs from m_bitrate in bulk
+// transfer mode
+static unsigned long m_current_bitrate;
+
+// Attribute used to change the sink bitrate, 0 if bulk transfer mode is off
+static uint16_t m_bulk_bitrate_attribute_id = 0;
+
+// Bulk transfer mode in use when the link was lost (bitrate 0 if none). Sink
+// may still use this bitrate if it didn't reboot
+static unsigned long m_lost_bulk_bitrate = 0;
+static uint16_t m_lost_bulk_bitrate_attribute_id;
+
+static bool restore_sink_bitrate(void);
+
 /*****************************************************************************/
 /*                Response implementation                                    */
 /*****************************************************************************/
@@ -97,29 +161,132 @@ static int send_response_to_stack(uint8_t primitive_id, uint8_t frame_id, bool m
 /*                Request implementation                                     */
 /*****************************************************************************/
 
+/**
+ * \brief   Schedule next recovery attempt with an exponential backoff
+ * \note    This function MUST be called with sending_mutex locked
+ */
+static void schedule_next_recovery_locked()
+{
+    m_next_recovery_attempt_ts = Platform_get_timestamp_ms_monotonic() + m_recovery_delay_ms;
+    m_recovery_delay_ms = MIN(m_recovery_delay_ms * 2, m_recovery_max_delay_ms);
+}
+
 static bool check_if_timeout_reached_locked()
 {
     // Check if it has failed for too long
-    if (m_timeout_no_answer_ms > 0)
+    if ((m_timeout_no_answer_ms > 0) && (m_link_state == LINK_UP))
     {
         if ((Platform_get_timestamp_ms_monotonic() - m_last_successful_answer_ts) > m_timeout_no_answer_ms)
         {
             // Poll request has failed for too long
-            // This is a fatal error as the com with sink was not possible
-            // for a too long period.
-            // Close the platform but release our lock first as someone else could be waiting for it
-            // No need to keep, we are exiting anyway
-            Platform_unlock_request();
-
-            Platform_close();
-            exit(EXIT_FAILURE);
-
-            // Never executed
+            // The com with sink was not possible for a too long period.
+            // Close the transport and let the polling context recover it
+            LOGE("No answer from sink for %d ms, link is down\n", m_timeout_no_answer_ms);
+            Serial_close();
+            m_link_state = LINK_DOWN;
+            // Link is reopened at the nominal bitrate, which is also the
+            // one used by the sink after a reboot. Remember the bulk one in
+            // case the sink didn't reboot
+            if (m_bulk_bitrate_attribute_id != 0)
+            {
+                m_lost_bulk_bitrate = m_current_bitrate;
+                m_lost_bulk_bitrate_attribute_id = m_bulk_bitrate_attribute_id;
+            }
+            m_current_bitrate = m_bitrate;
+            m_bulk_bitrate_attribute_id = 0;
+            // First attempt is also delayed, sink may be rebooting
+            m_recovery_delay_ms = m_recovery_min_delay_ms;
+            schedule_next_recovery_locked();
             return true;
         }
     }
     return false;
 }
+
+/**
+ * \brief   Try to recover a broken link with the sink
+ *          Transport is reopened and sink is probed by reading its
+ *          mesh API version before resuming normal operation
+ * \note    This function MUST be called with sending_mutex unlocked
+ *          as it issues requests to the sink
+ */
+static void try_to_recover_link()
+{
+    uint16_t mesh_version;
+
+    Platform_lock_request();
+    if ((m_link_state != LINK_DOWN)
+        || (Platform_get_timestamp_ms_monotonic() < m_next_recovery_attempt_ts))
+    {
+        Platform_unlock_request();
+        return;
+    }
+
+    LOGI("Trying to recover link with sink\n");
+    if (Serial_open(m_port_name, m_bitrate) < 0)
+    {
+        schedule_next_recovery_locked();
+        Platform_unlock_request();
+        return;
+    }
+    m_link_state = LINK_PROBING;
+    m_probing_thread_id = Platform_get_thread_id();
+    Platform_unlock_request();
+
+    // Sink may have been changed or rebooted, forget what we know about it.
+    // It must be done before probing so that the probe is not answered
+    // from the cache
+    attribute_cache_invalidate();
+
+    // Check the connectivity with sink, at the bulk transfer bitrate too if
+    // the link was lost in this mode
+    if ((WPC_get_mesh_API_version(&mesh_version) != APP_RES_OK)
+        && (!restore_sink_bitrate()
+            || (WPC_get_mesh_API_version(&mesh_version) != APP_RES_OK)))
+    {
+        LOGW("Sink is not answering, next attempt in %d ms\n", m_recovery_delay_ms);
+        Platform_lock_request();
+        Serial_close();
+        m_link_state = LINK_DOWN;
+        schedule_next_recovery_locked();
+        Platform_unlock_request();
+        return;
+    }
+
+    // Read back its mtu
+    WPC_Int_set_mtu();
+
+    Platform_lock_request();
+    m_link_state = LINK_UP;
+    m_lost_bulk_bitrate = 0;
+    m_last_successful_answer_ts = Platform_get_timestamp_ms_monotonic();
+    Platform_unlock_request();
+
+    LOGI("Link with sink recovered (mesh API version %d)\n", mesh_version);
+}
+
+/**
+ * \brief   Notify application about link state change
+ * \note    Only called from polling context without lock
+ */
+static void notify_link_status()
+{
+    bool link_up;
+
+    Platform_lock_request();
+    link_up = (m_link_state == LINK_UP);
+    Platform_unlock_request();
+
+    if (link_up != m_link_up_notified)
+    {
+        m_link_up_notified = link_up;
+        if (m_link_status_cb != NULL)
+        {
+            m_link_status_cb(link_up);
+        }
+    }
+}
+
 /**
  * \brief   This function send a request to the stack and wait for confirmation
  * \param   request
@@ -140,11 +307,22 @@ static int send_request_locked(wpc_frame_t * request, wpc_frame_t * confirm, uin
     uint8_t crc_request_retries = 0;
     uint8_t buffer[MAX_FRAME_SIZE];
     wpc_frame_t * rec_confirm;
+    unsigned long long first_byte_us;
 
     LOGD("Send_request LOCK \n");
 
+    if ((m_link_state == LINK_DOWN)
+        || ((m_link_state == LINK_PROBING)
+            && (m_probing_thread_id != Platform_get_thread_id())))
+    {
+        // Transport is closed until link is recovered, and only the probe
+        // can use it once reopened
+        return WPC_INT_LINK_DOWN_ERROR;
+    }
+
     // fill the frame id request
     request->frame_id = frame_id++;
+    m_last_request_resends = 0;
 
     // Send the request
     if (Slip_send_buffer((uint8_t *) request, request->payload_length + 3) < 0)
@@ -152,11 +330,12 @@ static int send_request_locked(wpc_frame_t * request, wpc_frame_t * confirm, uin
         check_if_timeout_reached_locked();
         return WPC_INT_GEN_ERROR;
     }
+    m_last_write_us = Platform_get_timestamp_us_monotonic();
 
     while (attempt < MAX_CONFIRM_ATTEMPT)
     {
         // Wait for confirm during TIMEOUT_CONFIRM seconds
-        confirm_size = Slip_get_buffer(buffer, sizeof(buffer), timeout_ms);
+        confirm_size = Slip_get_buffer_timestamped(buffer, sizeof(buffer), timeout_ms, &first_byte_us);
         if (confirm_size < 0)
         {
             if (confirm_size == WPC_INT_WRONG_CRC_FROM_HOST)
@@ -171,6 +350,8 @@ static int send_request_locked(wpc_frame_t * request, wpc_frame_t * confirm, uin
                         check_if_timeout_reached_locked();
                         return WPC_INT_GEN_ERROR;
                     }
+                    m_last_write_us = Platform_get_timestamp_us_monotonic();
+                    m_last_request_resends = crc_request_retries;
                     continue;
                 }
 
@@ -228,18 +409,149 @@ static int send_request_locked(wpc_frame_t * request, wpc_frame_t * confirm, uin
 
     // Copy the confirm
     memcpy((uint8_t *) confirm, buffer, confirm_size);
+    m_last_confirm_us = first_byte_us;
+    return 0;
+}
+
+/**
+ * \brief   Check that the sink answers, without using the attribute cache
+ * \note    This function MUST be called with sending_mutex locked
+ */
+static bool probe_sink_locked()
+{
+    wpc_frame_t request, confirm;
+
+    request.primitive_id = CSAP_ATTRIBUTE_READ_REQUEST;
+    uint16_encode_le(C_MESH_API_VER_ID,
+                     (uint8_t *) &request.payload.attribute_read_request_payload.attribute_id);
+    request.payload_length = sizeof(attribute_read_req_pl_t);
+
+    return (send_request_locked(&request, &confirm, TIMEOUT_CONFIRM_MS) == 0)
+           && (confirm.payload.attribute_read_confirm_payload.result == 0);
+}
+
+/**
+ * \brief   Ask the sink to use a new bitrate and follow it
+ * \param   attribute_id
+ *          CSAP attribute holding the sink uart bitrate
+ * \param   bitrate
+ *          New bitrate
+ * \return  0 if the sink answers at the new bitrate, a negative value
+ *          or the attribute write result otherwise
+ * \note    This function MUST be called with sending_mutex locked
+ */
+static int switch_bitrate_locked(uint16_t attribute_id, unsigned long bitrate)
+{
+    uint32_t bitrate_le;
+    int res;
+
+    uint32_encode_le(bitrate, (uint8_t *) &bitrate_le);
+    res = attribute_write_request_locked(CSAP_ATTRIBUTE_WRITE_REQUEST,
+                                         attribute_id,
+                                         sizeof(bitrate_le),
+                                         (uint8_t *) &bitrate_le);
+    if (res != 0)
+    {
+        LOGE("Sink cannot switch to bitrate %lu (%d)\n", bitrate, res);
+        return res;
+    }
+
+    // Confirm was sent at the previous bitrate, let the sink apply the new one
+    Platform_usleep(BITRATE_SWITCH_DELAY_MS * 1000);
+    if (Serial_set_bitrate(bitrate) < 0)
+    {
+        return WPC_INT_GEN_ERROR;
+    }
+    m_current_bitrate = bitrate;
+
+    if (!probe_sink_locked())
+    {
+        LOGE("Sink is not answering at bitrate %lu\n", bitrate);
+        return WPC_INT_TIMEOUT_ERROR;
+    }
+
     return 0;
 }
 
+/**
+ * \brief   Best effort to get back to a working link at a previous bitrate
+ *          after a failed switch
+ * \note    This function MUST be called with sending_mutex locked
+ */
+static void fall_back_to_bitrate_locked(uint16_t attribute_id, unsigned long bitrate)
+{
+    if (m_current_bitrate != bitrate)
+    {
+        uint32_t bitrate_le;
+
+        // Sink may have switched, ask it to come back. It may not be
+        // reachable at this bitrate so result is ignored
+        uint32_encode_le(bitrate, (uint8_t *) &bitrate_le);
+        attribute_write_request_locked(CSAP_ATTRIBUTE_WRITE_REQUEST,
+                                       attribute_id,
+                                       sizeof(bitrate_le),
+                                       (uint8_t *) &bitrate_le);
+        Platform_usleep(BITRATE_SWITCH_DELAY_MS * 1000);
+        Serial_set_bitrate(bitrate);
+        m_current_bitrate = bitrate;
+    }
+
+    if (probe_sink_locked())
+    {
+        LOGI("Back to bitrate %lu\n", bitrate);
+    }
+    else
+    {
+        LOGE("Sink lost after bitrate fallback, link recovery will handle it\n");
+    }
+}
+
+/**
+ * \brief   Bring back to the nominal bitrate a sink that still uses the bulk
+ *          transfer bitrate after a link loss
+ * \return  True if the sink is switched back, false if it doesn't answer at
+ *          the bulk transfer bitrate either (or link was not lost in bulk
+ *          transfer mode)
+ * \note    Only called from the probing thread, with sending_mutex unlocked
+ */
+static bool restore_sink_bitrate(void)
+{
+    bool restored = false;
+
+    Platform_lock_request();
+    if ((m_lost_bulk_bitrate != 0) && (Serial_set_bitrate(m_lost_bulk_bitrate) == 0))
+    {
+        m_current_bitrate = m_lost_bulk_bitrate;
+        if (probe_sink_locked())
+        {
+            LOGI("Sink still at bulk transfer bitrate %lu, switching it back\n", m_lost_bulk_bitrate);
+            restored = (switch_bitrate_locked(m_lost_bulk_bitrate_attribute_id, m_bitrate) == 0);
+        }
+
+        if (!restored && (m_current_bitrate != m_bitrate))
+        {
+            // Next attempt starts again from the nominal bitrate
+            Serial_set_bitrate(m_bitrate);
+            m_current_bitrate = m_bitrate;
+        }
+    }
+    Platform_unlock_request();
+
+    return restored;
+}
+
 /*****************************************************************************/
 /*                Indication implementation                                  */
 /*****************************************************************************/
-static void dispatch_indication(wpc_frame_t * frame, unsigned long long timestamp_ms)
+static void dispatch_indication(wpc_frame_t * frame,
+                                unsigned long long timestamp_ms,
+                                unsigned long long timestamp_us)
 {
     switch (frame->primitive_id)
     {
         case DSAP_DATA_TX_INDICATION:
-            dsap_data_tx_indication_handler(&frame->payload.dsap_data_tx_indication_payload);
+            dsap_data_tx_indication_handler(&frame->payload.dsap_data_tx_indication_payload,
+                                            timestamp_us);
             break;
         case DSAP_DATA_RX_INDICATION:
             dsap_data_rx_indication_handler(&frame->payload.dsap_data_rx_indication_payload,
@@ -282,18 +594,23 @@ static int handle_indication(bool last_one, onIndicationReceivedLocked_cb_f cb_l
     int res;
     int remaining_ind;
     wpc_frame_t frame;
+    unsigned long long first_byte_us;
     unsigned long long timestamp_ms_epoch;
 
     LOGD("Pending indication from stack, wait for it\n");
-    res = Slip_get_buffer((uint8_t *) &frame, sizeof(wpc_frame_t), TIMEOUT_INDICATION_MS);
+    res = Slip_get_buffer_timestamped((uint8_t *) &frame,
+                                      sizeof(wpc_frame_t),
+                                      TIMEOUT_INDICATION_MS,
+                                      &first_byte_us);
     if (res <= 0)
     {
         LOGE("Timeout waiting for indication last_one=%d\n", last_one);
         return WPC_INT_TIMEOUT_ERROR;
     }
 
-    // Get timestamp just after reception
-    timestamp_ms_epoch = Platform_get_timestamp_ms_epoch();
+    // Indication is timestamped at the reception of its first byte, so the
+    // transfer of a long frame and its decoding are not included
+    timestamp_ms_epoch = Platform_timestamp_us_monotonic_to_epoch(first_byte_us) / 1000;
 
     remaining_ind = frame.payload.generic_indication_payload.indication_status;
 
@@ -303,7 +620,7 @@ static int handle_indication(bool last_one, onIndicationReceivedLocked_cb_f cb_l
                            (remaining_ind > 0) && !last_one);
 
     // Call the cb to handle it (implemented by platform)
-    cb_locked(&frame, timestamp_ms_epoch);
+    cb_locked(&frame, timestamp_ms_epoch, first_byte_us);
 
     return remaining_ind;
 }
@@ -370,8 +687,20 @@ static int get_indication_locked(unsigned int max_ind, onIndicationReceivedLocke
 static int get_indication(unsigned int max_ind, onIndicationReceivedLocked_cb_f cb_locked)
 {
     int res;
+
+    // Recovery is handled from polling context. Link loss is notified
+    // before trying to recover it, so that a loss is never missed
+    notify_link_status();
+    try_to_recover_link();
+    notify_link_status();
+
     Platform_lock_request();
-    if (!m_disabled_poll_request)
+    if (m_link_state != LINK_UP)
+    {
+        // Nothing to poll until link is recovered
+        res = WPC_INT_LINK_DOWN_ERROR;
+    }
+    else if (!m_disabled_poll_request)
     {
         res = get_indication_locked(max_ind, cb_locked);
     }
@@ -394,6 +723,37 @@ int WPC_Int_send_request_timeout(wpc_frame_t * frame, wpc_frame_t * confirm, uin
     return res;
 }
 
+int WPC_Int_send_request_locked(wpc_frame_t * frame, wpc_frame_t * confirm)
+{
+    return send_request_locked(frame, confirm, TIMEOUT_CONFIRM_MS);
+}
+
+int WPC_Int_send_request_timed(wpc_frame_t * frame,
+                               wpc_frame_t * confirm,
+                               WPC_Int_request_timing_t * timing_p)
+{
+    int res;
+
+    Platform_lock_request();
+    timing_p->lock_us = Platform_get_timestamp_us_monotonic();
+    // Not updated if request is not written
+    m_last_write_us = timing_p->lock_us;
+
+    res = send_request_locked(frame, confirm, TIMEOUT_CONFIRM_MS);
+
+    timing_p->write_us = m_last_write_us;
+    timing_p->confirm_us = (res == 0) ? m_last_confirm_us : 0;
+    timing_p->resends = m_last_request_resends;
+    Platform_unlock_request();
+
+    return res;
+}
+
+unsigned long long WPC_Int_get_last_confirm_timestamp_us(void)
+{
+    return m_last_confirm_us;
+}
+
 void WPC_Int_disable_poll_request(bool disabled)
 {
     m_disabled_poll_request = disabled;
@@ -416,12 +776,103 @@ bool WPC_Int_set_timeout_s_no_answer(unsigned int duration_s)
     return true;
 }
 
+bool WPC_Int_set_link_recovery_backoff(unsigned int min_delay_ms, unsigned int max_delay_ms)
+{
+    if ((min_delay_ms == 0) || (min_delay_ms > max_delay_ms))
+    {
+        return false;
+    }
+
+    m_recovery_min_delay_ms = min_delay_ms;
+    m_recovery_max_delay_ms = max_delay_ms;
+    return true;
+}
+
+int WPC_Int_start_bulk_transfer(uint16_t attribute_id, unsigned long bitrate)
+{
+    unsigned long previous_bitrate;
+    int res;
+
+    if (attribute_id == 0 || bitrate == 0)
+    {
+        return WPC_INT_WRONG_PARAM_ERROR;
+    }
+
+    Platform_lock_request();
+    previous_bitrate = m_current_bitrate;
+    res = switch_bitrate_locked(attribute_id, bitrate);
+    if (res == 0)
+    {
+        m_bulk_bitrate_attribute_id = attribute_id;
+    }
+    else
+    {
+        fall_back_to_bitrate_locked(attribute_id, previous_bitrate);
+    }
+    Platform_unlock_request();
+
+    return res;
+}
+
+int WPC_Int_stop_bulk_transfer(void)
+{
+    int res = 0;
+
+    Platform_lock_request();
+    if (m_bulk_bitrate_attribute_id != 0)
+    {
+        res = switch_bitrate_locked(m_bulk_bitrate_attribute_id, m_bitrate);
+        if (res != 0)
+        {
+            fall_back_to_bitrate_locked(m_bulk_bitrate_attribute_id, m_bitrate);
+        }
+        m_bulk_bitrate_attribute_id = 0;
+    }
+    Platform_unlock_request();
+
+    return res;
+}
+
+bool WPC_Int_register_for_link_status(onLinkStatusChanged_cb_f cb)
+{
+    if (m_link_status_cb != NULL)
+    {
+        return false;
+    }
+
+    m_link_status_cb = cb;
+    return true;
+}
+
+bool WPC_Int_unregister_from_link_status(void)
+{
+    if (m_link_status_cb == NULL)
+    {
+        return false;
+    }
+
+    m_link_status_cb = NULL;
+    return true;
+}
+
 int WPC_Int_initialize(const char * port_name, unsigned long bitrate)
 {
+    if (strlen(port_name) >= MAX_PORT_NAME_SIZE)
+        return WPC_INT_WRONG_PARAM_ERROR;
+
     // Open the serial connection
     if (Serial_open(port_name, bitrate) < 0)
         return WPC_INT_GEN_ERROR;
 
+    // Keep the settings to be able to reopen the link
+    strcpy(m_port_name, port_name);
+    m_bitrate = bitrate;
+    m_current_bitrate = bitrate;
+    m_bulk_bitrate_attribute_id = 0;
+    m_lost_bulk_bitrate = 0;
+    m_link_state = LINK_UP;
+    m_link_up_notified = true;
+
     // Initialize the slip module
     Slip_init(&Serial_write, &Serial_read);
 
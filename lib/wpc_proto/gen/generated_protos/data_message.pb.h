@@ -11,7 +11,6 @@
 #endif
 
 /* Struct definitions */
-typedef PB_BYTES_ARRAY_T(1500) wp_SendPacketReq_payload_t;
 /* Commands/Responses definition */
 typedef struct _wp_SendPacketReq {
     wp_RequestHeader header;
@@ -19,7 +18,7 @@ typedef struct _wp_SendPacketReq {
     uint32_t source_endpoint;
     uint32_t destination_endpoint;
     uint32_t qos;
-    wp_SendPacketReq_payload_t payload;
+    proto_bytes_ref_t payload;
     bool has_initial_delay_ms;
     uint32_t initial_delay_ms;
     /* This field was renamed from is_fast_transmission
@@ -35,7 +34,6 @@ typedef struct _wp_SendPacketResp {
     wp_ResponseHeader header;
 } wp_SendPacketResp;
 
-typedef PB_BYTES_ARRAY_T(1500) wp_PacketReceivedEvent_payload_t;
 /* Event definition */
 typedef struct _wp_PacketReceivedEvent {
     wp_EventHeader header;
@@ -46,8 +44,7 @@ typedef struct _wp_PacketReceivedEvent {
     uint32_t travel_time_ms;
     uint64_t rx_time_ms_epoch; /* Reception time of the message on the gateway */
     uint32_t qos;
-    bool has_payload;
-    wp_PacketReceivedEvent_payload_t payload;
+    pb_bytes_array_t *payload;
     bool has_payload_size;
     uint32_t payload_size;
     bool has_hop_count;
@@ -62,12 +59,12 @@ extern "C" {
 #endif
 
 /* Initializer values for message structs */
-#define wp_SendPacketReq_init_default            {wp_RequestHeader_init_default, 0, 0, 0, 0, {0, {0}}, false, 0, false, 0, false, 0}
+#define wp_SendPacketReq_init_default            {wp_RequestHeader_init_default, 0, 0, 0, 0, {NULL, 0}, false, 0, false, 0, false, 0}
 #define wp_SendPacketResp_init_default           {wp_ResponseHeader_init_default}
-#define wp_PacketReceivedEvent_init_default      {wp_EventHeader_init_default, 0, 0, 0, 0, 0, 0, 0, false, {0, {0}}, false, 0, false, 0, false, 0}
-#define wp_SendPacketReq_init_zero               {wp_RequestHeader_init_zero, 0, 0, 0, 0, {0, {0}}, false, 0, false, 0, false, 0}
+#define wp_PacketReceivedEvent_init_default      {wp_EventHeader_init_default, 0, 0, 0, 0, 0, 0, 0, NULL, false, 0, false, 0, false, 0}
+#define wp_SendPacketReq_init_zero               {wp_RequestHeader_init_zero, 0, 0, 0, 0, {NULL, 0}, false, 0, false, 0, false, 0}
 #define wp_SendPacketResp_init_zero              {wp_ResponseHeader_init_zero}
-#define wp_PacketReceivedEvent_init_zero         {wp_EventHeader_init_zero, 0, 0, 0, 0, 0, 0, 0, false, {0, {0}}, false, 0, false, 0, false, 0}
+#define wp_PacketReceivedEvent_init_zero         {wp_EventHeader_init_zero, 0, 0, 0, 0, 0, 0, 0, NULL, false, 0, false, 0, false, 0}
 
 /* Field tags (for use in manual encoding/decoding) */
 #define wp_SendPacketReq_header_tag              1
@@ -100,11 +97,12 @@ X(a, STATIC,   REQUIRED, UINT32,   destination_address,   2) \
 X(a, STATIC,   REQUIRED, UINT32,   source_endpoint,   3) \
 X(a, STATIC,   REQUIRED, UINT32,   destination_endpoint,   4) \
 X(a, STATIC,   REQUIRED, UINT32,   qos,               5) \
-X(a, STATIC,   REQUIRED, BYTES,    payload,           6) \
+X(a, CALLBACK, REQUIRED, BYTES,    payload,           6) \
 X(a, STATIC,   OPTIONAL, UINT32,   initial_delay_ms,   7) \
 X(a, STATIC,   OPTIONAL, BOOL,     is_unack_csma_ca,   8) \
 X(a, STATIC,   OPTIONAL, UINT32,   hop_limit,         9)
-#define wp_SendPacketReq_CALLBACK NULL
+extern bool Proto_data_send_packet_callback(pb_istream_t *istream, pb_ostream_t *ostream, const pb_field_t *field);
+#define wp_SendPacketReq_CALLBACK Proto_data_send_packet_callback
 #define wp_SendPacketReq_DEFAULT NULL
 #define wp_SendPacketReq_header_MSGTYPE wp_RequestHeader
 
@@ -123,7 +121,7 @@ X(a, STATIC,   REQUIRED, UINT32,   destination_endpoint,   5) \
 X(a, STATIC,   REQUIRED, UINT32,   travel_time_ms,    6) \
 X(a, STATIC,   REQUIRED, UINT64,   rx_time_ms_epoch,   7) \
 X(a, STATIC,   REQUIRED, UINT32,   qos,               8) \
-X(a, STATIC,   OPTIONAL, BYTES,    payload,           9) \
+X(a, POINTER,  OPTIONAL, BYTES,    payload,           9) \
 X(a, STATIC,   OPTIONAL, UINT32,   payload_size,     10) \
 X(a, STATIC,   OPTIONAL, UINT32,   hop_count,        11) \
 X(a, STATIC,   OPTIONAL, UINT64,   network_address,  12)
@@ -141,9 +139,9 @@ extern const pb_msgdesc_t wp_PacketReceivedEvent_msg;
 #define wp_PacketReceivedEvent_fields &wp_PacketReceivedEvent_msg
 
 /* Maximum encoded size of messages (where known) */
-#define WP_DATA_MESSAGE_PB_H_MAX_SIZE            wp_PacketReceivedEvent_size
-#define wp_PacketReceivedEvent_size              1647
-#define wp_SendPacketReq_size                    1582
+/* wp_SendPacketReq_size depends on runtime parameters */
+/* wp_PacketReceivedEvent_size depends on runtime parameters */
+#define WP_DATA_MESSAGE_PB_H_MAX_SIZE            wp_SendPacketResp_size
 #define wp_SendPacketResp_size                   85
 
 #ifdef __cplusplus
@@ -40,13 +40,11 @@ typedef struct _wp_UploadScratchpadReq_ChunkInfo {
     uint32_t start_offset;
 } wp_UploadScratchpadReq_ChunkInfo;
 
-typedef PB_BYTES_ARRAY_T(1024) wp_UploadScratchpadReq_scratchpad_t;
 typedef struct _wp_UploadScratchpadReq {
     wp_RequestHeader header;
     uint32_t seq;
     /* If scratchpad is not set, it clears the stored scratchpad */
-    bool has_scratchpad;
-    wp_UploadScratchpadReq_scratchpad_t scratchpad;
+    pb_bytes_array_t *scratchpad;
     /* If ChunkInfo is present, then above scratchpad is a chunk */
     bool has_chunk_info;
     wp_UploadScratchpadReq_ChunkInfo chunk_info;
@@ -81,7 +79,7 @@ extern "C" {
 /* Initializer values for message structs */
 #define wp_GetScratchpadStatusReq_init_default   {wp_RequestHeader_init_default}
 #define wp_GetScratchpadStatusResp_init_default  {wp_ResponseHeader_init_default, false, wp_ScratchpadInfo_init_default, false, _wp_ScratchpadStatus_MIN, false, _wp_ScratchpadType_MIN, false, wp_ScratchpadInfo_init_default, false, 0, false, wp_TargetScratchpadAndAction_init_default}
-#define wp_UploadScratchpadReq_init_default      {wp_RequestHeader_init_default, 0, false, {0, {0}}, false, wp_UploadScratchpadReq_ChunkInfo_init_default}
+#define wp_UploadScratchpadReq_init_default      {wp_RequestHeader_init_default, 0, NULL, false, wp_UploadScratchpadReq_ChunkInfo_init_default}
 #define wp_UploadScratchpadReq_ChunkInfo_init_default {0, 0}
 #define wp_UploadScratchpadResp_init_default     {wp_ResponseHeader_init_default}
 #define wp_ProcessScratchpadReq_init_default     {wp_RequestHeader_init_default}
@@ -90,7 +88,7 @@ extern "C" {
 #define wp_SetScratchpadTargetAndActionResp_init_default {wp_ResponseHeader_init_default}
 #define wp_GetScratchpadStatusReq_init_zero      {wp_RequestHeader_init_zero}
 #define wp_GetScratchpadStatusResp_init_zero     {wp_ResponseHeader_init_zero, false, wp_ScratchpadInfo_init_zero, false, _wp_ScratchpadStatus_MIN, false, _wp_ScratchpadType_MIN, false, wp_ScratchpadInfo_init_zero, false, 0, false, wp_TargetScratchpadAndAction_init_zero}
-#define wp_UploadScratchpadReq_init_zero         {wp_RequestHeader_init_zero, 0, false, {0, {0}}, false, wp_UploadScratchpadReq_ChunkInfo_init_zero}
+#define wp_UploadScratchpadReq_init_zero         {wp_RequestHeader_init_zero, 0, NULL, false, wp_UploadScratchpadReq_ChunkInfo_init_zero}
 #define wp_UploadScratchpadReq_ChunkInfo_init_zero {0, 0}
 #define wp_UploadScratchpadResp_init_zero        {wp_ResponseHeader_init_zero}
 #define wp_ProcessScratchpadReq_init_zero        {wp_RequestHeader_init_zero}
@@ -145,7 +143,7 @@ X(a, STATIC,   OPTIONAL, MESSAGE,  target_and_action,   7)
 #define wp_UploadScratchpadReq_FIELDLIST(X, a) \
 X(a, STATIC,   REQUIRED, MESSAGE,  header,            1) \
 X(a, STATIC,   REQUIRED, UINT32,   seq,               2) \
-X(a, STATIC,   OPTIONAL, BYTES,    scratchpad,        3) \
+X(a, POINTER,  OPTIONAL, BYTES,    scratchpad,        3) \
 X(a, STATIC,   OPTIONAL, MESSAGE,  chunk_info,        4)
 #define wp_UploadScratchpadReq_CALLBACK NULL
 #define wp_UploadScratchpadReq_DEFAULT NULL
@@ -212,7 +210,8 @@ extern const pb_msgdesc_t wp_SetScratchpadTargetAndActionResp_msg;
 #define wp_SetScratchpadTargetAndActionResp_fields &wp_SetScratchpadTargetAndActionResp_msg
 
 /* Maximum encoded size of messages (where known) */
-#define WP_OTAP_MESSAGE_PB_H_MAX_SIZE            wp_UploadScratchpadReq_size
+/* wp_UploadScratchpadReq_size depends on runtime parameters */
+#define WP_OTAP_MESSAGE_PB_H_MAX_SIZE            wp_GetScratchpadStatusResp_size
 #define wp_GetScratchpadStatusReq_size           41
 #define wp_GetScratchpadStatusResp_size          157
 #define wp_ProcessScratchpadReq_size             41
@@ -220,7 +219,6 @@ extern const pb_msgdesc_t wp_SetScratchpadTargetAndActionResp_msg;
 #define wp_SetScratchpadTargetAndActionReq_size  63
 #define wp_SetScratchpadTargetAndActionResp_size 85
 #define wp_UploadScratchpadReq_ChunkInfo_size    12
-#define wp_UploadScratchpadReq_size              1088
 #define wp_UploadScratchpadResp_size             85
 
 #ifdef __cplusplus
@@ -7,6 +7,7 @@
 
 #include "common.h"
 #include "platform.h"
+#include "platform_atomic.h"
 #include "wp_global.pb.h"
 
 // String filled during init, ensuring that there're null terminated
@@ -15,6 +16,9 @@ static char m_gateway_model[GATEWAY_MODEL_MAX_SIZE];
 static char m_gateway_version[GATEWAY_VERSION_MAX_SIZE];
 static char m_sink_id[SINK_ID_MAX_SIZE];
 
+// Sequence of event ids, shared by all the contexts generating events
+static uint64_t m_event_id_sequence;
+
 /* Error code LUT for protobuf errors from app_res_e */
 static const wp_ErrorCode APP_ERROR_CODE_LUT[] = {
     wp_ErrorCode_OK                             ,   // APP_RES_OK,                           Everything is ok
@@ -70,6 +74,11 @@ bool Common_init(const char * gateway_id,
     strncpy(m_sink_id, sink_id, SINK_ID_MAX_SIZE);
     m_sink_id[SINK_ID_MAX_SIZE - 1]='\0';
 
+    // Ids must differ from the ones of a previous session
+    Platform_atomic_store(&m_event_id_sequence,
+                          Platform_get_timestamp_ms_epoch() * 0x9E3779B97F4A7C15ULL,
+                          PLATFORM_RELAXED);
+
     return true;
 }
 
@@ -103,6 +112,20 @@ wp_ErrorCode Common_convert_error_code(app_res_e error)
     return ret;
 }
 
+uint64_t Common_get_event_id(void)
+{
+    // splitmix64 generator: a single atomic increment gives each caller a
+    // distinct value of the sequence, mixed to look random. Mixing is a
+    // bijection, so ids never repeat before the sequence wraps
+    uint64_t z = Platform_atomic_add_fetch(&m_event_id_sequence,
+                                           0x9E3779B97F4A7C15ULL,
+                                           PLATFORM_RELAXED);
+
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
 void Common_fill_event_header(wp_EventHeader * header_p, bool has_sink_id)
 {
     _Static_assert(member_size(wp_EventHeader, gw_id) >= GATEWAY_ID_MAX_SIZE, "Gateway ID too long");
@@ -112,7 +135,7 @@ void Common_fill_event_header(wp_EventHeader * header_p, bool has_sink_id)
         .has_sink_id = (strlen(m_sink_id) != 0) && has_sink_id,
         .has_time_ms_epoch = true,
         .time_ms_epoch = Platform_get_timestamp_ms_epoch(),
-        .event_id = rand() + (((uint64_t) rand()) << 32),
+        .event_id = Common_get_event_id(),
     };
 
     strncpy(header_p->gw_id, Common_get_gateway_id(), GATEWAY_ID_MAX_SIZE);
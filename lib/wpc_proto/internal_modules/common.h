@@ -19,6 +19,10 @@
 #define GATEWAY_VERSION_MAX_SIZE 32
 #define SINK_ID_MAX_SIZE 16
 
+/* Max size of the bytes fields allocated at decode time (FT_POINTER in proto_options) */
+#define DATA_PAYLOAD_MAX_SIZE 1500
+#define SCRATCHPAD_CHUNK_MAX_SIZE 1024
+
 /**
  * \brief   Intialize the common module
  * \return  True if successful, False otherwise
@@ -38,6 +42,13 @@ char * Common_get_sink_id(void);
 
 wp_ErrorCode Common_convert_error_code(app_res_e error);
 
+/**
+ * \brief   Generate a random event id
+ * \return  The event id
+ * \note    Lock free, ids are distinct for all the callers of a session
+ */
+uint64_t Common_get_event_id(void);
+
 /**
  * \brief   Fill event message header
  * \param   header_p pointer to header to fill
@@ -0,0 +1,244 @@
+/* Wirepas Oy licensed under Apache License, Version 2.0
+ *
+ * See file LICENSE for full license details.
+ *
+ */
+#include <stdint.h>
+#include <string.h>
+
+#include "proto_arena.h"
+#include "platform.h"
+#include "platform_atomic.h"
+
+#define LOG_MODULE_NAME "proto_arena"
+#define MAX_LOG_LEVEL INFO_LOG_LEVEL
+#include "logger.h"
+
+/* Size of the arena, enough for the biggest request (decoded) and its
+ * response. Bigger needs are served from heap until the end of the request */
+#define ARENA_SIZE (8 * 1024)
+
+/* Alignment of the allocated blocks */
+#define ARENA_ALIGNMENT 16
+
+#define ALIGN_SIZE(size) (((size) + ARENA_ALIGNMENT - 1) & ~((size_t) ARENA_ALIGNMENT - 1))
+
+/* Header placed before each block, also when allocated from heap without
+ * arena as Platform_free needs the size */
+typedef union block_header
+{
+    struct
+    {
+        size_t size;                    //< Usable size of the block
+        union block_header * next_p;    //< Next overflow block (overflow blocks only)
+    } h;
+    uint8_t align[ARENA_ALIGNMENT];
+} block_header_t;
+
+static uint8_t * m_arena_p = NULL;
+static size_t m_arena_used;
+
+/* Blocks allocated from heap because arena was full */
+static block_header_t * m_overflow_p;
+
+/* Only one request at a time can use the arena */
+static platform_mutex_t * m_arena_mutex = NULL;
+
+/* Thread using the arena, 0 if free. Only written by the thread holding
+ * m_arena_mutex, so a thread reading its own id owns the arena */
+static uintptr_t m_arena_owner = 0;
+
+/**
+ * \brief   Check if arena is in use by the calling thread
+ */
+static bool is_arena_active(void)
+{
+    return Platform_atomic_load(&m_arena_owner, PLATFORM_RELAXED) == Platform_get_thread_id();
+}
+
+bool Proto_arena_init(void)
+{
+    m_arena_mutex = Platform_mutex_create();
+    m_arena_p = Platform_malloc(ARENA_SIZE);
+    if ((m_arena_mutex == NULL) || (m_arena_p == NULL))
+    {
+        LOGE("Cannot allocate arena\n");
+        Proto_arena_close();
+        return false;
+    }
+
+    m_arena_used = 0;
+    m_overflow_p = NULL;
+    return true;
+}
+
+void Proto_arena_close(void)
+{
+    if (m_arena_mutex == NULL)
+    {
+        Platform_free(m_arena_p, ARENA_SIZE);
+        m_arena_p = NULL;
+        return;
+    }
+
+    // Wait for the request in progress
+    Platform_mutex_lock(m_arena_mutex);
+    Platform_free(m_arena_p, ARENA_SIZE);
+    m_arena_p = NULL;
+    Platform_mutex_unlock(m_arena_mutex);
+
+    Platform_mutex_delete(m_arena_mutex);
+    m_arena_mutex = NULL;
+}
+
+bool Proto_arena_begin(void)
+{
+    if (m_arena_mutex == NULL)
+    {
+        return false;
+    }
+
+    if (!Platform_mutex_trylock(m_arena_mutex))
+    {
+        LOGD("Arena already in use\n");
+        return false;
+    }
+
+    if (m_arena_p == NULL)
+    {
+        Platform_mutex_unlock(m_arena_mutex);
+        return false;
+    }
+
+    Platform_atomic_store(&m_arena_owner, Platform_get_thread_id(), PLATFORM_RELAXED);
+    return true;
+}
+
+void Proto_arena_end(void)
+{
+    if (!is_arena_active())
+    {
+        return;
+    }
+
+    while (m_overflow_p != NULL)
+    {
+        block_header_t * next_p = m_overflow_p->h.next_p;
+        Platform_free(m_overflow_p, sizeof(block_header_t) + m_overflow_p->h.size);
+        m_overflow_p = next_p;
+    }
+
+    LOGD("Arena used: %zu\n", m_arena_used);
+    m_arena_used = 0;
+    Platform_atomic_store(&m_arena_owner, 0, PLATFORM_RELAXED);
+    Platform_mutex_unlock(m_arena_mutex);
+}
+
+void * Proto_arena_alloc(size_t size)
+{
+    block_header_t * header_p;
+
+    if (!is_arena_active())
+    {
+        return NULL;
+    }
+
+    size = ALIGN_SIZE(size);
+    if (m_arena_used + sizeof(block_header_t) + size <= ARENA_SIZE)
+    {
+        header_p = (block_header_t *) (m_arena_p + m_arena_used);
+        m_arena_used += sizeof(block_header_t) + size;
+    }
+    else
+    {
+        LOGD("Arena full, %zu bytes from heap\n", size);
+        header_p = Platform_malloc(sizeof(block_header_t) + size);
+        if (header_p == NULL)
+        {
+            return NULL;
+        }
+        header_p->h.next_p = m_overflow_p;
+        m_overflow_p = header_p;
+    }
+
+    header_p->h.size = size;
+    return header_p + 1;
+}
+
+/**
+ * \brief   Reallocate a block from heap, when arena is not used
+ */
+static void * realloc_from_heap(void * ptr, size_t size)
+{
+    block_header_t * old_p = (ptr != NULL) ? (block_header_t *) ptr - 1 : NULL;
+    block_header_t * header_p;
+
+    if ((old_p != NULL) && (size <= old_p->h.size))
+    {
+        return ptr;
+    }
+
+    header_p = Platform_malloc(sizeof(block_header_t) + size);
+    if (header_p == NULL)
+    {
+        // Old block is still valid, as with realloc
+        return NULL;
+    }
+    header_p->h.size = size;
+
+    if (old_p != NULL)
+    {
+        memcpy(header_p + 1, ptr, old_p->h.size);
+        Platform_free(old_p, sizeof(block_header_t) + old_p->h.size);
+    }
+    return header_p + 1;
+}
+
+void * Proto_arena_realloc(void * ptr, size_t size)
+{
+    block_header_t * header_p;
+    void * new_p;
+
+    if (!is_arena_active())
+    {
+        return realloc_from_heap(ptr, size);
+    }
+
+    if (ptr == NULL)
+    {
+        return Proto_arena_alloc(size);
+    }
+
+    header_p = (block_header_t *) ptr - 1;
+    if (size <= header_p->h.size)
+    {
+        return ptr;
+    }
+
+    // Last block of the arena can grow in place
+    if (((uint8_t *) ptr + header_p->h.size == m_arena_p + m_arena_used)
+        && (m_arena_used - header_p->h.size + ALIGN_SIZE(size) <= ARENA_SIZE))
+    {
+        m_arena_used += ALIGN_SIZE(size) - header_p->h.size;
+        header_p->h.size = ALIGN_SIZE(size);
+        return ptr;
+    }
+
+    // Old block is only released at the end of the request
+    new_p = Proto_arena_alloc(size);
+    if (new_p != NULL)
+    {
+        memcpy(new_p, ptr, header_p->h.size);
+    }
+    return new_p;
+}
+
+void Proto_arena_free(void * ptr)
+{
+    if ((ptr != NULL) && !is_arena_active())
+    {
+        block_header_t * header_p = (block_header_t *) ptr - 1;
+        Platform_free(header_p, sizeof(block_header_t) + header_p->h.size);
+    }
+    // Else, released with the whole arena
+}
@@ -0,0 +1,59 @@
+/* Wirepas Oy licensed under Apache License, Version 2.0
+ *
+ * See file LICENSE for full license details.
+ *
+ */
+#ifndef PROTO_ARENA_H_
+#define PROTO_ARENA_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * \brief   Allocate the arena used to handle requests
+ * \return  True if successful, False otherwise
+ */
+bool Proto_arena_init(void);
+
+/**
+ * \brief   Release the arena
+ */
+void Proto_arena_close(void);
+
+/**
+ * \brief   Start using the arena from the calling thread
+ *          Until \ref Proto_arena_end is called, all nanopb allocations
+ *          done from this thread are served from the arena
+ * \return  True if arena is now in use, False if it is not available (not
+ *          initialized or already in use by another request). In that case
+ *          nanopb allocations go to the heap as usual
+ */
+bool Proto_arena_begin(void);
+
+/**
+ * \brief   Release at once everything allocated from the arena since
+ *          \ref Proto_arena_begin
+ * \note    Must be called from the thread that called Proto_arena_begin
+ */
+void Proto_arena_end(void);
+
+/**
+ * \brief   Allocate memory from the arena
+ * \param   size
+ *          Size to allocate
+ * \return  Pointer to the memory, NULL if arena is not in use by this thread
+ *          or if there is not enough memory
+ * \note    Memory is valid until \ref Proto_arena_end
+ */
+void * Proto_arena_alloc(size_t size);
+
+/**
+ * \brief   Allocator hooks for nanopb (pb_realloc and pb_free)
+ *          They use the arena if it is in use by the calling thread and
+ *          the heap otherwise
+ */
+void * Proto_arena_realloc(void * ptr, size_t size);
+
+void Proto_arena_free(void * ptr);
+
+#endif
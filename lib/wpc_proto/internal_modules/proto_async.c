@@ -0,0 +1,283 @@
+/* Wirepas Oy licensed under Apache License, Version 2.0
+ *
+ * See file LICENSE for full license details.
+ *
+ */
+#include <string.h>
+
+#include "proto_async.h"
+#include "platform.h"
+#include "generic_message.pb.h"
+#include <pb_decode.h>
+
+#define LOG_MODULE_NAME "proto_async"
+#define MAX_LOG_LEVEL INFO_LOG_LEVEL
+#include "logger.h"
+
+/* Maximum number of requests waiting for the worker */
+#define MAX_PENDING_REQUESTS 16
+
+typedef struct pending_request
+{
+    struct pending_request * next_p;    //< Next request in queue
+    onProtoResponse_cb_f cb;            //< Callback to call with the response
+    void * ctx;                         //< Context given back to callback
+    size_t size;                        //< Size of the request
+    uint8_t request[];                  //< Copy of the encoded request
+} pending_request_t;
+
+/* Queue of requests, handled in order by the worker */
+static pending_request_t * m_first_p = NULL;
+static pending_request_t * m_last_p = NULL;
+static unsigned int m_pending_count = 0;
+
+static platform_mutex_t * m_queue_mutex = NULL;
+
+/* Worker draining the queue, requests are long sequences of requests to
+ * the sink so they don't use the shared one */
+static platform_worker_t * m_request_worker = NULL;
+
+/* Set to false when closing, queue is not drained anymore */
+static bool m_worker_running = false;
+
+/* Response buffer of the worker */
+static uint8_t m_response_buffer[WPC_PROTO_MAX_RESPONSE_SIZE];
+
+/**
+ * \brief   Get the type of a request without decoding it
+ * \return  The tag of the request in the WirepasMessage, 0 if not found
+ */
+static uint32_t get_request_tag(const uint8_t * request_p, size_t request_size)
+{
+    pb_istream_t stream = pb_istream_from_buffer(request_p, request_size);
+    pb_istream_t substream;
+    pb_wire_type_t wire_type;
+    uint32_t tag;
+    bool eof;
+
+    while (pb_decode_tag(&stream, &wire_type, &tag, &eof))
+    {
+        if ((tag != wp_GenericMessage_wirepas_tag) || (wire_type != PB_WT_STRING))
+        {
+            if (!pb_skip_field(&stream, wire_type))
+            {
+                break;
+            }
+            continue;
+        }
+
+        // First field of the WirepasMessage is the request (oneof like)
+        if (!pb_make_string_substream(&stream, &substream))
+        {
+            break;
+        }
+
+        if (!pb_decode_tag(&substream, &wire_type, &tag, &eof))
+        {
+            tag = 0;
+        }
+        pb_close_string_substream(&stream, &substream);
+        return tag;
+    }
+
+    return 0;
+}
+
+/**
+ * \brief   Requests only reading the gateway state that can be answered
+ *          without waiting for the requests in progress
+ * \note    They only read a copy of the cached sink config taken under its
+ *          lock, so they can run concurrently with the worker
+ */
+static bool is_read_only_request(uint32_t tag)
+{
+    return (tag == wp_WirepasMessage_get_configs_req_tag)
+           || (tag == wp_WirepasMessage_get_scratchpad_status_req_tag)
+           || (tag == wp_WirepasMessage_get_gateway_info_req_tag);
+}
+
+static void handle_request(const uint8_t * request_p,
+                           size_t request_size,
+                           uint8_t * response_p,
+                           onProtoResponse_cb_f cb,
+                           void * ctx)
+{
+    size_t response_size = WPC_PROTO_MAX_RESPONSE_SIZE;
+    app_proto_res_e res;
+
+    res = WPC_Proto_handle_request(request_p, request_size, response_p, &response_size);
+    if (res == APP_RES_PROTO_OK)
+    {
+        cb(res, response_p, response_size, ctx);
+    }
+    else
+    {
+        cb(res, NULL, 0, ctx);
+    }
+}
+
+/**
+ * \brief   Handle the queued requests in order
+ *          Executed from m_request_worker
+ */
+static void process_requests(void)
+{
+    pending_request_t * request_p;
+
+    Platform_mutex_lock(m_queue_mutex);
+    while (m_worker_running && (m_first_p != NULL))
+    {
+        request_p = m_first_p;
+        m_first_p = request_p->next_p;
+        if (m_first_p == NULL)
+        {
+            m_last_p = NULL;
+        }
+        m_pending_count--;
+
+        // Handle it unlocked, so other requests can be submitted meanwhile
+        Platform_mutex_unlock(m_queue_mutex);
+        handle_request(request_p->request,
+                       request_p->size,
+                       m_response_buffer,
+                       request_p->cb,
+                       request_p->ctx);
+        Platform_free(request_p, sizeof(pending_request_t) + request_p->size);
+        Platform_mutex_lock(m_queue_mutex);
+    }
+    Platform_mutex_unlock(m_queue_mutex);
+}
+
+bool Proto_async_init(void)
+{
+    m_queue_mutex = Platform_mutex_create();
+    m_request_worker = Platform_worker_create();
+    if ((m_queue_mutex == NULL) || (m_request_worker == NULL))
+    {
+        LOGE("Cannot create request worker\n");
+        if (m_request_worker != NULL)
+        {
+            Platform_worker_delete(m_request_worker);
+            m_request_worker = NULL;
+        }
+        if (m_queue_mutex != NULL)
+        {
+            Platform_mutex_delete(m_queue_mutex);
+            m_queue_mutex = NULL;
+        }
+        return false;
+    }
+
+    m_worker_running = true;
+    return true;
+}
+
+void Proto_async_close(void)
+{
+    pending_request_t * request_p;
+
+    if (m_queue_mutex == NULL)
+    {
+        return;
+    }
+
+    Platform_mutex_lock(m_queue_mutex);
+    m_worker_running = false;
+    Platform_mutex_unlock(m_queue_mutex);
+
+    // Request in progress is completed first
+    Platform_worker_delete(m_request_worker);
+    m_request_worker = NULL;
+
+    // Let the clients release their context of the requests not handled
+    while (m_first_p != NULL)
+    {
+        request_p = m_first_p;
+        m_first_p = request_p->next_p;
+        request_p->cb(APP_RES_PROTO_WPC_NOT_INITIALIZED, NULL, 0, request_p->ctx);
+        Platform_free(request_p, sizeof(pending_request_t) + request_p->size);
+    }
+    m_last_p = NULL;
+    m_pending_count = 0;
+
+    Platform_mutex_delete(m_queue_mutex);
+    m_queue_mutex = NULL;
+}
+
+app_proto_res_e Proto_async_submit_request(const uint8_t * request_p,
+                                           size_t request_size,
+                                           onProtoResponse_cb_f onProtoResponse_cb,
+                                           void * ctx)
+{
+    pending_request_t * pending_p;
+    uint32_t tag;
+
+    if ((request_p == NULL) || (onProtoResponse_cb == NULL))
+    {
+        return APP_RES_PROTO_WRONG_PARAMETER;
+    }
+
+    if (m_queue_mutex == NULL)
+    {
+        return APP_RES_PROTO_WPC_NOT_INITIALIZED;
+    }
+
+    tag = get_request_tag(request_p, request_size);
+    if (tag == 0)
+    {
+        LOGW("Not a wirepas request\n");
+        return APP_RES_PROTO_INVALID_REQUEST;
+    }
+
+    if (is_read_only_request(tag))
+    {
+        // Answered from the gateway state, no need to wait behind a long
+        // request to the sink (like a scratchpad upload)
+        uint8_t response[WPC_PROTO_MAX_RESPONSE_SIZE];
+
+        LOGD("Read only request %d handled immediately\n", tag);
+        handle_request(request_p, request_size, response, onProtoResponse_cb, ctx);
+        return APP_RES_PROTO_OK;
+    }
+
+    pending_p = Platform_malloc(sizeof(pending_request_t) + request_size);
+    if (pending_p == NULL)
+    {
+        return APP_RES_PROTO_NOT_ENOUGH_MEMORY;
+    }
+
+    pending_p->next_p = NULL;
+    pending_p->cb = onProtoResponse_cb;
+    pending_p->ctx = ctx;
+    pending_p->size = request_size;
+    memcpy(pending_p->request, request_p, request_size);
+
+    Platform_mutex_lock(m_queue_mutex);
+    if (!m_worker_running
+        || (m_pending_count >= MAX_PENDING_REQUESTS)
+        || !Platform_worker_schedule(m_request_worker, process_requests, 0))
+    {
+        app_proto_res_e res = (m_pending_count >= MAX_PENDING_REQUESTS)
+                                  ? APP_RES_PROTO_NOT_ENOUGH_MEMORY
+                                  : APP_RES_PROTO_WPC_NOT_INITIALIZED;
+        LOGW("Cannot queue request %d (%d pending)\n", tag, m_pending_count);
+        Platform_mutex_unlock(m_queue_mutex);
+        Platform_free(pending_p, sizeof(pending_request_t) + request_size);
+        return res;
+    }
+
+    // Requests modifying the sink are handled one by one, in order
+    if (m_last_p == NULL)
+    {
+        m_first_p = pending_p;
+    }
+    else
+    {
+        m_last_p->next_p = pending_p;
+    }
+    m_last_p = pending_p;
+    m_pending_count++;
+    Platform_mutex_unlock(m_queue_mutex);
+
+    return APP_RES_PROTO_OK;
+}
@@ -0,0 +1,36 @@
+/* Wirepas Oy licensed under Apache License, Version 2.0
+ *
+ * See file LICENSE for full license details.
+ *
+ */
+#ifndef PROTO_ASYNC_H_
+#define PROTO_ASYNC_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "wpc_proto.h"
+
+/**
+ * \brief   Start the worker handling the submitted requests
+ * \return  True if successful, False otherwise
+ */
+bool Proto_async_init(void);
+
+/**
+ * \brief   Stop the worker
+ *          Requests still in queue are answered with
+ *          APP_RES_PROTO_WPC_NOT_INITIALIZED
+ */
+void Proto_async_close(void);
+
+/**
+ * \brief   Submit a request, see @WPC_Proto_submit_request
+ */
+app_proto_res_e Proto_async_submit_request(const uint8_t * request_p,
+                                           size_t request_size,
+                                           onProtoResponse_cb_f onProtoResponse_cb,
+                                           void * ctx);
+
+#endif
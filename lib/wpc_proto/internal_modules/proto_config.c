@@ -9,6 +9,7 @@
 #include <pb_encode.h>
 #include <pb_decode.h>
 #include "platform.h"
+#include "platform_atomic.h"
 #include "common.h"
 
 #define LOG_MODULE_NAME "config_proto"
@@ -51,13 +52,80 @@ typedef struct sink_config
     uint16_t target_crc;
     uint8_t target_action;
     uint8_t target_param;
+    bool app_config_valid;
+    uint8_t app_config_seq;
+    uint16_t app_config_diag_interval;
+    uint8_t app_config[member_size(wp_AppConfigData_app_config_data_t, bytes)];
 } sink_config_t;
 
-/* TODO : Protect config access */
-
 /** Sink config storage */
 static sink_config_t m_sink_config;
 
+/* Keys cannot be read back from the sink, so keep a hash of the last keys
+ * set by this gateway to detect a SetConfig pushing the same keys again */
+static uint64_t m_keys_hash;
+static bool m_keys_hash_valid = false;
+
+/* Generation of m_sink_config, incremented each time it is updated. It tells
+ * if the pre-encoded parts below are still valid */
+static uint32_t m_config_generation = 1;
+
+/* Protects m_sink_config, the keys hash and the generation. Config is
+ * updated from request, worker and dispatching contexts: values are read
+ * from the sink unlocked and only stored under the lock. Readers work on a
+ * copy taken with get_sink_config() */
+static platform_mutex_t * m_sink_config_mutex;
+
+/* Copy of m_sink_config.network_address, read for each received packet
+ * without lock */
+static net_addr_t m_network_address;
+
+/** Pre-encoded parts of the messages built from m_sink_config and gateway
+ *  infos. Only the headers (and current time) are encoded for each message */
+typedef struct
+{
+    uint32_t generation;                            //< Config generation, 0 if never built
+    uint8_t config[wp_SinkReadConfig_size];         //< Encoded SinkReadConfig
+    size_t config_size;
+    uint8_t gw_info_tail[wp_GatewayInfo_size];      //< GatewayInfo fields after current time
+    size_t gw_info_tail_size;
+    uint8_t status_event_tail[wp_StatusEvent_size]; //< StatusEvent fields after configs
+    size_t status_event_tail_size;
+} encoded_cache_t;
+
+static encoded_cache_t m_encoded_cache;
+
+/* Cache is used from request, worker and dispatching contexts. It is locked
+ * before m_sink_config_mutex when both are needed */
+static platform_mutex_t * m_encoded_cache_mutex;
+
+/* StatusEvent structures are too big for the stack, these ones are only
+ * used with m_encoded_cache_mutex locked */
+static wp_StatusEvent m_cache_status_event;
+static wp_StatusEvent m_cache_status_event_leading;
+static wp_StatusEvent m_status_event_leading;
+
+/* Config refresh is a long sequence of requests to the sink, it has its own
+ * worker to not delay the works of other modules */
+static platform_worker_t * m_refresh_worker;
+
+/* Function writing the content of the message inside a WirepasMessage */
+typedef bool (*write_message_f)(pb_ostream_t * stream, const void * arg_p);
+
+/* Arguments to write a GetGwInfoResp */
+typedef struct
+{
+    wp_ResponseHeader header;
+    uint64_t current_time_s_epoch;
+} gw_info_resp_t;
+
+/* Arguments to write a StatusEvent */
+typedef struct
+{
+    const wp_StatusEvent * leading_p;   //< Fields before configs
+    bool with_config;                   //< Add the sink config
+} status_event_t;
+
 /* values for delay unit in MSAP scratchpad action */
 typedef enum
 {
@@ -73,6 +141,10 @@ typedef enum
  * to use when generating internally a status event with @onStackStatusReceived */
 #define IGNORE_STATUS 0xFF
 
+/** Stack status indications received within this window are merged into a
+ *  single config refresh */
+#define STATUS_REFRESH_DEBOUNCE_MS 200
+
 static onEventStatus_cb_f m_onProtoEventStatus_cb = NULL;
 
 /* Typedef used to avoid warning at compile time */
@@ -132,6 +204,114 @@ static app_role_t convert_role_to_app_format(wp_NodeRole * proto_role)
     return CREATE_ROLE(proto_role->role, options);
 }
 
+static uint64_t hash_keys(const wp_NetworkKeys * keys)
+{
+    // 64-bit FNV-1a, only used to compare keys, not for security
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    const uint8_t * parts[] = { keys->cipher, keys->authentication };
+
+    for (size_t p = 0; p < sizeof(parts) / sizeof(parts[0]); p++)
+    {
+        for (size_t i = 0; i < sizeof(keys->cipher); i++)
+        {
+            hash ^= parts[p][i];
+            hash *= 0x100000001b3ULL;
+        }
+    }
+    return hash;
+}
+
+static bool are_keys_already_set(const wp_NetworkKeys * keys)
+{
+    uint64_t hash = hash_keys(keys);
+    bool already_set;
+
+    Platform_mutex_lock(m_sink_config_mutex);
+    already_set = m_keys_hash_valid
+                  && m_sink_config.CipherKeySet
+                  && m_sink_config.AuthenticationKeySet
+                  && (hash == m_keys_hash);
+    Platform_mutex_unlock(m_sink_config_mutex);
+
+    return already_set;
+}
+
+/**
+ * \brief   Check if an app config is the one already stored in the sink
+ * \note    Sink pads the written data with zeros up to its maximum size
+ */
+static bool is_app_config_already_set(const wp_AppConfigData * app_config,
+                                      const sink_config_t * config_p)
+{
+    size_t size = app_config->app_config_data.size;
+
+    if (!config_p->app_config_valid
+        || (app_config->seq != config_p->app_config_seq)
+        || (app_config->diag_interval_s != config_p->app_config_diag_interval)
+        || (size > config_p->app_config_max_size)
+        || (memcmp(app_config->app_config_data.bytes, config_p->app_config, size) != 0))
+    {
+        return false;
+    }
+
+    for (size_t i = size; i < config_p->app_config_max_size; i++)
+    {
+        if (config_p->app_config[i] != 0)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * \brief   Check if a new config changes a parameter that can only be
+ *          written with the stack stopped
+ */
+static bool is_stack_stop_needed(wp_SinkNewConfig * cfg, const sink_config_t * config_p)
+{
+    return (cfg->has_node_role
+            && (convert_role_to_app_format(&cfg->node_role) != config_p->app_node_role))
+           || (cfg->has_node_address
+               && (cfg->node_address != config_p->node_address))
+           || (cfg->has_network_address
+               && (cfg->network_address != config_p->network_address))
+           || (cfg->has_network_channel
+               && (cfg->network_channel != config_p->network_channel))
+           || (cfg->has_keys
+               && !are_keys_already_set(&cfg->keys));
+}
+
+/**
+ * \brief   Take a coherent copy of the sink config
+ * \param   config_p
+ *          Filled with the sink config
+ * \return  Generation of the copied config
+ */
+static uint32_t get_sink_config(sink_config_t * config_p)
+{
+    uint32_t generation;
+
+    Platform_mutex_lock(m_sink_config_mutex);
+    *config_p = m_sink_config;
+    generation = m_config_generation;
+    Platform_mutex_unlock(m_sink_config_mutex);
+
+    return generation;
+}
+
+static uint8_t get_stack_status(void)
+{
+    uint8_t status;
+
+    Platform_mutex_lock(m_sink_config_mutex);
+    status = m_sink_config.StackStatus;
+    Platform_mutex_unlock(m_sink_config_mutex);
+
+    return status;
+}
+
 static void convert_role_to_proto_format(app_role_t role, wp_NodeRole * proto_role)
 {
     _Static_assert(member_size(wp_NodeRole, flags) >= (2 * sizeof(wp_NodeRole_RoleFlags)), "Too many role flags");
@@ -222,21 +402,21 @@ uint8_t convert_delay_to_app_format(wp_ProcessingDelay delay)
     }
 }
 
-static bool initialize_otap_variables()
+static bool initialize_otap_variables(sink_config_t * config_p)
 {
     bool res = true;
 
-    if (WPC_get_local_scratchpad_status(&m_sink_config.otap_status)
+    if (WPC_get_local_scratchpad_status(&config_p->otap_status)
         != APP_RES_OK)
     {
         LOGE("Cannot get local scratchpad status\n");
         res = false;
     }
 
-    if (WPC_read_target_scratchpad(&m_sink_config.target_sequence,
-                                   &m_sink_config.target_crc,
-                                   &m_sink_config.target_action,
-                                   &m_sink_config.target_param) != APP_RES_OK)
+    if (WPC_read_target_scratchpad(&config_p->target_sequence,
+                                   &config_p->target_crc,
+                                   &config_p->target_action,
+                                   &config_p->target_param) != APP_RES_OK)
     {
         LOGE("Cannot get target scratchpad status\n");
         res = false;
@@ -245,48 +425,79 @@ static bool initialize_otap_variables()
     return res;
 }
 
-static bool initialize_config_variables()
+/**
+ * \brief   Read app config from sink, so it can be given without accessing
+ *          the sink (it can be busy for a long time during an otap)
+ */
+static bool read_app_config(sink_config_t * config_p)
+{
+    uint16_t diag_data_interval = 0;  // needed to avoid trouble with pointer alignement
+
+    if (MAXIMUM_APP_CONFIG_SIZE < config_p->app_config_max_size)
+    {
+        config_p->app_config_valid = false;
+        return true;
+    }
+
+    if (WPC_get_app_config_data(&config_p->app_config_seq,
+                                &diag_data_interval,
+                                config_p->app_config,
+                                sizeof(config_p->app_config))
+        != APP_RES_OK)
+    {
+        LOGE("Cannot get App config data from node\n");
+        config_p->app_config_valid = false;
+        return false;
+    }
+
+    config_p->app_config_diag_interval = diag_data_interval;
+    config_p->app_config_valid = true;
+    return true;
+}
+
+static bool initialize_config_variables(sink_config_t * config_p)
 {
     bool res = true;
 
-    res &= get_value_from_node(WPC_get_stack_profile, &m_sink_config.stack_profile, NULL,
+    res &= get_value_from_node(WPC_get_stack_profile, &config_p->stack_profile, NULL,
                                "Stack profile");
-    res &= get_value_from_node(WPC_get_hw_magic, &m_sink_config.hw_magic, NULL,
+    res &= get_value_from_node(WPC_get_hw_magic, &config_p->hw_magic, NULL,
                                "Hw magic");
-    res &= get_value_from_node(WPC_get_mtu, &m_sink_config.max_mtu, NULL,
+    res &= get_value_from_node(WPC_get_mtu, &config_p->max_mtu, NULL,
                                "MTU");
-    res &= get_value_from_node(WPC_get_pdu_buffer_size, &m_sink_config.pdu_buffer_size, NULL,
+    res &= get_value_from_node(WPC_get_pdu_buffer_size, &config_p->pdu_buffer_size, NULL,
                                "PDU Buffer Size");
-    res &= get_value_from_node(WPC_get_channel_limits, &m_sink_config.ch_range_min, &m_sink_config.ch_range_max,
+    res &= get_value_from_node(WPC_get_channel_limits, &config_p->ch_range_min, &config_p->ch_range_max,
                                "Channel Range");
-    res &= get_value_from_node(WPC_get_access_cycle_limits, &m_sink_config.ac_limit_min, &m_sink_config.ac_limit_max,
+    res &= get_value_from_node(WPC_get_access_cycle_limits, &config_p->ac_limit_min, &config_p->ac_limit_max,
                                "AC Range");
-    res &= get_value_from_node(WPC_get_app_config_data_size, &m_sink_config.app_config_max_size, NULL,
+    res &= get_value_from_node(WPC_get_app_config_data_size, &config_p->app_config_max_size, NULL,
                                "App Config Max size");
-    res &= get_value_from_node(WPC_is_cipher_key_set, &m_sink_config.CipherKeySet, NULL,
+    res &= get_value_from_node(WPC_is_cipher_key_set, &config_p->CipherKeySet, NULL,
                                "Cipher key set");
-    res &= get_value_from_node(WPC_is_authentication_key_set, &m_sink_config.AuthenticationKeySet, NULL,
+    res &= get_value_from_node(WPC_is_authentication_key_set, &config_p->AuthenticationKeySet, NULL,
                                "Authentication key set");
-    res &= get_value_from_node(WPC_get_stack_status, &m_sink_config.StackStatus, NULL,
+    res &= get_value_from_node(WPC_get_stack_status, &config_p->StackStatus, NULL,
                                "Stack Status");
-    res &= get_value_from_node(WPC_get_access_cycle_range, &m_sink_config.ac_range_min_cur, &m_sink_config.ac_range_max_cur,
+    res &= get_value_from_node(WPC_get_access_cycle_range, &config_p->ac_range_min_cur, &config_p->ac_range_max_cur,
                                "Current access cycle range");
-    res &= get_value_from_node(WPC_get_node_address, &m_sink_config.node_address, NULL,
+    res &= get_value_from_node(WPC_get_node_address, &config_p->node_address, NULL,
                                "Network address");
-    res &= get_value_from_node(WPC_get_role, &m_sink_config.app_node_role, NULL,
+    res &= get_value_from_node(WPC_get_role, &config_p->app_node_role, NULL,
                                "Node role");
-    res &= get_value_from_node(WPC_get_network_address, &m_sink_config.network_address, NULL,
+    res &= get_value_from_node(WPC_get_network_address, &config_p->network_address, NULL,
                                "Network address");
-    res &= get_value_from_node(WPC_get_network_channel, &m_sink_config.network_channel, NULL,
+    res &= get_value_from_node(WPC_get_network_channel, &config_p->network_channel, NULL,
                                "Network channel");
+    res &= read_app_config(config_p);
 
-    if (WPC_get_firmware_version(m_sink_config.version) == APP_RES_OK)
+    if (WPC_get_firmware_version(config_p->version) == APP_RES_OK)
     {
         LOGI("Stack version is: %d.%d.%d.%d\n",
-             m_sink_config.version[0],
-             m_sink_config.version[1],
-             m_sink_config.version[2],
-             m_sink_config.version[3]);
+             config_p->version[0],
+             config_p->version[1],
+             config_p->version[2],
+             config_p->version[3]);
     }
     else
     {
@@ -296,20 +507,21 @@ static bool initialize_config_variables()
     return res;
 }
 
-static void fill_target_and_action(wp_TargetScratchpadAndAction * target_and_action_p)
+static void fill_target_and_action(wp_TargetScratchpadAndAction * target_and_action_p,
+                                   const sink_config_t * config_p)
 {
     *target_and_action_p = (wp_TargetScratchpadAndAction){
-        .action = m_sink_config.target_action + wp_ScratchpadAction_NO_OTAP, // NO_OTAP = 0 on CMeshAPI
+        .action = config_p->target_action + wp_ScratchpadAction_NO_OTAP, // NO_OTAP = 0 on CMeshAPI
         .has_target_sequence = true, // do we need to check action to set it true/false ?
-        .target_sequence = m_sink_config.target_sequence,
+        .target_sequence = config_p->target_sequence,
         .has_target_crc = true, // do we need to check action to set it true/false ?
-        .target_crc = m_sink_config.target_crc
+        .target_crc = config_p->target_crc
     };
 
     // Set param if target is PROPAGATE_AND_PROCESS_WITH_DELAY
-    if (m_sink_config.target_action == 3)
+    if (config_p->target_action == 3)
     {
-        wp_ProcessingDelay delay = convert_delay_to_proto_format(m_sink_config.target_param);
+        wp_ProcessingDelay delay = convert_delay_to_proto_format(config_p->target_param);
         if (delay != wp_ProcessingDelay_UNKNOWN_DELAY)
         {
             target_and_action_p->which_param = wp_TargetScratchpadAndAction_delay_tag;
@@ -318,104 +530,104 @@ static void fill_target_and_action(wp_TargetScratchpadAndAction * target_and_act
         else
         {
             target_and_action_p->which_param = wp_TargetScratchpadAndAction_raw_tag;
-            target_and_action_p->param.raw = m_sink_config.target_param;
+            target_and_action_p->param.raw = config_p->target_param;
         }
     }
 
 }
 
-static void fill_sink_read_config(wp_SinkReadConfig * config_p)
+static void fill_sink_read_config(wp_SinkReadConfig * config_p,
+                                  const sink_config_t * sink_config_p)
 {
     _Static_assert(     member_size(wp_AppConfigData_app_config_data_t, bytes)
                      >= member_size(msap_app_config_data_write_req_pl_t, app_config_data),
                       "wp_AppConfigData_app_config_data_t is too small");
     _Static_assert(member_size(wp_SinkReadConfig, sink_id) >= SINK_ID_MAX_SIZE, "wp_SinkReadConfig is too small");
 
-    uint8_t status = m_sink_config.StackStatus;
+    uint8_t status = sink_config_p->StackStatus;
 
     *config_p = (wp_SinkReadConfig){
         /* Sink minimal config */
         .has_node_role = true,
         .has_node_address =  true,
-        .node_address = m_sink_config.node_address,
+        .node_address = sink_config_p->node_address,
         .has_network_address = true,
-        .network_address = m_sink_config.network_address,
+        .network_address = sink_config_p->network_address,
         .has_network_channel = true,
-        .network_channel = m_sink_config.network_channel,
+        .network_channel = sink_config_p->network_channel,
         .has_app_config = true,
         .has_channel_map = false,
         .has_are_keys_set = true,
-        .are_keys_set =    m_sink_config.CipherKeySet
-                        && m_sink_config.AuthenticationKeySet,
+        .are_keys_set =    sink_config_p->CipherKeySet
+                        && sink_config_p->AuthenticationKeySet,
 
-        .has_current_ac_range = (m_sink_config.ac_range_min_cur == 0 ? false : true),
+        .has_current_ac_range = (sink_config_p->ac_range_min_cur == 0 ? false : true),
 
-        .current_ac_range = {.min_ms = m_sink_config.ac_range_min_cur,
-                             .max_ms = m_sink_config.ac_range_max_cur},
+        .current_ac_range = {.min_ms = sink_config_p->ac_range_min_cur,
+                             .max_ms = sink_config_p->ac_range_max_cur},
         /* Read only parameters */
         .has_ac_limits = true,
-        .ac_limits = {.min_ms = m_sink_config.ac_limit_min,
-                      .max_ms = m_sink_config.ac_limit_max},
+        .ac_limits = {.min_ms = sink_config_p->ac_limit_min,
+                      .max_ms = sink_config_p->ac_limit_max},
         .has_max_mtu = true,
-        .max_mtu = m_sink_config.max_mtu,
+        .max_mtu = sink_config_p->max_mtu,
         .has_channel_limits = true,
-        .channel_limits = {.min_channel = m_sink_config.ch_range_min,
-                           .max_channel = m_sink_config.ch_range_max},
+        .channel_limits = {.min_channel = sink_config_p->ch_range_min,
+                           .max_channel = sink_config_p->ch_range_max},
         .has_hw_magic = true,
-        .hw_magic = m_sink_config.hw_magic,
+        .hw_magic = sink_config_p->hw_magic,
         .has_stack_profile = true,
-        .stack_profile = m_sink_config.stack_profile,
+        .stack_profile = sink_config_p->stack_profile,
         .has_app_config_max_size = true,
-        .app_config_max_size = m_sink_config.app_config_max_size,
+        .app_config_max_size = sink_config_p->app_config_max_size,
         .has_firmware_version = true,
-        .firmware_version = {.major = m_sink_config.version[0],
-                             .minor = m_sink_config.version[1],
-                             .maint = m_sink_config.version[2],
-                             .dev = m_sink_config.version[3] },
+        .firmware_version = {.major = sink_config_p->version[0],
+                             .minor = sink_config_p->version[1],
+                             .maint = sink_config_p->version[2],
+                             .dev = sink_config_p->version[3] },
         /* State of sink */
         .has_sink_state = true,
         .sink_state = ((status & APP_STACK_STOPPED) ? wp_OnOffState_OFF : wp_OnOffState_ON),
         /* Scratchpad info for the sink */
         .has_stored_scratchpad = true,
-        .stored_scratchpad = { .len = m_sink_config.otap_status.scrat_len,
-                               .crc = m_sink_config.otap_status.scrat_crc,
-                               .seq = m_sink_config.otap_status.scrat_seq_number, },
+        .stored_scratchpad = { .len = sink_config_p->otap_status.scrat_len,
+                               .crc = sink_config_p->otap_status.scrat_crc,
+                               .seq = sink_config_p->otap_status.scrat_seq_number, },
         .has_stored_status = true,
-        .stored_status = convert_scrat_status_to_proto_format(m_sink_config.otap_status.scrat_status),
+        .stored_status = convert_scrat_status_to_proto_format(sink_config_p->otap_status.scrat_status),
         .has_stored_type = true,
-        .stored_type = convert_scrat_type_to_proto_format(m_sink_config.otap_status.scrat_type),
+        .stored_type = convert_scrat_type_to_proto_format(sink_config_p->otap_status.scrat_type),
         .has_processed_scratchpad = true,
-        .processed_scratchpad = { .len = m_sink_config.otap_status.processed_scrat_len,
-                                  .crc = m_sink_config.otap_status.processed_scrat_crc,
-                                  .seq = m_sink_config.otap_status.processed_scrat_seq_number, },
+        .processed_scratchpad = { .len = sink_config_p->otap_status.processed_scrat_len,
+                                  .crc = sink_config_p->otap_status.processed_scrat_crc,
+                                  .seq = sink_config_p->otap_status.processed_scrat_seq_number, },
         .has_firmware_area_id = true,
-        .firmware_area_id = m_sink_config.otap_status.firmware_memory_area_id,
+        .firmware_area_id = sink_config_p->otap_status.firmware_memory_area_id,
         .has_target_and_action = true,
     };
 
     strncpy(config_p->sink_id, Common_get_sink_id(), SINK_ID_MAX_SIZE);
 
-    convert_role_to_proto_format(m_sink_config.app_node_role, &config_p->node_role);
+    convert_role_to_proto_format(sink_config_p->app_node_role, &config_p->node_role);
 
-    fill_target_and_action(&config_p->target_and_action);
+    fill_target_and_action(&config_p->target_and_action, sink_config_p);
 
-    if (MAXIMUM_APP_CONFIG_SIZE >= m_sink_config.app_config_max_size)
+    if (MAXIMUM_APP_CONFIG_SIZE >= sink_config_p->app_config_max_size)
     {
-        uint16_t diag_data_interval = 0;  // needed to avoid trouble with pointer alignement
-        uint8_t seq = 0;
-        config_p->app_config.app_config_data.size = m_sink_config.app_config_max_size;
-        if (WPC_get_app_config_data(&seq,
-                                    &diag_data_interval,
-                                    config_p->app_config.app_config_data.bytes,
-                                    member_size(wp_AppConfigData_app_config_data_t, bytes))
-            != APP_RES_OK)
+        if (sink_config_p->app_config_valid)
+        {
+            config_p->app_config.app_config_data.size = sink_config_p->app_config_max_size;
+            memcpy(config_p->app_config.app_config_data.bytes,
+                   sink_config_p->app_config,
+                   sink_config_p->app_config_max_size);
+            config_p->app_config.seq = sink_config_p->app_config_seq;
+            config_p->app_config.diag_interval_s = sink_config_p->app_config_diag_interval;
+        }
+        else
         {
-            LOGE("Cannot get App config data from node\n");
             config_p->has_app_config = false;
             config_p->app_config.app_config_data.size = 0;
         }
-        config_p->app_config.seq = seq;
-        config_p->app_config.diag_interval_s = diag_data_interval;
     }
 }
 
@@ -433,13 +645,16 @@ static void fill_status_event(wp_StatusEvent * status_event_p,
         .has_gw_model = (strlen(Common_get_gateway_model()) != 0),
         .has_gw_version = (strlen(Common_get_gateway_version()) != 0),
         .has_max_scratchpad_size = true,
-        .max_scratchpad_size = member_size(wp_UploadScratchpadReq_scratchpad_t, bytes)
+        .max_scratchpad_size = SCRATCHPAD_CHUNK_MAX_SIZE
     };
 
     // Add current config for online node
     if (config_count == 1)
     {
-        fill_sink_read_config(&status_event_p->configs[0]);
+        sink_config_t sink_config;
+
+        get_sink_config(&sink_config);
+        fill_sink_read_config(&status_event_p->configs[0], &sink_config);
     }
 
     strncpy(status_event_p->gw_model, Common_get_gateway_model(), GATEWAY_MODEL_MAX_SIZE);
@@ -448,112 +663,415 @@ static void fill_status_event(wp_StatusEvent * status_event_p,
     Common_fill_event_header(&status_event_p->header, false);
 }
 
+static void fill_gateway_info(wp_GatewayInfo * info_p)
+{
+    *info_p = (wp_GatewayInfo){
+        .current_time_s_epoch = Platform_get_timestamp_ms_epoch() / 1000,
+        .has_gw_model = (Common_get_gateway_model() != 0),
+        .has_gw_version = (Common_get_gateway_version() != 0),
+        .has_implemented_api_version = true,
+        .implemented_api_version = GW_PROTO_API_VERSION,
+        .has_max_scratchpad_size = true,
+        .max_scratchpad_size = SCRATCHPAD_CHUNK_MAX_SIZE,
+    };
+
+    strcpy(info_p->gw_model, Common_get_gateway_model());
+    strcpy(info_p->gw_version, Common_get_gateway_version());
+}
+
+/**
+ * \brief   Remove from a StatusEvent the fields located after configs
+ */
+static void strip_status_event_tail(wp_StatusEvent * status_event_p)
+{
+    status_event_p->has_gw_model = false;
+    status_event_p->has_gw_version = false;
+    status_event_p->has_max_scratchpad_size = false;
+    status_event_p->gw_features_count = 0;
+}
+
+/**
+ * \brief   Config is updated, pre-encoded messages must be rebuilt
+ * \note    m_sink_config_mutex must be locked
+ */
+static void config_updated(void)
+{
+    m_config_generation++;
+    Platform_atomic_store(&m_network_address, m_sink_config.network_address, PLATFORM_RELAXED);
+}
+
+/**
+ * \brief   Encode the last fields of a message
+ * \param   fields
+ *          Description of the message
+ * \param   full_p
+ *          The full message
+ * \param   leading_p
+ *          The same message without the last fields
+ * \param   tail_p
+ *          Buffer to store the last fields, big enough for the full message
+ * \param   tail_size_p
+ *          [in] size of the buffer, [out] size of the last fields
+ * \note    Fields are encoded in tag order, so the leading fields are
+ *          encoded the same way in both messages
+ */
+static bool encode_tail(const pb_msgdesc_t * fields,
+                        const void * full_p,
+                        const void * leading_p,
+                        uint8_t * tail_p,
+                        size_t * tail_size_p)
+{
+    pb_ostream_t stream = pb_ostream_from_buffer(tail_p, *tail_size_p);
+    size_t leading_size;
+
+    if (!pb_get_encoded_size(&leading_size, fields, leading_p)
+        || !pb_encode(&stream, fields, full_p))
+    {
+        LOGE("Cannot encode tail: %s\n", PB_GET_ERROR(&stream));
+        return false;
+    }
+
+    *tail_size_p = stream.bytes_written - leading_size;
+    memmove(tail_p, tail_p + leading_size, *tail_size_p);
+    return true;
+}
+
+/**
+ * \brief   Build again the pre-encoded parts if config has changed
+ * \note    m_encoded_cache_mutex must be locked
+ */
+static bool refresh_encoded_cache_locked(void)
+{
+    uint32_t generation;
+    sink_config_t sink_config;
+    wp_SinkReadConfig config;
+    wp_GatewayInfo gw_info;
+    wp_GatewayInfo gw_info_leading = { 0 };
+    pb_ostream_t stream;
+    bool res;
+
+    // Generation is read with the copy, so an update in between is seen as a
+    // new generation at next encoding
+    Platform_mutex_lock(m_sink_config_mutex);
+    generation = m_config_generation;
+    if (m_encoded_cache.generation == generation)
+    {
+        Platform_mutex_unlock(m_sink_config_mutex);
+        return true;
+    }
+    sink_config = m_sink_config;
+    Platform_mutex_unlock(m_sink_config_mutex);
+
+    fill_sink_read_config(&config, &sink_config);
+    stream = pb_ostream_from_buffer(m_encoded_cache.config, sizeof(m_encoded_cache.config));
+    if (!pb_encode(&stream, wp_SinkReadConfig_fields, &config))
+    {
+        LOGE("SinkReadConfig encoding failed: %s\n", PB_GET_ERROR(&stream));
+        return false;
+    }
+    m_encoded_cache.config_size = stream.bytes_written;
+
+    // Current time is the first field of GatewayInfo, all others are constant
+    fill_gateway_info(&gw_info);
+    gw_info.current_time_s_epoch = 0;
+    m_encoded_cache.gw_info_tail_size = sizeof(m_encoded_cache.gw_info_tail);
+    res = encode_tail(wp_GatewayInfo_fields,
+                      &gw_info,
+                      &gw_info_leading,
+                      m_encoded_cache.gw_info_tail,
+                      &m_encoded_cache.gw_info_tail_size);
+
+    fill_status_event(&m_cache_status_event, wp_OnOffState_ON, 0);
+    m_cache_status_event_leading = m_cache_status_event;
+    strip_status_event_tail(&m_cache_status_event_leading);
+    m_encoded_cache.status_event_tail_size = sizeof(m_encoded_cache.status_event_tail);
+    res &= encode_tail(wp_StatusEvent_fields,
+                       &m_cache_status_event,
+                       &m_cache_status_event_leading,
+                       m_encoded_cache.status_event_tail,
+                       &m_encoded_cache.status_event_tail_size);
+
+    if (res)
+    {
+        LOGD("Encoded config updated to generation %d\n", generation);
+        m_encoded_cache.generation = generation;
+    }
+    return res;
+}
+
+/**
+ * \brief   Write the pre-encoded config as a field of a message
+ */
+static bool write_config_field(pb_ostream_t * stream, uint32_t tag)
+{
+    return pb_encode_tag(stream, PB_WT_STRING, tag)
+           && pb_encode_string(stream, m_encoded_cache.config, m_encoded_cache.config_size);
+}
+
+static bool write_get_configs_resp(pb_ostream_t * stream, const void * arg_p)
+{
+    const wp_ResponseHeader * header_p = arg_p;
+
+    return pb_encode_tag(stream, PB_WT_STRING, wp_GetConfigsResp_header_tag)
+           && pb_encode_submessage(stream, wp_ResponseHeader_fields, header_p)
+           && write_config_field(stream, wp_GetConfigsResp_configs_tag);
+}
+
+static bool write_gw_info(pb_ostream_t * stream, uint64_t current_time_s_epoch)
+{
+    return pb_encode_tag(stream, PB_WT_VARINT, wp_GatewayInfo_current_time_s_epoch_tag)
+           && pb_encode_varint(stream, current_time_s_epoch)
+           && pb_write(stream, m_encoded_cache.gw_info_tail, m_encoded_cache.gw_info_tail_size);
+}
+
+static bool write_get_gw_info_resp(pb_ostream_t * stream, const void * arg_p)
+{
+    const gw_info_resp_t * resp_p = arg_p;
+    pb_ostream_t sizing = PB_OSTREAM_SIZING;
+
+    (void) write_gw_info(&sizing, resp_p->current_time_s_epoch);
+
+    return pb_encode_tag(stream, PB_WT_STRING, wp_GetGwInfoResp_header_tag)
+           && pb_encode_submessage(stream, wp_ResponseHeader_fields, &resp_p->header)
+           && pb_encode_tag(stream, PB_WT_STRING, wp_GetGwInfoResp_info_tag)
+           && pb_encode_varint(stream, sizing.bytes_written)
+           && write_gw_info(stream, resp_p->current_time_s_epoch);
+}
+
+static bool write_status_event(pb_ostream_t * stream, const void * arg_p)
+{
+    const status_event_t * event_p = arg_p;
+
+    return pb_encode(stream, wp_StatusEvent_fields, event_p->leading_p)
+           && (!event_p->with_config || write_config_field(stream, wp_StatusEvent_configs_tag))
+           && pb_write(stream, m_encoded_cache.status_event_tail, m_encoded_cache.status_event_tail_size);
+}
+
+/**
+ * \brief   Encode a GenericMessage holding a WirepasMessage with a single
+ *          message, built from the pre-encoded parts
+ * \param   message_tag
+ *          Tag of the message in WirepasMessage
+ * \param   write_message
+ *          Function to write the content of the message
+ * \param   arg_p
+ *          Argument for write_message
+ * \param   buffer_p
+ *          Buffer to store the encoded message
+ * \param   size_p
+ *          [in] size of the buffer, [out] size of the encoded message
+ * \note    Output is the same as encoding the full structures with pb_encode
+ * \note    m_encoded_cache_mutex must be locked
+ */
+static app_proto_res_e encode_wirepas_message_locked(uint32_t message_tag,
+                                                     write_message_f write_message,
+                                                     const void * arg_p,
+                                                     uint8_t * buffer_p,
+                                                     size_t * size_p)
+{
+    pb_ostream_t message_sizing = PB_OSTREAM_SIZING;
+    pb_ostream_t wirepas_sizing = PB_OSTREAM_SIZING;
+    pb_ostream_t stream = pb_ostream_from_buffer(buffer_p, *size_p);
+    bool res;
+
+    res = refresh_encoded_cache_locked();
+
+    // Size of the nested messages are needed first
+    res = res
+          && write_message(&message_sizing, arg_p)
+          && pb_encode_tag(&wirepas_sizing, PB_WT_STRING, message_tag)
+          && pb_encode_varint(&wirepas_sizing, message_sizing.bytes_written);
+
+    res = res
+          && pb_encode_tag(&stream, PB_WT_STRING, wp_GenericMessage_wirepas_tag)
+          && pb_encode_varint(&stream,
+                              wirepas_sizing.bytes_written + message_sizing.bytes_written)
+          && pb_encode_tag(&stream, PB_WT_STRING, message_tag)
+          && pb_encode_varint(&stream, message_sizing.bytes_written)
+          && write_message(&stream, arg_p);
+
+    if (!res)
+    {
+        LOGE("Encoding failed: %s\n", PB_GET_ERROR(&stream));
+        *size_p = 0;
+        return APP_RES_PROTO_CANNOT_GENERATE_RESPONSE;
+    }
+
+    *size_p = stream.bytes_written;
+    return APP_RES_PROTO_OK;
+}
+
+/**
+ * \brief   Same as \ref encode_wirepas_message_locked, taking the lock
+ */
+static app_proto_res_e encode_wirepas_message(uint32_t message_tag,
+                                              write_message_f write_message,
+                                              const void * arg_p,
+                                              uint8_t * buffer_p,
+                                              size_t * size_p)
+{
+    app_proto_res_e res;
+
+    Platform_mutex_lock(m_encoded_cache_mutex);
+    res = encode_wirepas_message_locked(message_tag, write_message, arg_p, buffer_p, size_p);
+    Platform_mutex_unlock(m_encoded_cache_mutex);
+
+    return res;
+}
+
+/**
+ * \brief   Encode a StatusEvent
+ * \param   state
+ *          Gateway state
+ * \param   with_config
+ *          True to add the sink config (sink is online)
+ * \param   buffer_p
+ *          Buffer to store the encoded event
+ * \param   size_p
+ *          [in] size of the buffer, [out] size of the encoded event
+ */
+static app_proto_res_e encode_status_event(wp_OnOffState state,
+                                           bool with_config,
+                                           uint8_t * buffer_p,
+                                           size_t * size_p)
+{
+    app_proto_res_e res;
+    status_event_t status_event;
+
+    // Only the fields encoded for each event are filled
+    Platform_mutex_lock(m_encoded_cache_mutex);
+    fill_status_event(&m_status_event_leading, state, 0);
+    strip_status_event_tail(&m_status_event_leading);
+
+    status_event.leading_p = &m_status_event_leading;
+    status_event.with_config = with_config;
+    res = encode_wirepas_message_locked(wp_WirepasMessage_status_event_tag,
+                                        write_status_event,
+                                        &status_event,
+                                        buffer_p,
+                                        size_p);
+    Platform_mutex_unlock(m_encoded_cache_mutex);
+
+    return res;
+}
+
 static bool refresh_full_stack_state()
 {
     bool res = true;
+    sink_config_t config;
+    uint8_t previous_status;
 
-    uint8_t previous_status = m_sink_config.StackStatus;
+    // Values that cannot be read are kept
+    get_sink_config(&config);
 
     /* Read config from sink */
-    if (!initialize_config_variables())
+    if (!initialize_config_variables(&config))
     {
         LOGE("All the settings cannot be read\n");
         res = false;
     }
 
     /* Read otap config from sink */
-    if (!initialize_otap_variables())
+    if (!initialize_otap_variables(&config))
     {
         LOGE("All the otap settings cannot be read\n");
         res = false;
     }
 
+    Platform_mutex_lock(m_sink_config_mutex);
+    previous_status = m_sink_config.StackStatus;
+    m_sink_config = config;
+    config_updated();
+    Platform_mutex_unlock(m_sink_config_mutex);
+
     if(   (previous_status & APP_STACK_STOPPED)
-       != (m_sink_config.StackStatus & APP_STACK_STOPPED) )
+       != (config.StackStatus & APP_STACK_STOPPED) )
     {
         // Stack state changed
-        if ((m_sink_config.StackStatus & APP_STACK_STOPPED) == 0)
+        if ((config.StackStatus & APP_STACK_STOPPED) == 0)
         {
-            LOGI("Refresh : Stack started %d\n", m_sink_config.StackStatus);
+            LOGI("Refresh : Stack started %d\n", config.StackStatus);
         }
         else
         {
-            LOGI("Refresh : Stack stopped %d\n", m_sink_config.StackStatus);
+            LOGI("Refresh : Stack stopped %d\n", config.StackStatus);
         }
     }
 
     return res;
 }
 
-static void onStackStatusReceived(uint8_t status)
+/**
+ * \brief   Read back the full sink state and publish it in a StatusEvent
+ */
+static void refresh_and_publish_status(void)
 {
-    bool res;
-    wp_StatusEvent * message_StatusEvent_p;
     uint8_t * encoded_message_p;
-    wp_GenericMessage message = wp_GenericMessage_init_zero;
-    wp_WirepasMessage message_wirepas = wp_WirepasMessage_init_zero;
-    message.wirepas = &message_wirepas;
-
-    if (status == IGNORE_STATUS)
-    {
-        LOGI("Evt : Stack status event generated %d\n", m_sink_config.StackStatus);
-    }
-    else
-    {
-        LOGI("Evt : Stack status received : %d %d\n", status, m_sink_config.StackStatus);
-    }
+    size_t encoded_size = WPC_PROTO_MAX_EVENTSTATUS_SIZE;
 
     (void) refresh_full_stack_state();
 
-    LOGI("Evt : Stack status updated : %d\n", m_sink_config.StackStatus);
-
-    // Allocate the needed space for only the submessage we want to send
-    message_StatusEvent_p = Platform_malloc(sizeof(wp_StatusEvent));
-    if (message_StatusEvent_p == NULL)
-    {
-        LOGE("Not enough memory to encode StatusEvent\n");
-        return;
-    }
+    LOGI("Evt : Stack status updated : %d\n", get_stack_status());
 
     // Allocate needed buffer for encoded message
     encoded_message_p = Platform_malloc(WPC_PROTO_MAX_EVENTSTATUS_SIZE);
     if (encoded_message_p == NULL)
     {
         LOGE("Not enough memory for output buffer");
-        Platform_free(message_StatusEvent_p, sizeof(wp_StatusEvent));
         return;
     }
 
-    message_wirepas.status_event = message_StatusEvent_p;
-
-    fill_status_event(message_StatusEvent_p, wp_OnOffState_ON, 1);
-
-    // Using the module static buffer
-    pb_ostream_t stream = pb_ostream_from_buffer(encoded_message_p, WPC_PROTO_MAX_EVENTSTATUS_SIZE);
-
-    /* Now we are ready to encode the message! */
-    res = pb_encode(&stream, wp_GenericMessage_fields, &message);
-
-    /* Release buffer as we don't need it anymore */
-    Platform_free(message_StatusEvent_p, sizeof(wp_StatusEvent));
-
-	if (!res) {
-		LOGE("Encoding failed: %s\n", PB_GET_ERROR(&stream));
-	}
-	else
-	{
-        LOGD("Msg size %d\n", stream.bytes_written);
+    if (encode_status_event(wp_OnOffState_ON, true, encoded_message_p, &encoded_size)
+        == APP_RES_PROTO_OK)
+    {
+        LOGD("Msg size %d\n", encoded_size);
         if (m_onProtoEventStatus_cb != NULL)
         {
-            m_onProtoEventStatus_cb(encoded_message_p, stream.bytes_written);
+            m_onProtoEventStatus_cb(encoded_message_p, encoded_size);
         }
     }
 
     Platform_free(encoded_message_p, WPC_PROTO_MAX_EVENTSTATUS_SIZE);
 }
 
+static void onStackStatusReceived(uint8_t status)
+{
+    if (status == IGNORE_STATUS)
+    {
+        // Generated internally from a request context, the caller expects
+        // the config to be up to date when returning
+        LOGI("Evt : Stack status event generated %d\n", get_stack_status());
+        refresh_and_publish_status();
+        return;
+    }
+
+    LOGI("Evt : Stack status received : %d %d\n", status, get_stack_status());
+
+    // Received from the dispatching context. The refresh is a long sequence
+    // of requests to the sink so do it in background to not delay the
+    // next indications. A burst of status is handled by a single refresh
+    if (!Platform_worker_schedule(m_refresh_worker,
+                                  refresh_and_publish_status,
+                                  STATUS_REFRESH_DEBOUNCE_MS))
+    {
+        refresh_and_publish_status();
+    }
+}
+
 bool Proto_config_init(void)
 {
+    m_sink_config_mutex = Platform_mutex_create();
+    m_encoded_cache_mutex = Platform_mutex_create();
+    m_refresh_worker = Platform_worker_create();
+    if ((m_sink_config_mutex == NULL)
+        || (m_encoded_cache_mutex == NULL)
+        || (m_refresh_worker == NULL))
+    {
+        LOGE("Cannot create config locks and worker\n");
+        Proto_config_close();
+        return false;
+    }
+
     /* Read initial config from sink */
     if (!refresh_full_stack_state())
     {
@@ -562,8 +1080,8 @@ bool Proto_config_init(void)
 
     if (WPC_register_for_stack_status(onStackStatusReceived) != APP_RES_OK)
     {
+        // Not fatal, status events are not sent
         LOGE("Stack status already registered\n");
-        return false;
     }
 
     return true;
@@ -571,34 +1089,55 @@ bool Proto_config_init(void)
 
 void Proto_config_close()
 {
+    // A refresh in progress is completed first
+    if (m_refresh_worker != NULL)
+    {
+        Platform_worker_delete(m_refresh_worker);
+        m_refresh_worker = NULL;
+    }
+    if (m_encoded_cache_mutex != NULL)
+    {
+        Platform_mutex_delete(m_encoded_cache_mutex);
+        m_encoded_cache_mutex = NULL;
+    }
+    if (m_sink_config_mutex != NULL)
+    {
+        Platform_mutex_delete(m_sink_config_mutex);
+        m_sink_config_mutex = NULL;
+    }
 }
 
 app_proto_res_e Proto_config_handle_get_scratchpad_status(wp_GetScratchpadStatusReq *req,
                                                           wp_GetScratchpadStatusResp *resp)
 {
     app_res_e res = APP_RES_OK;
+    sink_config_t current;
 
     // TODO: Add some sanity checks
 
+    // Also answered from the submitting context, while the worker may be
+    // refreshing the config
+    get_sink_config(&current);
+
     *resp = (wp_GetScratchpadStatusResp){
         .has_stored_scratchpad = true,
-        .stored_scratchpad = { .len = m_sink_config.otap_status.scrat_len,
-                               .crc = m_sink_config.otap_status.scrat_crc,
-                               .seq = m_sink_config.otap_status.scrat_seq_number, },
+        .stored_scratchpad = { .len = current.otap_status.scrat_len,
+                               .crc = current.otap_status.scrat_crc,
+                               .seq = current.otap_status.scrat_seq_number, },
         .has_stored_status = true,
-        .stored_status = convert_scrat_status_to_proto_format(m_sink_config.otap_status.scrat_status),
+        .stored_status = convert_scrat_status_to_proto_format(current.otap_status.scrat_status),
         .has_stored_type = true,
-        .stored_type = convert_scrat_type_to_proto_format(m_sink_config.otap_status.scrat_type),
+        .stored_type = convert_scrat_type_to_proto_format(current.otap_status.scrat_type),
         .has_processed_scratchpad = true,
-        .processed_scratchpad = { .len = m_sink_config.otap_status.processed_scrat_len,
-                                  .crc = m_sink_config.otap_status.processed_scrat_crc,
-                                  .seq = m_sink_config.otap_status.processed_scrat_seq_number, },
+        .processed_scratchpad = { .len = current.otap_status.processed_scrat_len,
+                                  .crc = current.otap_status.processed_scrat_crc,
+                                  .seq = current.otap_status.processed_scrat_seq_number, },
         .has_firmware_area_id = true,
-        .firmware_area_id = m_sink_config.otap_status.firmware_memory_area_id,
+        .firmware_area_id = current.otap_status.firmware_memory_area_id,
         .has_target_and_action = true,
     };
 
-    fill_target_and_action(&resp->target_and_action);
+    fill_target_and_action(&resp->target_and_action, &current);
 
     Common_Fill_response_header(&resp->header,
                                 req->header.req_id,
@@ -617,6 +1156,8 @@ app_proto_res_e Proto_config_handle_set_config(wp_SetConfigReq *req,
     bool restart_stack = false;
     bool stop_stack = false;
     wp_SinkNewConfig * cfg = &req->config;
+    sink_config_t current;
+    uint8_t stack_status;
 
     // TODO: Add some sanity checks
 
@@ -632,14 +1173,24 @@ app_proto_res_e Proto_config_handle_set_config(wp_SetConfigReq *req,
     }
 
     // At least refresh stack status
-    WPC_get_stack_status(&m_sink_config.StackStatus);
+    if (WPC_get_stack_status(&stack_status) == APP_RES_OK)
+    {
+        Platform_mutex_lock(m_sink_config_mutex);
+        m_sink_config.StackStatus = stack_status;
+        config_updated();
+        Platform_mutex_unlock(m_sink_config_mutex);
+    }
+
+    // New values are compared to this copy, updates are stored in
+    // m_sink_config as soon as they are written to the sink
+    get_sink_config(&current);
 
     LOGI("Config received : %d, %d, %d, %d, %d, %d, %d/%d\n",
             cfg->has_node_role, cfg->has_node_address, cfg->has_network_address,
             cfg->has_network_channel, cfg->has_keys, cfg->has_current_ac_range,
             cfg->has_sink_state, cfg->sink_state);
 
-    if ((m_sink_config.StackStatus & APP_STACK_STOPPED))
+    if ((current.StackStatus & APP_STACK_STOPPED))
     {
         // stack already stopped, check if start will be needed
         if (cfg->has_sink_state && (cfg->sink_state == wp_OnOffState_ON) )
@@ -650,13 +1201,10 @@ app_proto_res_e Proto_config_handle_set_config(wp_SetConfigReq *req,
     }
     else
     {
-        // stack running, check if stop is needed to apply config
-        if  (    cfg->has_node_role
-              || cfg->has_node_address
-              || cfg->has_network_address
-              || cfg->has_network_channel
-              || cfg->has_keys
-              || cfg->has_current_ac_range )
+        // stack running, check if stop is needed to apply config.
+        // Values equal to the current ones and the access cycle range
+        // (written live) don't need it
+        if (is_stack_stop_needed(cfg, &current))
         {
             restart_stack = true;
             stop_stack = true;
@@ -684,8 +1232,11 @@ app_proto_res_e Proto_config_handle_set_config(wp_SetConfigReq *req,
         }
         else
         {
+            Platform_mutex_lock(m_sink_config_mutex);
             m_sink_config.StackStatus |= APP_STACK_STOPPED;
-            LOGI("SetConf : Stack stopped %d\n", m_sink_config.StackStatus);
+            config_updated();
+            Platform_mutex_unlock(m_sink_config_mutex);
+            LOGI("SetConf : Stack stopped\n");
             config_has_changed = true;
         }
     }
@@ -694,7 +1245,7 @@ app_proto_res_e Proto_config_handle_set_config(wp_SetConfigReq *req,
     if (cfg->has_node_role)
     {
         app_role_t new_role = convert_role_to_app_format(&cfg->node_role);
-        if (new_role != m_sink_config.app_node_role)
+        if (new_role != current.app_node_role)
         {
             res = WPC_set_role(new_role);
             if (res != APP_RES_OK)
@@ -705,14 +1256,17 @@ app_proto_res_e Proto_config_handle_set_config(wp_SetConfigReq *req,
             else
             {
                 LOGI("Set role 0x%02X\n", new_role);
+                Platform_mutex_lock(m_sink_config_mutex);
                 m_sink_config.app_node_role = new_role;
+                config_updated();
+                Platform_mutex_unlock(m_sink_config_mutex);
                 config_has_changed = true;
             }
         }
     }
 
     if ( cfg->has_node_address &&
-        (cfg->node_address != m_sink_config.node_address))
+        (cfg->node_address != current.node_address))
     {
         res = WPC_set_node_address(cfg->node_address);
         if (res != APP_RES_OK)
@@ -723,13 +1277,16 @@ app_proto_res_e Proto_config_handle_set_config(wp_SetConfigReq *req,
         else
         {
             LOGI("Set node address %d\n", cfg->node_address);
+            Platform_mutex_lock(m_sink_config_mutex);
             m_sink_config.node_address = cfg->node_address;
+            config_updated();
+            Platform_mutex_unlock(m_sink_config_mutex);
             config_has_changed = true;
         }
     }
 
     if (cfg->has_network_address &&
-        (cfg->network_address != m_sink_config.network_address))
+        (cfg->network_address != current.network_address))
     {
         if (cfg->network_address  > UINT32_MAX)
         {
@@ -747,14 +1304,17 @@ app_proto_res_e Proto_config_handle_set_config(wp_SetConfigReq *req,
             else
             {
                 LOGI("Set network address %d\n", cfg->network_address);
+                Platform_mutex_lock(m_sink_config_mutex);
                 m_sink_config.network_address = cfg->network_address;
+                config_updated();
+                Platform_mutex_unlock(m_sink_config_mutex);
                 config_has_changed = true;
             }
         }
     }
 
     if (cfg->has_network_channel &&
-        (cfg->network_channel != m_sink_config.network_channel))
+        (cfg->network_channel != current.network_channel))
     {
         if (cfg->network_channel > UINT8_MAX)
         {
@@ -772,7 +1332,10 @@ app_proto_res_e Proto_config_handle_set_config(wp_SetConfigReq *req,
             else
             {
                 LOGI("Set network channel %d\n", cfg->network_channel);
+                Platform_mutex_lock(m_sink_config_mutex);
                 m_sink_config.network_channel = cfg->network_channel;
+                config_updated();
+                Platform_mutex_unlock(m_sink_config_mutex);
                 config_has_changed = true;
             }
         }
@@ -790,7 +1353,7 @@ app_proto_res_e Proto_config_handle_set_config(wp_SetConfigReq *req,
             LOGE("App diagnostic interval value too large\n");
             global_res = APP_RES_INVALID_VALUE;
         }
-        else
+        else if (!is_app_config_already_set(&cfg->app_config, &current))
         {
             res = WPC_set_app_config_data(cfg->app_config.seq,
                                           cfg->app_config.diag_interval_s,
@@ -804,23 +1367,47 @@ app_proto_res_e Proto_config_handle_set_config(wp_SetConfigReq *req,
             else
             {
                 LOGI("Set app config\n");
+                Platform_mutex_lock(m_sink_config_mutex);
+                m_sink_config.app_config_seq = cfg->app_config.seq;
+                m_sink_config.app_config_diag_interval = cfg->app_config.diag_interval_s;
+                memset(m_sink_config.app_config, 0, sizeof(m_sink_config.app_config));
+                memcpy(m_sink_config.app_config,
+                       cfg->app_config.app_config_data.bytes,
+                       cfg->app_config.app_config_data.size);
+                config_updated();
+                Platform_mutex_unlock(m_sink_config_mutex);
                 config_has_changed = true;
             }
         }
     }
 
-    if (cfg->has_keys)
+    if (cfg->has_keys && !are_keys_already_set(&cfg->keys))
     {
+        // Failures of previous parameters must not prevent the hash update
+        bool keys_set = true;
+        bool key_set;
+
+        Platform_mutex_lock(m_sink_config_mutex);
+        m_keys_hash_valid = false;
+        Platform_mutex_unlock(m_sink_config_mutex);
+
         res = WPC_set_cipher_key(cfg->keys.cipher);
         if (res != APP_RES_OK)
         {
             LOGE("Set Cipher key failed\n");
             global_res = APP_RES_INVALID_VALUE;
+            keys_set = false;
         }
         else
         {
             LOGI("Set Cipher key\n");
-            WPC_is_cipher_key_set(&m_sink_config.CipherKeySet);
+            if (WPC_is_cipher_key_set(&key_set) == APP_RES_OK)
+            {
+                Platform_mutex_lock(m_sink_config_mutex);
+                m_sink_config.CipherKeySet = key_set;
+                config_updated();
+                Platform_mutex_unlock(m_sink_config_mutex);
+            }
             config_has_changed = true;
         }
 
@@ -829,13 +1416,30 @@ app_proto_res_e Proto_config_handle_set_config(wp_SetConfigReq *req,
         {
             LOGE("Set Authentication key failed\n");
             global_res = APP_RES_INVALID_VALUE;
+            keys_set = false;
         }
         else
         {
             LOGI("Set Authentication key\n");
-            WPC_is_authentication_key_set(&m_sink_config.AuthenticationKeySet);
+            if (WPC_is_authentication_key_set(&key_set) == APP_RES_OK)
+            {
+                Platform_mutex_lock(m_sink_config_mutex);
+                m_sink_config.AuthenticationKeySet = key_set;
+                config_updated();
+                Platform_mutex_unlock(m_sink_config_mutex);
+            }
             config_has_changed = true;
         }
+
+        if (keys_set)
+        {
+            uint64_t hash = hash_keys(&cfg->keys);
+
+            Platform_mutex_lock(m_sink_config_mutex);
+            m_keys_hash = hash;
+            m_keys_hash_valid = true;
+            Platform_mutex_unlock(m_sink_config_mutex);
+        }
     }
 
     if (cfg->has_current_ac_range)
@@ -846,8 +1450,8 @@ app_proto_res_e Proto_config_handle_set_config(wp_SetConfigReq *req,
             LOGE("AC range values too large\n");
             global_res = APP_RES_INVALID_VALUE;
         }
-        else if ((cfg->current_ac_range.min_ms != m_sink_config.ac_range_min_cur) ||
-                 (cfg->current_ac_range.max_ms != m_sink_config.ac_range_max_cur))
+        else if ((cfg->current_ac_range.min_ms != current.ac_range_min_cur) ||
+                 (cfg->current_ac_range.max_ms != current.ac_range_max_cur))
         {
             res = WPC_set_access_cycle_range(cfg->current_ac_range.min_ms,
                                              cfg->current_ac_range.max_ms);
@@ -860,8 +1464,11 @@ app_proto_res_e Proto_config_handle_set_config(wp_SetConfigReq *req,
             {
                 LOGI("Set AC range %d-%d\n", cfg->current_ac_range.min_ms,
                                              cfg->current_ac_range.max_ms);
+                Platform_mutex_lock(m_sink_config_mutex);
                 m_sink_config.ac_range_min_cur = cfg->current_ac_range.min_ms;
                 m_sink_config.ac_range_max_cur = cfg->current_ac_range.max_ms;
+                config_updated();
+                Platform_mutex_unlock(m_sink_config_mutex);
                 config_has_changed = true;
             }
         }
@@ -883,8 +1490,11 @@ app_proto_res_e Proto_config_handle_set_config(wp_SetConfigReq *req,
         else
         {
             WPC_set_autostart(1);
+            Platform_mutex_lock(m_sink_config_mutex);
             m_sink_config.StackStatus &= ~(uint8_t) APP_STACK_STOPPED;
-            LOGI("SetConf : Stack started %d\n", m_sink_config.StackStatus);
+            config_updated();
+            Platform_mutex_unlock(m_sink_config_mutex);
+            LOGI("SetConf : Stack started\n");
         }
     }
 
@@ -906,62 +1516,56 @@ app_proto_res_e Proto_config_handle_set_config(wp_SetConfigReq *req,
     Common_Fill_response_header(&resp->header,
                                 req->header.req_id,
                                 Common_convert_error_code(global_res));
-    fill_sink_read_config(&resp->config);
+    // Values may have been set even on failure
+    get_sink_config(&current);
+    fill_sink_read_config(&resp->config, &current);
 
     return APP_RES_PROTO_OK;
 }
 
-app_proto_res_e Proto_config_handle_get_configs(wp_GetConfigsReq *req,
-                                                wp_GetConfigsResp *resp)
+app_proto_res_e Proto_config_encode_get_configs(wp_GetConfigsReq * req,
+                                                uint8_t * response_p,
+                                                size_t * response_size_p)
 {
-    app_res_e res = APP_RES_OK;
+    wp_ResponseHeader header;
 
     // TODO: Add some sanity checks
 
-    // At least refresh stack status
-    res = WPC_get_stack_status(&m_sink_config.StackStatus);
-    if (res != APP_RES_OK)
-    {
-        LOGE("WPC_get_config failed, res=%d\n",res);
-    }
-    else
-    {
-        LOGI("WPC_get_config success\n");
-    }
+    // Config and stack status are kept up to date from stack status
+    // indications, so the sink is not accessed here. It can be answered
+    // even if the sink is busy
 
     // as config is available in cache, response is ok
-    Common_Fill_response_header(&resp->header,
+    Common_Fill_response_header(&header,
                                 req->header.req_id,
                                 wp_ErrorCode_OK);
-    resp->configs_count = 1;
-    fill_sink_read_config(&resp->configs[0]);
 
-    return APP_RES_PROTO_OK;
+    return encode_wirepas_message(wp_WirepasMessage_get_configs_resp_tag,
+                                  write_get_configs_resp,
+                                  &header,
+                                  response_p,
+                                  response_size_p);
 }
 
-app_proto_res_e Proto_config_handle_get_gateway_info_request(wp_GetGwInfoReq * req,
-                                                             wp_GetGwInfoResp * resp)
+app_proto_res_e Proto_config_encode_get_gateway_info(wp_GetGwInfoReq * req,
+                                                     uint8_t * response_p,
+                                                     size_t * response_size_p)
 {
+    gw_info_resp_t resp;
+
     // TODO: Add some sanity checks
 
-    Common_Fill_response_header(&resp->header,
+    Common_Fill_response_header(&resp.header,
                                 req->header.req_id,
                                 wp_ErrorCode_OK);
 
-    resp->info.current_time_s_epoch = Platform_get_timestamp_ms_epoch() / 1000;
+    resp.current_time_s_epoch = Platform_get_timestamp_ms_epoch() / 1000;
 
-    resp->info.has_gw_model = (Common_get_gateway_model() != 0);
-    strcpy(resp->info.gw_model, Common_get_gateway_model());
-    resp->info.has_gw_version = (Common_get_gateway_version() != 0);
-    strcpy(resp->info.gw_version, Common_get_gateway_version());
-
-    resp->info.has_implemented_api_version = true;
-    resp->info.implemented_api_version = GW_PROTO_API_VERSION;
-
-    resp->info.has_max_scratchpad_size = true,
-    resp->info.max_scratchpad_size = member_size(wp_UploadScratchpadReq_scratchpad_t, bytes);
-
-    return APP_RES_PROTO_OK;
+    return encode_wirepas_message(wp_WirepasMessage_get_gateway_info_resp_tag,
+                                  write_get_gw_info_resp,
+                                  &resp,
+                                  response_p,
+                                  response_size_p);
 }
 
 app_proto_res_e Proto_config_handle_set_scratchpad_target_and_action_request(
@@ -972,12 +1576,15 @@ app_proto_res_e Proto_config_handle_set_scratchpad_target_and_action_request(
     uint8_t seq;
     uint8_t param = 0;
     uint16_t crc;
+    sink_config_t current;
 
     // TODO: Add some sanity checks
 
     LOGI("Set scratchpad target and action request received with action: %d\n",
          req->target_and_action.action);
 
+    get_sink_config(&current);
+
     switch (req->target_and_action.action) {
 
         case wp_ScratchpadAction_NO_OTAP :
@@ -1022,9 +1629,9 @@ app_proto_res_e Proto_config_handle_set_scratchpad_target_and_action_request(
                 }
                 seq = req->target_and_action.target_sequence;
             }
-            else if (m_sink_config.otap_status.scrat_seq_number != 0)
+            else if (current.otap_status.scrat_seq_number != 0)
             {
-                seq = m_sink_config.otap_status.scrat_seq_number;
+                seq = current.otap_status.scrat_seq_number;
                 LOGI("Adding seq from node: %u\n", seq);
             }
             else
@@ -1046,7 +1653,7 @@ app_proto_res_e Proto_config_handle_set_scratchpad_target_and_action_request(
             else
             {
                 // No check on CRC as invalid scratchpad is already handled with seq
-                crc = m_sink_config.otap_status.scrat_crc;
+                crc = current.otap_status.scrat_crc;
                 LOGI("Adding CRC from node: %u\n", crc);
             }
 
@@ -1081,43 +1688,10 @@ app_proto_res_e Proto_config_get_current_event_status(bool gw_online,
                                                       uint8_t * event_status_p,
                                                       size_t * event_status_size_p)
 {
-    bool status;
-    wp_GenericMessage message = wp_GenericMessage_init_zero;
-    wp_WirepasMessage message_wirepas = wp_WirepasMessage_init_zero;
-    message.wirepas = &message_wirepas;
-
-    // Allocate the needed space for only the submessage we want to send
-    wp_StatusEvent * message_StatusEvent_p = Platform_malloc(sizeof(wp_StatusEvent));
-    if (message_StatusEvent_p == NULL)
-    {
-        LOGE("Not enough memory to encode StatusEvent\n");
-        return APP_RES_PROTO_NOT_ENOUGH_MEMORY;
-    }
-
-    message_wirepas.status_event = message_StatusEvent_p;
-
-    fill_status_event(message_StatusEvent_p,
-                      gw_online ? wp_OnOffState_ON : wp_OnOffState_OFF,
-                      sink_online ? 1 : 0);
-
-    // Using the module static buffer
-    pb_ostream_t stream = pb_ostream_from_buffer(event_status_p, *event_status_size_p);
-
-    /* Now we are ready to encode the message! */
-	status = pb_encode(&stream, wp_GenericMessage_fields, &message);
-
-    /* Release buffer as we don't need it anymore */
-    Platform_free(message_StatusEvent_p, sizeof(wp_StatusEvent));
-
-	if (!status) {
-		LOGE("StatusEvent encoding failed: %s\n", PB_GET_ERROR(&stream));
-        *event_status_size_p = 0;
-        return APP_RES_PROTO_CANNOT_GENERATE_RESPONSE;
-    }
-
-    LOGD("Msg size %d\n", stream.bytes_written);
-    *event_status_size_p = stream.bytes_written;
-    return APP_RES_PROTO_OK;
+    return encode_status_event(gw_online ? wp_OnOffState_ON : wp_OnOffState_OFF,
+                               sink_online,
+                               event_status_p,
+                               event_status_size_p);
 }
 
 app_proto_res_e Proto_config_register_for_event_status(onEventStatus_cb_f onProtoEventStatus_cb)
@@ -1136,7 +1710,15 @@ net_addr_t Proto_config_get_network_address(void)
 {
     // Take it from the cache. It will be called
     // for every rx message so cannot be read from node
-    return m_sink_config.network_address;
+    return Platform_atomic_load(&m_network_address, PLATFORM_RELAXED);
+}
+
+void Proto_config_get_local_scratchpad_status(app_scratchpad_status_t * status_p)
+{
+    // Take it from the cache, it is refreshed after each scratchpad operation
+    Platform_mutex_lock(m_sink_config_mutex);
+    *status_p = m_sink_config.otap_status;
+    Platform_mutex_unlock(m_sink_config_mutex);
 }
 
 void Proto_config_refresh_otap_infos()
@@ -52,25 +52,34 @@ app_proto_res_e Proto_config_handle_set_config(wp_SetConfigReq *req,
 
 /**
  * \brief   Handle Get config request
+ *          The config is pre-encoded, only the response header is encoded
  * \param   req
  *          Pointer to the request received
- * \param   resp
- *          Pointer to the reponse to send back
+ * \param   response_p
+ *          Buffer to store the encoded GenericMessage holding the response
+ * \param   response_size_p
+ *          [in] size of the buffer, [out] size of the encoded response
  * \return  APP_RES_PROTO_OK if answer is ready to send
  */
-app_proto_res_e Proto_config_handle_get_configs(wp_GetConfigsReq *req,
-                                                wp_GetConfigsResp *resp);
+app_proto_res_e Proto_config_encode_get_configs(wp_GetConfigsReq * req,
+                                                uint8_t * response_p,
+                                                size_t * response_size_p);
 
 /**
  * \brief   Handle Get gateway info
+ *          The gateway info is pre-encoded, only the response header and
+ *          current time are encoded
  * \param   req
  *          Pointer to the request received
- * \param   resp
- *          Pointer to the reponse to send back
+ * \param   response_p
+ *          Buffer to store the encoded GenericMessage holding the response
+ * \param   response_size_p
+ *          [in] size of the buffer, [out] size of the encoded response
  * \return  APP_RES_PROTO_OK if answer is ready to send
  */
-app_proto_res_e Proto_config_handle_get_gateway_info_request(wp_GetGwInfoReq * req,
-                                                             wp_GetGwInfoResp * resp);
+app_proto_res_e Proto_config_encode_get_gateway_info(wp_GetGwInfoReq * req,
+                                                     uint8_t * response_p,
+                                                     size_t * response_size_p);
 
 /**
  * \brief   Handle Set scratchpad target and action
@@ -96,4 +105,6 @@ app_proto_res_e Proto_config_register_for_event_status(onEventStatus_cb_f onProt
  */
 net_addr_t Proto_config_get_network_address(void);
 
+void Proto_config_get_local_scratchpad_status(app_scratchpad_status_t * status_p);
+
 #endif
@@ -3,9 +3,11 @@
  * See file LICENSE for full license details.
  *
  */
+#include <string.h>
 
 #include "proto_data.h"
 #include "proto_config.h"
+#include "proto_rx_event.h"
 #include <pb_encode.h>
 #include <pb_decode.h>
 #include "platform.h"
@@ -17,6 +19,260 @@
 
 static onDataRxEvent_cb_f m_rx_event_cb = NULL;
 
+/* Maximum number of batches (network, src_ep, dst_ep) collected at the same time */
+#define MAX_RX_BATCHES 8
+
+/* Size of the buffer of a batch */
+#define RX_BATCH_BUFFER_SIZE (16 * 1024)
+
+/* Max size of the varint length prefix of an event (event < 16KB) */
+#define RX_BATCH_PREFIX_SIZE 2
+
+typedef struct
+{
+    size_t count;                   //< Number of events in the batch, 0 if batch is free
+    size_t size;                    //< Bytes used in buffer
+    uint32_t network_address;       //< Network address of the events
+    uint8_t src_ep;                 //< Source endpoint of the events
+    uint8_t dst_ep;                 //< Destination endpoint of the events
+    unsigned long long deadline_ms; //< Monotonic time to deliver the batch
+    uint8_t * buffer_p;             //< Buffer of RX_BATCH_BUFFER_SIZE bytes
+} rx_batch_t;
+
+static onDataRxEventBatch_cb_f m_rx_batch_cb = NULL;
+static size_t m_rx_batch_max_events;
+static unsigned int m_rx_batch_max_delay_ms;
+static rx_batch_t m_rx_batches[MAX_RX_BATCHES];
+
+/* Batches are filled from dispatching context and flushed on timeout from
+ * m_rx_batch_worker context */
+static platform_mutex_t * m_rx_batch_mutex;
+
+/* Batches are delivered one at a time, in the order they are flushed, without
+ * m_rx_batch_mutex held. A flushed batch takes this spare buffer and gives
+ * its own one to the callback. Locked before m_rx_batch_mutex */
+static platform_mutex_t * m_rx_delivery_mutex;
+static uint8_t * m_rx_delivery_buffer_p = NULL;
+
+/* Worker only used for batch timeouts, so they are not delayed by the
+ * works of other modules */
+static platform_worker_t * m_rx_batch_worker;
+
+// Buffer to encode received packets. Only used from the dispatching context
+// and released as soon as the rx event callback returns
+static uint8_t m_rx_event_buffer[WPC_PROTO_OFFSET_DATA_SIZE
+                                 + DATA_PAYLOAD_MAX_SIZE];
+
+/**
+ * \brief   Deliver a batch and free it
+ * \note    m_rx_batch_mutex must be locked. It is released during the
+ *          delivery: other batches may have changed when returning, but this
+ *          one is only refilled from the dispatching context
+ */
+static void flush_batch_locked(rx_batch_t * batch_p)
+{
+    onDataRxEventBatch_cb_f cb;
+    rx_batch_t ready;
+
+    if (batch_p->count == 0)
+    {
+        return;
+    }
+
+    Platform_mutex_unlock(m_rx_batch_mutex);
+    Platform_mutex_lock(m_rx_delivery_mutex);
+    Platform_mutex_lock(m_rx_batch_mutex);
+
+    // It may have been delivered by another context meanwhile
+    cb = m_rx_batch_cb;
+    if ((batch_p->count == 0) || (cb == NULL))
+    {
+        Platform_mutex_unlock(m_rx_delivery_mutex);
+        return;
+    }
+
+    ready = *batch_p;
+    batch_p->buffer_p = m_rx_delivery_buffer_p;
+    batch_p->count = 0;
+    batch_p->size = 0;
+    m_rx_delivery_buffer_p = ready.buffer_p;
+    Platform_mutex_unlock(m_rx_batch_mutex);
+
+    LOGD("Flush batch of %zu events (%zu bytes)\n", ready.count, ready.size);
+    cb(ready.buffer_p,
+       ready.size,
+       ready.count,
+       ready.network_address,
+       ready.src_ep,
+       ready.dst_ep);
+
+    Platform_mutex_unlock(m_rx_delivery_mutex);
+    Platform_mutex_lock(m_rx_batch_mutex);
+}
+
+static void free_batch_buffers(void)
+{
+    for (unsigned int i = 0; i < MAX_RX_BATCHES; i++)
+    {
+        if (m_rx_batches[i].buffer_p != NULL)
+        {
+            Platform_free(m_rx_batches[i].buffer_p, RX_BATCH_BUFFER_SIZE);
+            m_rx_batches[i].buffer_p = NULL;
+        }
+    }
+
+    if (m_rx_delivery_buffer_p != NULL)
+    {
+        Platform_free(m_rx_delivery_buffer_p, RX_BATCH_BUFFER_SIZE);
+        m_rx_delivery_buffer_p = NULL;
+    }
+}
+
+/**
+ * \brief   Deliver the batches that have waited long enough
+ *          Executed from m_rx_batch_worker
+ */
+static void flush_expired_batches(void)
+{
+    unsigned long long now = Platform_get_timestamp_ms_monotonic();
+    unsigned long long next_deadline_ms = 0;
+
+    Platform_mutex_lock(m_rx_batch_mutex);
+    for (unsigned int i = 0; i < MAX_RX_BATCHES; i++)
+    {
+        rx_batch_t * batch_p = &m_rx_batches[i];
+        if (batch_p->count == 0)
+        {
+            continue;
+        }
+
+        if (batch_p->deadline_ms <= now)
+        {
+            flush_batch_locked(batch_p);
+        }
+        else if ((next_deadline_ms == 0) || (batch_p->deadline_ms < next_deadline_ms))
+        {
+            next_deadline_ms = batch_p->deadline_ms;
+        }
+    }
+    Platform_mutex_unlock(m_rx_batch_mutex);
+
+    if (next_deadline_ms != 0)
+    {
+        Platform_worker_schedule(m_rx_batch_worker,
+                                 flush_expired_batches,
+                                 next_deadline_ms - now);
+    }
+}
+
+/**
+ * \brief   Get the batch to use for an event, a new one is opened if needed
+ * \note    m_rx_batch_mutex must be locked
+ */
+static rx_batch_t * get_batch_locked(uint32_t network_address, uint8_t src_ep, uint8_t dst_ep)
+{
+    rx_batch_t * free_p = NULL;
+    rx_batch_t * oldest_p = NULL;
+
+    for (unsigned int i = 0; i < MAX_RX_BATCHES; i++)
+    {
+        rx_batch_t * batch_p = &m_rx_batches[i];
+        if (batch_p->count == 0)
+        {
+            if (free_p == NULL)
+            {
+                free_p = batch_p;
+            }
+            continue;
+        }
+
+        if ((batch_p->network_address == network_address)
+            && (batch_p->src_ep == src_ep)
+            && (batch_p->dst_ep == dst_ep))
+        {
+            return batch_p;
+        }
+
+        if ((oldest_p == NULL) || (batch_p->deadline_ms < oldest_p->deadline_ms))
+        {
+            oldest_p = batch_p;
+        }
+    }
+
+    if (free_p == NULL)
+    {
+        // All batches are in use, deliver the oldest one to reuse it
+        flush_batch_locked(oldest_p);
+        free_p = oldest_p;
+    }
+
+    free_p->network_address = network_address;
+    free_p->src_ep = src_ep;
+    free_p->dst_ep = dst_ep;
+    return free_p;
+}
+
+static void add_to_batch(const uint8_t * event_p,
+                         size_t event_size,
+                         uint32_t network_address,
+                         uint8_t src_ep,
+                         uint8_t dst_ep)
+{
+    rx_batch_t * batch_p;
+    uint8_t * p;
+
+    Platform_mutex_lock(m_rx_batch_mutex);
+
+    batch_p = get_batch_locked(network_address, src_ep, dst_ep);
+    if ((batch_p->size + RX_BATCH_PREFIX_SIZE + event_size) > RX_BATCH_BUFFER_SIZE)
+    {
+        flush_batch_locked(batch_p);
+    }
+
+    if (m_rx_batch_cb == NULL)
+    {
+        // Closed while a batch was delivered
+        Platform_mutex_unlock(m_rx_batch_mutex);
+        return;
+    }
+
+    if (batch_p->count == 0)
+    {
+        // First event of the batch, it sets the batch deadline
+        batch_p->deadline_ms = Platform_get_timestamp_ms_monotonic() + m_rx_batch_max_delay_ms;
+        if (!Platform_worker_schedule(m_rx_batch_worker,
+                                      flush_expired_batches,
+                                      m_rx_batch_max_delay_ms))
+        {
+            LOGW("Batch delay cannot be enforced\n");
+        }
+    }
+
+    // Length prefix as a varint
+    p = batch_p->buffer_p + batch_p->size;
+    if (event_size < 0x80)
+    {
+        *p++ = (uint8_t) event_size;
+    }
+    else
+    {
+        *p++ = (uint8_t) (event_size | 0x80);
+        *p++ = (uint8_t) (event_size >> 7);
+    }
+    memcpy(p, event_p, event_size);
+    p += event_size;
+
+    batch_p->size = p - batch_p->buffer_p;
+    batch_p->count++;
+
+    if (batch_p->count >= m_rx_batch_max_events)
+    {
+        flush_batch_locked(batch_p);
+    }
+
+    Platform_mutex_unlock(m_rx_batch_mutex);
+}
+
 static bool onDataReceived(const uint8_t * bytes,
                            size_t num_bytes,
                            app_addr_t src_addr,
@@ -28,13 +284,7 @@ static bool onDataReceived(const uint8_t * bytes,
                            uint8_t hop_count,
                            unsigned long long timestamp_ms)
 {
-    bool status;
-    wp_PacketReceivedEvent * message_PacketReceived_p;
-    uint8_t * encoded_message_p;
-    wp_GenericMessage message = wp_GenericMessage_init_zero;
-    wp_WirepasMessage message_wirepas = wp_WirepasMessage_init_zero;
-    message.wirepas = &message_wirepas;
-
+    size_t encoded_size;
     uint32_t network_address = Proto_config_get_network_address();
 
     LOGI("%llu -> Data received on EP %d of len %d from 0x%x to 0x%x\n",
@@ -44,85 +294,66 @@ static bool onDataReceived(const uint8_t * bytes,
          src_addr,
          dst_addr);
 
-    if (num_bytes > member_size(wp_PacketReceivedEvent_payload_t, bytes))
+    if (num_bytes > DATA_PAYLOAD_MAX_SIZE)
     {
         LOGE("Message received too big");
         return false;
     }
 
-    // Allocate the needed space for only the submessage we want to send
-    message_PacketReceived_p = Platform_malloc(sizeof(wp_PacketReceivedEvent));
-    if (message_PacketReceived_p == NULL)
-    {
-        LOGE("Not enough memory to encode");
-        return false;
-    }
-
-    // Allocate needed buffer for encoded message
-    size_t max_encoded_size = WPC_PROTO_OFFSET_DATA_SIZE + num_bytes;
-    encoded_message_p = Platform_malloc(max_encoded_size);
-    if (encoded_message_p == NULL)
-    {
-        LOGE("Not enough memory for output buffer");
-        Platform_free(message_PacketReceived_p, sizeof(wp_PacketReceivedEvent));
-        return false;
-    }
-
-    message_wirepas.packet_received_event = message_PacketReceived_p;
-
-    *message_PacketReceived_p = (wp_PacketReceivedEvent) {
-        .source_address = src_addr,
-        .destination_address = dst_addr,
-        .source_endpoint = src_ep,
-        .destination_endpoint = dst_ep,
-        .travel_time_ms = travel_time,
-        .rx_time_ms_epoch = timestamp_ms,
+    const proto_rx_event_t event = {
+        .payload_p = bytes,
+        .payload_size = num_bytes,
+        .src_addr = src_addr,
+        .dst_addr = dst_addr,
+        .src_ep = src_ep,
+        .dst_ep = dst_ep,
         .qos = qos,
-        .has_payload = true,
-        .has_payload_size = false,
-        .has_hop_count = true,
+        .travel_time_ms = travel_time,
         .hop_count = hop_count,
-        .has_network_address = true,
-        .network_address = network_address
+        .rx_time_ms_epoch = timestamp_ms,
+        .network_address = network_address,
     };
 
-    // Add payload
-    memcpy(message_PacketReceived_p->payload.bytes, bytes, num_bytes);
-    message_PacketReceived_p->payload.size = num_bytes;
-
-    Common_fill_event_header(&message_PacketReceived_p->header, true);
-
-    pb_ostream_t stream = pb_ostream_from_buffer(encoded_message_p, max_encoded_size);
-
-    /* Now we are ready to encode the message! */
-	status = pb_encode(&stream, wp_GenericMessage_fields, &message);
-
-    /* Release buffer as we don't need it anymore */
-    Platform_free(message_PacketReceived_p, sizeof(wp_PacketReceivedEvent));
-
-    if (!status)
+    encoded_size = Proto_rx_event_encode(&event, m_rx_event_buffer, sizeof(m_rx_event_buffer));
+    if (encoded_size == 0)
     {
-        LOGE("Encoding failed: %s\n", PB_GET_ERROR(&stream));
+        LOGE("Encoding failed\n");
     }
     else
-	{
-		LOGD("Msg size %d\n", stream.bytes_written);
-        if (m_rx_event_cb != NULL)
+    {
+        LOGD("Msg size %d\n", encoded_size);
+        if (m_rx_batch_cb != NULL)
+        {
+            add_to_batch(m_rx_event_buffer, encoded_size, network_address, src_ep, dst_ep);
+        }
+        else if (m_rx_event_cb != NULL)
         {
-            m_rx_event_cb(encoded_message_p, stream.bytes_written,
+            m_rx_event_cb(m_rx_event_buffer, encoded_size,
                           network_address,
                           src_ep,
                           dst_ep);
         }
     }
 
-    Platform_free(encoded_message_p, max_encoded_size);
-
     return true;
 }
 
 bool Proto_data_init(void)
 {
+    m_rx_batch_mutex = Platform_mutex_create();
+    m_rx_delivery_mutex = Platform_mutex_create();
+    m_rx_batch_worker = Platform_worker_create();
+    if ((m_rx_batch_mutex == NULL)
+        || (m_rx_delivery_mutex == NULL)
+        || (m_rx_batch_worker == NULL))
+    {
+        LOGE("Cannot create rx batch locks and worker\n");
+        Proto_data_close();
+        return false;
+    }
+
+    Proto_rx_event_init();
+
     /* Register for all data */
     return WPC_register_for_data(onDataReceived) == APP_RES_OK;
 }
@@ -130,6 +361,72 @@ bool Proto_data_init(void)
 void Proto_data_close(void)
 {
     WPC_unregister_for_data();
+
+    // A timeout delivery in progress is completed first
+    if (m_rx_batch_worker != NULL)
+    {
+        Platform_worker_delete(m_rx_batch_worker);
+        m_rx_batch_worker = NULL;
+    }
+
+    if ((m_rx_batch_mutex == NULL) || (m_rx_delivery_mutex == NULL))
+    {
+        // Not initialized
+        return;
+    }
+
+    // Deliver what was already received
+    Platform_mutex_lock(m_rx_batch_mutex);
+    for (unsigned int i = 0; i < MAX_RX_BATCHES; i++)
+    {
+        if (m_rx_batch_cb != NULL)
+        {
+            flush_batch_locked(&m_rx_batches[i]);
+        }
+    }
+    Platform_mutex_unlock(m_rx_batch_mutex);
+
+    // No delivery can be in progress once both are locked
+    Platform_mutex_lock(m_rx_delivery_mutex);
+    Platform_mutex_lock(m_rx_batch_mutex);
+    free_batch_buffers();
+    m_rx_batch_cb = NULL;
+    Platform_mutex_unlock(m_rx_batch_mutex);
+    Platform_mutex_unlock(m_rx_delivery_mutex);
+
+    Platform_mutex_delete(m_rx_batch_mutex);
+    Platform_mutex_delete(m_rx_delivery_mutex);
+    m_rx_batch_mutex = NULL;
+    m_rx_delivery_mutex = NULL;
+}
+
+bool Proto_data_send_packet_callback(pb_istream_t * istream,
+                                     pb_ostream_t * ostream,
+                                     const pb_field_t * field)
+{
+    proto_bytes_ref_t * payload_p = (proto_bytes_ref_t *) field->pData;
+
+    if (field->tag != wp_SendPacketReq_payload_tag)
+    {
+        return true;
+    }
+
+    if (istream != NULL)
+    {
+        // Requests are decoded from a buffer stream, the substream of the
+        // field points to the payload in the caller's buffer
+        payload_p->bytes = (const uint8_t *) istream->state;
+        payload_p->size = istream->bytes_left;
+        return pb_read(istream, NULL, istream->bytes_left);
+    }
+
+    if (ostream != NULL && payload_p->bytes != NULL)
+    {
+        return pb_encode_tag_for_field(ostream, field)
+               && pb_encode_string(ostream, payload_p->bytes, payload_p->size);
+    }
+
+    return true;
 }
 
 app_proto_res_e Proto_data_handle_send_data(wp_SendPacketReq *req,
@@ -137,6 +434,13 @@ app_proto_res_e Proto_data_handle_send_data(wp_SendPacketReq *req,
 {
     app_res_e res;
 
+    // Payload size is not bounded at decode time
+    if (req->payload.bytes == NULL || req->payload.size > DATA_PAYLOAD_MAX_SIZE)
+    {
+        LOGE("Invalid payload in send packet request\n");
+        return APP_RES_PROTO_INVALID_REQUEST;
+    }
+
     if (req->source_endpoint > UINT8_MAX || req->destination_endpoint > UINT8_MAX)
     {
         LOGE("Source or destination endpoint value too large\n");
@@ -167,7 +471,7 @@ app_proto_res_e Proto_data_handle_send_data(wp_SendPacketReq *req,
 app_proto_res_e Proto_data_register_for_data(onDataRxEvent_cb_f onDataRxEvent_cb)
 {
     // Only support one "client" for now
-    if (m_rx_event_cb != NULL)
+    if ((m_rx_event_cb != NULL) || (m_rx_batch_cb != NULL))
     {
         return APP_RES_PROTO_ALREADY_REGISTERED;
     }
@@ -175,4 +479,51 @@ app_proto_res_e Proto_data_register_for_data(onDataRxEvent_cb_f onDataRxEvent_cb
     m_rx_event_cb = onDataRxEvent_cb;
     return APP_RES_PROTO_OK;
 
-}
\ No newline at end of file
+}
+
+app_proto_res_e Proto_data_register_for_data_batch(onDataRxEventBatch_cb_f onDataRxEventBatch_cb,
+                                                   size_t max_events,
+                                                   unsigned int max_delay_ms)
+{
+    _Static_assert(RX_BATCH_BUFFER_SIZE >= RX_BATCH_PREFIX_SIZE + sizeof(m_rx_event_buffer),
+                   "Batch buffer too small for a single event");
+    _Static_assert(sizeof(m_rx_event_buffer) < (1 << (7 * RX_BATCH_PREFIX_SIZE)),
+                   "Event size prefix too small");
+
+    if ((onDataRxEventBatch_cb == NULL) || (max_events == 0))
+    {
+        return APP_RES_PROTO_WRONG_PARAMETER;
+    }
+
+    // Only support one "client" for now
+    if ((m_rx_event_cb != NULL) || (m_rx_batch_cb != NULL))
+    {
+        return APP_RES_PROTO_ALREADY_REGISTERED;
+    }
+
+    Platform_mutex_lock(m_rx_delivery_mutex);
+    Platform_mutex_lock(m_rx_batch_mutex);
+    m_rx_delivery_buffer_p = Platform_malloc(RX_BATCH_BUFFER_SIZE);
+    for (unsigned int i = 0; i < MAX_RX_BATCHES; i++)
+    {
+        m_rx_batches[i].count = 0;
+        m_rx_batches[i].size = 0;
+        m_rx_batches[i].buffer_p = Platform_malloc(RX_BATCH_BUFFER_SIZE);
+        if ((m_rx_batches[i].buffer_p == NULL) || (m_rx_delivery_buffer_p == NULL))
+        {
+            LOGE("Not enough memory for rx batches\n");
+            free_batch_buffers();
+            Platform_mutex_unlock(m_rx_batch_mutex);
+            Platform_mutex_unlock(m_rx_delivery_mutex);
+            return APP_RES_PROTO_NOT_ENOUGH_MEMORY;
+        }
+    }
+
+    m_rx_batch_max_events = max_events;
+    m_rx_batch_max_delay_ms = max_delay_ms;
+    m_rx_batch_cb = onDataRxEventBatch_cb;
+    Platform_mutex_unlock(m_rx_batch_mutex);
+    Platform_mutex_unlock(m_rx_delivery_mutex);
+
+    return APP_RES_PROTO_OK;
+}
@@ -21,9 +21,23 @@ bool Proto_data_init(void);
  */
 void Proto_data_close(void);
 
+/**
+ * \brief   Callback of the SendPacketReq fields (callback_function in
+ *          data_message.options)
+ * \note    The decoded payload references the decoded buffer, so it is only
+ *          valid while this buffer is
+ */
+bool Proto_data_send_packet_callback(pb_istream_t * istream,
+                                     pb_ostream_t * ostream,
+                                     const pb_field_t * field);
+
 app_proto_res_e Proto_data_handle_send_data(wp_SendPacketReq *req,
                                             wp_SendPacketResp *resp);
 
 app_proto_res_e Proto_data_register_for_data(onDataRxEvent_cb_f onDataRxEvent_cb);
 
+app_proto_res_e Proto_data_register_for_data_batch(onDataRxEventBatch_cb_f onDataRxEventBatch_cb,
+                                                   size_t max_events,
+                                                   unsigned int max_delay_ms);
+
 #endif
\ No newline at end of file
@@ -14,6 +14,7 @@
 #include <pb_encode.h>
 #include <pb_decode.h>
 #include "platform.h"
+#include "msap.h"  // For SCRATCHPAD_HEADER_SIZE
 #include "common.h"
 
 #define LOG_MODULE_NAME "otap_proto"
@@ -28,14 +29,319 @@ static uint32_t m_scratchpad_load_current_seq = INVALID_CURRENT_SEQ;
 
 static bool m_restart_after_load = false;
 
+// Used to store the scratchpad id of a chunked upload that is skipped
+// because the sink already holds the same scratchpad
+static uint32_t m_scratchpad_skip_seq = INVALID_CURRENT_SEQ;
+
+// Bytes of chunks acknowledged but not yet written to the sink. A few chunks
+// can be queued, so next ones are received while blocks are written
+#define SESSION_QUEUE_SIZE      (4 * SCRATCHPAD_CHUNK_MAX_SIZE)
+
+/**
+ * \brief   Chunked upload in progress, written to the sink in the background
+ * \note    Protected by m_session_mutex
+ */
+typedef struct
+{
+    uint32_t total_size;        //< Full size of the scratchpad
+    uint32_t queued_offset;     //< Offset of the next chunk expected
+    uint32_t written_offset;    //< Offset of the next block to write
+    uint8_t max_block_size;     //< Scratchpad block max, read once per session
+    app_res_e error;            //< First write error, reported on next chunk
+    bool writing;               //< A block is being written (out of the queue)
+    size_t queue_start;         //< Index of the first queued byte
+    size_t queue_count;         //< Number of queued bytes
+    uint8_t queue[SESSION_QUEUE_SIZE];
+} upload_session_t;
+
+static upload_session_t m_session;
+
+static platform_mutex_t * m_session_mutex;
+// Signaled when queued bytes are written or dropped
+static platform_condition_t * m_session_cond;
+// Blocks are written from this worker, scheduled when bytes are queued
+static platform_worker_t * m_writer_worker;
+static bool m_writer_running = false;
+
+/**
+ * \brief   Get the size of the next block to write, 0 if none
+ * \note    m_session_mutex must be locked. Only full blocks are written,
+ *          except the last one of the scratchpad
+ */
+static size_t get_next_block_size(void)
+{
+    if (m_session.queue_count >= m_session.max_block_size)
+    {
+        return m_session.max_block_size;
+    }
+
+    if ((m_session.queue_count > 0)
+        && (m_session.written_offset + m_session.queue_count == m_session.total_size))
+    {
+        return m_session.queue_count;
+    }
+
+    return 0;
+}
+
+/**
+ * \brief   Write the queued blocks, until a block is not complete yet
+ * \note    Executed from m_writer_worker
+ */
+static void write_blocks(void)
+{
+    uint8_t block[UINT8_MAX];
+    uint32_t offset;
+    uint8_t max_block_size;
+    size_t size;
+    size_t first_part;
+    app_res_e res;
+
+    Platform_mutex_lock(m_session_mutex);
+    while (m_writer_running)
+    {
+        size = get_next_block_size();
+        if (size == 0)
+        {
+            // Work is scheduled again when next chunk is queued
+            break;
+        }
+
+        // Queue is a ring buffer
+        first_part = SESSION_QUEUE_SIZE - m_session.queue_start;
+        if (first_part > size)
+        {
+            first_part = size;
+        }
+        memcpy(block, &m_session.queue[m_session.queue_start], first_part);
+        memcpy(block + first_part, m_session.queue, size - first_part);
+        offset = m_session.written_offset;
+        max_block_size = m_session.max_block_size;
+        m_session.writing = true;
+
+        // Write it unlocked, so next chunk can be queued meanwhile
+        Platform_mutex_unlock(m_session_mutex);
+        res = WPC_upload_local_block_scratchpad_with_max(size,
+                                                         block,
+                                                         offset,
+                                                         max_block_size);
+        Platform_mutex_lock(m_session_mutex);
+
+        m_session.writing = false;
+        if (res != APP_RES_OK)
+        {
+            LOGE("Cannot write scratchpad block at %u: %d\n", offset, res);
+            // Next chunks cannot be written anymore
+            m_session.error = res;
+            m_session.queue_count = 0;
+        }
+        else
+        {
+            m_session.written_offset += size;
+            m_session.queue_start = (m_session.queue_start + size) % SESSION_QUEUE_SIZE;
+            m_session.queue_count -= size;
+        }
+        Platform_condition_broadcast(m_session_cond);
+    }
+    Platform_mutex_unlock(m_session_mutex);
+}
+
+/**
+ * \brief   Drop the bytes not written yet of the current session
+ * \note    m_session_mutex must be locked
+ */
+static void drop_session_locked(void)
+{
+    // Block being written cannot be cancelled
+    while (m_session.writing)
+    {
+        Platform_condition_wait(m_session_cond, m_session_mutex);
+    }
+    m_session.queue_count = 0;
+}
+
+/**
+ * \brief   Abort the chunked upload in progress, if any
+ */
+static void abort_session(void)
+{
+    Platform_mutex_lock(m_session_mutex);
+    drop_session_locked();
+    Platform_mutex_unlock(m_session_mutex);
+    m_scratchpad_load_current_seq = INVALID_CURRENT_SEQ;
+}
+
 bool Proto_otap_init(void)
 {
+    m_session_mutex = Platform_mutex_create();
+    m_session_cond = Platform_condition_create();
+    m_writer_worker = Platform_worker_create();
+    if ((m_session_mutex == NULL)
+        || (m_session_cond == NULL)
+        || (m_writer_worker == NULL))
+    {
+        LOGE("Cannot create scratchpad writer\n");
+        Proto_otap_close();
+        return false;
+    }
+
+    m_writer_running = true;
     return true;
 }
 
 void Proto_otap_close(void)
 {
+    if (m_session_mutex != NULL)
+    {
+        Platform_mutex_lock(m_session_mutex);
+        m_writer_running = false;
+        Platform_mutex_unlock(m_session_mutex);
+    }
+
+    // Block in progress is completed first
+    if (m_writer_worker != NULL)
+    {
+        Platform_worker_delete(m_writer_worker);
+        m_writer_worker = NULL;
+    }
+
+    if (m_session_cond != NULL)
+    {
+        Platform_condition_delete(m_session_cond);
+        m_session_cond = NULL;
+    }
+
+    if (m_session_mutex != NULL)
+    {
+        Platform_mutex_delete(m_session_mutex);
+        m_session_mutex = NULL;
+    }
+
+    m_session.queue_count = 0;
+    m_scratchpad_load_current_seq = INVALID_CURRENT_SEQ;
+}
+
+/**
+ * \brief   Start a chunked upload session
+ */
+static app_res_e start_session(size_t total_size, uint32_t seq)
+{
+    app_res_e res;
+    uint8_t max_block_size;
+
+    res = WPC_start_local_scratchpad_update(total_size, seq);
+    if (res != APP_RES_OK)
+    {
+        return res;
+    }
+
+    // Read once, not for each chunk
+    res = WPC_get_scratchpad_block_max(&max_block_size);
+    if (res != APP_RES_OK)
+    {
+        LOGE("Cannot get max block scratchpad size\n");
+        return res;
+    }
+
+    Platform_mutex_lock(m_session_mutex);
+    m_session.total_size = total_size;
+    m_session.queued_offset = 0;
+    m_session.written_offset = 0;
+    m_session.max_block_size = max_block_size;
+    m_session.error = APP_RES_OK;
+    m_session.queue_start = 0;
+    m_session.queue_count = 0;
+    Platform_mutex_unlock(m_session_mutex);
+
+    m_scratchpad_load_current_seq = seq;
+    return APP_RES_OK;
+}
+
+/**
+ * \brief   Queue a chunk to be written by the scratchpad writer
+ * \return  APP_RES_OK if chunk is queued, or the error of a previous chunk.
+ *          For the last chunk, it returns once all the blocks are written
+ *          and reports the result of the whole upload
+ */
+static app_res_e queue_chunk(uint8_t * chunk,
+                             size_t chunk_size,
+                             uint32_t offset,
+                             bool * ended_p)
+{
+    app_res_e res;
+    size_t index;
+    size_t first_part;
+
+    *ended_p = false;
+
+    Platform_mutex_lock(m_session_mutex);
+
+    if (m_session.error != APP_RES_OK)
+    {
+        // Reported once, upload must be restarted from first chunk
+        res = m_session.error;
+        *ended_p = true;
+        Platform_mutex_unlock(m_session_mutex);
+        return res;
+    }
+
+    // Blocks are written in order, no gap or overlap allowed
+    if ((offset != m_session.queued_offset)
+        || (offset + chunk_size > m_session.total_size))
+    {
+        LOGE("Unexpected chunk at %u (size %u), expecting %u\n",
+             offset,
+             chunk_size,
+             m_session.queued_offset);
+        Platform_mutex_unlock(m_session_mutex);
+        return APP_RES_INVALID_START_ADDRESS;
+    }
+
+    while ((SESSION_QUEUE_SIZE - m_session.queue_count < chunk_size)
+           && (m_session.error == APP_RES_OK))
+    {
+        Platform_condition_wait(m_session_cond, m_session_mutex);
+    }
+
+    if (m_session.error == APP_RES_OK)
+    {
+        index = (m_session.queue_start + m_session.queue_count) % SESSION_QUEUE_SIZE;
+        first_part = SESSION_QUEUE_SIZE - index;
+        if (first_part > chunk_size)
+        {
+            first_part = chunk_size;
+        }
+        memcpy(&m_session.queue[index], chunk, first_part);
+        memcpy(m_session.queue, chunk + first_part, chunk_size - first_part);
+        m_session.queue_count += chunk_size;
+        m_session.queued_offset += chunk_size;
+        if (!Platform_worker_schedule(m_writer_worker, write_blocks, 0))
+        {
+            // Writer is stopped, nothing queued would ever be written
+            LOGE("Cannot schedule scratchpad writer\n");
+            m_session.error = APP_RES_INTERNAL_ERROR;
+            m_session.queue_count = 0;
+        }
+    }
 
+    if (m_session.queued_offset == m_session.total_size)
+    {
+        // Last chunk is acknowledged only when the sink has the full image
+        while ((m_session.queue_count > 0) && (m_session.error == APP_RES_OK))
+        {
+            Platform_condition_wait(m_session_cond, m_session_mutex);
+        }
+        *ended_p = true;
+    }
+
+    res = m_session.error;
+    if (res != APP_RES_OK)
+    {
+        *ended_p = true;
+    }
+
+    Platform_mutex_unlock(m_session_mutex);
+    return res;
 }
 
 static app_res_e handle_scratchpad_chunk(uint8_t * chunk,
@@ -45,6 +351,8 @@ static app_res_e handle_scratchpad_chunk(uint8_t * chunk,
                                          uint32_t seq)
 {
     app_res_e res;
+    bool ended;
+
     LOGD("Uploading scratchpad chunk: size %u, offset %u, total_size %u, seq %u\n",
                             chunk_size,
                             offset,
@@ -60,18 +368,11 @@ static app_res_e handle_scratchpad_chunk(uint8_t * chunk,
                                 m_scratchpad_load_current_seq,
                                 seq);
 
-            /* Only a log, keep going with it */
-        }
-
-        m_scratchpad_load_current_seq = seq;
-        res = WPC_start_local_scratchpad_update(total_size, seq);
-        
-        /* Force parameters update */
-        if (!m_restart_after_load)
-        {
-            Proto_config_refresh_otap_infos();
+            /* Only a log, previous one is dropped */
+            abort_session();
         }
 
+        res = start_session(total_size, seq);
         if (res != APP_RES_OK)
         {
             m_scratchpad_load_current_seq = INVALID_CURRENT_SEQ;
@@ -88,17 +389,11 @@ static app_res_e handle_scratchpad_chunk(uint8_t * chunk,
         return APP_RES_INVALID_SEQ;
     }
 
-    /* Load the chunk */
-    res = WPC_upload_local_block_scratchpad(chunk_size, chunk, offset);
-    if (res != APP_RES_OK)
-    {
-        return res;
-    }
+    /* Acknowledged as soon as queued, except the last one */
+    res = queue_chunk(chunk, chunk_size, offset, &ended);
 
-    /* Check if it is the last one */
-    if ((offset + chunk_size) == total_size)
+    if (ended)
     {
-        /* Yes it is */
         m_scratchpad_load_current_seq = INVALID_CURRENT_SEQ;
 
         /* Force parameters update */
@@ -108,7 +403,77 @@ static app_res_e handle_scratchpad_chunk(uint8_t * chunk,
         }
     }
 
-    return APP_RES_OK;
+    return res;
+}
+
+static bool is_stored_scratchpad(size_t len, uint16_t crc, uint32_t seq)
+{
+    app_scratchpad_status_t status;
+
+    Proto_config_get_local_scratchpad_status(&status);
+
+    return (status.scrat_len != 0)
+           && (status.scrat_len == len)
+           && (status.scrat_crc == crc)
+           && (status.scrat_seq_number == seq);
+}
+
+static bool is_redundant_upload(wp_UploadScratchpadReq *req)
+{
+    uint16_t crc;
+
+    if (req->scratchpad == NULL)
+    {
+        return false;
+    }
+
+    if (!req->has_chunk_info)
+    {
+        if (WPC_get_scratchpad_image_crc(req->scratchpad->size,
+                                         req->scratchpad->bytes,
+                                         &crc) != APP_RES_OK)
+        {
+            return false;
+        }
+
+        return is_stored_scratchpad(req->scratchpad->size, crc, req->seq);
+    }
+
+    if (req->chunk_info.start_offset != 0)
+    {
+        /* Following chunks of an already skipped upload */
+        if (m_scratchpad_skip_seq != req->seq)
+        {
+            return false;
+        }
+
+        if ((req->chunk_info.start_offset + req->scratchpad->size)
+            == req->chunk_info.scratchpad_total_size)
+        {
+            m_scratchpad_skip_seq = INVALID_CURRENT_SEQ;
+        }
+        return true;
+    }
+
+    /* First chunk: whole image is not known yet, so use the crc from its header */
+    m_scratchpad_skip_seq = INVALID_CURRENT_SEQ;
+    if (req->scratchpad->size < SCRATCHPAD_HEADER_SIZE)
+    {
+        return false;
+    }
+
+    crc = req->scratchpad->bytes[SCRATCHPAD_HEADER_CRC_OFFSET]
+          | (req->scratchpad->bytes[SCRATCHPAD_HEADER_CRC_OFFSET + 1] << 8);
+    if (!is_stored_scratchpad(req->chunk_info.scratchpad_total_size, crc, req->seq))
+    {
+        return false;
+    }
+
+    if (req->scratchpad->size != req->chunk_info.scratchpad_total_size)
+    {
+        m_scratchpad_skip_seq = req->seq;
+    }
+    return true;
 }
 
 app_proto_res_e Proto_otap_handle_upload_scratchpad(wp_UploadScratchpadReq *req,
@@ -130,6 +495,25 @@ app_proto_res_e Proto_otap_handle_upload_scratchpad(wp_UploadScratchpadReq *req,
         return APP_RES_PROTO_OK;
     }
 
+    /* Chunk size is not bounded anymore at decode time */
+    if ((req->scratchpad != NULL) && (req->scratchpad->size > SCRATCHPAD_CHUNK_MAX_SIZE))
+    {
+        LOGE("Scratchpad chunk too big: %d\n", req->scratchpad->size);
+        return APP_RES_PROTO_INVALID_REQUEST;
+    }
+
+    /* Sink already holds this scratchpad, no need to stop the stack */
+    if (is_redundant_upload(req))
+    {
+        LOGI("Scratchpad with seq %d already stored, upload skipped\n", req->seq);
+
+        Common_Fill_response_header(&resp->header,
+                                    req->header.req_id,
+                                    Common_convert_error_code(APP_RES_OK));
+
+        return APP_RES_PROTO_OK;
+    }
+
     if ((WPC_get_stack_status(&status) == APP_RES_OK)
         && (status == 0))
     {
@@ -147,13 +531,19 @@ app_proto_res_e Proto_otap_handle_upload_scratchpad(wp_UploadScratchpadReq *req,
         m_restart_after_load = true;
     }
 
-    if(req->has_scratchpad)
+    if (!req->has_chunk_info)
+    {
+        /* A chunked upload in progress is replaced */
+        abort_session();
+    }
+
+    if(req->scratchpad != NULL)
     {
         if (req->has_chunk_info)
         {
             /* This scratchpad is a chunk */
-            res = handle_scratchpad_chunk(req->scratchpad.bytes,
-                                          req->scratchpad.size,
+            res = handle_scratchpad_chunk(req->scratchpad->bytes,
+                                          req->scratchpad->size,
                                           req->chunk_info.start_offset,
                                           req->chunk_info.scratchpad_total_size,
                                           req->seq);
@@ -161,16 +551,16 @@ app_proto_res_e Proto_otap_handle_upload_scratchpad(wp_UploadScratchpadReq *req,
         else
         {
             /* Send the full file to the sink */
-            res = WPC_upload_local_scratchpad(req->scratchpad.size,
-                                              req->scratchpad.bytes,
+            res = WPC_upload_local_scratchpad(req->scratchpad->size,
+                                              req->scratchpad->bytes,
                                               req->seq);
             if (res == APP_RES_OK)
             {
-                LOGI("Scratchpad uploaded : with seq %d of size %d\n", req->seq, req->scratchpad.size);
+                LOGI("Scratchpad uploaded : with seq %d of size %d\n", req->seq, req->scratchpad->size);
             }
             else
             {
-                LOGE("Upload scratchpad failed %d: with seq %d of size %d\n", res, req->seq, req->scratchpad.size);
+                LOGE("Upload scratchpad failed %d: with seq %d of size %d\n", res, req->seq, req->scratchpad->size);
             }
             m_scratchpad_load_current_seq = INVALID_CURRENT_SEQ;
 
@@ -194,6 +584,12 @@ app_proto_res_e Proto_otap_handle_upload_scratchpad(wp_UploadScratchpadReq *req,
             LOGE("Clear scratchpad failed %d\n", res);
         }
         m_scratchpad_load_current_seq = INVALID_CURRENT_SEQ;
+
+        /* Force parameters update, stored scratchpad is used to skip uploads */
+        if (!m_restart_after_load)
+        {
+            Proto_config_refresh_otap_infos();
+        }
     }
 
     if ((m_restart_after_load)
@@ -238,6 +634,9 @@ app_proto_res_e Proto_otap_handle_process_scratchpad(wp_ProcessScratchpadReq *re
 
     // TODO: Add some sanity checks
 
+    /* Image of a chunked upload in progress is not complete */
+    abort_session();
+
     if ((WPC_get_stack_status(&status) == APP_RES_OK)
         && (status == 0))
     {
@@ -27,6 +27,9 @@ void Proto_otap_close(void);
  * \param   resp
  *          Pointer to the reponse to send back
  * \return  APP_RES_PROTO_OK if answer is ready to send
+ * \note    A chunk is acknowledged as soon as it is queued to be written to
+ *          the sink. An error writing it is reported on the next chunk, and
+ *          the last chunk is acknowledged once the full image is written
  */
 app_proto_res_e Proto_otap_handle_upload_scratchpad(wp_UploadScratchpadReq *req,
                                                     wp_UploadScratchpadResp *resp);
@@ -0,0 +1,35 @@
+/* Wirepas Oy licensed under Apache License, Version 2.0
+ *
+ * See file LICENSE for full license details.
+ *
+ */
+#ifndef PROTO_PB_SYSTEM_H_
+#define PROTO_PB_SYSTEM_H_
+
+/* System header used by nanopb instead of its default one (set with
+ * PB_SYSTEM_HEADER). It routes nanopb dynamic allocations to the request
+ * arena and declares the types of the callback fields */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+#include <limits.h>
+#include <stdlib.h>
+
+#include "proto_arena.h"
+
+#define pb_realloc(ptr, size) Proto_arena_realloc(ptr, size)
+#define pb_free(ptr) Proto_arena_free(ptr)
+
+/**
+ * \brief   Bytes field left in the buffer it is decoded from
+ *          (callback_datatype of the fields that are not copied)
+ */
+typedef struct
+{
+    const uint8_t * bytes;  //< First byte of the field, NULL if not present
+    size_t size;            //< Size of the field
+} proto_bytes_ref_t;
+
+#endif
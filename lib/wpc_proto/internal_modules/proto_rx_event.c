@@ -0,0 +1,155 @@
+/* Wirepas Oy licensed under Apache License, Version 2.0
+ *
+ * See file LICENSE for full license details.
+ *
+ */
+#include <string.h>
+
+#include "proto_rx_event.h"
+#include "common.h"
+#include "platform.h"
+#include "generic_message.pb.h"
+
+#define LOG_MODULE_NAME "rx_event"
+#define MAX_LOG_LEVEL INFO_LOG_LEVEL
+#include "logger.h"
+
+/* Protobuf wire types */
+#define WIRE_TYPE_VARINT    0
+#define WIRE_TYPE_LEN       2
+
+/* Single byte key of a field (all tags used here are lower than 16) */
+#define KEY(tag, wire_type) ((uint8_t) (((tag) << 3) | (wire_type)))
+
+/* Pre-serialized gw_id and sink_id fields of the EventHeader */
+static uint8_t m_header_ids[2 * (1 + 1) + GATEWAY_ID_MAX_SIZE + SINK_ID_MAX_SIZE];
+static size_t m_header_ids_size = 0;
+
+static size_t varint_size(uint64_t value)
+{
+    size_t size = 1;
+    while (value >= 0x80)
+    {
+        value >>= 7;
+        size++;
+    }
+    return size;
+}
+
+static uint8_t * write_varint(uint8_t * p, uint64_t value)
+{
+    while (value >= 0x80)
+    {
+        *p++ = (uint8_t) (value | 0x80);
+        value >>= 7;
+    }
+    *p++ = (uint8_t) value;
+    return p;
+}
+
+static uint8_t * write_varint_field(uint8_t * p, uint8_t tag, uint64_t value)
+{
+    *p++ = KEY(tag, WIRE_TYPE_VARINT);
+    return write_varint(p, value);
+}
+
+static uint8_t * write_string_field(uint8_t * p, uint8_t tag, const char * string)
+{
+    size_t len = strlen(string);
+
+    *p++ = KEY(tag, WIRE_TYPE_LEN);
+    p = write_varint(p, len);
+    memcpy(p, string, len);
+    return p + len;
+}
+
+bool Proto_rx_event_init(void)
+{
+    _Static_assert(GATEWAY_ID_MAX_SIZE < 0x80 && SINK_ID_MAX_SIZE < 0x80,
+                   "Id length must fit in a single byte varint");
+
+    uint8_t * p = m_header_ids;
+    const char * sink_id = Common_get_sink_id();
+
+    // gw_id is required, sink_id only present if set
+    p = write_string_field(p, wp_EventHeader_gw_id_tag, Common_get_gateway_id());
+    if (strlen(sink_id) != 0)
+    {
+        p = write_string_field(p, wp_EventHeader_sink_id_tag, sink_id);
+    }
+    m_header_ids_size = p - m_header_ids;
+
+    return true;
+}
+
+size_t Proto_rx_event_encode(const proto_rx_event_t * event_p,
+                             uint8_t * buffer_p,
+                             size_t buffer_size)
+{
+    uint64_t event_id = Common_get_event_id();
+    uint64_t time_ms_epoch = Platform_get_timestamp_ms_epoch();
+    size_t header_size, event_size, wirepas_size, total_size;
+    uint8_t * p = buffer_p;
+
+    // Compute the size of each nested message first, as they are prefixed
+    // with their length
+    header_size = m_header_ids_size
+                  + 1 + varint_size(event_id)
+                  + 1 + varint_size(time_ms_epoch);
+
+    event_size = 1 + varint_size(header_size) + header_size
+                 + 1 + varint_size(event_p->src_addr)
+                 + 1 + varint_size(event_p->dst_addr)
+                 + 1 + varint_size(event_p->src_ep)
+                 + 1 + varint_size(event_p->dst_ep)
+                 + 1 + varint_size(event_p->travel_time_ms)
+                 + 1 + varint_size(event_p->rx_time_ms_epoch)
+                 + 1 + varint_size(event_p->qos)
+                 + 1 + varint_size(event_p->payload_size) + event_p->payload_size
+                 + 1 + varint_size(event_p->hop_count)
+                 + 1 + varint_size(event_p->network_address);
+
+    wirepas_size = 1 + varint_size(event_size) + event_size;
+    total_size = 1 + varint_size(wirepas_size) + wirepas_size;
+
+    if (total_size > buffer_size)
+    {
+        LOGE("Buffer too small to encode event (%u > %u)\n", total_size, buffer_size);
+        return 0;
+    }
+
+    // GenericMessage.wirepas
+    *p++ = KEY(wp_GenericMessage_wirepas_tag, WIRE_TYPE_LEN);
+    p = write_varint(p, wirepas_size);
+
+    // WirepasMessage.packet_received_event
+    *p++ = KEY(wp_WirepasMessage_packet_received_event_tag, WIRE_TYPE_LEN);
+    p = write_varint(p, event_size);
+
+    // PacketReceivedEvent.header
+    *p++ = KEY(wp_PacketReceivedEvent_header_tag, WIRE_TYPE_LEN);
+    p = write_varint(p, header_size);
+    memcpy(p, m_header_ids, m_header_ids_size);
+    p += m_header_ids_size;
+    p = write_varint_field(p, wp_EventHeader_event_id_tag, event_id);
+    p = write_varint_field(p, wp_EventHeader_time_ms_epoch_tag, time_ms_epoch);
+
+    // PacketReceivedEvent fields, in tag order as nanopb does
+    p = write_varint_field(p, wp_PacketReceivedEvent_source_address_tag, event_p->src_addr);
+    p = write_varint_field(p, wp_PacketReceivedEvent_destination_address_tag, event_p->dst_addr);
+    p = write_varint_field(p, wp_PacketReceivedEvent_source_endpoint_tag, event_p->src_ep);
+    p = write_varint_field(p, wp_PacketReceivedEvent_destination_endpoint_tag, event_p->dst_ep);
+    p = write_varint_field(p, wp_PacketReceivedEvent_travel_time_ms_tag, event_p->travel_time_ms);
+    p = write_varint_field(p, wp_PacketReceivedEvent_rx_time_ms_epoch_tag, event_p->rx_time_ms_epoch);
+    p = write_varint_field(p, wp_PacketReceivedEvent_qos_tag, event_p->qos);
+
+    *p++ = KEY(wp_PacketReceivedEvent_payload_tag, WIRE_TYPE_LEN);
+    p = write_varint(p, event_p->payload_size);
+    memcpy(p, event_p->payload_p, event_p->payload_size);
+    p += event_p->payload_size;
+
+    p = write_varint_field(p, wp_PacketReceivedEvent_hop_count_tag, event_p->hop_count);
+    p = write_varint_field(p, wp_PacketReceivedEvent_network_address_tag, event_p->network_address);
+
+    return p - buffer_p;
+}
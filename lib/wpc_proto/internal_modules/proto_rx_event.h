@@ -0,0 +1,59 @@
+/* Wirepas Oy licensed under Apache License, Version 2.0
+ *
+ * See file LICENSE for full license details.
+ *
+ */
+#ifndef PROTO_RX_EVENT_H_
+#define PROTO_RX_EVENT_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * \brief   Content of a received packet to encode as a PacketReceivedEvent
+ */
+typedef struct
+{
+    const uint8_t * payload_p;      //< Payload, written as is in the event
+    size_t payload_size;            //< Size of the payload
+    uint32_t src_addr;              //< Source address
+    uint32_t dst_addr;              //< Destination address
+    uint8_t src_ep;                 //< Source endpoint
+    uint8_t dst_ep;                 //< Destination endpoint
+    uint32_t qos;                   //< Quality of service
+    uint32_t travel_time_ms;        //< Travel time of the packet
+    uint32_t hop_count;             //< Number of hops
+    uint64_t rx_time_ms_epoch;      //< Reception time
+    uint64_t network_address;       //< Network address of the sink
+} proto_rx_event_t;
+
+/**
+ * \brief   Initialize the encoder
+ *          The constant fields of the event header (gateway and sink ids)
+ *          are serialized once here
+ * \return  True if successful, False otherwise
+ * \note    Must be called after Common_init
+ */
+bool Proto_rx_event_init(void);
+
+/**
+ * \brief   Encode a received packet as a GenericMessage holding a
+ *          PacketReceivedEvent
+ * \param   event_p
+ *          The received packet
+ * \param   buffer_p
+ *          Buffer to store the encoded message
+ * \param   buffer_size
+ *          Size of the buffer. WPC_PROTO_OFFSET_DATA_SIZE + payload size
+ *          is always enough
+ * \return  Size of the encoded message, 0 if buffer is too small
+ * \note    The output is the same as encoding the message with nanopb, but
+ *          without any intermediate structure, allocation or copy of the
+ *          payload
+ */
+size_t Proto_rx_event_encode(const proto_rx_event_t * event_p,
+                             uint8_t * buffer_p,
+                             size_t buffer_size);
+
+#endif
@@ -6,6 +6,12 @@ PROTO_FOLDER=$WPC_FOLDER/deps/backend-apis/gateway_to_backend/protocol_buffers_f
 PROTO_OPTIONS_FOLDER=$WPC_FOLDER/proto_options/
 NANOPB_FOLDER=$WPC_FOLDER/deps/nanopb/
 
+# Generated files are removed below, so check the submodules are there first
+if [ ! -f ${PROTO_FOLDER}data_message.proto ] || [ ! -f ${NANOPB_FOLDER}generator/nanopb_generator.py ]; then
+    echo "Missing submodules, run: git submodule update --init" >&2
+    exit 1
+fi
+
 cd $WPC_FOLDER/gen
 
 mkdir -p proto_files generated_protos
@@ -27,6 +33,6 @@ sed -i 's/package wirepas.proto.gateway_api;/package wp;/g' proto_files/*.proto
 cp ${PROTO_OPTIONS_FOLDER}* proto_files/
 
 # Generate code
-python3 ${NANOPB_FOLDER}generator/nanopb_generator.py --proto-path=proto_files -D generated_protos `ls proto_files/*.proto`
+python3 ${NANOPB_FOLDER}generator/nanopb_generator.py --proto-path=proto_files -D generated_protos `ls proto_files/*.proto` || exit 1
 
 cd -
\ No newline at end of file
@@ -15,6 +15,8 @@
 #include "proto_data.h"
 #include "proto_config.h"
 #include "proto_otap.h"
+#include "proto_arena.h"
+#include "proto_async.h"
 #include "common.h"
 #include "platform.h"
 
@@ -97,9 +99,35 @@ app_proto_res_e WPC_Proto_initialize(const char * port_name,
         return APP_RES_PROTO_WRONG_PARAMETER;
     }
 
-    Proto_data_init();
-    Proto_config_init();
-    Proto_otap_init();
+    /* Config is read back at each stack status, avoid reading again attributes
+     * that can only change on a reboot */
+    WPC_enable_attribute_cache(true);
+
+    if (!Proto_arena_init())
+    {
+        // Not fatal, requests are handled from heap
+        LOGW("No arena for requests\n");
+    }
+
+    if (!Proto_data_init())
+    {
+        return APP_RES_PROTO_NOT_ENOUGH_MEMORY;
+    }
+
+    if (!Proto_config_init())
+    {
+        return APP_RES_PROTO_NOT_ENOUGH_MEMORY;
+    }
+
+    if (!Proto_otap_init())
+    {
+        return APP_RES_PROTO_NOT_ENOUGH_MEMORY;
+    }
+
+    if (!Proto_async_init())
+    {
+        return APP_RES_PROTO_NOT_ENOUGH_MEMORY;
+    }
 
     LOGI("WPC proto initialized with gw_id = %s\n", gateway_id);
     LOGI("gw_model = %s, gw_version = %s and sink_id = %s\n",
@@ -112,11 +140,15 @@ app_proto_res_e WPC_Proto_initialize(const char * port_name,
 
 void WPC_Proto_close()
 {
+    // Let the request in progress complete before closing the link
+    Proto_async_close();
+    // Same for the scratchpad blocks already acknowledged
+    Proto_otap_close();
     WPC_close();
     WPC_unregister_from_stack_status();
-    Proto_otap_close();
     Proto_config_close();
     Proto_data_close();
+    Proto_arena_close();
 }
 
 app_proto_res_e WPC_Proto_register_for_data_rx_event(onDataRxEvent_cb_f onDataRxEvent_cb)
@@ -124,11 +156,51 @@ app_proto_res_e WPC_Proto_register_for_data_rx_event(onDataRxEvent_cb_f onDataRx
     return Proto_data_register_for_data(onDataRxEvent_cb);
 }
 
+app_proto_res_e WPC_Proto_register_for_data_rx_event_batch(onDataRxEventBatch_cb_f onDataRxEventBatch_cb,
+                                                           size_t max_events,
+                                                           unsigned int max_delay_ms)
+{
+    return Proto_data_register_for_data_batch(onDataRxEventBatch_cb, max_events, max_delay_ms);
+}
+
 app_proto_res_e WPC_Proto_register_for_event_status(onEventStatus_cb_f onProtoEventStatus_cb)
 {
     return Proto_config_register_for_event_status(onProtoEventStatus_cb);
 }
 
+/**
+ * \brief   Allocate the response of a request
+ * \param   size
+ *          Size of the response
+ * \param   arena
+ *          True if the request arena is in use
+ */
+static void * allocate_response(size_t size, bool arena)
+{
+    return arena ? Proto_arena_alloc(size) : Platform_malloc(size);
+}
+
+/**
+ * \brief   Release everything allocated to handle a request
+ * \note    With arena, it is done at once without going through the
+ *          decoded request
+ */
+static void release_request(wp_GenericMessage * message_req_p,
+                            void * resp_msg_p,
+                            size_t resp_size,
+                            bool arena)
+{
+    if (arena)
+    {
+        Proto_arena_end();
+    }
+    else
+    {
+        pb_release(wp_GenericMessage_fields, message_req_p);
+        Platform_free(resp_msg_p, resp_size);
+    }
+}
+
 app_proto_res_e WPC_Proto_handle_request(const uint8_t * request_p,
                                          size_t request_size,
                                          uint8_t * response_p,
@@ -143,7 +215,10 @@ app_proto_res_e WPC_Proto_handle_request(const uint8_t * request_p,
     pb_ostream_t stream_out;
     void * resp_msg_p = NULL;
     size_t resp_size  = 0;
-
+    /* Request and response are allocated from the arena if available */
+    bool arena = Proto_arena_begin();
+    /* Some responses are directly encoded by their handler */
+    bool response_encoded = false;
 
     // Prepare response
     wp_GenericMessage message_resp = wp_GenericMessage_init_zero;
@@ -155,6 +230,7 @@ app_proto_res_e WPC_Proto_handle_request(const uint8_t * request_p,
     if (!status)
     {
         LOGE("Decoding failed: %s\n", PB_GET_ERROR(&stream_in));
+        release_request(&message_req, NULL, 0, arena);
         return APP_RES_PROTO_INVALID_REQUEST;
     }
 
@@ -163,7 +239,7 @@ app_proto_res_e WPC_Proto_handle_request(const uint8_t * request_p,
     if (!wp_message_req_p)
     {
         LOGW("Not a wirepas message\n");
-        pb_release(wp_GenericMessage_fields, &message_req);
+        release_request(&message_req, NULL, 0, arena);
         return APP_RES_PROTO_INVALID_REQUEST;
     }
 
@@ -171,27 +247,16 @@ app_proto_res_e WPC_Proto_handle_request(const uint8_t * request_p,
     if (wp_message_req_p->get_configs_req)
     {
         LOGI("Get config request\n");
-        resp_size  = sizeof(wp_GetConfigsResp);
-        resp_msg_p = Platform_malloc(resp_size);
-        if (resp_msg_p == NULL)
-        {
-            LOGE("Not enough memory to encode GetConfigsResp");
-            res = APP_RES_PROTO_NOT_ENOUGH_MEMORY;
-        }
-        else
-        {
-            message_resp.wirepas->get_configs_resp
-                = (wp_GetConfigsResp *) resp_msg_p;
-
-            res = Proto_config_handle_get_configs(wp_message_req_p->get_configs_req,
-                                                (wp_GetConfigsResp *) resp_msg_p);
-        }
+        res = Proto_config_encode_get_configs(wp_message_req_p->get_configs_req,
+                                              response_p,
+                                              response_size_p);
+        response_encoded = true;
     }
     else if (wp_message_req_p->set_config_req)
     {
         LOGI("Set config request\n");
         resp_size  = sizeof(wp_SetConfigResp);
-        resp_msg_p = Platform_malloc(resp_size);
+        resp_msg_p = allocate_response(resp_size, arena);
         if (resp_msg_p == NULL)
         {
             LOGE("Not enough memory to encode SetConfigResp");
@@ -208,9 +273,10 @@ app_proto_res_e WPC_Proto_handle_request(const uint8_t * request_p,
     }
     else if (wp_message_req_p->send_packet_req)
     {
-        LOGI("Send packet request, size = %d\n", wp_message_req_p->send_packet_req->payload.size);
+        LOGI("Send packet request, size = %zu\n",
+             wp_message_req_p->send_packet_req->payload.size);
         resp_size  = sizeof(wp_SendPacketResp);
-        resp_msg_p = Platform_malloc(resp_size);
+        resp_msg_p = allocate_response(resp_size, arena);
         if (resp_msg_p == NULL)
         {
             LOGE("Not enough memory to encode SendPacketResp");
@@ -229,7 +295,7 @@ app_proto_res_e WPC_Proto_handle_request(const uint8_t * request_p,
     {
         LOGI("Get scratchpad status request\n");
         resp_size  = sizeof(wp_GetScratchpadStatusResp);
-        resp_msg_p = Platform_malloc(resp_size);
+        resp_msg_p = allocate_response(resp_size, arena);
         if (resp_msg_p == NULL)
         {
             LOGE("Not enough memory to encode GetScratchpadStatusResp");
@@ -248,7 +314,7 @@ app_proto_res_e WPC_Proto_handle_request(const uint8_t * request_p,
     {
         LOGI("Upload scratchpad request\n");
         resp_size  = sizeof(wp_UploadScratchpadResp);
-        resp_msg_p = Platform_malloc(resp_size);
+        resp_msg_p = allocate_response(resp_size, arena);
         if (resp_msg_p == NULL)
         {
             LOGE("Not enough memory to encode UploadScratchpadResp");
@@ -268,7 +334,7 @@ app_proto_res_e WPC_Proto_handle_request(const uint8_t * request_p,
     {
         LOGI("Process scratchpad request\n");
         resp_size  = sizeof(wp_ProcessScratchpadResp);
-        resp_msg_p = Platform_malloc(resp_size);
+        resp_msg_p = allocate_response(resp_size, arena);
         if (resp_msg_p == NULL)
         {
             LOGE("Not enough memory to encode ProcessScratchpadResp");
@@ -286,26 +352,16 @@ app_proto_res_e WPC_Proto_handle_request(const uint8_t * request_p,
     else if (wp_message_req_p->get_gateway_info_req)
     {
         LOGI("Get gateway info request\n");
-        resp_size = sizeof(wp_GetGwInfoResp);
-        resp_msg_p = Platform_malloc(resp_size);
-        if (resp_msg_p == NULL)
-        {
-            LOGE("Not enough memory to encode GetGatewayInfo\n");
-            res = APP_RES_PROTO_NOT_ENOUGH_MEMORY;
-        }
-        else
-        {
-            message_resp.wirepas->get_gateway_info_resp = (wp_GetGwInfoResp *) resp_msg_p;
-
-            res = Proto_config_handle_get_gateway_info_request(
-                wp_message_req_p->get_gateway_info_req, (wp_GetGwInfoResp *) resp_msg_p);
-        }
+        res = Proto_config_encode_get_gateway_info(wp_message_req_p->get_gateway_info_req,
+                                                   response_p,
+                                                   response_size_p);
+        response_encoded = true;
     }
     else if (wp_message_req_p->set_scratchpad_target_and_action_req)
     {
         LOGI("Set scratchpad target and action request\n");
         resp_size = sizeof(wp_SetScratchpadTargetAndActionResp);
-        resp_msg_p = Platform_malloc(resp_size);
+        resp_msg_p = allocate_response(resp_size, arena);
         if (resp_msg_p == NULL)
         {
             LOGE("Not enough memory to encode SetScratchpadTargetAndAction\n");
@@ -327,7 +383,7 @@ app_proto_res_e WPC_Proto_handle_request(const uint8_t * request_p,
         res = APP_RES_PROTO_INVALID_REQUEST;
     }
 
-    if (res == APP_RES_PROTO_OK)
+    if ((res == APP_RES_PROTO_OK) && !response_encoded)
     {
         //Serialize the answer
         stream_out = pb_ostream_from_buffer(response_p, *response_size_p);
@@ -346,13 +402,20 @@ app_proto_res_e WPC_Proto_handle_request(const uint8_t * request_p,
         }
     }
 
-    pb_release(wp_GenericMessage_fields, &message_req);
-    Platform_free(resp_msg_p, resp_size);
+    release_request(&message_req, resp_msg_p, resp_size, arena);
 
     return res;
 
 }
 
+app_proto_res_e WPC_Proto_submit_request(const uint8_t * request_p,
+                                         size_t request_size,
+                                         onProtoResponse_cb_f onProtoResponse_cb,
+                                         void * ctx)
+{
+    return Proto_async_submit_request(request_p, request_size, onProtoResponse_cb, ctx);
+}
+
 app_proto_res_e WPC_Proto_get_current_event_status(bool gw_online,
                                                    bool sink_online,
                                                    uint8_t * event_status_p,
@@ -0,0 +1,489 @@
+/* Wirepas Oy licensed under Apache License, Version 2.0
+ *
+ * See file LICENSE for full license details.
+ *
+ */
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "wpc_proto.h"
+#include "wpc_internal.h"
+#include "reassembly.h"
+#include "common.h"
+#include "proto_data.h"
+#include "proto_rx_event.h"
+#include "replay_platform.h"
+#include "trace.h"
+
+#define LOG_MODULE_NAME "replay"
+#define MAX_LOG_LEVEL INFO_LOG_LEVEL
+#include "logger.h"
+
+/*
+ * Replay of captured frames through the reception path of the library:
+ * dispatch_indication -> dsap handlers -> reassembly -> data rx event encoding
+ *
+ * Stages are timed by wrapping the reassembly and encoding functions at link
+ * time (-Wl,--wrap). Allocations done by the library while a frame is
+ * dispatched are counted the same way.
+ */
+
+#define GATEWAY_ID      "replay_gw"
+#define GATEWAY_MODEL   "replay"
+#define GATEWAY_VERSION "1.0"
+#define SINK_ID         "sink0"
+
+// Max delay of a batch when events are delivered by batches
+#define BATCH_MAX_DELAY_MS 100
+
+typedef enum
+{
+    STAGE_DISPATCH,     //< Whole dispatch of the frame
+    STAGE_REASSEMBLY,   //< Adding a fragment and getting the full packet
+    STAGE_ENCODE,       //< Encoding of the PacketReceivedEvent
+    STAGE_OTHER,        //< Dispatch minus reassembly and encoding
+    STAGE_COUNT
+} stage_e;
+
+static const char * STAGE_NAMES[STAGE_COUNT] = {
+    "dispatch",
+    "reassembly",
+    "encode",
+    "other",
+};
+
+typedef struct
+{
+    uint32_t * samples_p;   //< Durations in ns
+    size_t count;
+    size_t capacity;
+} stage_samples_t;
+
+static stage_samples_t m_stages[STAGE_COUNT];
+
+// Time spent in each stage during the frame being dispatched
+static uint64_t m_frame_ns[STAGE_COUNT];
+
+// Allocations are only counted on the replay thread during a dispatch
+static __thread bool m_count_allocations = false;
+static unsigned long m_allocations;
+static unsigned long long m_allocated_bytes;
+
+static unsigned long m_events;
+static unsigned long long m_event_bytes;
+
+static inline uint64_t get_time_ns(void)
+{
+    struct timespec spec;
+
+    clock_gettime(CLOCK_MONOTONIC, &spec);
+    return (uint64_t) spec.tv_sec * 1000000000ULL + spec.tv_nsec;
+}
+
+/*****************************************************************************/
+/*                Link time wrappers                                         */
+/*****************************************************************************/
+void * __real_malloc(size_t size);
+void * __real_calloc(size_t count, size_t size);
+void * __real_realloc(void * ptr, size_t size);
+bool __real_reassembly_add_fragment(reassembly_fragment_t * frag, size_t * full_size_p);
+bool __real_reassembly_get_full_message(uint32_t src_addr,
+                                        uint16_t packet_id,
+                                        uint8_t * buffer_p,
+                                        size_t * size);
+size_t __real_Proto_rx_event_encode(const proto_rx_event_t * event_p,
+                                    uint8_t * buffer_p,
+                                    size_t buffer_size);
+
+static inline void count_allocation(size_t size)
+{
+    if (m_count_allocations)
+    {
+        m_allocations++;
+        m_allocated_bytes += size;
+    }
+}
+
+void * __wrap_malloc(size_t size)
+{
+    count_allocation(size);
+    return __real_malloc(size);
+}
+
+void * __wrap_calloc(size_t count, size_t size)
+{
+    count_allocation(count * size);
+    return __real_calloc(count, size);
+}
+
+void * __wrap_realloc(void * ptr, size_t size)
+{
+    count_allocation(size);
+    return __real_realloc(ptr, size);
+}
+
+bool __wrap_reassembly_add_fragment(reassembly_fragment_t * frag, size_t * full_size_p)
+{
+    uint64_t start = get_time_ns();
+    bool res = __real_reassembly_add_fragment(frag, full_size_p);
+    m_frame_ns[STAGE_REASSEMBLY] += get_time_ns() - start;
+    return res;
+}
+
+bool __wrap_reassembly_get_full_message(uint32_t src_addr,
+                                        uint16_t packet_id,
+                                        uint8_t * buffer_p,
+                                        size_t * size)
+{
+    uint64_t start = get_time_ns();
+    bool res = __real_reassembly_get_full_message(src_addr, packet_id, buffer_p, size);
+    m_frame_ns[STAGE_REASSEMBLY] += get_time_ns() - start;
+    return res;
+}
+
+size_t __wrap_Proto_rx_event_encode(const proto_rx_event_t * event_p,
+                                    uint8_t * buffer_p,
+                                    size_t buffer_size)
+{
+    uint64_t start = get_time_ns();
+    size_t res = __real_Proto_rx_event_encode(event_p, buffer_p, buffer_size);
+    m_frame_ns[STAGE_ENCODE] += get_time_ns() - start;
+    return res;
+}
+
+/*****************************************************************************/
+/*                Statistics                                                 */
+/*****************************************************************************/
+static bool add_sample(stage_samples_t * stage_p, uint64_t duration_ns)
+{
+    if (stage_p->count == stage_p->capacity)
+    {
+        size_t capacity = stage_p->capacity ? stage_p->capacity * 2 : 4096;
+        uint32_t * samples_p = realloc(stage_p->samples_p, capacity * sizeof(uint32_t));
+        if (samples_p == NULL)
+        {
+            return false;
+        }
+        stage_p->samples_p = samples_p;
+        stage_p->capacity = capacity;
+    }
+
+    stage_p->samples_p[stage_p->count++] =
+        duration_ns > UINT32_MAX ? UINT32_MAX : (uint32_t) duration_ns;
+    return true;
+}
+
+static int compare_samples(const void * a, const void * b)
+{
+    uint32_t x = *(const uint32_t *) a;
+    uint32_t y = *(const uint32_t *) b;
+    return (x > y) - (x < y);
+}
+
+static double get_percentile_us(const stage_samples_t * stage_p, double percentile)
+{
+    size_t index = (size_t) (percentile / 100.0 * (stage_p->count - 1) + 0.5);
+    return stage_p->samples_p[index] / 1000.0;
+}
+
+static void print_report(unsigned long frames,
+                         unsigned long skipped,
+                         uint64_t elapsed_ns)
+{
+    uint64_t busy_ns = 0;
+    double elapsed_s = elapsed_ns / 1e9;
+
+    for (size_t i = 0; i < m_stages[STAGE_DISPATCH].count; i++)
+    {
+        busy_ns += m_stages[STAGE_DISPATCH].samples_p[i];
+    }
+
+    printf("\nFrames dispatched: %lu (%lu requests and confirms skipped)\n", frames, skipped);
+    printf("Data events:       %lu (%llu bytes)\n", m_events, m_event_bytes);
+    printf("Elapsed:           %.3f s\n", elapsed_s);
+    if (frames == 0)
+    {
+        return;
+    }
+
+    printf("Throughput:        %.0f frames/s, %.0f events/s\n",
+           frames / elapsed_s,
+           m_events / elapsed_s);
+    printf("Dispatch capacity: %.0f frames/s\n", frames / (busy_ns / 1e9));
+    printf("Allocations:       %.2f per frame, %.2f per event (%.1f bytes per frame)\n",
+           (double) m_allocations / frames,
+           m_events ? (double) m_allocations / m_events : 0.0,
+           (double) m_allocated_bytes / frames);
+
+    printf("\n%-12s %10s %10s %10s %10s %10s %10s\n",
+           "Stage (us)", "samples", "p50", "p90", "p99", "p99.9", "max");
+    for (int i = 0; i < STAGE_COUNT; i++)
+    {
+        stage_samples_t * stage_p = &m_stages[i];
+        if (stage_p->count == 0)
+        {
+            printf("%-12s %10d\n", STAGE_NAMES[i], 0);
+            continue;
+        }
+
+        qsort(stage_p->samples_p, stage_p->count, sizeof(uint32_t), compare_samples);
+        printf("%-12s %10zu %10.3f %10.3f %10.3f %10.3f %10.3f\n",
+               STAGE_NAMES[i],
+               stage_p->count,
+               get_percentile_us(stage_p, 50),
+               get_percentile_us(stage_p, 90),
+               get_percentile_us(stage_p, 99),
+               get_percentile_us(stage_p, 99.9),
+               stage_p->samples_p[stage_p->count - 1] / 1000.0);
+    }
+}
+
+/*****************************************************************************/
+/*                Replay                                                     */
+/*****************************************************************************/
+static void onDataRxEvent_cb(uint8_t * event_p,
+                             size_t event_size,
+                             uint32_t network_id,
+                             uint16_t src_ep,
+                             uint16_t dst_ep)
+{
+    (void) event_p;
+    (void) network_id;
+    (void) src_ep;
+    (void) dst_ep;
+
+    m_events++;
+    m_event_bytes += event_size;
+}
+
+static void onDataRxEventBatch_cb(uint8_t * events_p,
+                                  size_t events_size,
+                                  size_t event_count,
+                                  uint32_t network_id,
+                                  uint16_t src_ep,
+                                  uint16_t dst_ep)
+{
+    (void) events_p;
+    (void) network_id;
+    (void) src_ep;
+    (void) dst_ep;
+
+    m_events += event_count;
+    m_event_bytes += events_size;
+}
+
+static bool dispatch_frame(Platform_dispatch_indication_f dispatch_f,
+                           trace_frame_t * frame_p)
+{
+    unsigned long long timestamp_ms;
+    uint64_t start, total;
+
+    if (frame_p->timestamp_us != 0)
+    {
+        timestamp_ms = frame_p->timestamp_us / 1000;
+    }
+    else
+    {
+        timestamp_ms = Platform_get_timestamp_ms_epoch();
+    }
+
+    memset(m_frame_ns, 0, sizeof(m_frame_ns));
+
+    m_count_allocations = true;
+    start = get_time_ns();
+    // Capture timestamps are not monotonic, only rx timestamps use them
+    dispatch_f(&frame_p->frame, timestamp_ms, Platform_get_timestamp_us_monotonic());
+    total = get_time_ns() - start;
+    m_count_allocations = false;
+
+    m_frame_ns[STAGE_DISPATCH] = total;
+    m_frame_ns[STAGE_OTHER] = total - m_frame_ns[STAGE_REASSEMBLY] - m_frame_ns[STAGE_ENCODE];
+
+    for (int i = 0; i < STAGE_COUNT; i++)
+    {
+        // Stages not involved in the frame are not sampled
+        if ((m_frame_ns[i] != 0) || (i == STAGE_DISPATCH) || (i == STAGE_OTHER))
+        {
+            if (!add_sample(&m_stages[i], m_frame_ns[i]))
+            {
+                LOGE("Cannot store samples\n");
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+static void wait_until_ns(uint64_t deadline_ns)
+{
+    struct timespec deadline = {
+        .tv_sec = deadline_ns / 1000000000ULL,
+        .tv_nsec = deadline_ns % 1000000000ULL,
+    };
+
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) != 0)
+    {
+    }
+}
+
+void print_usage()
+{
+    printf("Usage: wpcReplay [OPTIONS] <trace> [<trace>...]\n");
+    printf("Replay captured frames (pcapng or raw slip stream) through the library\n");
+    printf("Options:\n");
+    printf("  -p, --paced                 Replay at the pace of the capture timestamps\n");
+    printf("  -s, --speed <factor>        Speed factor of the paced replay (default: 1)\n");
+    printf("  -b, --batch <max_events>    Deliver events by batches of max_events\n");
+    printf("  -e, --expect <events>       Fail if the number of events differs\n");
+    printf("  -q, --quiet                 Only print warnings and errors from the library\n");
+    printf("  -h, --help                  Display this help message\n");
+}
+
+int main(int argc, char * argv[])
+{
+    bool paced = false;
+    double speed = 1.0;
+    size_t batch_max_events = 0;
+    long expected_events = -1;
+    unsigned long frames = 0;
+    unsigned long skipped = 0;
+    uint64_t first_trace_us = 0;
+    uint64_t start_ns;
+    Platform_dispatch_indication_f dispatch_f;
+    trace_frame_t frame;
+    int res = 0;
+    int c;
+
+    static struct option long_options[]
+        = { { "paced", no_argument, 0, 'p' },
+            { "speed", required_argument, 0, 's' },
+            { "batch", required_argument, 0, 'b' },
+            { "expect", required_argument, 0, 'e' },
+            { "quiet", no_argument, 0, 'q' },
+            { "help", no_argument, 0, 'h' },
+            { 0, 0, 0, 0 } };
+    while ((c = getopt_long(argc, argv, "ps:b:e:qh?", long_options, NULL)) != -1)
+    {
+        switch (c)
+        {
+            case 'p':
+                paced = true;
+                break;
+            case 's':
+                paced = true;
+                speed = strtod(optarg, NULL);
+                break;
+            case 'b':
+                batch_max_events = strtoul(optarg, NULL, 0);
+                break;
+            case 'e':
+                expected_events = strtol(optarg, NULL, 0);
+                break;
+            case 'q':
+                Platform_set_log_level(WARNING_LOG_LEVEL);
+                break;
+            case 'h':
+            case '?':
+            default:
+                print_usage();
+                return -1;
+        }
+    }
+
+    if ((optind >= argc) || (speed <= 0))
+    {
+        print_usage();
+        return -1;
+    }
+
+    // Only the reception path is needed, the node is never queried
+    if (!Common_init(GATEWAY_ID, GATEWAY_MODEL, GATEWAY_VERSION, SINK_ID)
+        || (WPC_Int_initialize("replay", 0) != 0)
+        || !Proto_data_init())
+    {
+        LOGE("Cannot initialize the library\n");
+        return -1;
+    }
+
+    if (batch_max_events > 0)
+    {
+        WPC_Proto_register_for_data_rx_event_batch(onDataRxEventBatch_cb,
+                                                   batch_max_events,
+                                                   BATCH_MAX_DELAY_MS);
+    }
+    else
+    {
+        WPC_Proto_register_for_data_rx_event(onDataRxEvent_cb);
+    }
+
+    dispatch_f = Replay_platform_get_dispatch();
+    start_ns = get_time_ns();
+
+    for (int i = optind; (i < argc) && (res == 0); i++)
+    {
+        if (!Trace_open(argv[i]))
+        {
+            res = -1;
+            break;
+        }
+
+        if (paced && !Trace_has_timestamps())
+        {
+            LOGW("No timestamps in %s, replayed as fast as possible\n", argv[i]);
+        }
+
+        while ((res = Trace_read(&frame)) > 0)
+        {
+            // Requests, confirms and responses are not dispatched
+            if (!frame.from_node || (frame.frame.primitive_id >= SAP_CONFIRM_OFFSET))
+            {
+                skipped++;
+                continue;
+            }
+
+            if (paced && (frame.timestamp_us != 0))
+            {
+                if (first_trace_us == 0)
+                {
+                    first_trace_us = frame.timestamp_us;
+                }
+                else if (frame.timestamp_us > first_trace_us)
+                {
+                    wait_until_ns(start_ns
+                                  + (uint64_t) ((frame.timestamp_us - first_trace_us)
+                                                * 1000 / speed));
+                }
+            }
+
+            if (!dispatch_frame(dispatch_f, &frame))
+            {
+                res = -1;
+                break;
+            }
+            frames++;
+
+            Replay_platform_run_works();
+        }
+
+        Trace_close();
+    }
+
+    // Deliver the pending batches before the report
+    Proto_data_close();
+    WPC_Int_close();
+
+    print_report(frames, skipped, get_time_ns() - start_ns);
+
+    if ((expected_events >= 0) && ((unsigned long) expected_events != m_events))
+    {
+        LOGE("%lu events delivered, %ld expected\n", m_events, expected_events);
+        res = -1;
+    }
+
+    return res == 0 ? 0 : -1;
+}
@@ -0,0 +1,365 @@
+/* Wirepas Oy licensed under Apache License, Version 2.0
+ *
+ * See file LICENSE for full license details.
+ *
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+
+#define LOG_MODULE_NAME "replay_plat"
+#define MAX_LOG_LEVEL INFO_LOG_LEVEL
+#include "logger.h"
+#include "replay_platform.h"
+#include "serial.h"
+
+/*
+ * Platform and serial implementation used to replay a trace in process.
+ * Frames are never polled from a node: the replay loop gives them directly to
+ * the dispatch function registered by the library.
+ */
+
+// Maximum number of works scheduled at the same time on a worker
+#define MAX_NUMBER_PENDING_WORKS 4
+
+typedef struct
+{
+    Platform_work_f work;
+    unsigned long long deadline_ms;
+} pending_work_t;
+
+// Works of a worker are executed from the replay loop, like the dispatching
+struct platform_worker
+{
+    pending_work_t pending_works[MAX_NUMBER_PENDING_WORKS];
+    struct platform_worker * next_p;
+};
+
+struct platform_mutex
+{
+    pthread_mutex_t mutex;
+};
+
+struct platform_condition
+{
+    pthread_cond_t cond;
+};
+
+static Platform_dispatch_indication_f m_dispatch_indication_f = NULL;
+
+// Worker used by Platform_schedule_work, followed by the created ones
+static struct platform_worker m_shared_worker;
+
+// Works are refused once the platform is closed
+static bool m_works_enabled = false;
+
+// Request lock, only taken by the library itself during a replay
+static pthread_mutex_t m_request_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+Platform_dispatch_indication_f Replay_platform_get_dispatch(void)
+{
+    return m_dispatch_indication_f;
+}
+
+void Replay_platform_run_works(void)
+{
+    unsigned long long now = Platform_get_timestamp_ms_monotonic();
+
+    for (struct platform_worker * worker_p = &m_shared_worker;
+         worker_p != NULL;
+         worker_p = worker_p->next_p)
+    {
+        for (int i = 0; i < MAX_NUMBER_PENDING_WORKS; i++)
+        {
+            pending_work_t * pending_p = &worker_p->pending_works[i];
+            Platform_work_f work = pending_p->work;
+
+            if ((work != NULL) && (pending_p->deadline_ms <= now))
+            {
+                // Released first so the work can schedule itself again
+                pending_p->work = NULL;
+                work();
+            }
+        }
+    }
+}
+
+bool Platform_init(Platform_get_indication_f get_indication_f,
+                   Platform_dispatch_indication_f dispatch_indication_f)
+{
+    (void) get_indication_f;
+
+    if (dispatch_indication_f == NULL)
+    {
+        return false;
+    }
+
+    m_dispatch_indication_f = dispatch_indication_f;
+    m_works_enabled = true;
+    return true;
+}
+
+unsigned long long Platform_get_timestamp_ms_epoch()
+{
+    struct timespec spec;
+
+    clock_gettime(CLOCK_REALTIME, &spec);
+    return ((unsigned long long) spec.tv_sec) * 1000 + (spec.tv_nsec) / 1000 / 1000;
+}
+
+unsigned long long Platform_get_timestamp_ms_monotonic()
+{
+    struct timespec spec;
+
+    clock_gettime(CLOCK_MONOTONIC, &spec);
+    return ((unsigned long long) spec.tv_sec) * 1000 + (spec.tv_nsec) / 1000 / 1000;
+}
+
+unsigned long long Platform_get_timestamp_us_monotonic()
+{
+    struct timespec spec;
+
+    clock_gettime(CLOCK_MONOTONIC_RAW, &spec);
+    return ((unsigned long long) spec.tv_sec) * 1000 * 1000 + (spec.tv_nsec) / 1000;
+}
+
+unsigned long long Platform_timestamp_us_monotonic_to_epoch(unsigned long long timestamp_us)
+{
+    struct timespec spec;
+
+    clock_gettime(CLOCK_REALTIME, &spec);
+    return ((unsigned long long) spec.tv_sec) * 1000 * 1000 + (spec.tv_nsec) / 1000
+           - (Platform_get_timestamp_us_monotonic() - timestamp_us);
+}
+
+void Platform_usleep(unsigned int time_us)
+{
+    usleep(time_us);
+}
+
+uintptr_t Platform_get_thread_id(void)
+{
+    return (uintptr_t) pthread_self();
+}
+
+bool Platform_lock_request()
+{
+    return pthread_mutex_lock(&m_request_mutex) == 0;
+}
+
+void Platform_unlock_request()
+{
+    pthread_mutex_unlock(&m_request_mutex);
+}
+
+void * Platform_malloc(size_t size)
+{
+    return malloc(size);
+}
+
+void Platform_free(void * ptr, size_t size)
+{
+    (void) size;
+    free(ptr);
+}
+
+bool Platform_worker_schedule(platform_worker_t * worker_p,
+                              Platform_work_f work,
+                              unsigned int delay_ms)
+{
+    int free_slot = -1;
+
+    if (!m_works_enabled)
+    {
+        return false;
+    }
+
+    for (int i = 0; i < MAX_NUMBER_PENDING_WORKS; i++)
+    {
+        if (worker_p->pending_works[i].work == work)
+        {
+            // Already pending, merged with it
+            return true;
+        }
+
+        if ((worker_p->pending_works[i].work == NULL) && (free_slot < 0))
+        {
+            free_slot = i;
+        }
+    }
+
+    if (free_slot < 0)
+    {
+        LOGW("Cannot schedule work\n");
+        return false;
+    }
+
+    worker_p->pending_works[free_slot].work = work;
+    worker_p->pending_works[free_slot].deadline_ms =
+        Platform_get_timestamp_ms_monotonic() + delay_ms;
+    return true;
+}
+
+bool Platform_schedule_work(Platform_work_f work, unsigned int delay_ms)
+{
+    return Platform_worker_schedule(&m_shared_worker, work, delay_ms);
+}
+
+platform_worker_t * Platform_worker_create(void)
+{
+    struct platform_worker * worker_p = calloc(1, sizeof(struct platform_worker));
+
+    if (worker_p != NULL)
+    {
+        worker_p->next_p = m_shared_worker.next_p;
+        m_shared_worker.next_p = worker_p;
+    }
+    return worker_p;
+}
+
+void Platform_worker_delete(platform_worker_t * worker_p)
+{
+    for (struct platform_worker * prev_p = &m_shared_worker;
+         prev_p != NULL;
+         prev_p = prev_p->next_p)
+    {
+        if (prev_p->next_p == worker_p)
+        {
+            prev_p->next_p = worker_p->next_p;
+            break;
+        }
+    }
+    free(worker_p);
+}
+
+platform_mutex_t * Platform_mutex_create(void)
+{
+    struct platform_mutex * mutex_p = malloc(sizeof(struct platform_mutex));
+
+    if ((mutex_p != NULL) && (pthread_mutex_init(&mutex_p->mutex, NULL) != 0))
+    {
+        free(mutex_p);
+        mutex_p = NULL;
+    }
+    return mutex_p;
+}
+
+void Platform_mutex_lock(platform_mutex_t * mutex_p)
+{
+    pthread_mutex_lock(&mutex_p->mutex);
+}
+
+bool Platform_mutex_trylock(platform_mutex_t * mutex_p)
+{
+    return pthread_mutex_trylock(&mutex_p->mutex) == 0;
+}
+
+void Platform_mutex_unlock(platform_mutex_t * mutex_p)
+{
+    pthread_mutex_unlock(&mutex_p->mutex);
+}
+
+void Platform_mutex_delete(platform_mutex_t * mutex_p)
+{
+    pthread_mutex_destroy(&mutex_p->mutex);
+    free(mutex_p);
+}
+
+platform_condition_t * Platform_condition_create(void)
+{
+    struct platform_condition * cond_p = malloc(sizeof(struct platform_condition));
+
+    if ((cond_p != NULL) && (pthread_cond_init(&cond_p->cond, NULL) != 0))
+    {
+        free(cond_p);
+        cond_p = NULL;
+    }
+    return cond_p;
+}
+
+void Platform_condition_wait(platform_condition_t * cond_p, platform_mutex_t * mutex_p)
+{
+    pthread_cond_wait(&cond_p->cond, &mutex_p->mutex);
+}
+
+void Platform_condition_broadcast(platform_condition_t * cond_p)
+{
+    pthread_cond_broadcast(&cond_p->cond);
+}
+
+void Platform_condition_delete(platform_condition_t * cond_p)
+{
+    pthread_cond_destroy(&cond_p->cond);
+    free(cond_p);
+}
+
+bool Platform_capture_start(const char * path, size_t max_file_size, unsigned int max_files)
+{
+    (void) path;
+    (void) max_file_size;
+    (void) max_files;
+
+    LOGE("Frame capture is not available during a replay\n");
+    return false;
+}
+
+void Platform_capture_frame(bool from_node, const uint8_t * frame_p, size_t size)
+{
+    (void) from_node;
+    (void) frame_p;
+    (void) size;
+}
+
+void Platform_capture_stop(void)
+{
+}
+
+void Platform_close()
+{
+    m_dispatch_indication_f = NULL;
+    m_works_enabled = false;
+
+    // Pending works are dropped, as on linux
+    for (struct platform_worker * worker_p = &m_shared_worker;
+         worker_p != NULL;
+         worker_p = worker_p->next_p)
+    {
+        memset(worker_p->pending_works, 0, sizeof(worker_p->pending_works));
+    }
+}
+
+/*
+ * No serial line during a replay: nothing is ever answered to requests
+ */
+int Serial_open(const char * port_name, unsigned long bitrate)
+{
+    (void) port_name;
+    (void) bitrate;
+    return 0;
+}
+
+int Serial_set_bitrate(unsigned long bitrate)
+{
+    (void) bitrate;
+    return 0;
+}
+
+int Serial_close(void)
+{
+    return 0;
+}
+
+int Serial_read(unsigned char * c, unsigned int timeout_ms)
+{
+    (void) c;
+    (void) timeout_ms;
+    return 0;
+}
+
+int Serial_write(const unsigned char * buffer, unsigned int buffer_size)
+{
+    (void) buffer;
+    return buffer_size;
+}
@@ -0,0 +1,26 @@
+/* Wirepas Oy licensed under Apache License, Version 2.0
+ *
+ * See file LICENSE for full license details.
+ *
+ */
+#ifndef REPLAY_PLATFORM_H_
+#define REPLAY_PLATFORM_H_
+
+#include "platform.h"
+
+/**
+ * \brief   Get the dispatch function given by the library to Platform_init
+ * \return  The function, NULL if the library is not initialized
+ * \note    There is no dispatching thread in the replay platform, frames
+ *          are dispatched directly from the caller context
+ */
+Platform_dispatch_indication_f Replay_platform_get_dispatch(void);
+
+/**
+ * \brief   Execute the scheduled works that are due
+ * \note    There is no worker thread in the replay platform, it must be
+ *          called regularly from the replay loop
+ */
+void Replay_platform_run_works(void);
+
+#endif
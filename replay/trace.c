@@ -0,0 +1,351 @@
+/* Wirepas Oy licensed under Apache License, Version 2.0
+ *
+ * See file LICENSE for full license details.
+ *
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "trace.h"
+#include "slip.h"
+
+#define LOG_MODULE_NAME "trace"
+#define MAX_LOG_LEVEL INFO_LOG_LEVEL
+#include "logger.h"
+
+// Block types and options used from the pcapng format
+#define PCAPNG_SHB_TYPE             0x0A0D0D0A
+#define PCAPNG_IDB_TYPE             0x00000001
+#define PCAPNG_EPB_TYPE             0x00000006
+#define PCAPNG_BYTE_ORDER_MAGIC     0x1A2B3C4D
+#define PCAPNG_OPT_END              0
+#define PCAPNG_OPT_IF_TSRESOL       9
+#define PCAPNG_OPT_EPB_FLAGS        2
+#define PCAPNG_EPB_FLAGS_INBOUND    1
+#define PCAPNG_EPB_FLAGS_OUTBOUND   2
+
+// Fixed part of the blocks (without the 8 bytes header)
+#define PCAPNG_IDB_FIXED_SIZE       8
+#define PCAPNG_EPB_FIXED_SIZE       20
+
+// Bigger blocks are skipped, frames are far smaller
+#define PCAPNG_MAX_BLOCK_SIZE       (64 * 1024)
+
+// Interfaces described in a section, a capture uses only one
+#define PCAPNG_MAX_INTERFACES       8
+
+// Timeout given to slip when reading a raw trace. Unused, end of file is
+// reported as a timeout
+#define RAW_READ_TIMEOUT_MS         1
+
+typedef struct
+{
+    uint32_t link_type;
+    uint64_t ticks_per_second;
+} interface_t;
+
+static FILE * m_file = NULL;
+static bool m_raw;
+
+static interface_t m_interfaces[PCAPNG_MAX_INTERFACES];
+static unsigned int m_interfaces_count;
+
+static uint8_t m_block[PCAPNG_MAX_BLOCK_SIZE];
+
+static inline uint16_t get_u16(const uint8_t * p)
+{
+    return (uint16_t) (p[0] | (p[1] << 8));
+}
+
+static inline uint32_t get_u32(const uint8_t * p)
+{
+    return (uint32_t) p[0] | ((uint32_t) p[1] << 8) | ((uint32_t) p[2] << 16)
+           | ((uint32_t) p[3] << 24);
+}
+
+/**
+ * \brief   Read function given to slip for raw traces
+ */
+static int read_raw_byte(unsigned char * c, unsigned int timeout_ms)
+{
+    (void) timeout_ms;
+    int value = fgetc(m_file);
+    if (value == EOF)
+    {
+        return 0;
+    }
+    *c = (unsigned char) value;
+    return 1;
+}
+
+/**
+ * \brief   Write function given to slip, nothing is sent during a replay
+ */
+static int write_nothing(const unsigned char * buffer, unsigned int buffer_size)
+{
+    (void) buffer;
+    return buffer_size;
+}
+
+/**
+ * \brief   Find an option in a list of options
+ * \return  Pointer to the option value, NULL if not found
+ */
+static const uint8_t * find_option(const uint8_t * options_p,
+                                   size_t size,
+                                   uint16_t code,
+                                   uint16_t * length_p)
+{
+    while (size >= 4)
+    {
+        uint16_t option_code = get_u16(options_p);
+        uint16_t option_length = get_u16(options_p + 2);
+        size_t padded_length = (option_length + 3u) & ~3u;
+
+        if ((option_code == PCAPNG_OPT_END) || (4 + padded_length > size))
+        {
+            break;
+        }
+        if (option_code == code)
+        {
+            *length_p = option_length;
+            return options_p + 4;
+        }
+        options_p += 4 + padded_length;
+        size -= 4 + padded_length;
+    }
+    return NULL;
+}
+
+static void add_interface(const uint8_t * body_p, size_t size)
+{
+    interface_t * interface_p;
+    const uint8_t * tsresol_p;
+    uint16_t length;
+
+    if ((m_interfaces_count >= PCAPNG_MAX_INTERFACES) || (size < PCAPNG_IDB_FIXED_SIZE))
+    {
+        LOGW("Interface ignored\n");
+        return;
+    }
+
+    interface_p = &m_interfaces[m_interfaces_count++];
+    interface_p->link_type = get_u16(body_p);
+    interface_p->ticks_per_second = 1000000;
+
+    tsresol_p = find_option(body_p + PCAPNG_IDB_FIXED_SIZE,
+                            size - PCAPNG_IDB_FIXED_SIZE,
+                            PCAPNG_OPT_IF_TSRESOL,
+                            &length);
+    if ((tsresol_p != NULL) && (length == 1))
+    {
+        if (*tsresol_p & 0x80)
+        {
+            interface_p->ticks_per_second = 1ULL << (*tsresol_p & 0x7F);
+        }
+        else
+        {
+            interface_p->ticks_per_second = 1;
+            for (int i = 0; i < *tsresol_p; i++)
+            {
+                interface_p->ticks_per_second *= 10;
+            }
+        }
+    }
+}
+
+/**
+ * \brief   Fill a frame from an Enhanced Packet Block
+ * \return  True if the block contains a frame
+ */
+static bool parse_packet(const uint8_t * body_p, size_t size, trace_frame_t * frame_p)
+{
+    uint32_t interface_id, captured_size;
+    uint64_t ticks, ticks_per_second;
+    size_t padded_size;
+    const uint8_t * flags_p;
+    uint16_t length;
+
+    if (size < PCAPNG_EPB_FIXED_SIZE)
+    {
+        return false;
+    }
+
+    interface_id = get_u32(body_p);
+    ticks = ((uint64_t) get_u32(body_p + 4) << 32) | get_u32(body_p + 8);
+    captured_size = get_u32(body_p + 12);
+    padded_size = (captured_size + 3u) & ~3u;
+
+    if ((interface_id >= m_interfaces_count)
+        || (PCAPNG_EPB_FIXED_SIZE + padded_size > size))
+    {
+        LOGW("Invalid packet block\n");
+        return false;
+    }
+
+    if ((captured_size < 3) || (captured_size > sizeof(wpc_frame_t)))
+    {
+        LOGW("Frame of %u bytes ignored\n", captured_size);
+        return false;
+    }
+
+    ticks_per_second = m_interfaces[interface_id].ticks_per_second;
+    if (ticks_per_second >= 1000000)
+    {
+        frame_p->timestamp_us = ticks / (ticks_per_second / 1000000);
+    }
+    else
+    {
+        frame_p->timestamp_us = ticks * (1000000 / ticks_per_second);
+    }
+
+    // Frames without direction are handled as received from the node
+    frame_p->from_node = true;
+    flags_p = find_option(body_p + PCAPNG_EPB_FIXED_SIZE + padded_size,
+                          size - PCAPNG_EPB_FIXED_SIZE - padded_size,
+                          PCAPNG_OPT_EPB_FLAGS,
+                          &length);
+    if ((flags_p != NULL) && (length == 4))
+    {
+        frame_p->from_node = (get_u32(flags_p) & 0x3) != PCAPNG_EPB_FLAGS_OUTBOUND;
+    }
+
+    frame_p->size = captured_size;
+    memcpy(&frame_p->frame, body_p + PCAPNG_EPB_FIXED_SIZE, captured_size);
+    return true;
+}
+
+static int read_pcapng(trace_frame_t * frame_p)
+{
+    uint8_t header[8];
+    uint32_t type, total_size, body_size;
+
+    while (fread(header, 1, sizeof(header), m_file) == sizeof(header))
+    {
+        type = get_u32(header);
+        total_size = get_u32(header + 4);
+        if ((total_size < 12) || (total_size % 4 != 0))
+        {
+            LOGE("Invalid block size %u\n", total_size);
+            return -1;
+        }
+
+        // Body and trailing total size
+        body_size = total_size - 12;
+        if (body_size > sizeof(m_block))
+        {
+            fseek(m_file, body_size + 4, SEEK_CUR);
+            continue;
+        }
+        if (fread(m_block, 1, body_size + 4, m_file) != body_size + 4)
+        {
+            LOGW("Truncated block at the end of the trace\n");
+            return 0;
+        }
+
+        switch (type)
+        {
+            case PCAPNG_SHB_TYPE:
+                if ((body_size < 4) || (get_u32(m_block) != PCAPNG_BYTE_ORDER_MAGIC))
+                {
+                    LOGE("Only little endian traces are supported\n");
+                    return -1;
+                }
+                // A new section has its own interfaces
+                m_interfaces_count = 0;
+                break;
+            case PCAPNG_IDB_TYPE:
+                add_interface(m_block, body_size);
+                break;
+            case PCAPNG_EPB_TYPE:
+                if (parse_packet(m_block, body_size, frame_p))
+                {
+                    return 1;
+                }
+                break;
+            default:
+                // Other blocks are not needed
+                break;
+        }
+    }
+
+    return 0;
+}
+
+static int read_raw(trace_frame_t * frame_p)
+{
+    int res;
+
+    while (true)
+    {
+        res = Slip_get_buffer((uint8_t *) &frame_p->frame,
+                              sizeof(frame_p->frame),
+                              RAW_READ_TIMEOUT_MS);
+        if (res >= 3 && (size_t) res <= sizeof(frame_p->frame))
+        {
+            frame_p->timestamp_us = 0;
+            frame_p->from_node = true;
+            frame_p->size = res;
+            return 1;
+        }
+
+        if (feof(m_file))
+        {
+            return 0;
+        }
+
+        // Corrupted frames are skipped, as the library would do
+        LOGW("Invalid frame in raw trace (%d)\n", res);
+    }
+}
+
+bool Trace_open(const char * path)
+{
+    uint8_t header[12];
+
+    m_file = fopen(path, "rb");
+    if (m_file == NULL)
+    {
+        LOGE("Cannot open %s: %s\n", path, strerror(errno));
+        return false;
+    }
+
+    m_interfaces_count = 0;
+    m_raw = (fread(header, 1, sizeof(header), m_file) != sizeof(header))
+            || (get_u32(header) != PCAPNG_SHB_TYPE)
+            || (get_u32(header + 8) != PCAPNG_BYTE_ORDER_MAGIC);
+    rewind(m_file);
+
+    if (m_raw)
+    {
+        Slip_init(write_nothing, read_raw_byte);
+    }
+
+    LOGI("Replaying %s trace %s\n", m_raw ? "raw" : "pcapng", path);
+    return true;
+}
+
+bool Trace_has_timestamps(void)
+{
+    return !m_raw;
+}
+
+int Trace_read(trace_frame_t * frame_p)
+{
+    if (m_file == NULL)
+    {
+        return -1;
+    }
+
+    return m_raw ? read_raw(frame_p) : read_pcapng(frame_p);
+}
+
+void Trace_close(void)
+{
+    if (m_file != NULL)
+    {
+        fclose(m_file);
+        m_file = NULL;
+    }
+}
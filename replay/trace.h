@@ -0,0 +1,58 @@
+/* Wirepas Oy licensed under Apache License, Version 2.0
+ *
+ * See file LICENSE for full license details.
+ *
+ */
+#ifndef TRACE_H_
+#define TRACE_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "wpc_types.h"
+
+/**
+ * \brief   A frame read from a trace
+ */
+typedef struct
+{
+    uint64_t timestamp_us;  //< Capture time in us since epoch, 0 if unknown
+    bool from_node;         //< True if the frame was sent by the node
+    size_t size;            //< Size of the frame in bytes
+    wpc_frame_t frame;      //< The frame without slip encoding and crc
+} trace_frame_t;
+
+/**
+ * \brief   Open a trace
+ * \param   path
+ *          Path of the trace. A pcapng file as written by the frame capture
+ *          (WPC_start_frame_capture) or a raw slip encoded byte stream as read
+ *          from the serial line. Format is detected from the content
+ * \return  True if successful, False otherwise
+ * \note    Raw traces are decoded with the slip module of the library, so it
+ *          must be called after the library is initialized
+ */
+bool Trace_open(const char * path);
+
+/**
+ * \brief   Tell if the frames of the opened trace are timestamped
+ * \return  True for pcapng traces, False for raw traces
+ */
+bool Trace_has_timestamps(void);
+
+/**
+ * \brief   Read the next frame of the trace
+ * \param   frame_p
+ *          Where to store the frame
+ * \return  1 if a frame is read, 0 at the end of the trace,
+ *          a negative value if the trace is corrupted
+ */
+int Trace_read(trace_frame_t * frame_p);
+
+/**
+ * \brief   Close the trace
+ */
+void Trace_close(void);
+
+#endif
@@ -266,6 +266,38 @@ TEST_F(WpcCallbackTest, testStackStatus)
     ASSERT_EQ(APP_RES_OK, WPC_start_stack());
 }
 
+TEST_F(WpcCallbackTest, testStopStackAsync)
+{
+    ASSERT_EQ(APP_RES_OK, WPC_stop_stack_async(onStackStatusReceived));
+
+    // Only one stop can be pending at a time
+    ASSERT_EQ(APP_RES_ALREADY_REGISTERED, WPC_stop_stack_async(onStackStatusReceived));
+
+    ASSERT_NO_FATAL_FAILURE(stack_status_cb.WaitForCallback(60));
+
+    {
+        std::lock_guard<std::mutex> lock(stack_status_cb.mutex);
+        ASSERT_NE(APP_STACK_STATUS_NO_REBOOT, stack_status_cb.status);
+        // bit 0: 0 = running, 1 = stopped
+        ASSERT_EQ(1, (stack_status_cb.status & 1));
+    }
+
+    ASSERT_EQ(APP_RES_OK, WPC_start_stack());
+}
+
+TEST_F(WpcCallbackTest, testCancelStopStackAsync)
+{
+    ASSERT_EQ(APP_RES_NOT_REGISTERED, WPC_cancel_stop_stack_async());
+
+    ASSERT_EQ(APP_RES_OK, WPC_stop_stack_async(onStackStatusReceived));
+    ASSERT_EQ(APP_RES_OK, WPC_cancel_stop_stack_async());
+    ASSERT_EQ(APP_RES_NOT_REGISTERED, WPC_cancel_stop_stack_async());
+
+    // Node reboots anyway, wait for it before restarting the stack
+    ASSERT_NO_FATAL_FAILURE(WpcTest::StopStack());
+    ASSERT_EQ(APP_RES_OK, WPC_start_stack());
+}
+
 TEST_F(WpcCallbackTest, testScanNeighbors)
 {
     ASSERT_EQ(APP_RES_OK, WPC_register_for_scan_neighbors_done(onScanNeighborsDone));
@@ -1,5 +1,13 @@
 #include "wpc_test.hpp"
 
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+extern "C" {
+  #include <serial.h>
+}
+
 class WpcGeneralTestStackOff : public WpcTest
 {
 public:
@@ -284,3 +292,181 @@ TEST_F(WpcGeneralTestStackOn, testReadMSAPAttributes)
     RecordProperty("current_access_cycle", (long) res16);
 }
 
+
+static void onLinkStatusChanged(bool link_up)
+{
+    (void) link_up;
+}
+
+static std::atomic<int> m_link_down_count;
+static std::atomic<int> m_link_up_count;
+
+static void onLinkStatusRecorded(bool link_up)
+{
+    if (link_up)
+    {
+        m_link_up_count++;
+    }
+    else
+    {
+        m_link_down_count++;
+    }
+}
+
+static bool waitForCount(const std::atomic<int> & count, int expected, std::chrono::milliseconds timeout)
+{
+    const auto deadline = std::chrono::steady_clock::now() + timeout;
+    while (count < expected)
+    {
+        if (std::chrono::steady_clock::now() > deadline)
+        {
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    return true;
+}
+
+TEST_F(WpcGeneralTestStackOn, testLinkRecoverySettings)
+{
+    ASSERT_EQ(APP_RES_INVALID_VALUE, WPC_set_link_recovery_backoff(0, 1000));
+    ASSERT_EQ(APP_RES_INVALID_VALUE, WPC_set_link_recovery_backoff(2000, 1000));
+    ASSERT_EQ(APP_RES_OK, WPC_set_link_recovery_backoff(500, 10000));
+
+    ASSERT_EQ(APP_RES_OK, WPC_register_for_link_status(onLinkStatusChanged));
+    ASSERT_EQ(APP_RES_ALREADY_REGISTERED, WPC_register_for_link_status(onLinkStatusChanged));
+    ASSERT_EQ(APP_RES_OK, WPC_unregister_from_link_status());
+    ASSERT_EQ(APP_RES_NOT_REGISTERED, WPC_unregister_from_link_status());
+}
+
+TEST_F(WpcGeneralTestStackOff, testLinkRecovery)
+{
+    // Recovery is delayed, so that the link stays down long enough to check
+    // the requests during that time
+    const unsigned int RECOVERY_DELAY_MS = 3000;
+    uint8_t status;
+
+    m_link_down_count = 0;
+    m_link_up_count = 0;
+    ASSERT_EQ(APP_RES_OK, WPC_set_max_poll_fail_duration(1));
+    ASSERT_EQ(APP_RES_OK, WPC_set_link_recovery_backoff(RECOVERY_DELAY_MS, RECOVERY_DELAY_MS));
+    ASSERT_EQ(APP_RES_OK, WPC_register_for_link_status(onLinkStatusRecorded));
+
+    // Force a timeout by closing the serial port under the library. Serial
+    // layer reopens the last port opened on next write, so point it to a
+    // port that doesn't exist: only the link recovery reopens the real one
+    Serial_close();
+    ASSERT_NE(0, Serial_open("/dev/wpc_test_no_port", 125000));
+
+    ASSERT_TRUE(waitForCount(m_link_down_count, 1, std::chrono::seconds(5)));
+    ASSERT_EQ(0, m_link_up_count);
+
+    // Requests fail without waiting for a confirm while link is down
+    const auto start = std::chrono::steady_clock::now();
+    ASSERT_NE(APP_RES_OK, WPC_get_stack_status(&status));
+    ASSERT_LT(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(100));
+
+    ASSERT_TRUE(waitForCount(m_link_up_count, 1, std::chrono::milliseconds(RECOVERY_DELAY_MS * 2)));
+    ASSERT_EQ(1, m_link_down_count);
+    ASSERT_EQ(APP_RES_OK, WPC_get_stack_status(&status));
+
+    // Restore default settings
+    ASSERT_EQ(APP_RES_OK, WPC_unregister_from_link_status());
+    ASSERT_EQ(APP_RES_OK, WPC_set_link_recovery_backoff(1000, 30000));
+    ASSERT_EQ(APP_RES_OK, WPC_set_max_poll_fail_duration(60));
+}
+
+TEST_F(WpcGeneralTestStackOff, testBulkTransferModeFallback)
+{
+    // No sink exposes this attribute, so the mode cannot be entered and
+    // the link must stay usable at its nominal bitrate
+    const uint16_t UNKNOWN_ATTRIBUTE_ID = 0xFFFF;
+    uint8_t mtu;
+
+    ASSERT_EQ(APP_RES_INVALID_VALUE, WPC_start_bulk_transfer_mode(0, 1000000));
+    ASSERT_NE(APP_RES_OK, WPC_start_bulk_transfer_mode(UNKNOWN_ATTRIBUTE_ID, 1000000));
+    ASSERT_EQ(APP_RES_OK, WPC_get_mtu(&mtu));
+
+    // Not in bulk transfer mode, nothing to do
+    ASSERT_EQ(APP_RES_OK, WPC_stop_bulk_transfer_mode());
+}
+
+TEST_F(WpcGeneralTestStackOff, testAttributeCache)
+{
+    uint32_t hits, misses;
+    uint8_t mtu_from_node, mtu_from_cache;
+
+    ASSERT_EQ(APP_RES_OK, WPC_enable_attribute_cache(true));
+    ASSERT_EQ(APP_RES_OK, WPC_get_attribute_cache_stats(&hits, &misses));
+
+    ASSERT_EQ(APP_RES_OK, WPC_get_mtu(&mtu_from_node));
+    ASSERT_EQ(APP_RES_OK, WPC_get_mtu(&mtu_from_cache));
+    ASSERT_EQ(mtu_from_node, mtu_from_cache);
+
+    uint32_t new_hits, new_misses;
+    ASSERT_EQ(APP_RES_OK, WPC_get_attribute_cache_stats(&new_hits, &new_misses));
+    ASSERT_EQ(hits + 1, new_hits);
+    ASSERT_EQ(misses + 1, new_misses);
+
+    // A write must update the cached value
+    const app_addr_t TEST_NODE_ADDRESS = 4321;
+    app_addr_t node_address;
+    ASSERT_EQ(APP_RES_OK, WPC_set_node_address(TEST_NODE_ADDRESS));
+    ASSERT_EQ(APP_RES_OK, WPC_get_node_address(&node_address));
+    ASSERT_EQ(TEST_NODE_ADDRESS, node_address);
+
+    ASSERT_EQ(APP_RES_OK, WPC_enable_attribute_cache(false));
+}
+
+TEST_F(WpcGeneralTestStackOff, testAttributeCacheable)
+{
+    // Attribute ids from Dual MCU API
+    const uint16_t MTU_ID = 5;
+    const uint16_t UNKNOWN_ATTRIBUTE_ID = 0xFFFF;
+    uint32_t hits, misses, new_hits, new_misses;
+    uint8_t mtu;
+
+    ASSERT_EQ(APP_RES_INVALID_VALUE, WPC_set_attribute_cacheable(APP_ATTR_CSAP, UNKNOWN_ATTRIBUTE_ID, true));
+
+    ASSERT_EQ(APP_RES_OK, WPC_enable_attribute_cache(true));
+    ASSERT_EQ(APP_RES_OK, WPC_set_attribute_cacheable(APP_ATTR_CSAP, MTU_ID, false));
+    ASSERT_EQ(APP_RES_OK, WPC_get_attribute_cache_stats(&hits, &misses));
+
+    // Not cacheable anymore, always read from node
+    ASSERT_EQ(APP_RES_OK, WPC_get_mtu(&mtu));
+    ASSERT_EQ(APP_RES_OK, WPC_get_mtu(&mtu));
+    ASSERT_EQ(APP_RES_OK, WPC_get_attribute_cache_stats(&new_hits, &new_misses));
+    ASSERT_EQ(hits, new_hits);
+
+    ASSERT_EQ(APP_RES_OK, WPC_set_attribute_cacheable(APP_ATTR_CSAP, MTU_ID, true));
+    ASSERT_EQ(APP_RES_OK, WPC_get_mtu(&mtu));
+    ASSERT_EQ(APP_RES_OK, WPC_get_mtu(&mtu));
+    ASSERT_EQ(APP_RES_OK, WPC_get_attribute_cache_stats(&new_hits, &new_misses));
+    ASSERT_EQ(hits + 1, new_hits);
+
+    ASSERT_EQ(APP_RES_OK, WPC_enable_attribute_cache(false));
+}
+
+TEST_F(WpcGeneralTestStackOff, testAttributeBatchRead)
+{
+    uint8_t mtu, pdus, batch_mtu, batch_pdus;
+    unsigned long long timestamp_ms_epoch = 0;
+
+    ASSERT_EQ(APP_RES_OK, WPC_get_mtu(&mtu));
+    ASSERT_EQ(APP_RES_OK, WPC_get_pdu_buffer_size(&pdus));
+
+    // Ids from Dual MCU API: 5 is MTU, 6 is PDU buffer size
+    app_attr_req_t reqs[] = {
+        { APP_ATTR_CSAP, 5, 1, &batch_mtu, APP_RES_INTERNAL_ERROR },
+        { APP_ATTR_CSAP, 6, 1, &batch_pdus, APP_RES_INTERNAL_ERROR },
+    };
+
+    ASSERT_EQ(APP_RES_OK, WPC_attribute_batch_read(reqs, 2, &timestamp_ms_epoch));
+    ASSERT_EQ(APP_RES_OK, reqs[0].result);
+    ASSERT_EQ(APP_RES_OK, reqs[1].result);
+    ASSERT_EQ(mtu, batch_mtu);
+    ASSERT_EQ(pdus, batch_pdus);
+    ASSERT_NE(0ULL, timestamp_ms_epoch);
+
+    ASSERT_EQ(APP_RES_INVALID_VALUE, WPC_attribute_batch_read(reqs, 0, NULL));
+}
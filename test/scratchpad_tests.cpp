@@ -1,3 +1,5 @@
+#include <fcntl.h>
+#include <unistd.h>
 #include <fstream>
 #include <filesystem>
 #include <gtest/gtest.h>
@@ -95,6 +97,52 @@ TEST_F(WpcScratchpadTest, testUploadAndClearScratchpad)
     ASSERT_EQ(0, seq);
 }
 
+TEST_F(WpcScratchpadTest, testResumableUploadFromFd)
+{
+    static uint32_t last_progress;
+    last_progress = 0;
+    const auto size = std::filesystem::file_size(OTAP_UPLOAD_FILE_PATH);
+
+    const int fd = open(OTAP_UPLOAD_FILE_PATH.c_str(), O_RDONLY);
+    ASSERT_GE(fd, 0);
+
+    const uint8_t TEST_SEQ = 77;
+    uint32_t offset = 0;
+    const app_res_e res = WPC_upload_local_scratchpad_from_fd(fd,
+                                                              size,
+                                                              TEST_SEQ,
+                                                              &offset,
+                                                              [](uint32_t uploaded, uint32_t total) {
+                                                                  ASSERT_GT(uploaded, last_progress);
+                                                                  ASSERT_LE(uploaded, total);
+                                                                  last_progress = uploaded;
+                                                              });
+    close(fd);
+
+    ASSERT_EQ(APP_RES_OK, res);
+    ASSERT_EQ(size, offset);
+    ASSERT_EQ(size, last_progress);
+    ASSERT_NO_FATAL_FAILURE(VerifyUploadedScratchpad(TEST_SEQ, size));
+}
+
+TEST_F(WpcScratchpadTest, testResumeUploadFromOffset)
+{
+    const auto buffer = ReadUploadFile();
+    const uint32_t MAX_BLOCK_SIZE = 32;
+    ASSERT_LT(MAX_BLOCK_SIZE, buffer.size());
+
+    // Simulate an interrupted upload: only the first block was acknowledged
+    const uint8_t TEST_SEQ = 78;
+    ASSERT_EQ(APP_RES_OK, WPC_start_local_scratchpad_update(buffer.size(), TEST_SEQ));
+    ASSERT_EQ(APP_RES_OK, WPC_upload_local_block_scratchpad(MAX_BLOCK_SIZE, buffer.data(), 0));
+
+    uint32_t offset = MAX_BLOCK_SIZE;
+    ASSERT_EQ(APP_RES_OK,
+              WPC_upload_local_scratchpad_resumable(buffer.size(), buffer.data(), TEST_SEQ, &offset, NULL));
+    ASSERT_EQ(buffer.size(), offset);
+    ASSERT_NO_FATAL_FAILURE(VerifyUploadedScratchpad(TEST_SEQ, buffer.size()));
+}
+
 TEST_F(WpcScratchpadTest, testUploadAndDownloadScratchpadInBlocks)
 {
     const auto upload_buffer = ReadUploadFile();
@@ -0,0 +1,27 @@
+#include "wpc_test.hpp"
+#include <gtest/gtest.h>
+
+extern "C" {
+  #include <slip.h>
+}
+
+// Slip encoding doesn't need a node, so the test is not a WpcTest
+
+TEST(SlipTest, testEncodeDecodeLongFrame)
+{
+    // Bigger than 255 bytes, with bytes to escape all along the frame
+    const uint32_t FRAME_SIZE = 600;
+    uint8_t frame[FRAME_SIZE];
+    uint8_t encoded[RECOMMENDED_BUFFER_SIZE(FRAME_SIZE)];
+
+    for (uint32_t i = 0; i < FRAME_SIZE; i++)
+    {
+        frame[i] = (i % 3 == 0) ? 0xC0 : i & 0xFF;
+    }
+
+    const int encoded_size = Slip_encode(frame, FRAME_SIZE, encoded, sizeof(encoded));
+    ASSERT_GT(encoded_size, (int) FRAME_SIZE + 2);
+
+    ASSERT_EQ((int) FRAME_SIZE, Slip_decode(encoded, encoded_size));
+    ASSERT_EQ_ARRAY(frame, encoded, FRAME_SIZE);
+}
@@ -0,0 +1,208 @@
+-- Wirepas Oy licensed under Apache License, Version 2.0
+--
+-- See file LICENSE for full license details.
+--
+-- Wireshark dissector for the frames captured with WPC_start_frame_capture().
+-- Frames are the SAP primitives exchanged with the node on the serial link,
+-- without slip encoding and crc (link type USER0).
+--
+-- Usage: wireshark -X lua_script:wpc_sap.lua capture.pcapng.0
+-- or copy it to the Wireshark personal plugins folder.
+
+local wpc = Proto("wpc", "Wirepas serial SAP")
+
+local CONFIRM_OFFSET = 0x80
+
+local primitives = {
+    [0x01] = "DSAP data TX request",
+    [0x02] = "DSAP data TX indication",
+    [0x03] = "DSAP data RX indication",
+    [0x04] = "MSAP indication poll request",
+    [0x05] = "MSAP stack start request",
+    [0x06] = "MSAP stack stop request",
+    [0x07] = "MSAP stack state indication",
+    [0x0B] = "MSAP attribute write request",
+    [0x0C] = "MSAP attribute read request",
+    [0x0D] = "CSAP attribute write request",
+    [0x0E] = "CSAP attribute read request",
+    [0x0F] = "DSAP data TX fragment request",
+    [0x10] = "DSAP data RX fragment indication",
+    [0x16] = "CSAP factory reset request",
+    [0x17] = "MSAP scratchpad start request",
+    [0x18] = "MSAP scratchpad block request",
+    [0x19] = "MSAP scratchpad status request",
+    [0x1A] = "MSAP scratchpad update request",
+    [0x1B] = "MSAP scratchpad clear request",
+    [0x1F] = "DSAP data TX TT request",
+    [0x20] = "MSAP get neighbors request",
+    [0x21] = "MSAP scan neighbors request",
+    [0x22] = "MSAP scan neighbors indication",
+    [0x26] = "MSAP scratchpad target write request",
+    [0x27] = "MSAP scratchpad target read request",
+    [0x28] = "MSAP scratchpad block read request",
+    [0x29] = "MSAP config data item set request",
+    [0x30] = "MSAP config data item get request",
+    [0x31] = "MSAP config data item RX indication",
+    [0x32] = "MSAP config data item list request",
+    [0x38] = "MSAP sink cost write request",
+    [0x39] = "MSAP sink cost read request",
+    [0x3A] = "MSAP app config data write request",
+    [0x3B] = "MSAP app config data read request",
+    [0x3F] = "MSAP app config data RX indication",
+}
+
+-- Confirms (and responses) are the request (or indication) id + 0x80
+local function primitive_name(id)
+    if id >= CONFIRM_OFFSET then
+        local name = primitives[id - CONFIRM_OFFSET]
+        if name == nil then
+            return "Unknown confirm"
+        end
+        name = name:gsub("request$", "confirm"):gsub("indication$", "response")
+        return name
+    end
+    return primitives[id] or "Unknown"
+end
+
+local f = wpc.fields
+f.primitive_id = ProtoField.uint8("wpc.primitive_id", "Primitive id", base.HEX)
+f.frame_id = ProtoField.uint8("wpc.frame_id", "Frame id", base.DEC)
+f.payload_length = ProtoField.uint8("wpc.payload_length", "Payload length", base.DEC)
+f.payload = ProtoField.bytes("wpc.payload", "Payload")
+f.result = ProtoField.uint8("wpc.result", "Result", base.DEC)
+f.indication_status = ProtoField.uint8("wpc.indication_status", "Indication status", base.DEC)
+f.pdu_id = ProtoField.uint16("wpc.pdu_id", "PDU id", base.DEC)
+f.capacity = ProtoField.uint8("wpc.capacity", "Capacity", base.DEC)
+f.src_add = ProtoField.uint32("wpc.src_add", "Source address", base.DEC_HEX)
+f.dest_add = ProtoField.uint32("wpc.dest_add", "Destination address", base.DEC_HEX)
+f.src_endpoint = ProtoField.uint8("wpc.src_endpoint", "Source endpoint", base.DEC)
+f.dest_endpoint = ProtoField.uint8("wpc.dest_endpoint", "Destination endpoint", base.DEC)
+f.qos = ProtoField.uint8("wpc.qos", "QoS", base.DEC)
+f.hop_count = ProtoField.uint8("wpc.hop_count", "Hop count", base.DEC)
+f.tx_options = ProtoField.uint8("wpc.tx_options", "TX options", base.HEX)
+f.buffering_delay = ProtoField.uint32("wpc.buffering_delay", "Buffering delay", base.DEC)
+f.travel_time = ProtoField.uint32("wpc.travel_time", "Travel time", base.DEC)
+f.full_packet_id = ProtoField.uint16("wpc.full_packet_id", "Full packet id", base.DEC, nil, 0x0FFF)
+f.fragment_offset = ProtoField.uint16("wpc.fragment_offset", "Fragment offset", base.DEC, nil, 0x0FFF)
+f.last_fragment = ProtoField.bool("wpc.last_fragment", "Last fragment", 16, nil, 0x8000)
+f.apdu_length = ProtoField.uint8("wpc.apdu_length", "APDU length", base.DEC)
+f.apdu = ProtoField.bytes("wpc.apdu", "APDU")
+f.attribute_id = ProtoField.uint16("wpc.attribute_id", "Attribute id", base.DEC)
+f.attribute_length = ProtoField.uint8("wpc.attribute_length", "Attribute length", base.DEC)
+f.attribute_value = ProtoField.bytes("wpc.attribute_value", "Attribute value")
+f.stack_status = ProtoField.uint8("wpc.stack_status", "Stack status", base.HEX)
+f.start_address = ProtoField.uint32("wpc.start_address", "Start address", base.DEC)
+f.number_of_bytes = ProtoField.uint8("wpc.number_of_bytes", "Number of bytes", base.DEC)
+f.max_indications = ProtoField.uint8("wpc.max_indications", "Indications", base.DEC)
+
+-- Each payload layout is a list of (field, size), little endian
+local layouts = {
+    [0x01] = { {f.pdu_id, 2}, {f.src_endpoint, 1}, {f.dest_add, 4}, {f.dest_endpoint, 1},
+               {f.qos, 1}, {f.tx_options, 1}, {f.apdu_length, 1}, {f.apdu, -1} },
+    [0x1F] = { {f.pdu_id, 2}, {f.src_endpoint, 1}, {f.dest_add, 4}, {f.dest_endpoint, 1},
+               {f.qos, 1}, {f.tx_options, 1}, {f.buffering_delay, 4}, {f.apdu_length, 1},
+               {f.apdu, -1} },
+    [0x0F] = { {f.pdu_id, 2}, {f.src_endpoint, 1}, {f.dest_add, 4}, {f.dest_endpoint, 1},
+               {f.qos, 1}, {f.tx_options, 1}, {f.buffering_delay, 4}, {f.full_packet_id, 2},
+               {{f.fragment_offset, f.last_fragment}, 2}, {f.apdu_length, 1}, {f.apdu, -1} },
+    [0x02] = { {f.indication_status, 1}, {f.pdu_id, 2}, {f.src_endpoint, 1}, {f.dest_add, 4},
+               {f.dest_endpoint, 1}, {f.buffering_delay, 4}, {f.result, 1} },
+    [0x03] = { {f.indication_status, 1}, {f.src_add, 4}, {f.src_endpoint, 1}, {f.dest_add, 4},
+               {f.dest_endpoint, 1}, {{f.qos, f.hop_count}, 1}, {f.travel_time, 4},
+               {f.apdu_length, 1}, {f.apdu, -1} },
+    [0x10] = { {f.indication_status, 1}, {f.src_add, 4}, {f.src_endpoint, 1}, {f.dest_add, 4},
+               {f.dest_endpoint, 1}, {{f.qos, f.hop_count}, 1}, {f.travel_time, 4},
+               {f.full_packet_id, 2}, {{f.fragment_offset, f.last_fragment}, 2},
+               {f.apdu_length, 1}, {f.apdu, -1} },
+    [0x81] = { {f.pdu_id, 2}, {f.result, 1}, {f.capacity, 1} },
+    [0x9F] = { {f.pdu_id, 2}, {f.result, 1}, {f.capacity, 1} },
+    [0x8F] = { {f.pdu_id, 2}, {f.result, 1}, {f.capacity, 1} },
+    [0x84] = { {f.result, 1} },
+    [0x04] = { },
+    [0x07] = { {f.indication_status, 1}, {f.stack_status, 1} },
+    [0x0B] = { {f.attribute_id, 2}, {f.attribute_length, 1}, {f.attribute_value, -1} },
+    [0x0D] = { {f.attribute_id, 2}, {f.attribute_length, 1}, {f.attribute_value, -1} },
+    [0x0C] = { {f.attribute_id, 2} },
+    [0x0E] = { {f.attribute_id, 2} },
+    [0x8C] = { {f.result, 1}, {f.attribute_id, 2}, {f.attribute_length, 1}, {f.attribute_value, -1} },
+    [0x8E] = { {f.result, 1}, {f.attribute_id, 2}, {f.attribute_length, 1}, {f.attribute_value, -1} },
+    [0x18] = { {f.start_address, 4}, {f.number_of_bytes, 1}, {f.payload, -1} },
+}
+
+-- QoS (bit 0) and hop count (bits 2-7) share a byte
+local sub_masks = {
+    [f.qos] = function(v) return bit.band(v, 0x01) end,
+    [f.hop_count] = function(v) return bit.rshift(v, 2) end,
+}
+
+local function add_field(tree, field, range)
+    if sub_masks[field] ~= nil then
+        tree:add(field, range, sub_masks[field](range:uint()))
+    else
+        tree:add_le(field, range)
+    end
+end
+
+local function dissect_payload(id, buffer, tree)
+    local layout = layouts[id]
+    local offset = 0
+    local length = buffer:len()
+
+    if layout == nil then
+        -- Generic confirm: result first
+        if id >= CONFIRM_OFFSET and length > 0 then
+            tree:add(f.result, buffer(0, 1))
+            offset = 1
+        end
+        if offset < length then
+            tree:add(f.payload, buffer(offset))
+        end
+        return
+    end
+
+    for _, item in ipairs(layout) do
+        local fields, size = item[1], item[2]
+        if size < 0 then
+            size = length - offset
+        end
+        if size <= 0 or offset + size > length then
+            break
+        end
+        if type(fields) == "table" then
+            for _, field in ipairs(fields) do
+                add_field(tree, field, buffer(offset, size))
+            end
+        else
+            add_field(tree, fields, buffer(offset, size))
+        end
+        offset = offset + size
+    end
+end
+
+function wpc.dissector(buffer, pinfo, tree)
+    if buffer:len() < 3 then
+        return 0
+    end
+
+    local id = buffer(0, 1):uint()
+    local name = primitive_name(id)
+    local payload_length = buffer(2, 1):uint()
+
+    pinfo.cols.protocol = "WPC"
+    pinfo.cols.info = string.format("%s (frame %d)", name, buffer(1, 1):uint())
+
+    local subtree = tree:add(wpc, buffer(), "Wirepas SAP: " .. name)
+    subtree:add(f.primitive_id, buffer(0, 1)):append_text(" (" .. name .. ")")
+    subtree:add(f.frame_id, buffer(1, 1))
+    subtree:add(f.payload_length, buffer(2, 1))
+
+    if payload_length > 0 and buffer:len() > 3 then
+        local available = math.min(payload_length, buffer:len() - 3)
+        local payload_tree = subtree:add(wpc, buffer(3, available), "Payload")
+        dissect_payload(id, buffer(3, available):tvb(), payload_tree)
+    end
+
+    return buffer:len()
+end
+
+DissectorTable.get("wtap_encap"):add(wtap.USER0, wpc)